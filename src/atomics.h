@@ -456,7 +456,7 @@ static INLINE void att64_set_bit (atomic64_t *atval, unsigned int bit) /*{{{*/
 	__asm__ __volatile__ ("					\n"
 			"	lock; btsq %1, %0		\n"
 			: "+m" (__dummy_atomic64 (atval))
-			: "Ir" (bit)
+			: "Ir" ((uint64_t)bit)
 			: "cc"
 			);
 }
@@ -619,6 +619,34 @@ static INLINE unsigned int bis128_eq (bitset128_t *a, bitset128_t *b) /*{{{*/
 	return (bis128_val_lo (a) == bis128_val_lo (b)) && (bis128_val_hi (a) == bis128_val_hi (b));
 }
 /*}}}*/
+/* non-atomic versions, for private copies (e.g. on the stack) */
+static INLINE unsigned int bis128_unsafe_isbitset (bitset128_t *bs, unsigned int bit) /*{{{*/
+{
+	return (unsigned int)((bs->values[bit >> 6] >> (bit & 0x3f)) & 1);
+}
+/*}}}*/
+static INLINE void bis128_unsafe_clear_bit (bitset128_t *bs, unsigned int bit) /*{{{*/
+{
+	bs->values[bit >> 6] &= ~(1ULL << (bit & 0x3f));
+}
+/*}}}*/
+static INLINE int bis128_unsafe_iszero (bitset128_t *bs) /*{{{*/
+{
+	return !(bs->values[0] | bs->values[1]);
+}
+/*}}}*/
+static INLINE void bis128_unsafe_and (bitset128_t *s0, bitset128_t *s1, bitset128_t *d) /*{{{*/
+{
+	d->values[0] = s0->values[0] & s1->values[0];
+	d->values[1] = s0->values[1] & s1->values[1];
+}
+/*}}}*/
+static INLINE void bis128_unsafe_andinv (bitset128_t *s0, bitset128_t *s1, bitset128_t *d) /*{{{*/
+{
+	d->values[0] = s0->values[0] & ~(s1->values[0]);
+	d->values[1] = s0->values[1] & ~(s1->values[1]);
+}
+/*}}}*/
 
 #endif	/* !__ATOMICS_H */
 
@@ -33,12 +33,22 @@
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 #include <time.h>
 #include <errno.h>
+#include <setjmp.h>
 
 #include <sched.h>
 #include <pthread.h>
 
+#ifdef HAVE_LINUX_IO_URING_H
+#include <sys/mman.h>
+#include <linux/io_uring.h>
+#endif
+
 #include "atomics.h"
 #include "slick_types.h"
 #include "slick_priv.h"
@@ -58,15 +68,24 @@
 // #define LOCAL_DEBUG
 
 static __thread psched_t psched CACHELINE_ALIGN;		/* per-thread scheduler structure */
+__thread volatile int slick_yield = 0;				/* set when the running process should yield (safepoints poll this) */
 
 static void deadlock (void) __attribute__ ((noreturn));
-static void slick_schedule (psched_t *s) __attribute__ ((noreturn));
+static void slick_schedule (psched_t *s) __attribute__ ((noreturn, force_align_arg_pointer));
 
 static void sched_setup_spin (psched_t *s);
+static uint64_t sched_time_fine (void);
 static void sched_enqueue (psched_t *s, workspace_t w);
 static void sched_allocate_to_free_list (psched_t *s, unsigned int count);
 static INLINE pbatch_t *sched_allocate_batch (psched_t *s);
 static INLINE void sched_new_current_batch (psched_t *s);
+static INLINE int sched_isbatchend (psched_t *s);
+static void sched_uring_setup (psched_t *s, int entries);
+static void sched_epoll_setup (psched_t *s);
+#ifdef HAVE_LINUX_IO_URING_H
+static int sched_shmchan_woken (psched_t *s, workspace_t w);
+#endif
+static INLINE void sched_trigger_alt_guard (psched_t *s, uint64_t val);
 static INLINE void sched_add_to_runqueue (psched_t *s, uint64_t priofinity, unsigned int rq_n, pbatch_t *bch);
 static INLINE void sched_add_affine_batch_to_runqueue (runqueue_t *rq, pbatch_t *bch);
 
@@ -75,8 +94,37 @@ static void batch_enqueue_process (pbatch_t *bch, workspace_t w);
 static inline void runqueue_atomic_enqueue (runqueue_t *rq, int isws, void *ptr);
 
 extern void slick_schedlinkage (psched_t *s) __attribute__ ((noreturn));
+extern void slick_external_stub (void);
+
+static __thread jmp_buf sched_exitpoint;		/* where a run-time thread leaves the scheduler for (sched_exit) */
 
 
+/*{{{  static void sched_prefault_stack (int kb)*/
+/*
+ *	touches 'kb' of the calling thread's stack below here (at most half of it), so that processes
+ *	running on it don't fault the pages in one at a time (--rt-prefault)
+ */
+static __attribute__ ((noinline)) void sched_prefault_stack (int kb)
+{
+	size_t bytes = (size_t)kb << 10;
+	size_t stacksize = 0;
+	pthread_attr_t attr;
+	volatile uint8_t *base;
+	size_t offs;
+
+	if (!pthread_getattr_np (pthread_self (), &attr)) {
+		pthread_attr_getstacksize (&attr, &stacksize);
+		pthread_attr_destroy (&attr);
+	}
+	if (stacksize && (bytes > (stacksize >> 1))) {
+		bytes = stacksize >> 1;
+	}
+	base = (volatile uint8_t *)alloca (bytes);
+	for (offs=0; offs<bytes; offs += 4096) {
+		base[offs] = 0;
+	}
+}
+/*}}}*/
 /*{{{  void *slick_threadentry (void *arg)*/
 /*
  *	pthreads entry-point
@@ -87,12 +135,31 @@ void *slick_threadentry (void *arg)
 	int fds[2];
 	int i;
 
+	if (tinf->cpu >= 0) {
+		cpu_set_t cset;
+
+		CPU_ZERO (&cset);
+		CPU_SET (tinf->cpu, &cset);
+		if (pthread_setaffinity_np (pthread_self (), sizeof (cset), &cset)) {
+			slick_warning ("failed to bind run-time thread %d to CPU %d", tinf->thridx, tinf->cpu);
+		}
+	}
+	if (slickss.numa) {
+		/* thread-local state was first touched by whoever created us, so move it here */
+		smove_to_node (&psched, sizeof (psched_t), tinf->node);
+	}
+
 	memset (&psched, 0, sizeof (psched_t));
 
 	init_psched_t (&psched);
 
 	psched.sptr = tinf->sptr;
 	psched.sidx = tinf->thridx;
+	bis128_set_bit (&(psched.id), psched.sidx);
+	psched.cpu = tinf->cpu;
+	psched.node = tinf->node;
+	psched.reserved = (psched.sidx >= slickss.reserve_base);
+	psched.nspinning = psched.reserved ? &slickss.nrspinning : &slickss.nspinning;
 	psched.priofinity = BuildPriofinity (0, (MAX_PRIORITY_LEVELS / 2));
 
 #if defined(SLICK_DEBUG) || defined(LOCAL_DEBUG)
@@ -114,13 +181,33 @@ fprintf (stderr, "slick_threadentry(): enqueue initial process at %p, entry-poin
 		return NULL;
 	}
 
-	sched_allocate_to_free_list (&psched, MAX_PRIORITY_LEVELS * 2);
+	if (tinf->sptr->uring_entries) {
+		sched_uring_setup (&psched, tinf->sptr->uring_entries);
+	}
+	sched_epoll_setup (&psched);
+
+	if (tinf->sptr->prefault_kb) {
+		/* everything a process might touch here faulted in now, rather than mid-request */
+		sched_prefault_stack (tinf->sptr->prefault_kb);
+		sched_allocate_to_free_list (&psched, PREFAULT_BATCHES);
+	} else {
+		sched_allocate_to_free_list (&psched, MAX_PRIORITY_LEVELS * 2);
+	}
 	for (i=0; i<MAX_PRIORITY_LEVELS; i++) {
 		psched.rq[i].pending = sched_allocate_batch (&psched);
 	}
 
 	sched_new_current_batch (&psched);
 
+	if (psched.sidx) {
+		/* thread 0 goes first: it has the initial process, and until it's enabled the rest of us would look deadlocked */
+		pthread_mutex_lock (&(tinf->sptr->start_lock));
+		while (!tinf->sptr->start_open) {
+			pthread_cond_wait (&(tinf->sptr->start_cond), &(tinf->sptr->start_lock));
+		}
+		pthread_mutex_unlock (&(tinf->sptr->start_lock));
+	}
+
 	if (tinf->initial_ws && tinf->initial_proc) {
 		/* enqueue this process */
 		workspace_t iws = (workspace_t)tinf->initial_ws;
@@ -130,110 +217,550 @@ fprintf (stderr, "slick_threadentry(): enqueue initial process at %p, entry-poin
 		sched_enqueue (&psched, iws);
 	}
 
+	psched.yield = &slick_yield;
 	slickss.schedulers[psched.sidx] = &psched;
 
 	sched_setup_spin (&psched);
 
-	bis128_set_bit (&slickss.enabled_threads, psched.sidx);
+	shard_set_enabled (psched.sidx);
 	write_barrier ();
 
+	if (!psched.sidx) {
+		pthread_mutex_lock (&(tinf->sptr->start_lock));
+		tinf->sptr->start_open = 1;
+		pthread_cond_broadcast (&(tinf->sptr->start_cond));
+		pthread_mutex_unlock (&(tinf->sptr->start_lock));
+	}
+	if (att32_val (&(tinf->sptr->rt_shutdown))) {
+		/* shut down before we got here (to be woken) */
+		att32_set_bit (&(psched.sync), SYNC_INTR_BIT);
+	}
+
 	if (slickss.verbose) {
 		slick_message ("run-time thread %d about to enter scheduler (sched at %p).", psched.sidx, &psched);
 	}
 
+	if (setjmp (sched_exitpoint)) {
+		/* the run-time has shut down: returning rather than pthread_exit(), which costs an unwind */
+		return NULL;
+	}
 	slick_schedlinkage (&psched);
 
 	/* assert: never get here */
 	return NULL;
 }
 /*}}}*/
-/*{{{  static void slick_safe_pause (psched_t *s)*/
+/*{{{  io_uring file I/O (os_read, os_write, os_fsync)*/
+#define FIO_READ	0
+#define FIO_WRITE	1
+#define FIO_FSYNC	2
+
+#define FIO_MAX_COUNT	(0x7ffff000)		/* most a single read() or write() transfers (Linux) */
+
+#define URING_OP_FUTEX_WAIT	(51)		/* IORING_OP_FUTEX_WAIT (6.7), which older headers lack.. */
+#define URING_FUTEX2_SIZE_U32	(0x02)		/* ..as they do FUTEX2_SIZE_U32 */
+#define URING_WAIT_TAG		(1)		/* low bit of user_data: a process waiting on a shared-memory channel */
+
+#ifdef HAVE_LINUX_IO_URING_H
+/*{{{  static int sched_uring_enter (int fd, unsigned int submit, unsigned int wait, unsigned int flags, void *arg, size_t argsz)*/
+/*
+ *	io_uring_enter(2) (no liburing), returns what that does
+ */
+static int sched_uring_enter (int fd, unsigned int submit, unsigned int wait, unsigned int flags, void *arg, size_t argsz)
+{
+	return (int)syscall (__NR_io_uring_enter, fd, submit, wait, flags, arg, argsz);
+}
+/*}}}*/
+/*{{{  static void sched_uring_setup (psched_t *s, int entries)*/
+/*
+ *	creates this thread's io_uring and maps its rings.  Needs a kernel with IORING_OP_READ and IORING_OP_WRITE
+ *	(IORING_FEAT_RW_CUR_POS, 5.6); without one, file I/O goes to the blocking-call helpers.  Notes whether it
+ *	can wait on futexes as well (for os_shmchanin and os_shmchanout).
+ */
+static void sched_uring_setup (psched_t *s, int entries)
+{
+	struct io_uring_params p;
+	struct io_uring_probe *probe;
+	uint8_t *ring;
+	size_t rsize, csize;
+	uint32_t *array;
+	int fd, i;
+
+	memset (&p, 0, sizeof (p));
+	fd = (int)syscall (__NR_io_uring_setup, entries, &p);
+	if (fd < 0) {
+		if (slickss.verbose) {
+			slick_message ("run-time thread %d: no io_uring [%s], file I/O goes to helper threads.", s->sidx, strerror (errno));
+		}
+		return;
+	}
+	if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_RW_CUR_POS)) {
+		if (slickss.verbose) {
+			slick_message ("run-time thread %d: io_uring too old, file I/O goes to helper threads.", s->sidx);
+		}
+		close (fd);
+		return;
+	}
+
+	rsize = p.sq_off.array + (p.sq_entries * sizeof (uint32_t));
+	csize = p.cq_off.cqes + (p.cq_entries * sizeof (struct io_uring_cqe));
+	if (csize > rsize) {
+		rsize = csize;
+	}
+	ring = (uint8_t *)mmap (NULL, rsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (ring == MAP_FAILED) {
+		slick_warning ("failed to map io_uring for thread %d, [%s]", s->sidx, strerror (errno));
+		close (fd);
+		return;
+	}
+	s->sqes = mmap (NULL, p.sq_entries * sizeof (struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			fd, IORING_OFF_SQES);
+	if (s->sqes == MAP_FAILED) {
+		slick_warning ("failed to map io_uring for thread %d, [%s]", s->sidx, strerror (errno));
+		s->sqes = NULL;
+		munmap (ring, rsize);
+		close (fd);
+		return;
+	}
+
+	s->sq_head = (uint32_t *)(ring + p.sq_off.head);
+	s->sq_tail = (uint32_t *)(ring + p.sq_off.tail);
+	s->sq_mask = *(uint32_t *)(ring + p.sq_off.ring_mask);
+	array = (uint32_t *)(ring + p.sq_off.array);
+	for (i=0; i<(int)p.sq_entries; i++) {
+		array[i] = (uint32_t)i;		/* entries used in ring order */
+	}
+	s->cq_head = (uint32_t *)(ring + p.cq_off.head);
+	s->cq_tail = (uint32_t *)(ring + p.cq_off.tail);
+	s->cq_mask = *(uint32_t *)(ring + p.cq_off.ring_mask);
+	s->cqes = (void *)(ring + p.cq_off.cqes);
+	s->uring_fd = fd;
+
+	probe = (struct io_uring_probe *)smalloc (sizeof (struct io_uring_probe) + (256 * sizeof (struct io_uring_probe_op)));
+	memset (probe, 0, sizeof (struct io_uring_probe) + (256 * sizeof (struct io_uring_probe_op)));
+	if (!syscall (__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) && (probe->ops_len > URING_OP_FUTEX_WAIT) &&
+			(probe->ops[URING_OP_FUTEX_WAIT].flags & IO_URING_OP_SUPPORTED)) {
+		/* processes waiting on shared-memory channels can wait here too */
+		s->uring_futex = 1;
+	}
+	sfree (probe);
+}
+/*}}}*/
+/*{{{  static void sched_uring_submit (psched_t *s)*/
+/*
+ *	passes queued requests to the kernel, all in one system call.  Anything it won't take yet
+ *	(EAGAIN, or EBUSY with completions backed up) stays queued for next time.
+ */
+static __attribute__ ((noinline, force_align_arg_pointer)) void sched_uring_submit (psched_t *s)
+{
+	int r = sched_uring_enter (s->uring_fd, s->uring_pending, 0, 0, NULL, 0);
+
+	if (r > 0) {
+		s->uring_pending -= (uint32_t)r;
+		s->stats.iosubmits++;
+	}
+}
+/*}}}*/
+/*{{{  static INLINE int sched_uring_ready (psched_t *s)*/
+/*
+ *	non-zero if there are completions to reap
+ */
+static INLINE int sched_uring_ready (psched_t *s)
+{
+	return (*(volatile uint32_t *)(s->cq_head) != *(volatile uint32_t *)(s->cq_tail));
+}
+/*}}}*/
+/*{{{  static void sched_uring_reap (psched_t *s)*/
+/*
+ *	picks up completed requests: each result goes where the process asked (w[LPointer]) and the process
+ *	is made ready again here.  A process woken from a shared-memory channel wait finishes its communication
+ *	first, or waits again (which may submit, and reap, so each entry is taken off the ring before that).
+ */
+static void sched_uring_reap (psched_t *s)
+{
+	uint32_t head;
+	uint32_t n = 0;
+
+	while ((head = *(volatile uint32_t *)(s->cq_head)) != *(volatile uint32_t *)(s->cq_tail)) {
+		struct io_uring_cqe *cqe = &(((struct io_uring_cqe *)s->cqes)[head & s->cq_mask]);
+		uint64_t udata = cqe->user_data;
+		int64_t res = (int64_t)cqe->res;
+		workspace_t w = (workspace_t)(udata & ~URING_WAIT_TAG);
+
+		compiler_barrier ();
+		*(volatile uint32_t *)(s->cq_head) = head + 1;
+
+		if (udata & URING_WAIT_TAG) {
+			if (!sched_shmchan_woken (s, w)) {
+				continue;		/* while(): waiting again */
+			}
+		} else {
+			*(int64_t *)(w[LPointer]) = res;
+		}
+		sched_enqueue (s, w);
+		n++;
+	}
+
+	if (n) {
+		s->uring_inflight -= n;
+		att32_sub (&slickss.offloaded, n);		/* only now: they're back in a run-queue */
+	}
+}
+/*}}}*/
+/*{{{  static struct io_uring_sqe *sched_uring_sqe (psched_t *s, workspace_t w)*/
+/*
+ *	next free submission queue entry, for a request made by 'w'; submits (and reaps) to make room
+ */
+static struct io_uring_sqe *sched_uring_sqe (psched_t *s, workspace_t w)
+{
+	uint32_t tail = *(s->sq_tail);
+	struct io_uring_sqe *sqe;
+
+	while ((tail - *(volatile uint32_t *)(s->sq_head)) > s->sq_mask) {
+		sched_uring_submit (s);
+		if (sched_uring_ready (s)) {
+			sched_uring_reap (s);
+		}
+	}
+	sqe = &(((struct io_uring_sqe *)s->sqes)[tail & s->sq_mask]);
+	memset (sqe, 0, sizeof (struct io_uring_sqe));
+	sqe->user_data = (uint64_t)w;
+
+	return sqe;
+}
+/*}}}*/
+/*{{{  static INLINE void sched_uring_queue (psched_t *s)*/
+/*
+ *	makes the entry from sched_uring_sqe() visible to the kernel (at the next submit)
+ */
+static INLINE void sched_uring_queue (psched_t *s)
+{
+	compiler_barrier ();
+	*(volatile uint32_t *)(s->sq_tail) = *(s->sq_tail) + 1;
+	s->uring_pending++;
+}
+/*}}}*/
+/*{{{  static INLINE void sched_uring_poll (psched_t *s)*/
+/*
+ *	called each time round the scheduler loop while file I/O is outstanding: submits what's queued at the
+ *	end of a batch (so that a batch's requests go in together), and reaps whatever has completed
+ */
+static INLINE void sched_uring_poll (psched_t *s)
+{
+	if (s->uring_pending && sched_isbatchend (s)) {
+		sched_uring_submit (s);
+	}
+	if (sched_uring_ready (s)) {
+		sched_uring_reap (s);
+	}
+}
+/*}}}*/
+#else	/* !HAVE_LINUX_IO_URING_H */
+static INLINE void sched_uring_setup (psched_t *s, int entries) { return; }
+static INLINE void sched_uring_poll (psched_t *s) { return; }
+static INLINE int sched_uring_ready (psched_t *s) { return 0; }
+static INLINE void sched_uring_reap (psched_t *s) { return; }
+static INLINE void sched_uring_submit (psched_t *s) { return; }
+#endif	/* !HAVE_LINUX_IO_URING_H */
+/*}}}*/
+/*{{{  epoll: sleeping, and descriptor guards (os_enbfd, os_disfd)*/
+#define EV_WAKE		(0)			/* epoll_event.data for the wake-up pipe.. */
+#define EV_URING	(1)			/* ..and the io_uring (completions to reap); else an fdguard_t */
+#define EV_BATCH	(32)			/* events taken at once */
+
+/*{{{  static void sched_epoll_setup (psched_t *s)*/
+/*
+ *	creates this thread's epoll instance, which it sleeps in: with the wake-up pipe, the io_uring if
+ *	there is one, and descriptors that ALTs running here are waiting on
+ */
+static void sched_epoll_setup (psched_t *s)
+{
+	struct epoll_event ev;
+
+	s->epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
+	if (s->epoll_fd < 0) {
+		slick_fatal ("failed to create epoll instance for thread %d, [%s]", s->sidx, strerror (errno));
+	}
+	if (fcntl (s->signal_out, F_SETFL, O_NONBLOCK) < 0) {
+		slick_fatal ("failed to set NONBLOCK option on pipe for thread %d, [%s]", s->sidx, strerror (errno));
+	}
+
+	ev.events = EPOLLIN;
+	ev.data.u64 = EV_WAKE;
+	if (epoll_ctl (s->epoll_fd, EPOLL_CTL_ADD, s->signal_out, &ev) < 0) {
+		slick_fatal ("failed to add signalling pipe to epoll for thread %d, [%s]", s->sidx, strerror (errno));
+	}
+	if (s->uring_fd >= 0) {
+		ev.events = EPOLLIN;
+		ev.data.u64 = EV_URING;
+		if (epoll_ctl (s->epoll_fd, EPOLL_CTL_ADD, s->uring_fd, &ev) < 0) {
+			slick_fatal ("failed to add io_uring to epoll for thread %d, [%s]", s->sidx, strerror (errno));
+		}
+	}
+}
+/*}}}*/
+/*{{{  static INLINE void sched_fdguard_disarmed (psched_t *s)*/
+/*
+ *	called when a descriptor guard armed in s's epoll has fired or moved elsewhere
+ */
+static INLINE void sched_fdguard_disarmed (psched_t *s)
+{
+	att32_dec (&(s->fdarmed));
+	att32_dec (&slickss.offloaded);
+}
+/*}}}*/
+/*{{{  static int sched_fd_events (psched_t *s, int timeout_ms)*/
+/*
+ *	waits in epoll_wait() for at most 'timeout_ms' milliseconds (forever if negative, just looks if zero) for a
+ *	wake-up, io_uring completions or a guarded descriptor becoming ready, submitting queued file I/O first.
+ *	ALTs whose guard fired and processes whose I/O is done are made ready here, after (when asleep) marking us
+ *	awake and setting SYNC_IO so that the caller stops sleeping.  Returns non-zero if nothing happened.
+ */
+static __attribute__ ((noinline, force_align_arg_pointer)) int sched_fd_events (psched_t *s, int timeout_ms)
+{
+	struct epoll_event ev[EV_BATCH];
+	int n, i;
+
+	if (s->uring_pending) {
+		sched_uring_submit (s);
+	}
+	n = epoll_wait (s->epoll_fd, ev, EV_BATCH, timeout_ms);
+	if (n <= 0) {
+		return (n == 0);		/* (interrupted is not timed out) */
+	}
+
+	if (timeout_ms) {
+		for (i=0; i<n; i++) {
+			if ((ev[i].data.u64 != EV_WAKE) && ((ev[i].data.u64 != EV_URING) || s->uring_inflight)) {
+				/* processes may be back: awake before they stop counting as waiting (see slick_all_threads_stuck()) */
+				shard_clear_sleeping (s->sidx);
+				att32_set_bit (&(s->sync), SYNC_IO_BIT);
+				break;		/* for() */
+			}
+		}
+	}
+
+	for (i=0; i<n; i++) {
+		if (ev[i].data.u64 == EV_WAKE) {
+			uint8_t buffer[64];
+
+			while (read (s->signal_out, buffer, sizeof (buffer)) > 0);
+		} else if (ev[i].data.u64 == EV_URING) {
+			if (sched_uring_ready (s)) {
+				sched_uring_reap (s);
+			}
+		} else {
+			fdguard_t *g = (fdguard_t *)ev[i].data.ptr;
+			uint64_t ptr = att64_swap (&(g->wptr), (uint64_t)NULL);
+
+			if (ptr != (uint64_t)NULL) {
+				s->stats.fdwakes++;
+				sched_trigger_alt_guard (s, ptr);
+			}
+			if (att64_cas (&(g->armed), (uint64_t)s, (uint64_t)NULL)) {
+				/* (else re-armed in another scheduler's epoll, which counted it off here) */
+				sched_fdguard_disarmed (s);
+			}
+		}
+	}
+	return 0;
+}
+/*}}}*/
+/*}}}*/
+/*{{{  static int slick_safe_pause (psched_t *s, int timeout_ms)*/
 /*
- *	puts a run-time thread to sleep
+ *	puts a run-time thread to sleep (in its epoll), for at most 'timeout_ms' milliseconds if not negative;
+ *	returns non-zero if it timed out (nothing to do)
  */
-static void slick_safe_pause (psched_t *s)
+static int slick_safe_pause (psched_t *s, int timeout_ms)
 {
-	uint32_t buffer, sync;
+	uint32_t sync;
+	uint64_t t0, t1;
+	int timedout = 0;
 
 #if defined(SLICK_DEBUG) || defined(LOCAL_DEBUG)
 fprintf (stderr, "slick_safe_pause(): thread index %d\n", s->sidx);
 #endif
+
+	t0 = sched_time_fine ();
+	if (s->spin_start) {
+		if (s->spin && (t0 > s->spin_start)) {
+			/* ran out of spin: refine the calibration against real idle-loop iterations (which include looking for work) */
+			uint64_t per_us = (s->spin * 1000ULL) / (t0 - s->spin_start);
+
+			s->spin_per_us = ((s->spin_per_us * 3) + (per_us ? per_us : 1) + 3) >> 2;
+		}
+		s->stats.spin_ns += t0 - s->spin_start;
+		s->spin_window_ns += t0 - s->spin_start;
+		s->spin_start = 0;
+	}
+	s->stats.sleeps++;
+
 	while (!(sync = att32_swap (&(s->sync), 0))) {
 		serialise ();
-		read (s->signal_out, &buffer, 1);
+		if (sched_fd_events (s, timeout_ms)) {
+			sync = att32_swap (&(s->sync), 0);
+			timedout = !sync;
+			break;		/* while() */
+		}
 		serialise ();
 	}
 
 	att32_or (&(s->sync), sync);		/* put back the flags */
 
+	t1 = sched_time_fine ();
+	s->stats.sleep_ns += t1 - t0;
+	if (s->stats.idle_since) {
+		s->spin_start = t1;		/* back to spinning for work */
+	}
+
 #if defined(SLICK_DEBUG) || defined(LOCAL_DEBUG)
 fprintf (stderr, "slick_safe_pause(): thread index %d about to resume after pause\n", psched.sidx);
 #endif
+	return timedout;
 }
 /*}}}*/
 void slick_wake_thread (psched_t *s, unsigned int sync_bit) /*{{{*/
 {
 	uint32_t data = 0;
 
-	bis128_clear_bit (&slickss.sleeping_threads, s->sidx);
+	shard_clear_sleeping (s->sidx);
+	att64_inc (&(shard_of_thread (s->sidx)->wakes));
 	write_barrier ();
 	att32_set_bit (&(s->sync), sync_bit);
 	serialise ();
 	write (s->signal_in, &data, 1);
 }
 /*}}}*/
-static INLINE int64_t calculate_dispatches (uint64_t size) /*{{{*/
+int slick_current_thread (void) /*{{{*/
 {
-	size <<= BATCH_PPD_SHIFT;
-	size |= (one_if_z64 (size, (~BATCH_MD_MASK)) - 1);
-	return (int64_t)(size & BATCH_MD_MASK);
-
+	return psched.sptr ? psched.sidx : -1;
+}
+/*}}}*/
+static INLINE int64_t calculate_dispatches (psched_t *s, uint64_t size) /*{{{*/
+{
+	unsigned int pri = PPriority (s->priofinity);
+	int shift = s->qshift[pri];
+	uint64_t max = (uint64_t)slickss.quantum_max[pri];
+
+	size *= (uint64_t)slickss.quantum_ppd[pri];
+	if (shift > 0) {
+		size <<= shift;
+		max <<= shift;
+	} else if (shift < 0) {
+		size >>= -shift;
+		max >>= -shift;
+	}
+	if (size > max) {
+		size = max;
+	}
+	return size ? (int64_t)size : 1;
 }
 /*}}}*/
-/*{{{  unsigned int sched_spin_us (void)*/
+/*{{{  static INLINE void sched_quantum_alone (psched_t *s)*/
 /*
- *	determines the spin-time for a scheduler, based on the number of CPUs
- *	FIXME: preset and put in slickss
+ *	adaptive quantum: called when the current batch ran out of dispatches but is picked again as there
+ *	is nothing else to run -- the trip through the scheduler was wasted, so grow the quantum if it
+ *	keeps happening
  */
-unsigned int sched_spin_us (void)
+static INLINE void sched_quantum_alone (psched_t *s)
 {
-	char *ch;
-	unsigned int ncpus;
+	unsigned int pri = PPriority (s->priofinity);
 
-	if (slickss.ncpus < 2) {
-		return 0;
+	if (++s->qalone[pri] >= QUANTUM_GROW_RUNS) {
+		s->qalone[pri] = 0;
+		if (s->qshift[pri] < QUANTUM_SHIFT_MAX) {
+			s->qshift[pri]++;
+		}
 	}
-
-	ch = getenv ("SLICKSCHEDULERSPIN");
-	if (ch) {
-		if (sscanf (ch, "%u", &ncpus) != 1) {
-			slick_warning ("sched_spin_us(): not using environment variable SLICKSCHEDULERSPIN, not integer [%s]", ch);
-		} else {
-			return ncpus;
+}
+/*}}}*/
+/*{{{  static INLINE void sched_quantum_picked (psched_t *s, unsigned int pri)*/
+/*
+ *	adaptive quantum: called when a batch is picked from a local run-queue.  If thieves have been
+ *	racing each other for our migration windows, there is more demand for work than we expose, so
+ *	shrink the quantum (batches get split and pushed back, and so become visible, sooner).
+ */
+static INLINE void sched_quantum_picked (psched_t *s, unsigned int pri)
+{
+	s->qalone[pri] = 0;
+	if (att32_val (&(s->contended))) {
+		att32_set (&(s->contended), 0);
+		if (s->qshift[pri] > QUANTUM_SHIFT_MIN) {
+			s->qshift[pri]--;
 		}
 	}
-
-	return 16;
 }
 /*}}}*/
 /*{{{  static void sched_setup_spin (psched_t *s)*/
 /*
- *	sets up the spin counter for a scheduler
+ *	calibrates idle_cpu() for a scheduler and sets the initial spin budget (the cap).  Briefly, as this
+ *	delays start-up: slick_safe_pause() refines it against real idle loops.
  */
 static void sched_setup_spin (psched_t *s)
 {
-	uint64_t start, end, ns;
-	int i = 10000;
+	uint64_t start, ns;
+	int i = 100;
 
-	start = sched_time_now ();
+	start = sched_time_fine ();
 	while (i--) {
 		idle_cpu ();
 	}
+	ns = sched_time_fine () - start;
+
+	s->spin_per_us = (100ULL * 1000ULL) / (ns ? ns : 1);
+	if (!s->spin_per_us) {
+		s->spin_per_us = 1;
+	}
+
+	/* start by assuming waits of around half the cap */
+	s->spin_ewma = (uint64_t)slickss.spin_max_us * 500ULL;
+	s->spin_window = sched_time_fine ();
+	s->spin_window_ns = 0;
+	if (att32_val (&slickss.oversubscribed)) {
+		s->stats.spin_budget_ns = 0;
+		s->spin = 0;
+	} else {
+		s->stats.spin_budget_ns = (uint64_t)slickss.spin_max_us * 1000ULL;
+		s->spin = (uint64_t)slickss.spin_max_us * s->spin_per_us;
+	}
+}
+/*}}}*/
+/*{{{  static void sched_adapt_spin (psched_t *s, uint64_t now, uint64_t waited)*/
+/*
+ *	adjusts the spin budget after an idle period of 'waited' nanoseconds ended with new work.
+ *	Spins for about twice the recent average wait if that is within the cap, only briefly if
+ *	waits are typically longer (sleeping is cheaper), and not at all once this thread has
+ *	spent more than its share of CPU spinning in the current window.
+ */
+static void sched_adapt_spin (psched_t *s, uint64_t now, uint64_t waited)
+{
+	uint64_t cap = (uint64_t)slickss.spin_max_us * 1000ULL;
+	uint64_t budget;
+
+	s->spin_ewma = (uint64_t)((int64_t)s->spin_ewma + (((int64_t)waited - (int64_t)s->spin_ewma) >> SPIN_EWMA_SHIFT));
+
+	if ((now - s->spin_window) >= SPIN_WINDOW_NS) {
+		s->spin_window = now;
+		s->spin_window_ns = 0;
+	}
 
-	end = sched_time_now ();
-	ns = end - start;
+	if (!cap || att32_val (&slickss.oversubscribed)) {
+		/* more threads than CPUs: spinning would only take time from a thread with work */
+		budget = 0;
+	} else if ((s->spin_window_ns * 100ULL) >= ((uint64_t)SPIN_WINDOW_NS * (uint64_t)slickss.spin_max_pct)) {
+		budget = 0;
+	} else if (s->spin_ewma <= cap) {
+		budget = (s->spin_ewma << 1) + SPIN_MIN_NS;
+		if (budget > cap) {
+			budget = cap;
+		}
+	} else {
+		budget = (SPIN_MIN_NS < cap) ? SPIN_MIN_NS : cap;
+	}
 
-	psched.spin = (sched_spin_us () * 1000) / (ns ? ns : 1);
+	s->stats.spin_budget_ns = budget;
+	s->spin = (budget * s->spin_per_us) / 1000ULL;
 }
 /*}}}*/
 
@@ -315,16 +842,36 @@ static void sched_do_laundry (psched_t *s)
 	}
 }
 /*}}}*/
+/*{{{  static INLINE void sched_bpool_lock (bpool_t *bp), static INLINE void sched_bpool_unlock (bpool_t *bp)*/
+/*
+ *	locks/unlocks a shard's pool of spare arena batches.  Only touched when a free-list is trimmed
+ *	or runs dry, so rarely contended.
+ */
+static INLINE void sched_bpool_lock (bpool_t *bp)
+{
+	while (!att32_cas (&(bp->lock), 0, 1)) {
+		idle_cpu ();
+	}
+}
+
+static INLINE void sched_bpool_unlock (bpool_t *bp)
+{
+	write_barrier ();
+	att32_set (&(bp->lock), 0);
+}
+/*}}}*/
 /*{{{  static void sched_release_excess_memory (psched_t *s)*/
 /*
- *	keeps no more than 32 batches on the scheduler's free-list
+ *	keeps no more than FREE_BATCHES_KEPT batches on the scheduler's free-list (PREFAULT_BATCHES with
+ *	--rt-prefault, the ones allocated up-front).  Batches carved from node-local arenas can't be freed
+ *	individually, so the excess goes to our shard's pool instead, for us or a neighbour to reuse.
  */
 static void sched_release_excess_memory (psched_t *s)
 {
 	pbatch_t *bch = s->free;
 	int count;
 
-	for (count=0; bch && (count < 32); count++) {
+	for (count=0; bch && (count < slickss.batches_kept); count++) {
 		bch = bch->nb;
 	}
 
@@ -334,6 +881,21 @@ static void sched_release_excess_memory (psched_t *s)
 		bch->nb = NULL;
 		bch = next;
 
+		if (bch && slickss.numa) {
+			bpool_t *bp = &(slickss.bpools[slickss.shard_of[s->sidx]]);
+			pbatch_t *last = bch;
+
+			for (count=1; last->nb; count++) {
+				last = last->nb;
+			}
+			sched_bpool_lock (bp);
+			last->nb = bp->free;
+			bp->free = bch;
+			bp->count += count;
+			sched_bpool_unlock (bp);
+			return;
+		}
+
 		while (bch) {
 			next = bch->nb;
 			sfree (bch);
@@ -342,14 +904,63 @@ static void sched_release_excess_memory (psched_t *s)
 	}
 }
 /*}}}*/
+/*{{{  static unsigned int sched_take_pooled_batches (psched_t *s, unsigned int count)*/
+/*
+ *	moves up to 'count' spare batches from our shard's pool to the scheduler's free-list (--rt-numa),
+ *	returns how many
+ */
+static unsigned int sched_take_pooled_batches (psched_t *s, unsigned int count)
+{
+	bpool_t *bp = &(slickss.bpools[slickss.shard_of[s->sidx]]);
+	pbatch_t *first, *last;
+	unsigned int n;
+
+	if (!bp->count) {
+		return 0;		/* racy peek, but the pool is only an economy */
+	}
+
+	sched_bpool_lock (bp);
+	first = bp->free;
+	last = NULL;
+	for (n=0; bp->free && (n < count); n++) {
+		last = bp->free;
+		bp->free = last->nb;
+	}
+	bp->count -= n;
+	sched_bpool_unlock (bp);
+
+	if (last) {
+		last->nb = s->free;
+		s->free = first;
+	}
+	return n;
+}
+/*}}}*/
 /*{{{  static void sched_allocate_to_free_list (psched_t *s, unsigned int count)*/
 /*
  *	allocates and assigns batches to a scheduler's free-list
  */
 static void sched_allocate_to_free_list (psched_t *s, unsigned int count)
 {
+	if (slickss.numa) {
+		count -= sched_take_pooled_batches (s, count);
+	}
+
 	while (count--) {
-		pbatch_t *bch = (pbatch_t *)smalloc (PBATCH_ALLOC_SIZE);
+		pbatch_t *bch;
+
+		if (slickss.numa) {
+			/* carve from a node-local arena */
+			if (s->arena_left < PBATCH_ALLOC_SIZE) {
+				s->arena = (uint8_t *)smalloc_node (BATCH_ARENA_SIZE, s->node);
+				s->arena_left = BATCH_ARENA_SIZE;
+			}
+			bch = (pbatch_t *)s->arena;
+			s->arena += PBATCH_ALLOC_SIZE;
+			s->arena_left -= PBATCH_ALLOC_SIZE;
+		} else {
+			bch = (pbatch_t *)smalloc (PBATCH_ALLOC_SIZE);
+		}
 
 		init_pbatch_t (bch);
 		sched_release_clean_batch (s, bch);
@@ -375,6 +986,24 @@ static INLINE pbatch_t *sched_allocate_batch (psched_t *s)
 	return bch;
 }
 /*}}}*/
+/*{{{  static INLINE void batch_copy (pbatch_t *to, pbatch_t *from)*/
+/*
+ *	copies the processes in one batch to another (its ring and list), dropping BATCH_EMPTIED
+ */
+static INLINE void batch_copy (pbatch_t *to, pbatch_t *from)
+{
+	uint32_t i;
+
+	to->fptr = from->fptr;
+	to->bptr = from->bptr;
+	to->size = (from->size & (~BATCH_EMPTIED));
+	to->head = from->head;
+	to->tail = from->tail;
+	for (i=from->head; i != from->tail; i++) {
+		to->ws[i & BATCH_INLINE_MASK] = from->ws[i & BATCH_INLINE_MASK];
+	}
+}
+/*}}}*/
 /*{{{  static INLINE pbatch_t *sched_save_current_batch (psched_t *s)*/
 /*
  *	saves the contents of the current scheduler batch
@@ -383,25 +1012,39 @@ static INLINE pbatch_t *sched_save_current_batch (psched_t *s)
 {
 	pbatch_t *nb = sched_allocate_batch (s);
 
-	nb->fptr = s->cbch.fptr;
-	nb->bptr = s->cbch.bptr;
-	nb->size = (s->cbch.size & (~BATCH_EMPTIED));
+	batch_copy (nb, &(s->cbch));
 
 	return nb;
 }
 /*}}}*/
+/*{{{  static INLINE void sched_publish_load (psched_t *s)*/
+/*
+ *	updates the backlog others see when choosing where to push work (read racily)
+ */
+static INLINE void sched_publish_load (psched_t *s)
+{
+	uint64_t rqs = att64_val (&(s->rqstate));
+	uint64_t load = (s->cbch.size & ~BATCH_EMPTIED) + s->edf_n;
+
+	while (rqs) {
+		unsigned int rq_n = bsf64 (rqs);
+
+		load += s->rq[rq_n].length;
+		rqs &= ~(1ULL << rq_n);
+	}
+	att32_set (&(s->load), (load > 0x7fffffff) ? 0x7fffffff : (uint32_t)load);
+}
+/*}}}*/
 /*{{{  static INLINE void sched_load_current_batch (psched_t *s, pbatch_t *bch, int remote)*/
 /*
  *	loads a particular batch into the scheduler
  */
 static INLINE void sched_load_current_batch (psched_t *s, pbatch_t *bch, int remote)
 {
-	s->cbch.fptr = bch->fptr;
-	s->cbch.bptr = bch->bptr;
-	s->cbch.size = (bch->size & (~BATCH_EMPTIED));
+	batch_copy (&(s->cbch), bch);
 
-	s->dispatches = calculate_dispatches (s->cbch.size);
-	s->priofinity = s->cbch.fptr[LPriofinity];
+	s->priofinity = batch_front (&(s->cbch))[LPriofinity];
+	s->dispatches = calculate_dispatches (s, s->cbch.size);
 
 	if (!remote) {
 		reinit_pbatch_t (bch);
@@ -409,67 +1052,460 @@ static INLINE void sched_load_current_batch (psched_t *s, pbatch_t *bch, int rem
 	} else {
 		batch_mark_clean (bch);			/* owning scheduler needs to clean */
 	}
+
+	s->shed_hold = 0;
+	sched_publish_load (s);
 }
 /*}}}*/
-/*{{{  static void mail_process (uint64_t affinity, workspace_t w)*/
+/*{{{  static void sched_mail_batch (psched_t *other, uint64_t priofinity, pbatch_t *bch)*/
 /*
- *	sends a process to another scheduler
+ *	sends a (clean) batch of processes to another scheduler, waking it if needed
  */
-static void mail_process (uint64_t affinity, workspace_t w)
+static void sched_mail_batch (psched_t *other, uint64_t priofinity, pbatch_t *bch)
 {
-	bitset128_t targets;
-	unsigned int n;
-	psched_t *s;
-
-	if (!affinity) {
-		bis128_copy (&targets, &slickss.enabled_threads);
-	} else {
-		bis128_set_hi (&targets, 0);
-		bis128_set_lo (&targets, bis128_val_lo (&slickss.enabled_threads) & affinity);
+	bch->priofinity = priofinity;
 
-		if (!bis128_val_lo (&targets)) {
-			/* impossible: no such scheduler */
-			slick_fatal ("mail_process(): impossible affinity detected: 0x%16.16lx.", affinity);
-		}
-	}
-
-	n = bis128_pick_random_bit (&targets);
-	s = slickss.schedulers[n];
-
-	runqueue_atomic_enqueue (&(s->pmail), 1, w);
+	runqueue_atomic_enqueue (&(other->bmail), 0, bch);
 	write_barrier ();
-	att32_set_bit (&(s->sync), SYNC_PMAIL_BIT);
+	att32_set_bit (&(other->sync), SYNC_BMAIL_BIT);
 	read_barrier ();
 
-	if (bis128_isbitset (&slickss.sleeping_threads, s->sidx)) {
-		slick_wake_thread (s, SYNC_PMAIL_BIT);
+	if (shard_is_sleeping (other->sidx) || att32_val (&(other->parked))) {
+		slick_wake_thread (other, SYNC_BMAIL_BIT);
 	}
 }
 /*}}}*/
-/*{{{  static void sched_enqueue_far_process (psched_t *s, uint64_t priofinity, workspace_t w)*/
+/*{{{  static void sched_flush_outbox (psched_t *s, unsigned int n)*/
 /*
- *	enqueues a process elsewhere
+ *	sends the processes collected for a particular scheduler
  */
-static void sched_enqueue_far_process (psched_t *s, uint64_t priofinity, workspace_t w)
+static void sched_flush_outbox (psched_t *s, unsigned int n)
 {
-	if (!PHasAffinity (priofinity)) {
-		int pri = PPriority (priofinity);
-		runqueue_t *rq = &(s->rq[pri]);
+	pbatch_t *bch = s->outbox[n];
 
-		if (PHasAffinity (rq->priofinity)) {
-			sched_add_affine_batch_to_runqueue (rq, rq->pending);
-			rq->pending = sched_allocate_batch (s);
-		}
+	s->outbox[n] = NULL;
+	s->outboxes &= ~(1ULL << n);
+	s->stats.mailed++;
+
+	sched_mail_batch (slickss.schedulers[n], bch->priofinity, bch);
+}
+/*}}}*/
+/*{{{  static void sched_flush_mail (psched_t *s)*/
+/*
+ *	sends all collected processes (called on the way into the scheduler)
+ */
+static void sched_flush_mail (psched_t *s)
+{
+	while (s->outboxes) {
+		sched_flush_outbox (s, bsf64 (s->outboxes));
+	}
+}
+/*}}}*/
+/*{{{  static void sched_mail_direct (psched_t *other, workspace_t w)*/
+/*
+ *	sends a single process to another scheduler straight away, waking it if needed
+ */
+static void sched_mail_direct (psched_t *other, workspace_t w)
+{
+	runqueue_atomic_enqueue (&(other->pmail), 1, w);
+	write_barrier ();
+	att32_set_bit (&(other->sync), SYNC_PMAIL_BIT);
+	read_barrier ();
+
+	if (shard_is_sleeping (other->sidx) || att32_val (&(other->parked))) {
+		slick_wake_thread (other, SYNC_PMAIL_BIT);
+	}
+}
+/*}}}*/
+/*{{{  static void sched_mail_to (psched_t *s, unsigned int n, workspace_t w)*/
+/*
+ *	sends a process to a particular scheduler: collected in its outbox, or directly if it has none
+ */
+static void sched_mail_to (psched_t *s, unsigned int n, workspace_t w)
+{
+	uint64_t priofinity = w[LPriofinity];
+	pbatch_t *bch;
+
+	if (n >= MAX_OUTBOXES) {
+		/*
+		 *	no outbox: only reachable with more than MAX_OUTBOXES run-time threads (affinity can't
+		 *	name these, but a woken process may go home to one).  Such pools are rare enough to
+		 *	send singly rather than widen the outbox mask
+		 */
+		sched_mail_direct (slickss.schedulers[n], w);
+		return;
+	}
+
+	bch = s->outbox[n];
+	if (bch && (bch->priofinity != priofinity)) {
+		sched_flush_outbox (s, n);
+		bch = NULL;
+	}
+	if (!bch) {
+		bch = sched_allocate_batch (s);
+		bch->priofinity = priofinity;
+		s->outbox[n] = bch;
+		s->outboxes |= (1ULL << n);
+	}
+
+	batch_enqueue_process (bch, w);
+	if (bch->size >= OUTBOX_MAX_PROCS) {
+		sched_flush_outbox (s, n);
+	}
+}
+/*}}}*/
+/*{{{  void slick_resume_process (workspace_t w)*/
+/*
+ *	called on a helper thread when a process's blocking call is done: sends it back to the scheduler
+ *	it made the call on (w[LLink]), which picks it up with the rest of its mail
+ */
+void slick_resume_process (workspace_t w)
+{
+	sched_mail_direct (slickss.schedulers[w[LLink]], w);
+}
+/*}}}*/
+/*{{{  static unsigned int sched_affine_fallback (psched_t *s, uint64_t affinity)*/
+/*
+ *	picks a scheduler for a process whose affinity covers none that are enabled: one that is parked
+ *	(mail wakes it), or waits for one that has been created but is still starting up
+ */
+static unsigned int sched_affine_fallback (psched_t *s, uint64_t affinity)
+{
+	unsigned int n;
+
+	for (;;) {
+		int created = 0;
+
+		for (n=0; n<MAX_OUTBOXES; n++) {
+			if (affinity & (1ULL << n)) {
+				if (slickss.schedulers[n]) {
+					return n;
+				} else if (n < att32_val (&(s->sptr->rt_started))) {
+					created = 1;
+				}
+			}
+		}
+		if (!created) {
+			/* impossible: no such scheduler */
+			slick_fatal ("mail_process(): impossible affinity detected: 0x%16.16lx.", affinity);
+		}
+		idle_cpu ();
+	}
+}
+/*}}}*/
+/*{{{  static void mail_process (psched_t *s, uint64_t affinity, workspace_t w)*/
+/*
+ *	sends a process to another scheduler.  Processes are collected per destination (and priofinity)
+ *	and sent as a batch when we next reschedule, or when the batch is full, so that waking many
+ *	processes affine to another scheduler costs one hand-over and at most one wake-up.
+ */
+static void mail_process (psched_t *s, uint64_t affinity, workspace_t w)
+{
+	bitset128_t targets;
+	unsigned int n;
+
+	slick_enabled_threads (&targets);
+	if (affinity) {
+		bis128_set_hi (&targets, 0);
+		bis128_set_lo (&targets, bis128_val_lo (&targets) & affinity);
+
+		if (!bis128_val_lo (&targets)) {
+			/* none of them enabled (yet) */
+			sched_mail_to (s, sched_affine_fallback (s, affinity), w);
+			return;
+		}
+	}
+
+	if (bis128_val_lo (&targets) & s->outboxes) {
+		/* already collecting for one of them */
+		n = bsf64 (bis128_val_lo (&targets) & s->outboxes);
+	} else {
+		n = bis128_pick_random_bit (&targets);
+	}
+	sched_mail_to (s, n, w);
+}
+/*}}}*/
+/*{{{  static INLINE int sched_misplaced (psched_t *s, uint64_t priofinity)*/
+/*
+ *	non-zero if work at 'priofinity' belongs on the other side of the reserved partition (--rt-reserve)
+ *	from 's': fixed priorities above the threshold on the reserved threads, everything else on the
+ *	ordinary ones.  Hard affinity goes where it says regardless.
+ */
+static INLINE int sched_misplaced (psched_t *s, uint64_t priofinity)
+{
+	int critical;
+
+	if (!slickss.reserve_pri || PHasAffinity (priofinity)) {
+		return 0;
+	}
+	critical = !PIsEDF (priofinity) && (PPriority (priofinity) < (uint64_t)slickss.reserve_pri);
+	return (critical != s->reserved);
+}
+/*}}}*/
+/*{{{  static unsigned int sched_partition_target (psched_t *s)*/
+/*
+ *	picks a scheduler on the other side of the reserved partition to send misplaced work to: one we
+ *	are already collecting processes for, otherwise the least loaded (idle ones have none).  Returns
+ *	MAX_RT_THREADS if none there are enabled yet (still starting up), in which case the work stays here.
+ */
+static unsigned int sched_partition_target (psched_t *s)
+{
+	bitset128_t targets;
+	unsigned int best = MAX_RT_THREADS;
+	uint32_t best_load = 0;
+	unsigned int i;
+
+	slick_enabled_threads (&targets);
+	bis128_unsafe_andinv (&targets, slick_partition (s->sidx), &targets);
+
+	if (targets.values[0] & s->outboxes) {
+		return bsf64 (targets.values[0] & s->outboxes);
+	}
+	for (i=0; i<MAX_RT_THREADS; i++) {
+		if (bis128_unsafe_isbitset (&targets, i)) {
+			uint32_t load = att32_val (&(slickss.schedulers[i]->load));
+
+			if ((best == MAX_RT_THREADS) || (load < best_load)) {
+				best = i;
+				best_load = load;
+				if (!load) {
+					break;		/* for() */
+				}
+			}
+		}
+	}
+	return best;
+}
+/*}}}*/
+/*{{{  static int sched_route_process (psched_t *s, workspace_t w)*/
+/*
+ *	sends a process that is misplaced here across the reserved partition.  Latency-critical ones are
+ *	sent straight away rather than when we next reschedule: getting them running promptly is the point.
+ *	Returns zero if there was nowhere to send it (yet).
+ */
+static int sched_route_process (psched_t *s, workspace_t w)
+{
+	unsigned int n = sched_partition_target (s);
+
+	if (n == MAX_RT_THREADS) {
+		return 0;
+	}
+	s->stats.routed++;
+	sched_mail_to (s, n, w);
+	if (!s->reserved && (n < MAX_OUTBOXES) && (s->outboxes & (1ULL << n))) {
+		sched_flush_outbox (s, n);
+	}
+	return 1;
+}
+/*}}}*/
+/*{{{  static INLINE int sched_preempts (psched_t *s, uint64_t priofinity)*/
+/*
+ *	non-zero if work at 'priofinity' should end the current batch's turn early: any deadline beats
+ *	the fixed priorities, and an earlier deadline beats a later one
+ */
+static INLINE int sched_preempts (psched_t *s, uint64_t priofinity)
+{
+	if (PIsEDF (priofinity)) {
+		return !PIsEDF (s->priofinity) || (PDeadline (priofinity) < PDeadline (s->priofinity));
+	}
+	return !PIsEDF (s->priofinity) && (PPriority (priofinity) < PPriority (s->priofinity));
+}
+/*}}}*/
+/*{{{  static INLINE void sched_edf_lock (psched_t *s), static INLINE void sched_edf_unlock (psched_t *s)*/
+/*
+ *	locks/unlocks a scheduler's deadline heap.  Only thieves contend with the owner for it, so this
+ *	is almost always a single uncontended atomic.
+ */
+static INLINE void sched_edf_lock (psched_t *s)
+{
+	while (!att32_cas (&(s->edf_lock), 0, 1)) {
+		idle_cpu ();
+	}
+}
+
+static INLINE void sched_edf_unlock (psched_t *s)
+{
+	write_barrier ();
+	att32_set (&(s->edf_lock), 0);
+}
+/*}}}*/
+/*{{{  static void sched_edf_grow (psched_t *s)*/
+/*
+ *	makes room in the deadline heap (called with it locked).  Reached from process code on whatever
+ *	stack alignment that had, so realigns for libc.
+ */
+static __attribute__ ((noinline, force_align_arg_pointer)) void sched_edf_grow (psched_t *s)
+{
+	uint32_t size = s->edf_size ? (s->edf_size << 1) : EDF_HEAP_INITIAL;
+	pbatch_t **heap = (pbatch_t **)smalloc (size * sizeof (pbatch_t *));
+
+	if (s->edf_heap) {
+		memcpy (heap, s->edf_heap, s->edf_n * sizeof (pbatch_t *));
+		sfree (s->edf_heap);
+	}
+	s->edf_heap = heap;
+	s->edf_size = size;
+}
+/*}}}*/
+/*{{{  static INLINE void sched_edf_publish (psched_t *s)*/
+/*
+ *	updates what thieves see of the deadline heap (called with it locked)
+ */
+static INLINE void sched_edf_publish (psched_t *s)
+{
+	att64_set (&(s->edf_head), s->edf_n ? s->edf_heap[0]->priofinity : 0);
+}
+/*}}}*/
+/*{{{  static void sched_edf_insert (psched_t *s, pbatch_t *bch)*/
+/*
+ *	adds a batch to the deadline heap (called with it locked)
+ */
+static void sched_edf_insert (psched_t *s, pbatch_t *bch)
+{
+	pbatch_t **heap;
+	uint64_t deadline = PDeadline (bch->priofinity);
+	uint32_t i;
+
+	if (s->edf_n == s->edf_size) {
+		sched_edf_grow (s);
+	}
+	heap = s->edf_heap;
+
+	for (i = s->edf_n++; i > 0; ) {
+		uint32_t up = (i - 1) >> 1;
+
+		if (PDeadline (heap[up]->priofinity) <= deadline) {
+			break;		/* for() */
+		}
+		heap[i] = heap[up];
+		i = up;
+	}
+	heap[i] = bch;
+}
+/*}}}*/
+/*{{{  static pbatch_t *sched_edf_take (psched_t *s)*/
+/*
+ *	removes the most urgent batch from a non-empty deadline heap (called with it locked)
+ */
+static pbatch_t *sched_edf_take (psched_t *s)
+{
+	pbatch_t **heap = s->edf_heap;
+	pbatch_t *bch = heap[0];
+	pbatch_t *last = heap[--s->edf_n];
+	uint64_t deadline = PDeadline (last->priofinity);
+	uint32_t n = s->edf_n;
+	uint32_t i = 0;
+
+	for (;;) {
+		uint32_t down = (i << 1) + 1;
+
+		if (down >= n) {
+			break;		/* for() */
+		}
+		if (((down + 1) < n) && (PDeadline (heap[down + 1]->priofinity) < PDeadline (heap[down]->priofinity))) {
+			down++;
+		}
+		if (deadline <= PDeadline (heap[down]->priofinity)) {
+			break;		/* for() */
+		}
+		heap[i] = heap[down];
+		i = down;
+	}
+	if (n) {
+		heap[i] = last;
+	}
+
+	bch->nb = (pbatch_t *)(-1);
+	return bch;
+}
+/*}}}*/
+/*{{{  static void sched_edf_push (psched_t *s, uint64_t priofinity, pbatch_t *bch)*/
+/*
+ *	queues a (clean, non-empty) batch of earliest-deadline-first processes
+ */
+static void sched_edf_push (psched_t *s, uint64_t priofinity, pbatch_t *bch)
+{
+	bch->priofinity = priofinity;
+
+	sched_edf_lock (s);
+	sched_edf_insert (s, bch);
+	sched_edf_publish (s);
+	sched_edf_unlock (s);
+}
+/*}}}*/
+/*{{{  static void sched_edf_enqueue (psched_t *s, uint64_t priofinity, workspace_t w)*/
+/*
+ *	queues an earliest-deadline-first process: with the most urgent batch if it has the same
+ *	deadline (typically processes of one PAR), otherwise in a batch of its own
+ */
+static void sched_edf_enqueue (psched_t *s, uint64_t priofinity, workspace_t w)
+{
+	pbatch_t *bch;
+
+	sched_edf_lock (s);
+	if (s->edf_n && (s->edf_heap[0]->priofinity == priofinity)) {
+		batch_enqueue_process (s->edf_heap[0], w);
+		sched_edf_unlock (s);
+	} else {
+		sched_edf_unlock (s);
+
+		bch = sched_allocate_batch (s);
+		batch_enqueue_process (bch, w);
+		sched_edf_push (s, priofinity, bch);
+	}
+
+	if (sched_preempts (s, priofinity)) {
+		/* force new-batch pick next time */
+		s->dispatches = 0;
+	}
+}
+/*}}}*/
+/*{{{  static pbatch_t *sched_edf_pop (psched_t *s)*/
+/*
+ *	takes the most urgent batch from our deadline heap, NULL if there isn't one (any more)
+ */
+static pbatch_t *sched_edf_pop (psched_t *s)
+{
+	pbatch_t *bch = NULL;
+
+	sched_edf_lock (s);
+	if (s->edf_n) {
+		bch = sched_edf_take (s);
+		sched_edf_publish (s);
+	}
+	sched_edf_unlock (s);
+
+	return bch;
+}
+/*}}}*/
+/*{{{  static void sched_enqueue_far_process (psched_t *s, uint64_t priofinity, workspace_t w)*/
+/*
+ *	enqueues a process elsewhere
+ */
+static void sched_enqueue_far_process (psched_t *s, uint64_t priofinity, workspace_t w)
+{
+	if (sched_misplaced (s, priofinity) && sched_route_process (s, w)) {
+		/* sent across the reserved partition */
+	} else if (PIsEDF (priofinity)) {
+		sched_edf_enqueue (s, priofinity, w);
+	} else if (!PHasAffinity (priofinity)) {
+		int pri = PPriority (priofinity);
+		runqueue_t *rq = &(s->rq[pri]);
+
+		if (PHasAffinity (rq->priofinity)) {
+			sched_add_affine_batch_to_runqueue (rq, rq->pending);
+			rq->pending = sched_allocate_batch (s);
+		}
 
 		rq->priofinity = BuildPriofinity (0, 1);
 		batch_enqueue_process (rq->pending, w);
 
 		att64_unsafe_set_bit (&(s->rqstate), pri);
-		if (pri < PPriority (s->priofinity)) {
+		if (sched_preempts (s, priofinity)) {
 			/* force new-batch pick next time */
 			s->dispatches = 0;
 		}
-	} else if ((PAffinity (priofinity) & bis128_val_lo (&s->id)) != 0) {		/* XXX: only handles affinity for low-order 59 threads */
+	} else if ((PAffinity (priofinity) & bis128_val_lo (&s->id)) != 0) {		/* XXX: only handles affinity for low-order 58 threads */
 		/* affinity for this scheduler (and maybe others) */
 		int pri = PPriority (priofinity);
 		runqueue_t *rq = &(s->rq[pri]);
@@ -483,12 +1519,12 @@ static void sched_enqueue_far_process (psched_t *s, uint64_t priofinity, workspa
 		batch_enqueue_process (rq->pending, w);
 
 		att64_unsafe_set_bit (&(s->rqstate), pri);
-		if (pri < PPriority (s->priofinity)) {
+		if (sched_preempts (s, priofinity)) {
 			/* force new-batch pick next time */
 			s->dispatches = 0;
 		}
 	} else {
-		mail_process (PAffinity (priofinity), w);
+		mail_process (s, PAffinity (priofinity), w);
 	}
 }
 /*}}}*/
@@ -499,33 +1535,33 @@ static void sched_enqueue_far_process (psched_t *s, uint64_t priofinity, workspa
  */
 static INLINE void batch_enqueue_hint (pbatch_t *bch, workspace_t w, int isempty)
 {
-	w[LLink] = (uint64_t)NULL;
-
 	if (isempty) {
-		bch->fptr = w;
-		bch->bptr = w;
+		bch->ws[bch->tail++ & BATCH_INLINE_MASK] = w;
 		bch->size = 1;
 	} else {
-		bch->bptr[LLink] = (uint64_t)w;
-		bch->bptr = w;
-		bch->size++;
+		batch_enqueue_process (bch, w);
 	}
 }
 /*}}}*/
-/*{{{  static void batch_enqueue_process (pbatch_t *bch, workspace_t w)*/
+/*{{{  static INLINE void batch_enqueue_process (pbatch_t *bch, workspace_t w)*/
 /*
- *	enqueues a process to a particular batch (current typically)
+ *	enqueues a process to a particular batch (current typically): in its ring if there's room and
+ *	nothing has overflowed yet, else on the end of its list
  */
-static void batch_enqueue_process (pbatch_t *bch, workspace_t w)
+static INLINE void batch_enqueue_process (pbatch_t *bch, workspace_t w)
 {
-	w[LLink] = (uint64_t)NULL;
-
-	if (bch->fptr == NULL) {
-		bch->fptr = w;
+	if ((bch->fptr == NULL) && (batch_ring_count (bch) < BATCH_INLINE)) {
+		bch->ws[bch->tail++ & BATCH_INLINE_MASK] = w;
 	} else {
-		bch->bptr[LLink] = (uint64_t)w;
+		w[LLink] = (uint64_t)NULL;
+
+		if (bch->fptr == NULL) {
+			bch->fptr = w;
+		} else {
+			bch->bptr[LLink] = (uint64_t)w;
+		}
+		bch->bptr = w;
 	}
-	bch->bptr = w;
 	bch->size++;
 }
 /*}}}*/
@@ -535,14 +1571,17 @@ static void batch_enqueue_process (pbatch_t *bch, workspace_t w)
  */
 static inline void batch_enqueue_process_front (pbatch_t *bch, workspace_t w)
 {
-	w[LLink] = (uint64_t)bch->fptr;
+	if (batch_ring_count (bch) == BATCH_INLINE) {
+		/* ring full: its last process goes to the front of the list */
+		workspace_t last = bch->ws[--bch->tail & BATCH_INLINE_MASK];
 
-	if (w[LLink] == (uint64_t)NULL) {
-		bch->fptr = w;
-		bch->bptr = w;
-	} else {
-		bch->fptr = w;
+		last[LLink] = (uint64_t)bch->fptr;
+		if (bch->fptr == NULL) {
+			bch->bptr = last;
+		}
+		bch->fptr = last;
 	}
+	bch->ws[--bch->head & BATCH_INLINE_MASK] = w;
 	bch->size++;
 }
 /*}}}*/
@@ -562,6 +1601,83 @@ static void sched_enqueue (psched_t *s, workspace_t w)
 	}
 }
 /*}}}*/
+/*{{{  static INLINE unsigned int comm_slot (workspace_t w)*/
+/*
+ *	where a process's last partner is noted
+ */
+static INLINE unsigned int comm_slot (workspace_t w)
+{
+	return (unsigned int)((((uint64_t)w >> 3) * 0x9e3779b97f4a7c15ULL) >> (64 - COMM_TABLE_BITS));
+}
+/*}}}*/
+/*{{{  static INLINE void sched_note_partners (psched_t *s, workspace_t a, workspace_t b)*/
+/*
+ *	called for a sample of channel communications: notes that two processes talk to each other
+ */
+static INLINE void sched_note_partners (psched_t *s, workspace_t a, workspace_t b)
+{
+	unsigned int i = comm_slot (a);
+	unsigned int j = comm_slot (b);
+
+	s->comm_w[i] = a;
+	s->comm_partner[i] = b;
+	s->comm_w[j] = b;
+	s->comm_partner[j] = a;
+}
+/*}}}*/
+/*{{{  static INLINE int sched_partners (psched_t *s, workspace_t a, workspace_t b)*/
+/*
+ *	non-zero if either process was last seen talking to the other
+ */
+static INLINE int sched_partners (psched_t *s, workspace_t a, workspace_t b)
+{
+	unsigned int i = comm_slot (a);
+	unsigned int j = comm_slot (b);
+
+	return ((s->comm_w[i] == a) && (s->comm_partner[i] == b)) || ((s->comm_w[j] == b) && (s->comm_partner[j] == a));
+}
+/*}}}*/
+/*{{{  static INLINE void sched_sample_comm (psched_t *s, workspace_t a, workspace_t b)*/
+/*
+ *	called for every channel communication, notes partners for one in every slickss.comm_sample
+ */
+static INLINE void sched_sample_comm (psched_t *s, workspace_t a, workspace_t b)
+{
+	if (slickss.comm_sample && (--s->comm_count <= 0)) {
+		s->comm_count = slickss.comm_sample;
+		sched_note_partners (s, a, b);
+	}
+}
+/*}}}*/
+/*{{{  static INLINE void sched_enqueue_woken (psched_t *s, workspace_t self, workspace_t w)*/
+/*
+ *	enqueues a process woken by channel communication with 'self'.  With soft affinity, a process
+ *	without hard affinity goes back to the scheduler it blocked on (tagged in its link word, which is
+ *	free while it waits in a channel) so that it finds its cache warm, provided that scheduler is
+ *	awake and not much busier than we are, and that it's not a regular partner of 'self' (which it
+ *	is better off next to); otherwise it stays here as usual.
+ */
+static INLINE void sched_enqueue_woken (psched_t *s, workspace_t self, workspace_t w)
+{
+	sched_sample_comm (s, self, w);
+
+	if (slickss.soft_affinity && !PHasAffinity (w[LPriofinity]) && !sched_partners (s, self, w)) {
+		unsigned int home = LinkHome (w[LLink]);
+
+		if ((home != (unsigned int)s->sidx) && (home < MAX_RT_THREADS)) {
+			psched_t *other = slickss.schedulers[home];
+
+			if (other && !shard_is_sleeping (home) && !att32_val (&(other->parked)) && !sched_misplaced (other, w[LPriofinity]) &&
+					(att32_val (&(other->load)) <= (att32_val (&(s->load)) + (uint32_t)slickss.soft_slack))) {
+				s->stats.homed++;
+				sched_mail_to (s, home, w);
+				return;
+			}
+		}
+	}
+	sched_enqueue (s, w);
+}
+/*}}}*/
 /*{{{  static INLINE void sched_enqueue_nopri (psched_t *s, workspace_t w)*/
 /*
  *	enqueues a process on the current scheduler's batch, ignoring priority
@@ -571,16 +1687,22 @@ static INLINE void sched_enqueue_nopri (psched_t *s, workspace_t w)
 	batch_enqueue_process (&(s->cbch), w);
 }
 /*}}}*/
-/*{{{  static workspace_t batch_dequeue_process (pbatch_t *bch)*/
+/*{{{  static INLINE workspace_t batch_dequeue_process (pbatch_t *bch)*/
 /*
  *	dequeues a process from a specific batch (assumes non-empty)
  */
-static workspace_t batch_dequeue_process (pbatch_t *bch)
+static INLINE workspace_t batch_dequeue_process (pbatch_t *bch)
 {
-	workspace_t tmp = bch->fptr;
 	uint64_t bsize = bch->size;
+	workspace_t tmp;
 
-	bch->fptr = (workspace_t)(tmp[LLink]);
+	if (bch->head != bch->tail) {
+		tmp = bch->ws[bch->head++ & BATCH_INLINE_MASK];
+	} else {
+		tmp = bch->fptr;
+		bch->fptr = (workspace_t)(tmp[LLink]);
+		ASSERT ((bch->fptr != NULL) || (bch->bptr == tmp));
+	}
 	bch->size = ((bsize - 2) & BATCH_EMPTIED) | (bsize - 1);
 	/*
 	 *	Note from Carl Ritson's CCSP on the above:
@@ -593,20 +1715,43 @@ static workspace_t batch_dequeue_process (pbatch_t *bch)
 	 *	give us either 0 or BATCH_EMPTIED, which we then OR
 	 *	with the real new size.
 	 */
-	
-	ASSERT ((bch->fptr != NULL) || (bch->bptr == tmp));
+
 	SAFETY { tmp[LLink] = ~(uint64_t)NULL; }
 
 	return tmp;
 }
 /*}}}*/
-/*{{{  static workspace_t sched_dequeue (psched_t *s)*/
+/*{{{  static INLINE void sched_prefetch_process (workspace_t w)*/
 /*
- *	dequeues a process from the current scheduler's batch
+ *	starts bringing in what dispatching a queued process will touch: its process slots just below
+ *	Wptr (iptr, link, priofinity, pointer) and the top of its frame
  */
-static workspace_t sched_dequeue (psched_t *s)
+static INLINE void sched_prefetch_process (workspace_t w)
 {
-	return batch_dequeue_process (&(s->cbch));
+	__builtin_prefetch (&(w[LPointer]), 1, 3);
+	__builtin_prefetch (&(w[LTemp]), 1, 3);
+}
+/*}}}*/
+/*{{{  static INLINE workspace_t sched_dequeue (psched_t *s)*/
+/*
+ *	dequeues a process from the current scheduler's batch.  The next one or two are then in the ring
+ *	(no pointer chasing to find them), so we start bringing them in while this one runs.
+ */
+static INLINE workspace_t sched_dequeue (psched_t *s)
+{
+	pbatch_t *bch = &(s->cbch);
+	workspace_t w = batch_dequeue_process (bch);
+	uint32_t n = batch_ring_count (bch);
+
+	if (n) {
+		sched_prefetch_process (bch->ws[bch->head & BATCH_INLINE_MASK]);
+		if (n > 1) {
+			sched_prefetch_process (bch->ws[(bch->head + 1) & BATCH_INLINE_MASK]);
+		}
+	} else if (bch->fptr) {
+		sched_prefetch_process (bch->fptr);
+	}
+	return w;
 }
 /*}}}*/
 /*{{{  static INLINE int sched_isbatchend (psched_t *s)*/
@@ -615,7 +1760,7 @@ static workspace_t sched_dequeue (psched_t *s)
  */
 static INLINE int sched_isbatchend (psched_t *s)
 {
-	return ((s->dispatches < 0) || (s->cbch.fptr == NULL));
+	return ((s->dispatches < 0) || batch_isempty (&(s->cbch)));
 }
 /*}}}*/
 
@@ -625,32 +1770,77 @@ static INLINE int sched_isbatchend (psched_t *s)
  */
 static INLINE int batch_empty (pbatch_t *b)
 {
-	return (b->fptr == NULL);
+	return batch_isempty (b);
 }
 /*}}}*/
 /*{{{  static void batch_verify_integrity (pbatch_t *bch)*/
 /*
- *	verifies batch integrity (sanity)
+ *	verifies batch integrity (sanity): the ring, the ends of the list and the size agree.  Doesn't
+ *	walk the list, so is cheap enough to leave in SAFETY builds' hot paths.
  */
 static void batch_verify_integrity (pbatch_t *bch)
 {
-	workspace_t ptr = bch->fptr;
-	uint64_t size = 1;
+	uint64_t size = bch->size & ~BATCH_EMPTIED;
+	uint64_t n = (uint64_t)batch_ring_count (bch);
 
-	while (ptr[LLink] != (uint64_t)NULL) {
-		if (size > (bch->size & ~BATCH_EMPTIED)) {
-			slick_fatal ("batch_verify_integrity(): batch at %p, size = 0x%16.16lx, counted = 0x%16.16lx", bch, bch->size, size);
-		}
-		size++;
-		ptr = (workspace_t)(ptr[LLink]);
+	if (n > BATCH_INLINE) {
+		slick_fatal ("batch_verify_integrity(): batch at %p, ring head = %u, tail = %u", bch, bch->head, bch->tail);
 	}
+	if (!bch->fptr) {
+		if (size != n) {
+			slick_fatal ("batch_verify_integrity(): batch at %p, size = 0x%16.16lx, in ring = 0x%16.16lx, no list", bch, bch->size, n);
+		}
+	} else if (!bch->bptr || (bch->bptr[LLink] != (uint64_t)NULL)) {
+		slick_fatal ("batch_verify_integrity(): batch at %p, size = 0x%16.16lx, fptr=%p, bptr=%p", bch, bch->size, bch->fptr, bch->bptr);
+	} else if ((size <= n) || ((bch->fptr == bch->bptr) != (size == (n + 1)))) {
+		slick_fatal ("batch_verify_integrity(): batch at %p, size = 0x%16.16lx, in ring = 0x%16.16lx, fptr=%p, bptr=%p", bch, bch->size, n, bch->fptr, bch->bptr);
+	}
+}
+/*}}}*/
+
+/*{{{  static INLINE workspace_t batch_after (pbatch_t *bch, workspace_t w, uint64_t i)*/
+/*
+ *	returns the process after 'w' in a batch, 'w' being the i'th (from 0), or NULL if it's the last
+ */
+static INLINE workspace_t batch_after (pbatch_t *bch, workspace_t w, uint64_t i)
+{
+	uint64_t n = (uint64_t)batch_ring_count (bch);
 
-	if (ptr != bch->bptr) {
-		slick_fatal ("batch_verify_integrity(): batch at %p, size = 0x%16.16lx, ptr=%p, bptr=%p", bch, bch->size, ptr, bch->bptr);
+	if ((i + 1) < n) {
+		return bch->ws[(bch->head + (uint32_t)i + 1) & BATCH_INLINE_MASK];
+	} else if ((i + 1) == n) {
+		return bch->fptr;
 	}
-	if ((bch->size & ~BATCH_EMPTIED) != size) {
-		slick_fatal ("batch_verify_integrity(): batch at %p, size = 0x%16.16lx, counted=0x%16.16lx", bch, bch->size, size);
+	return (workspace_t)(w[LLink]);
+}
+/*}}}*/
+/*{{{  static void batch_split (pbatch_t *bch, uint64_t keep, workspace_t w, pbatch_t *nb)*/
+/*
+ *	moves all but the first 'keep' processes of a batch ('w' being the last of those kept) to an
+ *	empty batch.  A cut in the ring copies the rest of it; a cut in the list is spliced, as ever.
+ */
+static void batch_split (pbatch_t *bch, uint64_t keep, workspace_t w, pbatch_t *nb)
+{
+	uint64_t size = bch->size & ~BATCH_EMPTIED;
+
+	if (keep <= (uint64_t)batch_ring_count (bch)) {
+		uint32_t i;
+
+		for (i = bch->head + (uint32_t)keep; i != bch->tail; i++) {
+			nb->ws[nb->tail++ & BATCH_INLINE_MASK] = bch->ws[i & BATCH_INLINE_MASK];
+		}
+		bch->tail = bch->head + (uint32_t)keep;
+		nb->fptr = bch->fptr;
+		nb->bptr = bch->bptr;
+		bch->fptr = NULL;
+	} else {
+		nb->fptr = (workspace_t)(w[LLink]);
+		nb->bptr = bch->bptr;
+		w[LLink] = (uint64_t)NULL;
+		bch->bptr = w;
 	}
+	nb->size = size - keep;
+	bch->size = keep;
 }
 /*}}}*/
 
@@ -745,6 +1935,7 @@ static inline void *runqueue_atomic_dequeue (runqueue_t *rq, int isws)
 static INLINE void sched_add_to_local_runqueue (runqueue_t *rq, pbatch_t *bch)
 {
 	bch->nb = NULL;
+	rq->length++;
 
 	if (rq->fptr == NULL) {
 		rq->fptr = bch;
@@ -831,6 +2022,7 @@ static INLINE pbatch_t *sched_try_pull_from_runqueue (psched_t *s, unsigned int
 		unsigned int window;
 
 		rq->fptr = bch->nb;
+		rq->length--;
 		window = batch_window (bch);
 
 		if (window) {
@@ -875,14 +2067,30 @@ static INLINE void sched_push_batch (psched_t *s, uint64_t priofinity, pbatch_t
 	unsigned int rq_n = PPriority (priofinity);
 	runqueue_t *rq = &(s->rq[rq_n]);
 
-	if (!bch->fptr) {
-		slick_fatal ("sched_push_batch(): empty batch (fptr == NULL) in scheduler at %p, batch at %p", s, bch);
+	if (batch_isempty (bch)) {
+		slick_fatal ("sched_push_batch(): empty batch in scheduler at %p, batch at %p", s, bch);
 	}
 	if ((bch->size & ~BATCH_EMPTIED) == 0) {
 		slick_fatal ("sched_push_batch(): empty batch (size == 0) in scheduler at %p, batch at %p", s, bch);
 	}
 	SAFETY { batch_verify_integrity (bch); }
 
+	if (sched_misplaced (s, priofinity)) {
+		/* belongs across the reserved partition (mailed to us, or what we were running) */
+		unsigned int n = sched_partition_target (s);
+
+		if (n < MAX_RT_THREADS) {
+			s->stats.routed += bch->size & ~BATCH_EMPTIED;
+			sched_mail_batch (slickss.schedulers[n], priofinity, bch);
+			return;
+		}
+	}
+	if (PIsEDF (priofinity)) {
+		/* goes in the deadline heap, not a run-queue */
+		sched_edf_push (s, priofinity, bch);
+		return;
+	}
+
 	if (rq->priofinity) {
 		pbatch_t *p_bch;
 		uint64_t p_priofinity;
@@ -910,20 +2118,31 @@ static INLINE void sched_new_current_batch (psched_t *s)
 {
 	s->dispatches = BATCH_PPD;
 	s->cbch.fptr = NULL;
+	s->cbch.head = 0;
+	s->cbch.tail = 0;
 	s->cbch.size = BATCH_EMPTIED;
 }
 /*}}}*/
 /*{{{  static INLINE void sched_push_current_batch (psched_t *s)*/
 /*
- *	saves the current batch, possibly splits it
+ *	saves the current batch, possibly splits it.  The front process is split off along with any
+ *	partners queued right behind it (up to half the batch), so that a thief takes a group that
+ *	talks among itself rather than one process whose partners stay here.
  */
 static INLINE void sched_push_current_batch (psched_t *s)
 {
 	if ((s->dispatches <= 0) && ((s->cbch.size ^ BATCH_EMPTIED) > (BATCH_EMPTIED + 1))) {
 		/* split batch */
 		pbatch_t *nb = sched_allocate_batch (s);
+		workspace_t w = sched_dequeue (s);
+		uint64_t limit = s->cbch.size >> 1;
 
-		batch_enqueue_hint (nb, sched_dequeue (s), 1);
+		batch_enqueue_hint (nb, w, 1);
+		while (slickss.comm_sample && limit && sched_partners (s, w, batch_front (&(s->cbch)))) {
+			w = sched_dequeue (s);
+			batch_enqueue_hint (nb, w, 0);
+			limit--;
+		}
 		sched_push_batch (s, s->priofinity, nb);
 	}
 	sched_push_batch (s, s->priofinity, sched_save_current_batch (s));
@@ -976,6 +2195,10 @@ static pbatch_t *sched_try_migrate_from_scheduler (psched_t *s, unsigned int rq_
 
 		att64_clear_bit (&(mw->data[MWINDOW_STATE]), w + MWINDOW_BM_OFFSET);
 		bch = (pbatch_t *)att64_swap (&(mw->data[w]), (uint64_t)NULL);
+		if (!bch && slickss.quantum_adapt) {
+			/* another thief got there first */
+			att32_inc (&(s->contended));
+		}
 
 		bm &= ~(1ULL << w);
 	}
@@ -988,19 +2211,16 @@ static pbatch_t *sched_try_migrate_from_scheduler (psched_t *s, unsigned int rq_
 	return bch;
 }
 /*}}}*/
-/*{{{  static pbatch_t *sched_migrate_some_work (psched_t *s)*/
+/*{{{  static pbatch_t *sched_migrate_from_set (bitset128_t *active, unsigned int shift)*/
 /*
- *	migrates some work
+ *	migrates some work from the highest priority window amongst a set of schedulers,
+ *	scanning from a particular thread index (which wins ties)
  */
-static pbatch_t *sched_migrate_some_work (psched_t *s)
+static pbatch_t *sched_migrate_from_set (bitset128_t *active, unsigned int shift)
 {
-	bitset128_t active;
-	unsigned int shift = (s->sidx & ~0x03);
 	pbatch_t *bch = NULL;
 
-	bis128_andinv (&slickss.enabled_threads, &slickss.sleeping_threads, &active);
-
-	while (!bis128_iszero (&active) && !bch) {
+	while (!bis128_unsafe_iszero (active) && !bch) {
 		unsigned int best_n = MAX_RT_THREADS;
 		unsigned int best_pri = MAX_PRIORITY_LEVELS;
 		unsigned int i;
@@ -1008,7 +2228,7 @@ static pbatch_t *sched_migrate_some_work (psched_t *s)
 		for (i=0; i<MAX_RT_THREADS; i++) {
 			unsigned int n = (i + shift) & (MAX_RT_THREADS - 1);
 
-			if (bis128_isbitset (&active, n)) {
+			if (bis128_unsafe_isbitset (active, n)) {
 				uint64_t work = att64_val (&(slickss.schedulers[n]->mwstate));
 
 				if (work) {
@@ -1019,7 +2239,7 @@ static pbatch_t *sched_migrate_some_work (psched_t *s)
 						best_pri = pri;
 					}
 				} else {
-					bis128_clear_bit (&active, n);
+					bis128_unsafe_clear_bit (active, n);
 				}
 			}
 		}
@@ -1032,6 +2252,297 @@ static pbatch_t *sched_migrate_some_work (psched_t *s)
 	return bch;
 }
 /*}}}*/
+/*{{{  static pbatch_t *sched_migrate_some_work (psched_t *s)*/
+/*
+ *	migrates some work, from schedulers on the same NUMA node if possible.  Only from our own side of
+ *	the reserved partition (--rt-reserve): ordinary threads never touch the reserved threads' windows,
+ *	and the reserved threads only hold (and so only steal) latency-critical work.
+ */
+static pbatch_t *sched_migrate_some_work (psched_t *s)
+{
+	bitset128_t active;
+	unsigned int shift = shard_of_thread (s->sidx)->base;		/* own shard first, so it wins ties */
+	pbatch_t *bch;
+
+	slick_active_threads (&active);
+	bis128_unsafe_and (&active, slick_partition (s->sidx), &active);
+
+	if (slickss.numa) {
+		bitset128_t local;
+		unsigned int n;
+
+		local = active;
+		for (n=0; n<MAX_RT_THREADS; n++) {
+			if (bis128_unsafe_isbitset (&local, n) && (slickss.schedulers[n]->node != s->node)) {
+				bis128_unsafe_clear_bit (&local, n);
+			}
+		}
+		active.values[0] &= ~local.values[0];
+		active.values[1] &= ~local.values[1];
+
+		bch = sched_migrate_from_set (&local, shift);
+		if (bch) {
+			return bch;
+		}
+		bch = sched_migrate_from_set (&active, shift);
+		if (bch) {
+			s->stats.rsteals++;
+		}
+		return bch;
+	}
+
+	return sched_migrate_from_set (&active, shift);
+}
+/*}}}*/
+/*{{{  static pbatch_t *sched_steal_edf (psched_t *s)*/
+/*
+ *	takes the most urgent earliest-deadline-first batch queued anywhere, if there is one.  Tried before
+ *	fixed-priority work, as deadline batches come before those wherever they are queued.  A heap that
+ *	is busy (its owner or another thief in it) is left alone, rather than waited for.
+ */
+static pbatch_t *sched_steal_edf (psched_t *s)
+{
+	bitset128_t active;
+	psched_t *best = NULL;
+	uint64_t best_head = 0;
+	pbatch_t *bch = NULL;
+	unsigned int i;
+
+	slick_active_threads (&active);
+	bis128_unsafe_and (&active, slick_partition (s->sidx), &active);
+
+	for (i=0; i<MAX_RT_THREADS; i++) {
+		if ((i != (unsigned int)s->sidx) && bis128_unsafe_isbitset (&active, i)) {
+			psched_t *other = slickss.schedulers[i];
+			uint64_t head = att64_val (&(other->edf_head));
+
+			if (head && (!best || (PDeadline (head) < PDeadline (best_head)))) {
+				best = other;
+				best_head = head;
+			}
+		}
+	}
+
+	if (best && att32_cas (&(best->edf_lock), 0, 1)) {
+		if (best->edf_n) {
+			bch = sched_edf_take (best);
+			sched_edf_publish (best);
+		}
+		sched_edf_unlock (best);
+	}
+
+	return bch;
+}
+/*}}}*/
+
+
+/*{{{  static int sched_work_visible (psched_t *s)*/
+/*
+ *	returns non-zero if any awake scheduler on our side of the reserved partition has work visible in
+ *	its migration windows or deadline heap
+ */
+static int sched_work_visible (psched_t *s)
+{
+	bitset128_t active;
+	unsigned int i;
+
+	slick_active_threads (&active);
+	bis128_unsafe_and (&active, slick_partition (s->sidx), &active);
+
+	for (i=0; i<MAX_RT_THREADS; i++) {
+		if (bis128_unsafe_isbitset (&active, i) && (att64_val (&(slickss.schedulers[i]->mwstate)) || att64_val (&(slickss.schedulers[i]->edf_head)))) {
+			return 1;
+		}
+	}
+	return 0;
+}
+/*}}}*/
+/*{{{  static void sched_maybe_grow (psched_t *s)*/
+/*
+ *	called when there's visible work but no thread to wake for it: if that keeps happening
+ *	for a while, adds a thread to an elastic pool
+ */
+static void sched_maybe_grow (psched_t *s)
+{
+	uint64_t now = sched_time_fine ();
+
+	if (!s->grow_since || ((now - s->grow_last) > ELASTIC_GROW_NS)) {
+		/* start of a new run */
+		s->grow_since = now;
+	}
+	s->grow_last = now;
+
+	if ((now - s->grow_since) >= ELASTIC_GROW_NS) {
+		s->grow_since = 0;
+		slick_grow_pool ();
+	}
+}
+/*}}}*/
+/*{{{  static void sched_wake_idle_thread (psched_t *s)*/
+/*
+ *	wakes a sleeping thread to come and look for work; it is counted as spinning on its behalf
+ *	so that others don't wake more threads before it gets going
+ */
+static void sched_wake_idle_thread (psched_t *s)
+{
+	unsigned int sidx = slick_first_sleeping (s->sidx);
+
+	if (sidx < MAX_RT_THREADS) {
+		psched_t *other = slickss.schedulers[sidx];
+
+		if (!att32_test_set_bit (&(other->spinwake), 0)) {
+			att32_inc (other->nspinning);
+		}
+		s->stats.wakes++;
+		slick_wake_thread (other, SYNC_WORK_BIT);
+		s->grow_since = 0;
+	} else if (slickss.elastic) {
+		sched_maybe_grow (s);
+	}
+}
+/*}}}*/
+/*{{{  static psched_t *sched_shed_target (psched_t *s, uint64_t load)*/
+/*
+ *	picks a scheduler to push work to: the nearest sleeping one, otherwise the least loaded
+ *	awake one, provided it has under half our 'load'; NULL if nowhere is worth it.  Always
+ *	one on our side of the reserved partition.
+ */
+static psched_t *sched_shed_target (psched_t *s, uint64_t load)
+{
+	unsigned int sidx = slick_first_sleeping (s->sidx);
+	bitset128_t enabled;
+	psched_t *best = NULL;
+	uint64_t best_load = load >> 1;
+	unsigned int i;
+
+	if (sidx < MAX_RT_THREADS) {
+		return slickss.schedulers[sidx];
+	}
+
+	slick_enabled_threads (&enabled);
+	bis128_unsafe_and (&enabled, slick_partition (s->sidx), &enabled);
+	for (i=0; i<MAX_RT_THREADS; i++) {
+		if ((i != (unsigned int)s->sidx) && bis128_unsafe_isbitset (&enabled, i)) {
+			uint64_t other = att32_val (&(slickss.schedulers[i]->load));
+
+			if (other < best_load) {
+				best = slickss.schedulers[i];
+				best_load = other;
+			}
+		}
+	}
+	return best;
+}
+/*}}}*/
+/*{{{  static void sched_shed_current_batch (psched_t *s)*/
+/*
+ *	called when the current batch has grown big (typically a burst of new processes): splits off
+ *	its back half and pushes that elsewhere, rather than waiting for the batch to be stolen
+ */
+static void sched_shed_current_batch (psched_t *s)
+{
+	uint64_t size = s->cbch.size;
+	uint64_t keep = size >> 1;
+	psched_t *other;
+	pbatch_t *nb;
+	workspace_t w;
+	uint64_t i;
+
+	if (s->shed_hold || PHasAffinity (s->priofinity)) {
+		return;
+	}
+	other = sched_shed_target (s, size);
+	if (!other) {
+		s->shed_hold = 1;
+		return;
+	}
+
+	w = batch_front (&(s->cbch));
+	for (i=1; i<keep; i++) {
+		w = batch_after (&(s->cbch), w, i - 1);
+	}
+	if (slickss.comm_sample) {
+		/* rather cut between processes not seen talking, if there are some a little further on */
+		workspace_t c = w;
+
+		for (i=0; (i < (keep >> 1)) && sched_partners (s, c, batch_after (&(s->cbch), c, keep + i - 1)); i++) {
+			c = batch_after (&(s->cbch), c, keep + i - 1);
+		}
+		if (i < (keep >> 1)) {
+			w = c;
+			keep += i;
+		}
+	}
+
+	nb = sched_allocate_batch (s);
+	batch_split (&(s->cbch), keep, w, nb);
+
+	SAFETY { batch_verify_integrity (&(s->cbch)); batch_verify_integrity (nb); }
+	s->stats.pushes++;
+	sched_mail_batch (other, s->priofinity, nb);
+	sched_publish_load (s);
+}
+/*}}}*/
+/*{{{  static void sched_shed_queued_batch (psched_t *s, unsigned int rq_n)*/
+/*
+ *	called when a run-queue has grown long: pushes the batch at its front elsewhere
+ */
+static void sched_shed_queued_batch (psched_t *s, unsigned int rq_n)
+{
+	runqueue_t *rq = &(s->rq[rq_n]);
+	psched_t *other;
+	pbatch_t *bch;
+
+	if (s->shed_hold || !rq->fptr || !batch_window (rq->fptr)) {
+		/* front batch is affine to us (not in the migration window) */
+		return;
+	}
+	other = sched_shed_target (s, att32_val (&(s->load)));
+	if (!other) {
+		s->shed_hold = 1;
+		return;
+	}
+
+	bch = sched_try_pull_from_runqueue (s, rq_n);
+	if (bch) {
+		s->stats.pushes++;
+		sched_mail_batch (other, batch_front (bch)[LPriofinity], bch);
+		sched_publish_load (s);
+	}
+	/* else stolen from under us */
+}
+/*}}}*/
+/*{{{  static INLINE void sched_spinning_begin (psched_t *s)*/
+/*
+ *	called when a thread starts spinning in the idle loop
+ */
+static INLINE void sched_spinning_begin (psched_t *s)
+{
+	if (!s->spinning) {
+		s->spinning = 1;
+		if (!att32_swap (&(s->spinwake), 0)) {
+			att32_inc (s->nspinning);
+		}
+		/* else whoever woke us already counted us */
+	}
+}
+/*}}}*/
+/*{{{  static INLINE int sched_spinning_end (psched_t *s)*/
+/*
+ *	called when a thread stops spinning (found work or going to sleep), returns non-zero if it was the last spinner
+ */
+static INLINE int sched_spinning_end (psched_t *s)
+{
+	if (s->spinning) {
+		s->spinning = 0;
+		return att32_dec_z (s->nspinning);
+	} else if (att32_swap (&(s->spinwake), 0)) {
+		/* woken as a spinner, but found work before spinning */
+		return att32_dec_z (s->nspinning);
+	}
+	return 0;
+}
+/*}}}*/
 
 
 /*{{{  uint64_t sched_time_now (void)*/
@@ -1049,6 +2560,21 @@ uint64_t sched_time_now (void)
 	return (((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec);
 }
 /*}}}*/
+/*{{{  static uint64_t sched_time_fine (void)*/
+/*
+ *	reads the current time at full clock resolution (for measuring short intervals, not used in the dispatch path)
+ */
+static uint64_t sched_time_fine (void)
+{
+	struct timespec ts;
+
+	if (clock_gettime (CLOCK_MONOTONIC, &ts) != 0) {
+		slick_fatal ("sched_time_fine(): clock_gettime() failed with: %s", strerror (errno));
+		return 0;
+	}
+	return (((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec);
+}
+/*}}}*/
 /*{{{  static INLINE void sched_time_settimeoutn (psched_t *s, uint64_t now, uint64_t timeout)*/
 /*
  *	sets up a particular timeout (timeout) based on current time (now)
@@ -1379,18 +2905,225 @@ static inline int sched_remove_from_timer_queue (psched_t *s, tqnode_t *tn, work
 }
 /*}}}*/
 
+/*{{{  static void sched_check_cpus (psched_t *s)*/
+/*
+ *	every so often, one idle scheduler re-checks how many CPUs we're allowed
+ */
+static void sched_check_cpus (psched_t *s)
+{
+	uint64_t last = att64_val (&slickss.cpus_checked);
+	uint64_t now = sched_time_now ();
+
+	if (((now - last) >= CPU_RECHECK_NS) && att64_cas (&slickss.cpus_checked, last, now)) {
+		slick_recheck_cpus ();
+	}
+}
+/*}}}*/
+/*{{{  static INLINE void sched_idle_begin (psched_t *s)*/
+/*
+ *	notes the start of an idle period (no local or migratable work found)
+ */
+static INLINE void sched_idle_begin (psched_t *s)
+{
+	if (!s->stats.idle_since) {
+		att32_set (&(s->load), 0);
+		s->stats.idle_since = sched_time_fine ();
+		s->spin_start = s->stats.idle_since;
+		sched_spinning_begin (s);
+		if ((att32_val (&slickss.nspinning) + att32_val (&slickss.nrspinning)) > att32_val (&slickss.usable_cpus)) {
+			/* every CPU we have already has a spinner on it */
+			s->loop = 0;
+		}
+	}
+}
+/*}}}*/
+/*{{{  static INLINE void sched_idle_end (psched_t *s)*/
+/*
+ *	notes the end of an idle period (work found), adapting the spin budget to it.
+ *	The last spinner to find work is responsible for waking the next one.
+ */
+static INLINE void sched_idle_end (psched_t *s)
+{
+	if (s->stats.idle_since) {
+		uint64_t now = sched_time_fine ();
+
+		s->stats.idle_ns += now - s->stats.idle_since;
+		if (s->spin_start) {
+			s->stats.spin_ns += now - s->spin_start;
+			s->spin_window_ns += now - s->spin_start;
+			s->spin_start = 0;
+		}
+		sched_adapt_spin (s, now, now - s->stats.idle_since);
+		s->stats.idle_since = 0;
+		s->loop = s->spin;
+	}
+	if (sched_spinning_end (s) && sched_work_visible (s)) {
+		/* we were the last spinner and there's more work about: get another thread looking */
+		sched_wake_idle_thread (s);
+	}
+}
+/*}}}*/
+
+/*{{{  static int sched_retire_timeout (psched_t *s)*/
+/*
+ *	how long an idle thread sleeps before leaving an elastic pool (-1 = forever).  Thread 0 never
+ *	leaves, nor does a thread with timers pending (timer-queue nodes are referenced from the waiting
+ *	processes and may be cancelled by other threads, so can't move; they drain as they expire), nor
+ *	one with file I/O in its io_uring or descriptor guards in its epoll.
+ */
+static int sched_retire_timeout (psched_t *s)
+{
+	if (!slickss.elastic || !s->sidx || s->tq_fptr || s->uring_inflight || att32_val (&(s->fdarmed))) {
+		return -1;
+	}
+	return slickss.retire_ms;
+}
+/*}}}*/
+/*{{{  static void sched_retire (psched_t *s)*/
+/*
+ *	parks an idle thread from an elastic pool, until it's needed again.  The thread's run-queues and
+ *	mail are empty (it was asleep with nothing to do); once the enabled bit goes nobody will steal from,
+ *	mail or wake it, except for mail sent just before -- for which 'parked' makes the sender wake us.
+ *	Reached from process code on whatever stack alignment that had, so realigns for libc.
+ */
+static __attribute__ ((noinline, force_align_arg_pointer)) void sched_retire (psched_t *s)
+{
+	uint32_t live = att32_val (&slickss.nlive);
+
+	do {
+		if ((int)live <= s->sptr->rt_minthreads) {
+			return;
+		}
+	} while (!att32_cas (&slickss.nlive, live, live - 1));
+
+	att32_set (&(s->parked), 1);
+	memory_barrier ();
+	shard_clear_enabled (s->sidx);
+	shard_clear_idle (s->sidx);
+	att32_set (&slickss.oversubscribed, (live - 1) > att32_val (&slickss.usable_cpus));
+
+	if (slickss.verbose) {
+		slick_message ("run-time thread %d parked (%d left in the pool).", s->sidx, live - 1);
+	}
+	if (slick_all_threads_stuck ()) {
+		/* we may have been the one to notice */
+		deadlock ();
+	}
+
+	sched_do_laundry (s);
+	sched_release_excess_memory (s);
+
+	/* sleep until something wakes us: growing the pool, or late mail */
+	while (att32_val (&(s->parked)) && !att32_val (&(s->sync))) {
+		slick_safe_pause (s, -1);
+	}
+	if (att32_cas (&(s->parked), 1, 0)) {
+		/* woken by mail rather than by slick_grow_pool(), which counts for us */
+		att32_inc (&slickss.nlive);
+	}
+	shard_set_idle (s->sidx);		/* caller clears */
+	shard_set_enabled (s->sidx);
+
+	if (slickss.verbose) {
+		slick_message ("run-time thread %d rejoined the pool.", s->sidx);
+	}
+}
+/*}}}*/
+/*{{{  static void sched_exit (psched_t *s)*/
+/*
+ *	leaves the scheduler for good once the run-time is shutting down (slick_shutdown), returning from
+ *	slick_threadentry(): the thread ends, or if it's an embedding thread that became thread 0
+ *	(slick_run_on_current_thread), goes back there.  Any processes still queued here are abandoned.
+ */
+static __attribute__ ((noinline, noreturn, force_align_arg_pointer)) void sched_exit (psched_t *s)
+{
+	shard_clear_enabled (s->sidx);
+	shard_clear_idle (s->sidx);
+
+	if (slickss.verbose) {
+		slick_message ("run-time thread %d leaving.", s->sidx);
+	}
+	longjmp (sched_exitpoint, 1);
+}
+/*}}}*/
+
+/*{{{  static void sched_note_overrun (psched_t *s)*/
+/*
+ *	called on the way into the scheduler if the watchdog asked the last process dispatched to
+ *	yield: records it as a hog (with where it stopped, to find it by) and ends the current batch's
+ *	turn so that other batches get to run
+ */
+static void sched_note_overrun (psched_t *s)
+{
+	workspace_t w = s->current;
+	int i, slot = 0;
+
+	slick_yield = 0;
+	s->stats.overruns++;
+	s->dispatches = -1;
+
+	if (!w) {
+		return;
+	}
+	for (i=0; i<HOG_TABLE_SIZE; i++) {
+		if (s->hog_w[i] == w) {
+			slot = i;
+			break;		/* for() */
+		} else if (s->hog_count[i] < s->hog_count[slot]) {
+			slot = i;
+		}
+	}
+	if (s->hog_w[slot] != w) {
+		s->hog_w[slot] = w;
+		s->hog_count[slot] = 0;
+	}
+	s->hog_iptr[slot] = w[LIPtr];
+	s->hog_count[slot]++;
+}
+/*}}}*/
+/*{{{  static INLINE void sched_note_edf (psched_t *s, pbatch_t *bch)*/
+/*
+ *	counts an earliest-deadline-first batch picked to run, and whether it is already late
+ */
+static INLINE void sched_note_edf (psched_t *s, pbatch_t *bch)
+{
+	s->stats.edf++;
+	if (sched_time_now () > PDeadline (bch->priofinity)) {
+		s->stats.late++;
+	}
+}
+/*}}}*/
 /*{{{  static void slick_schedule (psched_t *s)*/
 /*
- *	picks a new process to run and dispatches
+ *	picks a new process to run and dispatches.  Entered from process code on whatever stack alignment
+ *	that had (os_altend, os_chanin, ..), and may arm the interval timer or walk the timer queue here,
+ *	so realigns.
  */
 static void slick_schedule (psched_t *s)
 {
 	workspace_t w = NULL;
 
+	if (slick_yield) {
+		/* last process ran past its slice */
+		sched_note_overrun (s);
+	}
+
 	do {
+		if (s->uring_inflight) {
+			/* file I/O outstanding (SYNC_IO only ends a sleep, completions are found here) */
+			sched_uring_poll (s);
+		}
+		if (att32_val (&(s->fdarmed)) && sched_isbatchend (s)) {
+			/* ALTs waiting on descriptors here: look for any that are ready, between batches */
+			sched_fd_events (s, 0);
+		}
+
 		if (att32_val (&(s->sync))) {
 			uint32_t sync = att32_swap (&(s->sync), 0);
 
+			if ((sync & SYNC_INTR) && att32_val (&(s->sptr->rt_shutdown))) {
+				sched_exit (s);
+			}
 			if (sync & SYNC_TIME) {
 				sched_check_timer_queue (s);
 			}
@@ -1399,8 +3132,14 @@ static void slick_schedule (psched_t *s)
 				pbatch_t *bch = (pbatch_t *)runqueue_atomic_dequeue (&(s->bmail), 0);
 
 				if (bch) {
-					sched_push_batch (s, bch->priofinity, bch);
-				} else {
+					uint64_t priofinity = bch->priofinity;
+
+					sched_push_batch (s, priofinity, bch);
+					if (sched_preempts (s, priofinity)) {
+						/* force new-batch pick next time */
+						s->dispatches = 0;
+					}
+				} else {
 					sync &= ~SYNC_BMAIL;
 				}
 			}
@@ -1411,7 +3150,7 @@ static void slick_schedule (psched_t *s)
 				if (ptr) {
 					sched_enqueue (s, ptr);
 				} else {
-					sync &= SYNC_PMAIL;
+					sync &= ~SYNC_PMAIL;
 				}
 			}
 
@@ -1421,29 +3160,43 @@ static void slick_schedule (psched_t *s)
 			}
 
 		}
+
+		if (s->outboxes) {
+			/* processes made ready for other schedulers by the last process, or just now */
+			sched_flush_mail (s);
+		}
 		
 		if (sched_isbatchend (s)) {
-			if ((s->cbch.size > BATCH_EMPTIED) && (att64_val (&(s->rqstate)) == 0)) {
+			if ((s->cbch.size > BATCH_EMPTIED) && (att64_val (&(s->rqstate)) == 0) && !s->edf_n) {
 				/* scheduled-out batch, but nothing else */
 				uint64_t size = s->cbch.size & ~BATCH_EMPTIED;
 
-				s->dispatches = calculate_dispatches (size);
+				if (slickss.quantum_adapt) {
+					sched_quantum_alone (s);
+				}
+				s->dispatches = calculate_dispatches (s, size);
 				s->cbch.size = size;
 
 				w = sched_dequeue (s);
 			} else {
 				uint64_t tmp;
 				pbatch_t *nb = NULL;
+				unsigned int rq = 0;
+				int edf = 0;
 
 				if (!batch_empty (&(s->cbch))) {
 					/* current batch still has stuff in it -- save */
 					sched_push_current_batch (s);
 				}
 
+				if (s->edf_n) {
+					/* earliest-deadline-first work comes before the fixed priorities */
+					nb = sched_edf_pop (s);
+					edf = (nb != NULL);
+				}
+
 				/* pick batch from the run-queue with highest priority */
 				while (nb == NULL) {
-					unsigned int rq;
-
 					tmp = att64_val (&(s->rqstate));
 					if (!tmp) {
 						break;
@@ -1454,18 +3207,37 @@ static void slick_schedule (psched_t *s)
 
 				if (nb) {
 					/* got a new batch of processes to schedule :) */
-					unsigned int sidx = bis128_bsf (&slickss.sleeping_threads);
-
-					if (att64_val (&(s->mwstate)) && (sidx < 128)) {
-						slick_wake_thread (slickss.schedulers[sidx], SYNC_WORK_BIT);
+					if ((att64_val (&(s->mwstate)) || s->edf_n) && !att32_val (s->nspinning)) {
+						/* visible work and nobody spinning to steal it */
+						sched_wake_idle_thread (s);
 					}
 
 					if (batch_isdirty (nb)) {
 						slick_fatal ("slick_schedule(): s=%p, unclean batch at %p", s, nb);
 					}
+					sched_idle_end (s);
+					s->stats.batches++;
+					if (edf) {
+						sched_note_edf (s, nb);
+					} else if (slickss.quantum_adapt) {
+						sched_quantum_picked (s, rq);
+					}
 					sched_load_current_batch (s, nb, 0);
 					w = sched_dequeue (s);
 
+					if (!edf && slickss.shed_batches && (s->rq[rq].length > (uint64_t)slickss.shed_batches)) {
+						/* long run-queue: give some of it away */
+						sched_shed_queued_batch (s, rq);
+					}
+
+				} else if ((nb = sched_steal_edf (s)) != NULL) {
+					/* got someone else's most urgent deadline work */
+					sched_idle_end (s);
+					s->stats.steals++;
+					s->loop = s->spin;
+					sched_note_edf (s, nb);
+					sched_load_current_batch (s, nb, 0);
+					w = sched_dequeue (s);
 				} else if ((nb = sched_migrate_some_work (s)) != NULL) {
 					/* got some work! */
 					if (!batch_isdirty (nb)) {
@@ -1473,16 +3245,20 @@ static void slick_schedule (psched_t *s)
 					}
 
 					SAFETY { batch_verify_integrity (nb); }
+					sched_idle_end (s);
+					s->stats.steals++;
 					s->loop = s->spin;
 					sched_load_current_batch (s, nb, 1);
 					w = sched_dequeue (s);
 				} else {
 					sched_new_current_batch (s);
+					sched_idle_begin (s);
 
 					if ((s->loop & 0x0f) == 0) {
 						sched_clean_timer_queue (s);
 						sched_do_laundry (s);
 						sched_release_excess_memory (s);
+						sched_check_cpus (s);
 					}
 
 					if (s->loop > 0) {
@@ -1491,33 +3267,39 @@ static void slick_schedule (psched_t *s)
 					} else {
 						
 						/* no more processes -- consider going to sleep */
-						bis128_set_bit (&slickss.sleeping_threads, s->sidx);
+						shard_set_sleeping (s->sidx);
 						read_barrier ();
 
+						if (sched_spinning_end (s) && sched_work_visible (s)) {
+							/* last spinner, but work turned up that nobody will wake us for: keep looking */
+							shard_clear_sleeping (s->sidx);
+							sched_spinning_begin (s);
+							continue;
+						}
+
 						if (s->tq_fptr != NULL) {
-							slick_safe_pause (s);
+							slick_safe_pause (s, -1);
 							sched_check_timer_queue (s);
 						} else if (!att32_val (&(s->sync))) {
-							bitset128_t idle;
-
-							bis128_set_bit (&slickss.idle_threads, s->sidx);
+							shard_set_idle (s->sidx);
 
-							/* FIXME: check for blocking calls, etc. */
+							/* (processes in blocking calls count as live, see slick_all_threads_stuck()) */
 							read_barrier ();
 
-							bis128_and (&slickss.idle_threads, &slickss.sleeping_threads, &idle);
-
-							if (bis128_eq (&idle, &slickss.enabled_threads)) {
+							if (slick_all_threads_stuck ()) {
 								/* (idle & sleeping) == enabled, so all stuck */
 								deadlock ();
-							} else {
-								slick_safe_pause (s);
+							} else if (slick_safe_pause (s, sched_retire_timeout (s))) {
+								/* idle for a long time in an elastic pool */
+								shard_clear_sleeping (s->sidx);
+								sched_retire (s);
 							}
 
-							bis128_clear_bit (&slickss.idle_threads, s->sidx);
+							shard_clear_idle (s->sidx);
 						} else {
-							bis128_clear_bit (&slickss.sleeping_threads, s->sidx);
+							shard_clear_sleeping (s->sidx);
 						}
+						sched_spinning_begin (s);
 						s->loop = s->spin;
 					}
 				}
@@ -1532,7 +3314,15 @@ static void slick_schedule (psched_t *s)
 #if defined(SLICK_DEBUG) || defined(LOCAL_DEBUG)
 	fprintf (stderr, "slick_schedule(): scheduling process at %p\n", w);
 #endif
+	s->stats.dispatches++;
+
+	if (slickss.shed_procs && (s->cbch.size > (uint64_t)slickss.shed_procs) && !(s->cbch.size & BATCH_EMPTIED)) {
+		/* big current batch (burst of new processes): give half of it away */
+		sched_shed_current_batch (s);
+	}
+
 	/* and go! */
+	s->current = w;
 	reschedule_process_out (w, s);
 //	_exit (42);		/* assert: never get here (prevent gcc warning about returning non-return function) */
 }
@@ -1541,266 +3331,1017 @@ static void slick_schedule (psched_t *s)
 
 /*{{{  void os_entry (void)*/
 /*
- *	entry-point from slick_schedlinkage
+ *	entry-point from slick_schedlinkage
+ */
+void os_entry (void)
+{
+#if defined(SLICK_DEBUG) || defined(LOCAL_DEBUG)
+	slick_message ("scheduler entry for thread %d, saved SP is %p", psched.sidx, psched.saved_sp);
+#endif
+
+	slick_schedule (&psched);
+}
+/*}}}*/
+/*{{{  void os_shutdown (workspace_t w)*/
+/*
+ *	called when return from the top-level thing: the application is done, so the run-time shuts down.
+ *	Reached from process code on whatever stack alignment that had, so realigns for libc.
+ */
+__attribute__ ((force_align_arg_pointer)) void os_shutdown (workspace_t w)
+{
+	slick_message ("scheduler exit for process at %p", w);
+
+	slick_shutdown ();
+	slick_schedule (&psched);
+}
+/*}}}*/
+
+/*{{{  channel flags (integer)*/
+#define CIO_NONE	(0x00000000)
+#define CIO_INPUT	(0x00000001)
+#define CIO_OUTPUT	(0x00000002)
+
+/*}}}*/
+/*{{{  static INLINE void channel_io (const int flags, workspace_t w, void **chanptr, void *addr, const int count, uint64_t raddr)*/
+/*
+ *	channel communication -- both ways.  This gets inlined and, hopefully, gcc optimises away everything
+ *	that isn't used or can't be determined statically.
+ */
+static INLINE void channel_io (const int flags, workspace_t w, void **chanptr, void *addr, const int count, uint64_t raddr)
+{
+	uint64_t *chanval;
+	workspace_t other;
+	void *optr;
+
+#if defined(SLICK_DEBUG) || defined(LOCAL_DEBUG)
+	fprintf (stderr, "channel_io(): flags=0x%8.8x, w=%p, chanptr=%p, addr=%p, raddr=%p, count=%d\n", flags, w, chanptr, addr, raddr, count);
+#endif
+
+	chanval = (uint64_t *)att64_val ((atomic64_t *)chanptr);
+
+	if (!chanval || ((uint64_t)chanval & 1)) {
+		/* not here, or ALTing -- prepare to sleep */
+		w[LIPtr] = raddr;
+		w[LPriofinity] = psched.priofinity;
+		w[LPointer] = (uint64_t)addr;
+		w[LLink] = BuildLinkHome (psched.sidx);		/* home, for soft affinity */
+
+		write_barrier ();
+
+		chanval = (uint64_t *)att64_swap ((atomic64_t *)chanptr, (uint64_t)w);
+		if (!chanval) {
+			/* we're in the channel now */
+			slick_schedule (&psched);
+		} else if ((uint64_t)chanval & 1) {
+			/* something ALTy in the channel, but we're there now */
+			sched_trigger_alt_guard (&psched, (uint64_t)chanval);
+			slick_schedule (&psched);
+		}
+		/* else, something arrived in the channel along the way, so go with it */
+	}
+
+	other = (workspace_t)chanval;
+	optr = (void *)other[LPointer];
+
+	if (flags & CIO_INPUT) {
+		switch (count) {
+		case 0:							break;			/* a signalling mechanism */
+		case 1:	*(uint8_t *)(addr) = *(uint8_t *)(optr);	break;
+		case 2:	*(uint16_t *)(addr) = *(uint16_t *)(optr);	break;
+		case 4:	*(uint32_t *)(addr) = *(uint32_t *)(optr);	break;
+		case 8:	*(uint64_t *)(addr) = *(uint64_t *)(optr);	break;
+		default:
+			memcpy (addr, optr, count);
+			break;
+		}
+	} else {
+		switch (count) {
+		case 0:							break;			/* a signalling mechanism */
+		case 1:	*(uint8_t *)(optr) = *(uint8_t *)(addr);	break;
+		case 2:	*(uint16_t *)(optr) = *(uint16_t *)(addr);	break;
+		case 4:	*(uint32_t *)(optr) = *(uint32_t *)(addr);	break;
+		case 8:	*(uint64_t *)(optr) = *(uint64_t *)(addr);	break;
+		default:
+			memcpy (optr, addr, count);
+			break;
+		}
+	}
+
+	*chanptr = NULL;			/* write barrier will make sure this goes first */
+	// att64_set ((atomic64_t *)chanptr, (uint64_t)NULL);
+	write_barrier ();
+	sched_enqueue_woken (&psched, w, other);
+	return;
+}
+/*}}}*/
+/*{{{  void os_chanin (workspace_t w, void **chanptr, void *addr, const int count)*/
+/*
+ *	channel input
+ */
+void os_chanin (workspace_t w, void **chanptr, void *addr, const int count)
+{
+	channel_io (CIO_INPUT, w, chanptr, addr, count, (uint64_t)__builtin_return_address (0));
+}
+/*}}}*/
+/*{{{  void os_chanin64 (workspace_t w, void **chanptr, void *addr)*/
+/*
+ *	channel input (64-bit)
+ */
+void os_chanin64 (workspace_t w, void **chanptr, void *addr)
+{
+	channel_io (CIO_INPUT, w, chanptr, addr, 8, (uint64_t)__builtin_return_address (0));
+}
+/*}}}*/
+/*{{{  void os_chanout (workspace_t w, void **chanptr, const void *addr, const int count)*/
+/*
+ *	channel output
+ */
+void os_chanout (workspace_t w, void **chanptr, void *addr, const int count)
+{
+	channel_io (CIO_OUTPUT, w, chanptr, addr, count, (uint64_t)__builtin_return_address (0));
+}
+/*}}}*/
+/*{{{  void os_chanoutv64 (workspace_t w, void **chanptr, const uint64_t val)*/
+/*
+ *	channel output -- a 64-bit value to output is given, stored in w[LTemp] if channel not-ready
+ */
+void os_chanoutv64 (workspace_t w, void **chanptr, const uint64_t val)
+{
+	uint64_t *chanval;
+	workspace_t other;
+	void *dptr;
+
+#if defined(SLICK_DEBUG) || defined(LOCAL_DEBUG)
+	fprintf (stderr, "os_chanoutv64(): w=%p, chanptr=%p, val=%16.16lx\n", w, chanptr, val);
+#endif
+
+	chanval = (uint64_t *)att64_val ((atomic64_t *)chanptr);
+
+	/* if nothing here, or ALTy, save value and go to channel code */
+	if (!chanval || ((uint64_t)chanval & 1)) {
+		w[LTemp] = val;
+		channel_io (CIO_OUTPUT, w, chanptr, (void *)w, 8, (uint64_t)__builtin_return_address (0));
+		/* if we get this far, we raced with the input, but done now */
+		return;
+	}
+
+	/* channel has a process in it, and it's not ALTing, so not going anywhere */
+	other = (workspace_t)chanval;
+	dptr = (void *)other[LPointer];
+
+	*(uint64_t *)dptr = val;
+	*chanptr = NULL;
+
+	write_barrier ();
+	sched_enqueue_woken (&psched, w, other);
+}
+/*}}}*/
+
+/*{{{  void os_runp (workspace_t w, workspace_t other)*/
+/*
+ *	run process: just pop it on the run-queue (simple enqueue for generated code)
+ */
+void os_runp (workspace_t w, workspace_t other)
+{
+	sched_enqueue (&psched, (workspace_t)((uint64_t)other & ~0x07));
+}
+/*}}}*/
+/*{{{  void os_stopp (workspace_t w)*/
+/*
+ *	stop process: save return address (and priof) and schedule another
+ */
+void os_stopp (workspace_t w)
+{
+	w[LIPtr] = (uint64_t)__builtin_return_address (0);
+	w[LPriofinity] = psched.priofinity;
+
+	slick_schedule (&psched);
+}
+/*}}}*/
+/*{{{  void os_startp (workspace_t w, workspace_t other, void *entrypoint)*/
+/*
+ *	start process: setup a process and enqueue it
+ */
+void os_startp (workspace_t w, workspace_t other, void *entrypoint)
+{
+#if defined(SLICK_DEBUG) || defined(LOCAL_DEBUG)
+	fprintf (stderr, "os_startp(): w=%p, other=%p, entrypoint=%p\n", w, other, entrypoint);
+#endif
+	other[LTemp] = (uint64_t)w;						/* parent workspace */
+	other[LIPtr] = (uint64_t)entrypoint;
+	other[LPriofinity] = psched.priofinity;
+
+	SAFETY { if (!batch_isempty (&(psched.cbch))) {
+			batch_verify_integrity (&(psched.cbch));
+		}
+	}
+
+	sched_enqueue_nopri (&psched, other);
+
+	SAFETY { batch_verify_integrity (&(psched.cbch)); }
+	psched.dispatches--;
+	if (psched.dispatches <= 0) {
+		/* force a reschedule */
+		w[LPriofinity] = psched.priofinity;
+		w[LIPtr] = (uint64_t)__builtin_return_address (0);
+
+		batch_enqueue_process_front (&(psched.cbch), w);
+		slick_schedule (&psched);
+	}
+}
+/*}}}*/
+/*{{{  void os_endp (workspace_t w, workspace_t other)*/
+/*
+ *	end process: decrement par-count and reschedule if done
+ */
+void os_endp (workspace_t w, workspace_t other)
+{
+	other[LCount]--;
+	if (!other[LCount]) {
+		/* we were the last */
+		other[LPriofinity] = other[LSavedPri];
+		other[LIPtr] = other[LIPtrSucc];
+
+		sched_enqueue (&psched, other);
+	}
+	/* else we were not the last -- reschedule */
+	slick_schedule (&psched);
+}
+/*}}}*/
+/*{{{  uint64_t os_ldtimer (workspace_t w)*/
+/*
+ *	read the current time in nanoseconds
+ */
+uint64_t os_ldtimer (workspace_t w)
+{
+	struct timespec ts;
+
+	if (clock_gettime (CLOCK_MONOTONIC_COARSE, &ts) != 0) {
+		slick_fatal ("clock_gettime() failed with: %s", strerror (errno));
+		return 0;
+	}
+	return (((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec);
+}
+/*}}}*/
+/*{{{  void os_pause (workspace_t w)*/
+/*
+ *	reschedule (yield).  This uses up one of the current batch's dispatches, so that a batch whose
+ *	processes only ever yield (as at preemption safepoints) still gives way to others in time.
+ */
+void os_pause (workspace_t w)
+{
+	w[LPriofinity] = psched.priofinity;
+	w[LIPtr] = (uint64_t)__builtin_return_address (0);
+
+	psched.dispatches--;
+	sched_enqueue_nopri (&psched, w);
+	slick_schedule (&psched);
+}
+/*}}}*/
+/*{{{  static void sched_block_on (workspace_t w, void *iptr, void (*fn)(void *), void *arg)*/
+/*
+ *	hands fn(arg) to a helper thread, with the process resuming at 'iptr' on this scheduler when it's done
+ */
+static void sched_block_on (workspace_t w, void *iptr, void (*fn)(void *), void *arg)
+{
+	w[LIPtr] = (uint64_t)iptr;
+	w[LPriofinity] = psched.priofinity;
+	w[LLink] = (uint64_t)psched.sidx;		/* where to come back to */
+	w[LPointer] = (uint64_t)arg;
+	w[LTimef] = (uint64_t)fn;			/* (not waiting on a timer meanwhile) */
+
+	slick_offload (w);
+	slick_schedule (&psched);
+}
+/*}}}*/
+/*{{{  void os_blocking_call (workspace_t w, void (*fn)(void *), void *arg)*/
+/*
+ *	calls fn(arg) on a helper thread, for anything that might block (read(), fsync(), a blocking library
+ *	function): the process waits, but the run-time thread carries on with others.  The process resumes
+ *	on this scheduler when fn returns; any result should go through 'arg'.  With --rt-offload=0 there
+ *	are no helpers and fn is simply called here.  Reached from process code on whatever stack alignment
+ *	that had, so realigns for libc.
+ */
+__attribute__ ((force_align_arg_pointer)) void os_blocking_call (workspace_t w, void (*fn)(void *), void *arg)
+{
+	if (!psched.sptr->offload_max) {
+		fn (arg);
+		return;
+	}
+	sched_block_on (w, __builtin_return_address (0), fn, arg);
+}
+/*}}}*/
+/*{{{  fileio_t: file I/O request for a helper thread (without an io_uring)*/
+typedef struct TAG_fileio_t {
+	int op;					/* FIO_... */
+	int fd;
+	void *buf;
+	uint64_t count;
+	int64_t offset;				/* -1 for the file position */
+	int64_t *result;
+} fileio_t;
+
+/*}}}*/
+/*{{{  static int64_t sched_file_io_now (int op, int fd, void *buf, uint64_t count, int64_t offset)*/
+/*
+ *	does a file I/O request with plain system calls, returns the result as io_uring would (-errno on failure)
+ */
+static int64_t sched_file_io_now (int op, int fd, void *buf, uint64_t count, int64_t offset)
+{
+	ssize_t r;
+
+	switch (op) {
+	case FIO_READ:
+		r = (offset < 0) ? read (fd, buf, count) : pread (fd, buf, count, (off_t)offset);
+		break;
+	case FIO_WRITE:
+		r = (offset < 0) ? write (fd, buf, count) : pwrite (fd, buf, count, (off_t)offset);
+		break;
+	default:
+		r = fsync (fd);
+		break;
+	}
+	return (r < 0) ? -(int64_t)errno : (int64_t)r;
+}
+/*}}}*/
+/*{{{  static void sched_file_io_helper (void *arg)*/
+/*
+ *	runs a file I/O request on a helper thread (through sched_block_on())
+ */
+static void sched_file_io_helper (void *arg)
+{
+	fileio_t *fio = (fileio_t *)arg;
+
+	*(fio->result) = sched_file_io_now (fio->op, fio->fd, fio->buf, fio->count, fio->offset);
+	sfree (fio);
+}
+/*}}}*/
+/*{{{  static void sched_file_io (workspace_t w, void *iptr, int op, int fd, void *buf, uint64_t count, int64_t offset, int64_t *result)*/
+/*
+ *	starts a file I/O request for a process, which resumes at 'iptr' when it's done: through this thread's
+ *	io_uring if it has one, else on a helper thread, else (--rt-offload=0 too) right here
+ */
+static void sched_file_io (workspace_t w, void *iptr, int op, int fd, void *buf, uint64_t count, int64_t offset, int64_t *result)
+{
+	psched_t *s = &psched;
+	fileio_t *fio;
+
+	if (count > FIO_MAX_COUNT) {
+		count = FIO_MAX_COUNT;		/* a short read or write, as the system call would give */
+	}
+#ifdef HAVE_LINUX_IO_URING_H
+	if (s->uring_fd >= 0) {
+		struct io_uring_sqe *sqe = sched_uring_sqe (s, w);
+
+		switch (op) {
+		case FIO_READ:
+			sqe->opcode = IORING_OP_READ;
+			break;
+		case FIO_WRITE:
+			sqe->opcode = IORING_OP_WRITE;
+			break;
+		default:
+			sqe->opcode = IORING_OP_FSYNC;
+			break;
+		}
+		sqe->fd = fd;
+		if (op != FIO_FSYNC) {
+			sqe->addr = (uint64_t)buf;
+			sqe->len = (uint32_t)count;
+			sqe->off = (uint64_t)offset;
+		}
+		w[LIPtr] = (uint64_t)iptr;
+		w[LPriofinity] = s->priofinity;
+		w[LPointer] = (uint64_t)result;
+
+		att32_inc (&slickss.offloaded);
+		s->uring_inflight++;
+		s->stats.ioreqs++;
+		sched_uring_queue (s);
+
+		slick_schedule (s);
+	}
+#endif
+	if (!s->sptr->offload_max) {
+		*result = sched_file_io_now (op, fd, buf, count, offset);
+		return;
+	}
+	fio = (fileio_t *)smalloc (sizeof (fileio_t));
+	fio->op = op;
+	fio->fd = fd;
+	fio->buf = buf;
+	fio->count = count;
+	fio->offset = offset;
+	fio->result = result;
+	sched_block_on (w, iptr, sched_file_io_helper, fio);
+}
+/*}}}*/
+/*{{{  void os_read (workspace_t w, int fd, void *buf, uint64_t count, int64_t offset, int64_t *result)*/
+/*
+ *	reads up to 'count' bytes from 'fd' into 'buf', at 'offset' (-1 for the file position).  The process
+ *	waits while the run-time thread carries on with others; '*result' is then the number of bytes read,
+ *	or -errno.  Goes through the run-time thread's io_uring (--rt-uring), else as os_blocking_call.
+ *	Reached from process code on whatever stack alignment that had, so realigns for libc.
+ */
+__attribute__ ((force_align_arg_pointer)) void os_read (workspace_t w, int fd, void *buf, uint64_t count, int64_t offset, int64_t *result)
+{
+	sched_file_io (w, __builtin_return_address (0), FIO_READ, fd, buf, count, offset, result);
+}
+/*}}}*/
+/*{{{  void os_write (workspace_t w, int fd, void *buf, uint64_t count, int64_t offset, int64_t *result)*/
+/*
+ *	writes up to 'count' bytes from 'buf' to 'fd', as os_read; '*result' is the number of bytes written
+ */
+__attribute__ ((force_align_arg_pointer)) void os_write (workspace_t w, int fd, void *buf, uint64_t count, int64_t offset, int64_t *result)
+{
+	sched_file_io (w, __builtin_return_address (0), FIO_WRITE, fd, buf, count, offset, result);
+}
+/*}}}*/
+/*{{{  void os_fsync (workspace_t w, int fd, int64_t *result)*/
+/*
+ *	flushes 'fd' to storage, as os_read; '*result' is zero or -errno
+ */
+__attribute__ ((force_align_arg_pointer)) void os_fsync (workspace_t w, int fd, int64_t *result)
+{
+	sched_file_io (w, __builtin_return_address (0), FIO_FSYNC, fd, NULL, 0, 0, result);
+}
+/*}}}*/
+/*{{{  shared-memory channels between OS processes (os_shmchanin, os_shmchanout)*/
+typedef struct TAG_shmwait_t {
+	shmchan_t *c;
+	void *addr;
+	int count;
+	int input;
+} shmwait_t;
+
+/*{{{  static INLINE atomic32_t *sched_shmchan_word (shmchan_t *c, const int input)*/
+/*
+ *	the futex a reader (input) or writer waits on: what the other end moves on
+ */
+static INLINE atomic32_t *sched_shmchan_word (shmchan_t *c, const int input)
+{
+	return input ? &(c->tail) : &(c->head);
+}
+/*}}}*/
+/*{{{  static void sched_futex (atomic32_t *word, int op, uint32_t val)*/
+/*
+ *	futex(2) on a word that may be shared with other OS processes (so not FUTEX_PRIVATE_FLAG)
+ */
+static void sched_futex (atomic32_t *word, int op, uint32_t val)
+{
+	syscall (SYS_futex, &(word->value), op, val, NULL, NULL, 0);
+}
+/*}}}*/
+/*{{{  static INLINE void sched_shmchan_wake (atomic32_t *waiting, atomic32_t *word)*/
+/*
+ *	wakes the other end if it said it was waiting (on 'word'), clearing the flag only if it still holds the
+ *	value seen: by then the other end may have woken by itself and flagged a later wait.
+ */
+static INLINE void sched_shmchan_wake (atomic32_t *waiting, atomic32_t *word)
+{
+	uint32_t flag = att32_val (waiting);
+
+	if (flag && att32_cas (waiting, flag, 0)) {
+		sched_futex (word, FUTEX_WAKE, 1);
+	}
+}
+/*}}}*/
+/*{{{  static int sched_shmchan_try (shmchan_t *c, void *addr, const int count, const int input, uint32_t *val)*/
+/*
+ *	reads or writes a message if there is one, or room for one; returns non-zero if done.  Otherwise the
+ *	caller should wait on the futex from sched_shmchan_word() for as long as it holds '*val' (the other end
+ *	has been asked to wake it, and won't make a system call unless asked).  The waiting flag holds the
+ *	position waited at, so that one wait's flag can't be taken for the next's.
+ */
+static int sched_shmchan_try (shmchan_t *c, void *addr, const int count, const int input, uint32_t *val)
+{
+	if (input) {
+		uint32_t head = att32_val (&(c->head));
+
+		if (att32_val (&(c->tail)) == head) {
+			att32_set (&(c->rwaiting), (head << 1) | 1);
+			memory_barrier ();
+			if (att32_val (&(c->tail)) == head) {
+				*val = head;
+				return 0;
+			}
+			att32_set (&(c->rwaiting), 0);
+		}
+		compiler_barrier ();
+		memcpy (addr, c->data + ((uint64_t)(head & (c->nslots - 1)) * c->slotsize), count);
+		compiler_barrier ();
+		att32_set (&(c->head), head + 1);
+		memory_barrier ();
+		sched_shmchan_wake (&(c->wwaiting), &(c->head));
+	} else {
+		uint32_t tail = att32_val (&(c->tail));
+		uint32_t head = att32_val (&(c->head));
+
+		if ((tail - head) >= c->nslots) {
+			att32_set (&(c->wwaiting), (head << 1) | 1);
+			memory_barrier ();
+			if ((tail - att32_val (&(c->head))) >= c->nslots) {
+				*val = head;
+				return 0;
+			}
+			att32_set (&(c->wwaiting), 0);
+		}
+		memcpy (c->data + ((uint64_t)(tail & (c->nslots - 1)) * c->slotsize), addr, count);
+		compiler_barrier ();
+		att32_set (&(c->tail), tail + 1);
+		memory_barrier ();
+		sched_shmchan_wake (&(c->rwaiting), &(c->tail));
+	}
+	return 1;
+}
+/*}}}*/
+#ifdef HAVE_LINUX_IO_URING_H
+/*{{{  static void sched_shmchan_wait (psched_t *s, workspace_t w, shmwait_t *sw, uint32_t val)*/
+/*
+ *	queues a futex wait in this thread's io_uring for 'w' (already counted in flight), which sched_uring_reap()
+ *	hands to sched_shmchan_woken()
+ */
+static void sched_shmchan_wait (psched_t *s, workspace_t w, shmwait_t *sw, uint32_t val)
+{
+	struct io_uring_sqe *sqe = sched_uring_sqe (s, (workspace_t)((uint64_t)w | URING_WAIT_TAG));
+
+	sqe->opcode = URING_OP_FUTEX_WAIT;
+	sqe->fd = URING_FUTEX2_SIZE_U32;
+	sqe->addr = (uint64_t)&(sched_shmchan_word (sw->c, sw->input)->value);
+	sqe->addr2 = (uint64_t)val;
+	sqe->addr3 = FUTEX_BITSET_MATCH_ANY;
+	sched_uring_queue (s);
+}
+/*}}}*/
+/*{{{  static int sched_shmchan_woken (psched_t *s, workspace_t w)*/
+/*
+ *	called when a process's futex wait completes (woken, or the word had moved on already): finishes
+ *	its communication and returns non-zero, or waits again and returns zero
+ */
+static int sched_shmchan_woken (psched_t *s, workspace_t w)
+{
+	shmwait_t *sw = (shmwait_t *)w[LPointer];
+	uint32_t val;
+
+	if (sched_shmchan_try (sw->c, sw->addr, sw->count, sw->input, &val)) {
+		sfree (sw);
+		return 1;
+	}
+	sched_shmchan_wait (s, w, sw, val);
+	return 0;
+}
+/*}}}*/
+#endif	/* HAVE_LINUX_IO_URING_H */
+/*{{{  static void sched_shmchan_helper (void *arg)*/
+/*
+ *	waits for a shared-memory channel on a helper thread (through sched_block_on()), without an io_uring
+ *	that can
+ */
+static void sched_shmchan_helper (void *arg)
+{
+	shmwait_t *sw = (shmwait_t *)arg;
+	uint32_t val;
+
+	while (!sched_shmchan_try (sw->c, sw->addr, sw->count, sw->input, &val)) {
+		sched_futex (sched_shmchan_word (sw->c, sw->input), FUTEX_WAIT, val);
+	}
+	sfree (sw);
+}
+/*}}}*/
+/*{{{  static void sched_shmchan_io (workspace_t w, void *iptr, shmchan_t *c, void *addr, const int count, const int input)*/
+/*
+ *	shared-memory channel communication, the process resuming at 'iptr' if it has to wait: in this thread's
+ *	io_uring if that can wait on a futex, else on a helper thread, else (--rt-offload=0 too) right here
+ */
+static void sched_shmchan_io (workspace_t w, void *iptr, shmchan_t *c, void *addr, const int count, const int input)
+{
+	psched_t *s = &psched;
+	shmwait_t *sw;
+	uint32_t val;
+
+	if ((uint32_t)count > c->slotsize) {
+		slick_fatal ("%d byte message on shared-memory channel at %p with %u byte slots", count, c, c->slotsize);
+	}
+	if (sched_shmchan_try (c, addr, count, input, &val)) {
+		return;
+	}
+	if (!s->uring_futex && !s->sptr->offload_max) {
+		do {
+			sched_futex (sched_shmchan_word (c, input), FUTEX_WAIT, val);
+		} while (!sched_shmchan_try (c, addr, count, input, &val));
+		return;
+	}
+
+	sw = (shmwait_t *)smalloc (sizeof (shmwait_t));
+	sw->c = c;
+	sw->addr = addr;
+	sw->count = count;
+	sw->input = input;
+	s->stats.shmwaits++;
+#ifdef HAVE_LINUX_IO_URING_H
+	if (s->uring_futex) {
+		w[LIPtr] = (uint64_t)iptr;
+		w[LPriofinity] = s->priofinity;
+		w[LPointer] = (uint64_t)sw;
+
+		att32_inc (&slickss.offloaded);
+		s->uring_inflight++;
+		sched_shmchan_wait (s, w, sw, val);
+
+		slick_schedule (s);
+	}
+#endif
+	sched_block_on (w, iptr, sched_shmchan_helper, sw);
+}
+/*}}}*/
+/*{{{  void os_shmchanin (workspace_t w, void *chan, void *addr, const int count)*/
+/*
+ *	shared-memory channel input (from slick_shmchan_create() or slick_shmchan_attach(), probably written in
+ *	another OS process): takes the next message, waiting for one if need be.  Messages are buffered, up to
+ *	the channel's slots, so output only waits when they're all full.  Not for ALTs.  Reached from process
+ *	code on whatever stack alignment that had, so realigns for libc.
+ */
+__attribute__ ((force_align_arg_pointer)) void os_shmchanin (workspace_t w, void *chan, void *addr, const int count)
+{
+	sched_shmchan_io (w, __builtin_return_address (0), (shmchan_t *)chan, addr, count, 1);
+}
+/*}}}*/
+/*{{{  void os_shmchanout (workspace_t w, void *chan, void *addr, const int count)*/
+/*
+ *	shared-memory channel output, as os_shmchanin
+ */
+__attribute__ ((force_align_arg_pointer)) void os_shmchanout (workspace_t w, void *chan, void *addr, const int count)
+{
+	sched_shmchan_io (w, __builtin_return_address (0), (shmchan_t *)chan, addr, count, 0);
+}
+/*}}}*/
+/*}}}*/
+/*{{{  networked channels between slick nodes (os_netchanin, os_netchanout)*/
+/*{{{  static void sched_netchan_io (workspace_t w, void *iptr, netlink_t *link, const int vchan, void *addr, const int count, const int input)*/
+/*
+ *	networked channel communication: handed to the link manager, the process resuming at 'iptr' on this
+ *	scheduler when it's done
+ */
+static void sched_netchan_io (workspace_t w, void *iptr, netlink_t *link, const int vchan, void *addr, const int count, const int input)
+{
+	netreq_t *nr;
+
+	if ((uint32_t)vchan >= link->nvchans) {
+		slick_fatal ("virtual channel %d on networked channel link %p, which has %u", vchan, link, link->nvchans);
+	}
+	nr = (netreq_t *)smalloc (sizeof (netreq_t));
+	nr->link = link;
+	nr->w = w;
+	nr->addr = addr;
+	nr->count = (uint64_t)count;
+	nr->vchan = (uint32_t)vchan;
+	nr->input = input;
+
+	w[LIPtr] = (uint64_t)iptr;
+	w[LPriofinity] = psched.priofinity;
+	w[LLink] = (uint64_t)psched.sidx;		/* where to come back to */
+	w[LPointer] = (uint64_t)nr;
+
+	slick_netlink_request (w);
+	slick_schedule (&psched);
+}
+/*}}}*/
+/*{{{  void os_netchanin (workspace_t w, void *link, const int vchan, void *addr, const int count)*/
+/*
+ *	networked channel input, on virtual channel 'vchan' of a link to another slick node (slick_netlink_connect()
+ *	and friends): waits for the process outputting on it there.  Rendezvous, as a local channel: the waiting input
+ *	sends credit for one message, and the output goes only with that.  'count' must match.  Not for ALTs.
+ *	Reached from process code on whatever stack alignment that had, so realigns for libc.
+ */
+__attribute__ ((force_align_arg_pointer)) void os_netchanin (workspace_t w, void *link, const int vchan, void *addr, const int count)
+{
+	sched_netchan_io (w, __builtin_return_address (0), (netlink_t *)link, vchan, addr, count, 1);
+}
+/*}}}*/
+/*{{{  void os_netchanout (workspace_t w, void *link, const int vchan, void *addr, const int count)*/
+/*
+ *	networked channel output, as os_netchanin: done once the message is written to the link, the input at
+ *	the other end having said it was waiting for it
+ */
+__attribute__ ((force_align_arg_pointer)) void os_netchanout (workspace_t w, void *link, const int vchan, void *addr, const int count)
+{
+	sched_netchan_io (w, __builtin_return_address (0), (netlink_t *)link, vchan, addr, count, 0);
+}
+/*}}}*/
+/*}}}*/
+/*{{{  work from outside the run-time (slick_submit, slick_external_chanout)*/
+/*{{{  static unsigned int sched_external_target (uint64_t priofinity)*/
+/*
+ *	picks a scheduler for a process made ready by a thread that isn't one: an enabled one its affinity
+ *	allows, preferring one that is awake (so no wake-up needed), round-robin from the last pick so that
+ *	a busy host spreads its work.  If none is enabled, any that exists (mail wakes a parked one).
+ */
+static unsigned int sched_external_target (uint64_t priofinity)
+{
+	uint64_t affinity = PHasAffinity (priofinity) ? PAffinity (priofinity) : 0;
+	unsigned int start = att32_val (&slickss.external_next);
+	unsigned int asleep = MAX_RT_THREADS;
+	bitset128_t targets;
+	unsigned int i, n;
+
+	slick_enabled_threads (&targets);
+	if (affinity) {
+		bis128_set_hi (&targets, 0);
+		bis128_set_lo (&targets, bis128_val_lo (&targets) & affinity);
+	}
+
+	for (i=0; i<MAX_RT_THREADS; i++) {
+		n = (start + i) % MAX_RT_THREADS;
+		if (bis128_isbitset (&targets, n)) {
+			if (!shard_is_sleeping (n)) {
+				att32_set (&slickss.external_next, n + 1);
+				return n;
+			} else if (asleep == MAX_RT_THREADS) {
+				asleep = n;
+			}
+		}
+	}
+	if (asleep < MAX_RT_THREADS) {
+		att32_set (&slickss.external_next, asleep + 1);
+		return asleep;
+	}
+
+	for (n=0; n<MAX_RT_THREADS; n++) {
+		if (slickss.schedulers[n] && (!affinity || ((n < 64) && (affinity & (1ULL << n))))) {
+			return n;
+		}
+	}
+	slick_fatal ("no run-time thread to take work from outside (priofinity 0x%16.16lx), not started?", priofinity);
+	return 0;
+}
+/*}}}*/
+/*{{{  void slick_submit (void *ws, void (*entry)(void), uint64_t priofinity)*/
+/*
+ *	starts a process from any thread, including ones that are not run-time threads (which have no
+ *	scheduler to enqueue it on): mailed to a scheduler picked for it, which is woken if asleep.  'ws' is
+ *	the new process's workspace pointer, as slick_startup(); 'priofinity' as process code has it
+ *	(priority in the low bits, affinity above).  The process has no parent, so should finish by
+ *	stopping (os_stopp) or by telling whoever is waiting for it over a channel.
+ */
+__attribute__ ((force_align_arg_pointer)) void slick_submit (void *ws, void (*entry)(void), uint64_t priofinity)
+{
+	workspace_t w = (workspace_t)ws;
+	unsigned int n = sched_external_target (priofinity);
+
+	w[LTemp] = 0;
+	w[LIPtr] = (uint64_t)entry;
+	w[LPriofinity] = priofinity;
+
+	sched_mail_direct (slickss.schedulers[n], w);
+}
+/*}}}*/
+/*{{{  void os_external_woken (workspace_t w)*/
+/*
+ *	reached (from slick_external_stub) when the process standing in for a thread outside the run-time
+ *	in a channel is scheduled: the channel input has taken its message, so the thread can go on.  The
+ *	workspace is on that thread's stack, so is not touched once it's told.
  */
-void os_entry (void)
+__attribute__ ((force_align_arg_pointer, noreturn)) void os_external_woken (workspace_t w)
 {
-#if defined(SLICK_DEBUG) || defined(LOCAL_DEBUG)
-	slick_message ("scheduler entry for thread %d, saved SP is %p", psched.sidx, psched.saved_sp);
-#endif
+	atomic32_t *done = (atomic32_t *)w[LTemp];
+
+	att32_set (done, 1);
+	sched_futex (done, FUTEX_WAKE, 1);
 
 	slick_schedule (&psched);
 }
 /*}}}*/
-/*{{{  void os_shutdown (workspace_t w)*/
+/*{{{  static void sched_external_trigger_alt (uint64_t val)*/
 /*
- *	called when return from the top-level thing
+ *	as sched_trigger_alt_guard, from a thread outside the run-time: the ALTing process, if it's to be
+ *	run, is mailed to a scheduler
  */
-void os_shutdown (workspace_t w)
+static void sched_external_trigger_alt (uint64_t val)
 {
-	slick_message ("scheduler exit for process at %p", w);
-
-	pthread_exit (NULL);
-}
-/*}}}*/
+	workspace_t other = (workspace_t)(val & ~1);
+	uint64_t state, nstate;
 
-/*{{{  channel flags (integer)*/
-#define CIO_NONE	(0x00000000)
-#define CIO_INPUT	(0x00000001)
-#define CIO_OUTPUT	(0x00000002)
+	do {
+		state = att64_val ((atomic64_t *)&(other[LState]));
+		nstate = (state - 1) & (~(ALT_NOT_READY | ALT_WAITING));		/* decrement guard count, clear NOT_READY and WAITING flags */
+	} while (!att64_cas ((atomic64_t *)&(other[LState]), state, nstate));
 
+	if ((state & ALT_WAITING) || (nstate == 0)) {
+		sched_mail_direct (slickss.schedulers[sched_external_target (other[LPriofinity])], other);
+	}
+}
 /*}}}*/
-/*{{{  static INLINE void channel_io (const int flags, workspace_t w, void **chanptr, void *addr, const int count, uint64_t raddr)*/
+/*{{{  void slick_external_chanout (void **chanptr, void *addr, const int count)*/
 /*
- *	channel communication -- both ways.  This gets inlined and, hopefully, gcc optimises away everything
- *	that isn't used or can't be determined statically.
+ *	channel output from a thread that isn't a run-time thread, to a process (which may be ALTing): if
+ *	the input is already waiting, the message is copied across and the process mailed back to the
+ *	scheduler it blocked on.  Otherwise a workspace on this thread's stack waits in the channel as an
+ *	output process would, resuming at slick_external_stub when the input has taken the message, and
+ *	this thread sleeps on a futex until then.  The caller must be the channel's only outputter, as
+ *	for process code.
  */
-static INLINE void channel_io (const int flags, workspace_t w, void **chanptr, void *addr, const int count, uint64_t raddr)
+__attribute__ ((force_align_arg_pointer)) void slick_external_chanout (void **chanptr, void *addr, const int count)
 {
+	uint64_t frame[8];
+	workspace_t w = (workspace_t)&(frame[7]);		/* down to LTimef */
+	atomic32_t done;
 	uint64_t *chanval;
 	workspace_t other;
-	void *optr;
-
-#if defined(SLICK_DEBUG) || defined(LOCAL_DEBUG)
-	fprintf (stderr, "channel_io(): flags=0x%8.8x, w=%p, chanptr=%p, addr=%p, raddr=%p, count=%d\n", flags, w, chanptr, addr, raddr, count);
-#endif
+	unsigned int home;
 
 	chanval = (uint64_t *)att64_val ((atomic64_t *)chanptr);
 
 	if (!chanval || ((uint64_t)chanval & 1)) {
-		/* not here, or ALTing -- prepare to sleep */
-		w[LIPtr] = raddr;
-		w[LPriofinity] = psched.priofinity;
+		/* not here, or ALTing -- wait in the channel */
+		att32_set (&done, 0);
+		w[LTemp] = (uint64_t)&done;
+		w[LIPtr] = (uint64_t)slick_external_stub;
+		w[LPriofinity] = BuildPriofinity (0, (MAX_PRIORITY_LEVELS / 2));
 		w[LPointer] = (uint64_t)addr;
+		w[LLink] = BuildLinkHome (sched_external_target (w[LPriofinity]));		/* home, for soft affinity */
 
 		write_barrier ();
 
 		chanval = (uint64_t *)att64_swap ((atomic64_t *)chanptr, (uint64_t)w);
-		if (!chanval) {
-			/* we're in the channel now */
-			slick_schedule (&psched);
-		} else if ((uint64_t)chanval & 1) {
-			/* something ALTy in the channel, but we're there now */
-			sched_trigger_alt_guard (&psched, (uint64_t)chanval);
-			slick_schedule (&psched);
+		if (!chanval || ((uint64_t)chanval & 1)) {
+			if ((uint64_t)chanval & 1) {
+				sched_external_trigger_alt ((uint64_t)chanval);
+			}
+			while (!att32_val (&done)) {
+				sched_futex (&done, FUTEX_WAIT, 0);
+			}
+			return;
 		}
-		/* else, something arrived in the channel along the way, so go with it */
+		/* else, the input arrived along the way, so go with it */
 	}
 
 	other = (workspace_t)chanval;
-	optr = (void *)other[LPointer];
-
-	if (flags & CIO_INPUT) {
-		switch (count) {
-		case 0:							break;			/* a signalling mechanism */
-		case 1:	*(uint8_t *)(addr) = *(uint8_t *)(optr);	break;
-		case 2:	*(uint16_t *)(addr) = *(uint16_t *)(optr);	break;
-		case 4:	*(uint32_t *)(addr) = *(uint32_t *)(optr);	break;
-		case 8:	*(uint64_t *)(addr) = *(uint64_t *)(optr);	break;
-		default:
-			memcpy (addr, optr, count);
-			break;
-		}
-	} else {
-		switch (count) {
-		case 0:							break;			/* a signalling mechanism */
-		case 1:	*(uint8_t *)(optr) = *(uint8_t *)(addr);	break;
-		case 2:	*(uint16_t *)(optr) = *(uint16_t *)(addr);	break;
-		case 4:	*(uint32_t *)(optr) = *(uint32_t *)(addr);	break;
-		case 8:	*(uint64_t *)(optr) = *(uint64_t *)(addr);	break;
-		default:
-			memcpy (optr, addr, count);
-			break;
-		}
-	}
+	memcpy ((void *)other[LPointer], addr, count);
 
-	*chanptr = NULL;			/* write barrier will make sure this goes first */
-	// att64_set ((atomic64_t *)chanptr, (uint64_t)NULL);
+	*chanptr = NULL;
 	write_barrier ();
-	sched_enqueue (&psched, other);
-	return;
+	home = LinkHome (other[LLink]);		/* where it blocked (channel_io) */
+	if (home >= MAX_RT_THREADS) {
+		/* no home noted: wherever a submitted process would go */
+		home = sched_external_target (other[LPriofinity]);
+	}
+	sched_mail_direct (slickss.schedulers[home], other);
 }
 /*}}}*/
-/*{{{  void os_chanin (workspace_t w, void **chanptr, void *addr, const int count)*/
+/*{{{  void slick_external_hold (void)*/
 /*
- *	channel input
+ *	called by a host that will be submitting processes or communicating from outside the run-time:
+ *	until the matching slick_external_release(), processes waiting for it are not a deadlock
  */
-void os_chanin (workspace_t w, void **chanptr, void *addr, const int count)
+void slick_external_hold (void)
 {
-	channel_io (CIO_INPUT, w, chanptr, addr, count, (uint64_t)__builtin_return_address (0));
+	att32_inc (&slickss.offloaded);
 }
 /*}}}*/
-/*{{{  void os_chanin64 (workspace_t w, void **chanptr, void *addr)*/
+/*{{{  void slick_external_release (void)*/
 /*
- *	channel input (64-bit)
+ *	ends a slick_external_hold(): if nothing else is live, a scheduler is woken to look again (and
+ *	report deadlock if everything is stuck)
  */
-void os_chanin64 (workspace_t w, void **chanptr, void *addr)
+void slick_external_release (void)
 {
-	channel_io (CIO_INPUT, w, chanptr, addr, 8, (uint64_t)__builtin_return_address (0));
+	if (att32_dec_z (&slickss.offloaded)) {
+		bitset128_t targets;
+
+		slick_enabled_threads (&targets);
+		if (!bis128_iszero (&targets)) {
+			slick_wake_thread (slickss.schedulers[bis128_bsf (&targets)], SYNC_WORK_BIT);
+		}
+	}
 }
 /*}}}*/
-/*{{{  void os_chanout (workspace_t w, void **chanptr, const void *addr, const int count)*/
-/*
- *	channel output
- */
-void os_chanout (workspace_t w, void **chanptr, void *addr, const int count)
-{
-	channel_io (CIO_OUTPUT, w, chanptr, addr, count, (uint64_t)__builtin_return_address (0));
-}
 /*}}}*/
-/*{{{  void os_chanoutv64 (workspace_t w, void **chanptr, const uint64_t val)*/
+/*{{{  void os_setdeadline (workspace_t w, uint64_t deadline)*/
 /*
- *	channel output -- a 64-bit value to output is given, stored in w[LTemp] if channel not-ready
+ *	moves the process into the earliest-deadline-first class, with an absolute deadline (as from
+ *	os_ldtimer), or out of it again if 'deadline' is zero.  Processes it starts inherit the deadline.
+ *	Entering the class drops any affinity; leaving it restores the priority the process had before.
+ *	Reschedules, so that a more urgent process (or batch) gets to run first.
  */
-void os_chanoutv64 (workspace_t w, void **chanptr, const uint64_t val)
+void os_setdeadline (workspace_t w, uint64_t deadline)
 {
-	uint64_t *chanval;
-	workspace_t other;
-	void *dptr;
-
-#if defined(SLICK_DEBUG) || defined(LOCAL_DEBUG)
-	fprintf (stderr, "os_chanoutv64(): w=%p, chanptr=%p, val=%16.16lx\n", w, chanptr, val);
-#endif
-
-	chanval = (uint64_t *)att64_val ((atomic64_t *)chanptr);
+	uint64_t pri = PPriority (psched.priofinity);
 
-	/* if nothing here, or ALTy, save value and go to channel code */
-	if (!chanval || ((uint64_t)chanval & 1)) {
-		w[LTemp] = val;
-		channel_io (CIO_OUTPUT, w, chanptr, (void *)w, 8, (uint64_t)__builtin_return_address (0));
-		/* if we get this far, we raced with the input, but done now */
+	if (deadline) {
+		w[LPriofinity] = BuildDeadline (deadline, pri);
+	} else if (PIsEDF (psched.priofinity)) {
+		w[LPriofinity] = BuildPriofinity (0, pri);
+	} else {
 		return;
 	}
+	w[LIPtr] = (uint64_t)__builtin_return_address (0);
 
-	/* channel has a process in it, and it's not ALTing, so not going anywhere */
-	other = (workspace_t)chanval;
-	dptr = (void *)other[LPointer];
-
-	*(uint64_t *)dptr = val;
-	*chanptr = NULL;
-
-	write_barrier ();
-	sched_enqueue (&psched, other);
+	psched.dispatches--;
+	sched_enqueue (&psched, w);
+	slick_schedule (&psched);
 }
 /*}}}*/
-
-/*{{{  void os_runp (workspace_t w, workspace_t other)*/
+/*{{{  static int sched_relabel_current (psched_t *s, uint64_t priofinity)*/
 /*
- *	run process: just pop it on the run-queue (simple enqueue for generated code)
+ *	called when the running process changes its own priority or affinity: if it is alone in the
+ *	current batch, may stay here, and nothing queued would now come before it, the batch simply takes
+ *	on the new priofinity and the process carries on.  Returns zero if it needs to be requeued.
  */
-void os_runp (workspace_t w, workspace_t other)
+static int sched_relabel_current (psched_t *s, uint64_t priofinity)
 {
-	sched_enqueue (&psched, (workspace_t)((uint64_t)other & ~0x07));
+	uint64_t rqs = att64_val (&(s->rqstate));
+
+	if (!batch_empty (&(s->cbch)) || s->edf_n || PIsEDF (priofinity) || PIsEDF (s->priofinity)) {
+		return 0;
+	}
+	if (PHasAffinity (priofinity) && !(PAffinity (priofinity) & bis128_val_lo (&(s->id)))) {
+		return 0;
+	}
+	if (sched_misplaced (s, priofinity) || (rqs && (bsf64 (rqs) <= PPriority (priofinity)))) {
+		return 0;
+	}
+	s->priofinity = priofinity;
+	return 1;
 }
 /*}}}*/
-/*{{{  void os_stopp (workspace_t w)*/
+/*{{{  static void sched_change_priofinity (workspace_t w, uint64_t priofinity, void *iptr)*/
 /*
- *	stop process: save return address (and priof) and schedule another
+ *	moves the running process to a new priofinity: it leaves the current batch (which carries on
+ *	otherwise undisturbed) for the run-queue at its new priority, or a scheduler it has affinity for
  */
-void os_stopp (workspace_t w)
+static void sched_change_priofinity (workspace_t w, uint64_t priofinity, void *iptr)
 {
-	w[LIPtr] = (uint64_t)__builtin_return_address (0);
-	w[LPriofinity] = psched.priofinity;
+	if ((priofinity == psched.priofinity) || sched_relabel_current (&psched, priofinity)) {
+		return;
+	}
+	w[LPriofinity] = priofinity;
+	w[LIPtr] = (uint64_t)iptr;
 
+	sched_enqueue (&psched, w);
 	slick_schedule (&psched);
 }
 /*}}}*/
-/*{{{  void os_startp (workspace_t w, workspace_t other, void *entrypoint)*/
+/*{{{  uint64_t os_getpri (workspace_t w)*/
 /*
- *	start process: setup a process and enqueue it
+ *	returns the running process's priority (0 is highest, MAX_PRIORITY_LEVELS - 1 lowest).  For a process
+ *	in the earliest-deadline-first class, that's the priority it will have when it leaves.
  */
-void os_startp (workspace_t w, workspace_t other, void *entrypoint)
+uint64_t os_getpri (workspace_t w)
 {
-#if defined(SLICK_DEBUG) || defined(LOCAL_DEBUG)
-	fprintf (stderr, "os_startp(): w=%p, other=%p, entrypoint=%p\n", w, other, entrypoint);
-#endif
-	other[LTemp] = (uint64_t)w;						/* parent workspace */
-	other[LIPtr] = (uint64_t)entrypoint;
-	other[LPriofinity] = psched.priofinity;
-
-	SAFETY { if (psched.cbch.fptr) {
-			batch_verify_integrity (&(psched.cbch));
-		}
-	}
-
-	sched_enqueue_nopri (&psched, other);
-
-	SAFETY { batch_verify_integrity (&(psched.cbch)); }
-	psched.dispatches--;
-	if (psched.dispatches <= 0) {
-		/* force a reschedule */
-		w[LPriofinity] = psched.priofinity;
-		w[LIPtr] = (uint64_t)__builtin_return_address (0);
-
-		batch_enqueue_process_front (&(psched.cbch), w);
-		slick_schedule (&psched);
-	}
+	return PPriority (psched.priofinity);
 }
 /*}}}*/
-/*{{{  void os_endp (workspace_t w, workspace_t other)*/
+/*{{{  void os_setpri (workspace_t w, int64_t pri)*/
 /*
- *	end process: decrement par-count and reschedule if done
+ *	sets the running process's priority (clamped to 0 .. MAX_PRIORITY_LEVELS - 1), keeping its
+ *	affinity or deadline
  */
-void os_endp (workspace_t w, workspace_t other)
+void os_setpri (workspace_t w, int64_t pri)
 {
-	other[LCount]--;
-	if (!other[LCount]) {
-		/* we were the last */
-		other[LPriofinity] = other[LSavedPri];
-		other[LIPtr] = other[LIPtrSucc];
+	uint64_t cur = psched.priofinity;
 
-		sched_enqueue (&psched, other);
+	if (pri < 0) {
+		pri = 0;
+	} else if (pri >= MAX_PRIORITY_LEVELS) {
+		pri = MAX_PRIORITY_LEVELS - 1;
+	}
+	if (PIsEDF (cur)) {
+		/* only changes where it goes back to */
+		sched_change_priofinity (w, BuildDeadline (PDeadline (cur), pri), __builtin_return_address (0));
+	} else {
+		sched_change_priofinity (w, BuildPriofinity (PAffinity (cur), pri), __builtin_return_address (0));
 	}
-	/* else we were not the last -- reschedule */
-	slick_schedule (&psched);
 }
 /*}}}*/
-/*{{{  uint64_t os_ldtimer (workspace_t w)*/
+/*{{{  uint64_t os_getaff (workspace_t w)*/
 /*
- *	read the current time in nanoseconds
+ *	returns the running process's affinity: bit n set for each run-time thread n it may run on,
+ *	zero if it may run on any
  */
-uint64_t os_ldtimer (workspace_t w)
+uint64_t os_getaff (workspace_t w)
 {
-	struct timespec ts;
-
-	if (clock_gettime (CLOCK_MONOTONIC_COARSE, &ts) != 0) {
-		slick_fatal ("clock_gettime() failed with: %s", strerror (errno));
-		return 0;
-	}
-	return (((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec);
+	return PHasAffinity (psched.priofinity) ? PAffinity (psched.priofinity) : 0;
 }
 /*}}}*/
-/*{{{  void os_pause (workspace_t w)*/
+/*{{{  void os_setaff (workspace_t w, uint64_t affinity)*/
 /*
- *	reschedule (yield)
+ *	sets the running process's affinity (as for os_getaff, zero for none), keeping its priority.
+ *	Threads not started (beyond the pool's size, or not yet created in an elastic pool) are ignored;
+ *	it's an error to leave none.  Parked threads count, mail to them unparks them.  A process in the
+ *	earliest-deadline-first class leaves it.
  */
-void os_pause (workspace_t w)
+void os_setaff (workspace_t w, uint64_t affinity)
 {
-	w[LPriofinity] = psched.priofinity;
-	w[LIPtr] = (uint64_t)__builtin_return_address (0);
+	int nthreads = (int)att32_val (&(psched.sptr->rt_started));
+	uint64_t valid = AFFINITY_MASK >> AFFINITY_SHIFT;
 
-	sched_enqueue_nopri (&psched, w);
-	slick_schedule (&psched);
+	if (nthreads < (64 - AFFINITY_SHIFT - 1)) {
+		valid &= (1ULL << nthreads) - 1;
+	}
+	if (affinity && !(affinity & valid)) {
+		slick_fatal ("os_setaff(): no run-time thread in affinity 0x%16.16lx", affinity);
+	}
+	sched_change_priofinity (w, BuildPriofinity (affinity & valid, PPriority (psched.priofinity)), __builtin_return_address (0));
 }
 /*}}}*/
 
@@ -1879,9 +4420,10 @@ void os_altwt (workspace_t w)
 /*}}}*/
 /*{{{  void os_taltwt (workspace_t w)*/
 /*
- *	timer alternative wait
+ *	timer alternative wait.  Reached from process code on whatever stack alignment that had, so realigns
+ *	(for the timer queue).
  */
-void os_taltwt (workspace_t w)
+__attribute__ ((force_align_arg_pointer)) void os_taltwt (workspace_t w)
 {
 	uint64_t state, now;
 
@@ -1893,7 +4435,7 @@ void os_taltwt (workspace_t w)
 	if (state & ALT_NOT_READY) {
 		uint64_t nstate = (state | ALT_WAITING) & (~(ALT_ENABLING | ALT_NOT_READY));
 
-		if ((w[LTLink] == TimeSet_p) && (now <= w[LTimef])) {
+		if ((w[LTLink] == TimeSet_p) && (w[LTimef] <= now)) {
 			/* already past or at timeout */
 		} else {
 			tqnode_t *tn = NULL;
@@ -2054,9 +4596,9 @@ int os_diss (workspace_t w, uint64_t paddr, const int guard)
 /*}}}*/
 /*{{{  int os_dist (workspace_t w, uint64_t timeout, uint64_t paddr, const int guard)*/
 /*
- *	disable timeout guard
+ *	disable timeout guard (realigns, as os_taltwt)
  */
-int os_dist (workspace_t w, uint64_t timeout, uint64_t paddr, const int guard)
+__attribute__ ((force_align_arg_pointer)) int os_dist (workspace_t w, uint64_t timeout, uint64_t paddr, const int guard)
 {
 	uint64_t tlink;
 
@@ -2102,6 +4644,129 @@ int os_dist (workspace_t w, uint64_t timeout, uint64_t paddr, const int guard)
 }
 /*}}}*/
 
+/*{{{  static fdguard_t *sched_fdguard (int fd)*/
+/*
+ *	the guard state for a descriptor
+ */
+static fdguard_t *sched_fdguard (int fd)
+{
+	if ((fd < 0) || (fd >= slickss.nfdguards)) {
+		slick_fatal ("descriptor %d can't be an ALT guard (expect [0..%d])", fd, slickss.nfdguards - 1);
+	}
+	return &(slickss.fdguards[fd]);
+}
+/*}}}*/
+/*{{{  int os_enbfd (workspace_t w, int fd, int events, const int guard)*/
+/*
+ *	enable descriptor guard, ready when 'fd' is readable (POLLIN, the default) or writable (POLLOUT) as
+ *	'events' asks, or on error or hang-up -- returns guard.  Waits in this run-time thread's epoll, one-shot;
+ *	taken back out of it when disabled without firing, so that nothing waits on it any more.  Only
+ *	one ALT may wait on a descriptor at a time.  Descriptors epoll can't wait on (regular files) are ready.
+ *	Reached from process code on whatever stack alignment that had, so realigns for libc.
+ */
+__attribute__ ((force_align_arg_pointer)) int os_enbfd (workspace_t w, int fd, int events, const int guard)
+{
+	psched_t *s = &psched;
+	fdguard_t *g;
+	psched_t *prev;
+	struct epoll_event ev;
+	int r;
+
+	if (!guard) {
+		return 0;
+	}
+	g = sched_fdguard (fd);
+
+	att64_inc ((atomic64_t *)&(w[LState]));
+	att64_set (&(g->wptr), (uint64_t)w | 1);
+
+	prev = (psched_t *)att64_swap (&(g->armed), (uint64_t)s);
+	if (prev != s) {
+		att32_inc (&(s->fdarmed));
+		att32_inc (&slickss.offloaded);
+		if (prev) {
+			/* still armed where we last waited on it */
+			sched_fdguard_disarmed (prev);
+		}
+	}
+
+	ev.events = (events & (EPOLLIN | EPOLLOUT | EPOLLPRI)) ? (events & (EPOLLIN | EPOLLOUT | EPOLLPRI)) : EPOLLIN;
+	ev.events |= EPOLLONESHOT;
+	ev.data.ptr = g;
+	if (g->reg == s) {
+		r = epoll_ctl (s->epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+		if ((r < 0) && (errno == ENOENT)) {
+			/* closed and re-opened since */
+			r = epoll_ctl (s->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+		}
+	} else {
+		if (g->reg) {
+			epoll_ctl (g->reg->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+		}
+		r = epoll_ctl (s->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+		if ((r < 0) && (errno == EEXIST)) {
+			r = epoll_ctl (s->epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+		}
+	}
+
+	if (r < 0) {
+		/* can't wait on it: ready now, as a skip guard */
+		g->reg = NULL;
+		if (att64_cas (&(g->armed), (uint64_t)s, (uint64_t)NULL)) {
+			sched_fdguard_disarmed (s);
+		}
+		if (att64_swap (&(g->wptr), (uint64_t)NULL) != (uint64_t)NULL) {
+			att64_dec ((atomic64_t *)&(w[LState]));
+		}
+		if (att64_val ((atomic64_t *)&(w[LState])) & ALT_NOT_READY) {
+			att64_and ((atomic64_t *)&(w[LState]), ~(ALT_NOT_READY | ALT_ENABLING));
+		}
+	} else {
+		g->reg = s;
+	}
+
+	return 1;
+}
+/*}}}*/
+/*{{{  int os_disfd (workspace_t w, int fd, uint64_t paddr, const int guard)*/
+/*
+ *	disable descriptor guard -- returns non-zero if the descriptor was ready.  One that didn't fire is
+ *	disarmed, else it would count as an outstanding wait (see slick_all_threads_stuck()) for good.
+ *	Reached from process code on whatever stack alignment that had, so realigns for libc.
+ */
+__attribute__ ((force_align_arg_pointer)) int os_disfd (workspace_t w, int fd, uint64_t paddr, const int guard)
+{
+	fdguard_t *g;
+	psched_t *prev;
+
+	if (!guard) {
+		return 0;
+	}
+	g = sched_fdguard (fd);
+
+	if (att64_swap (&(g->wptr), (uint64_t)NULL) != (uint64_t)NULL) {
+		/* still us, not fired: out of the epoll (not MOD to no events: hang-up and error still report) */
+		att64_dec ((atomic64_t *)&(w[LState]));
+		if (g->reg) {
+			epoll_ctl (g->reg->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+			g->reg = NULL;
+		}
+		prev = (psched_t *)att64_swap (&(g->armed), (uint64_t)NULL);
+		if (prev) {
+			/* (else an event got there first, and counted it off) */
+			sched_fdguard_disarmed (prev);
+		}
+		return 0;
+	}
+
+	if (w[LTemp] == NoneSelected_o) {
+		w[LTemp] = paddr;
+	}
+
+	return 1;
+}
+/*}}}*/
+
 /*{{{  */
 /*
  */
@@ -30,9 +30,19 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/uio.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
 #include <fcntl.h>
 #include <time.h>
 #include <errno.h>
+#include <limits.h>
 #include <signal.h>
 
 #include <sched.h>
@@ -70,7 +80,9 @@ static void slick_sigalrm (int sig)
 	int i;
 
 	for (i=0; i<slick.rt_nthreads; i++) {
-		slick_wake_thread (slickss.schedulers[i], SYNC_TIME_BIT);
+		if (slickss.schedulers[i] && !att32_val (&(slickss.schedulers[i]->parked))) {
+			slick_wake_thread (slickss.schedulers[i], SYNC_TIME_BIT);
+		}
 	}
 
 	signal (SIGALRM, slick_sigalrm);
@@ -111,6 +123,640 @@ void slick_assert (const int v, const char *file, const int line)
 }
 /*}}}*/
 
+/*{{{  static int slick_read_small_file (const char *fname, char *buf, const int blen)*/
+/*
+ *	reads a small (sysfs/procfs/cgroupfs) file into a NUL-terminated buffer,
+ *	returns length read or -1 on error
+ */
+static int slick_read_small_file (const char *fname, char *buf, const int blen)
+{
+	int fd = open (fname, O_RDONLY);
+	int n;
+
+	if (fd < 0) {
+		return -1;
+	}
+	n = read (fd, buf, blen - 1);
+	close (fd);
+	if (n < 0) {
+		return -1;
+	}
+	buf[n] = '\0';
+	return n;
+}
+/*}}}*/
+/*{{{  static int slick_count_cpu_list (const char *list)*/
+/*
+ *	counts the CPUs in a list like "0-3,8,10-11", returns 0 if empty or unparseable
+ */
+static int slick_count_cpu_list (const char *list)
+{
+	const char *ch = list;
+	int count = 0;
+
+	while (*ch && (*ch != '\n')) {
+		int lo, hi, len;
+
+		if (sscanf (ch, "%d-%d%n", &lo, &hi, &len) == 2) {
+			count += (hi >= lo) ? (hi - lo) + 1 : 0;
+		} else if (sscanf (ch, "%d%n", &lo, &len) == 1) {
+			count++;
+		} else {
+			return 0;
+		}
+		ch += len;
+		if (*ch == ',') {
+			ch++;
+		}
+	}
+	return count;
+}
+/*}}}*/
+/*{{{  static int slick_cgroup_dir_limit (const char *dir, const int v2)*/
+/*
+ *	CPU limit imposed by one cgroup directory: quota/period rounded up, or the size of
+ *	its effective cpuset, whichever is smaller; 0 if no limit (or nothing readable)
+ */
+static int slick_cgroup_dir_limit (const char *dir, const int v2)
+{
+	char fname[PATH_MAX + 64];
+	char buf[256];
+	int64_t quota = -1, period = 0;
+	int limit = 0;
+	int n;
+
+	if (v2) {
+		snprintf (fname, sizeof (fname), "%s/cpu.max", dir);
+		if (slick_read_small_file (fname, buf, sizeof (buf)) > 0) {
+			if (sscanf (buf, "%ld %ld", &quota, &period) != 2) {
+				quota = -1;		/* "max", unlimited */
+			}
+		}
+		snprintf (fname, sizeof (fname), "%s/cpuset.cpus.effective", dir);
+	} else {
+		snprintf (fname, sizeof (fname), "%s/cpu.cfs_quota_us", dir);
+		if (slick_read_small_file (fname, buf, sizeof (buf)) > 0) {
+			sscanf (buf, "%ld", &quota);
+		}
+		snprintf (fname, sizeof (fname), "%s/cpu.cfs_period_us", dir);
+		if (slick_read_small_file (fname, buf, sizeof (buf)) > 0) {
+			sscanf (buf, "%ld", &period);
+		}
+		snprintf (fname, sizeof (fname), "%s/cpuset.effective_cpus", dir);
+	}
+
+	if ((quota > 0) && (period > 0)) {
+		limit = (int)((quota + period - 1) / period);
+	}
+	if (slick_read_small_file (fname, buf, sizeof (buf)) > 0) {
+		n = slick_count_cpu_list (buf);
+		if (n && (!limit || (n < limit))) {
+			limit = n;
+		}
+	}
+	return limit;
+}
+/*}}}*/
+/*{{{  static int slick_cgroup_limit (void)*/
+/*
+ *	works out the CPU limit imposed by our cgroup (v2 unified or v1 cpu/cpuset controllers),
+ *	including its ancestors; returns 0 if there isn't one (or we can't tell)
+ */
+static int slick_cgroup_limit (void)
+{
+	char buf[4096];
+	char *line, *next;
+	int limit = 0;
+
+	if (slick_read_small_file ("/proc/self/cgroup", buf, sizeof (buf)) <= 0) {
+		return 0;
+	}
+
+	for (line = buf; line && *line; line = next) {
+		char dir[PATH_MAX];
+		char *ctls, *path;
+		int v2, root;
+
+		next = strchr (line, '\n');
+		if (next) {
+			*next++ = '\0';
+		}
+		/* "hierarchy-id:controller-list:path" */
+		ctls = strchr (line, ':');
+		path = ctls ? strchr (ctls + 1, ':') : NULL;
+		if (!path) {
+			continue;		/* for() */
+		}
+		*ctls++ = '\0';
+		*path++ = '\0';
+
+		v2 = !strcmp (line, "0") && (*ctls == '\0');
+		if (v2) {
+			root = snprintf (dir, sizeof (dir), "/sys/fs/cgroup");
+		} else if (strstr (ctls, "cpu")) {
+			root = snprintf (dir, sizeof (dir), "/sys/fs/cgroup/%s", ctls);
+		} else {
+			continue;		/* for() */
+		}
+		if (strcmp (path, "/")) {
+			strncat (dir, path, sizeof (dir) - (strlen (dir) + 1));
+		}
+
+		/* this group and its ancestors (when namespaced, the path may not exist, so we end up at the root) */
+		for (;;) {
+			int n = slick_cgroup_dir_limit (dir, v2);
+			char *ch;
+
+			if (n && (!limit || (n < limit))) {
+				limit = n;
+			}
+			if ((int)strlen (dir) <= root) {
+				break;		/* for() */
+			}
+			ch = strrchr (dir + root, '/');
+			if (!ch) {
+				break;		/* for() */
+			}
+			*ch = '\0';
+		}
+	}
+
+	return limit;
+}
+/*}}}*/
+/*{{{  static int slick_usable_cpus (void)*/
+/*
+ *	number of CPUs we can actually use: those in our affinity mask, limited by any cgroup quota
+ *	or cpuset; returns 0 if it can't be determined
+ */
+static int slick_usable_cpus (void)
+{
+	cpu_set_t cset;
+	int n = 0;
+	int cg;
+
+	if (!sched_getaffinity (0, sizeof (cset), &cset)) {
+		n = CPU_COUNT (&cset);
+	}
+	cg = slick_cgroup_limit ();
+	if (cg && (!n || (cg < n))) {
+		n = cg;
+	}
+	if (n > MAX_RT_THREADS) {
+		n = MAX_RT_THREADS;
+	}
+	return n;
+}
+/*}}}*/
+/*{{{  void slick_recheck_cpus (void)*/
+/*
+ *	called periodically by one of the schedulers to pick up changes to our CPU allowance
+ *	(cgroup quota changed, container resized, affinity changed)
+ */
+__attribute__ ((force_align_arg_pointer)) void slick_recheck_cpus (void)
+{
+	int n, live;
+
+	if (slick.fixed_ncpus) {
+		return;
+	}
+	n = slick_usable_cpus ();
+	live = (int)att32_val (&slickss.nlive);
+
+	if (!n || (n == (int)att32_val (&slickss.usable_cpus))) {
+		return;
+	}
+	att32_set (&slickss.usable_cpus, (uint32_t)n);
+	att32_set (&slickss.oversubscribed, (live > n));
+
+	if (slick.verbose) {
+		slick_message ("now have %d usable CPU%s for %d run-time threads%s", n, (n == 1) ? "" : "s", live,
+				(live > n) ? " (oversubscribed, not spinning)" : "");
+	}
+}
+/*}}}*/
+/*{{{  static int slick_count_llcs (void)*/
+/*
+ *	counts distinct last-level caches from sysfs (by their shared CPU lists), falls back to
+ *	NUMA nodes; returns 0 if neither could be found
+ */
+static int slick_count_llcs (void)
+{
+	char lists[MAX_SHARDS][64];
+	int nlists = 0;
+	int i;
+
+	for (i=0; i<slickss.ncpus; i++) {
+		char fname[128];
+		char buf[64];
+		int fd, n, j;
+
+		snprintf (fname, sizeof (fname), "/sys/devices/system/cpu/cpu%d/cache/index3/shared_cpu_list", i);
+		fd = open (fname, O_RDONLY);
+		if (fd < 0) {
+			continue;
+		}
+		n = read (fd, buf, sizeof (buf) - 1);
+		close (fd);
+		if (n <= 0) {
+			continue;
+		}
+		buf[n] = '\0';
+
+		for (j=0; (j<nlists) && strcmp (lists[j], buf); j++);
+		if ((j == nlists) && (nlists < MAX_SHARDS)) {
+			strcpy (lists[nlists++], buf);
+		}
+	}
+
+	if (!nlists) {
+		/* no cache topology, try NUMA nodes */
+		for (i=0; i<MAX_SHARDS; i++) {
+			char fname[64];
+			struct stat st_buf;
+
+			snprintf (fname, sizeof (fname), "/sys/devices/system/node/node%d", i);
+			if (stat (fname, &st_buf) < 0) {
+				break;
+			}
+			nlists++;
+		}
+	}
+
+	return nlists;
+}
+/*}}}*/
+/*{{{  static int slick_add_shards (int k, int nsub, int base, int count)*/
+/*
+ *	splits a contiguous range of threads into 'nsub' shards starting at shard 'k',
+ *	as evenly as possible; returns the next free shard
+ */
+static int slick_add_shards (int k, int nsub, int base, int count)
+{
+	int i, t = base;
+
+	for (i=0; i<nsub; i++, k++) {
+		sshard_t *sh = &(slickss.shards[k]);
+		int n = ((base + count) - t) / (nsub - i);
+
+		att64_init (&(sh->enabled), 0);
+		att64_init (&(sh->idle), 0);
+		att64_init (&(sh->sleeping), 0);
+		att64_init (&(sh->wakes), 0);
+		sh->base = t;
+		sh->count = n;
+
+		for (; n; n--, t++) {
+			slickss.shard_of[t] = (uint8_t)k;
+		}
+	}
+	return k;
+}
+/*}}}*/
+/*{{{  static void slick_setup_shards (void)*/
+/*
+ *	divides the run-time threads into shards for idle/sleeping state: one per LLC (or NUMA node)
+ *	unless set explicitly, but never more than 64 threads in one shard; when threads are bound
+ *	across NUMA nodes, no shard spans two nodes.  Reserved threads (--rt-reserve) get a shard
+ *	of their own, so that waking threads for ordinary work never picks one.
+ */
+static void slick_setup_shards (void)
+{
+	int nshards = slickss.nshards;
+	int nthreads = slick.rt_nthreads - slickss.reserve_n;		/* ordinary ones */
+	int maxshards = slickss.reserve_n ? (MAX_SHARDS - 1) : MAX_SHARDS;
+	int i;
+
+	if (nshards <= 0) {
+		char *ch = getenv ("SLICKRTNSHARDS");
+
+		nshards = 0;
+		if (ch && (sscanf (ch, "%d", &nshards) != 1)) {
+			slick_warning ("not using environment variable SLICKRTNSHARDS, not an integer [%s]", ch);
+			nshards = 0;
+		}
+	}
+	if (nshards <= 0) {
+		nshards = slick_count_llcs ();
+	}
+	if (nshards < ((nthreads + MAX_SHARD_THREADS - 1) / MAX_SHARD_THREADS)) {
+		nshards = (nthreads + MAX_SHARD_THREADS - 1) / MAX_SHARD_THREADS;
+	}
+	if (nshards > nthreads) {
+		nshards = nthreads;
+	}
+	if (nshards > maxshards) {
+		nshards = maxshards;
+	}
+
+	if (slickss.nnodes > 1) {
+		/* threads are ordered by node: share the shards out between the nodes' ranges */
+		int left = slickss.nnodes;
+		int k = 0;
+		int t = 0;
+
+		while (t < nthreads) {
+			int count, nsub;
+
+			for (count=1; ((t + count) < nthreads) && (slick.rt_node[t + count] == slick.rt_node[t]); count++);
+			left--;
+
+			nsub = (nshards * count) / nthreads;
+			if (nsub < ((count + MAX_SHARD_THREADS - 1) / MAX_SHARD_THREADS)) {
+				nsub = (count + MAX_SHARD_THREADS - 1) / MAX_SHARD_THREADS;
+			}
+			if (nsub > count) {
+				nsub = count;
+			}
+			if ((k + nsub + left) > maxshards) {
+				nsub = maxshards - (k + left);
+			}
+			k = slick_add_shards (k, nsub, t, count);
+			t += count;
+		}
+		nshards = k;
+	} else {
+		/* contiguous ranges of threads, as even as possible */
+		slick_add_shards (0, nshards, 0, nthreads);
+	}
+
+	bis128_init (&(slickss.partition[0]), 1);
+	bis128_init (&(slickss.partition[1]), 0);
+	slickss.reserved_shards = 0;
+	if (slickss.reserve_n) {
+		slickss.reserved_shards = 1ULL << nshards;
+		nshards = slick_add_shards (nshards, 1, nthreads, slickss.reserve_n);
+		for (i=nthreads; i<slick.rt_nthreads; i++) {
+			bis128_clear_bit (&(slickss.partition[0]), i);
+			bis128_set_bit (&(slickss.partition[1]), i);
+		}
+	}
+	att64_init (&(slickss.sleeping_shards), 0);
+	slickss.nshards = nshards;
+
+	if (slick.verbose) {
+		slick_message ("using %d thread-state shard%s", nshards, (nshards == 1) ? "" : "s");
+	}
+}
+/*}}}*/
+/*{{{  static void slick_setup_binding (void)*/
+/*
+ *	if binding, assigns each run-time thread a CPU from those we're allowed to run on, ordered
+ *	by NUMA node so that neighbouring threads share a node; works out whether memory should
+ *	be placed per node
+ */
+static void slick_setup_binding (void)
+{
+	int cpus[MAX_RT_THREADS];
+	int nodes[MAX_RT_THREADS];
+	cpu_set_t cset;
+	int n = 0;
+	int c, i;
+
+	for (i=0; i<MAX_RT_THREADS; i++) {
+		slick.rt_cpu[i] = -1;
+		slick.rt_node[i] = 0;
+	}
+	slickss.nnodes = 1;
+	slickss.numa = 0;
+
+	if (!slick.binding) {
+		return;
+	}
+	if (sched_getaffinity (0, sizeof (cset), &cset)) {
+		slick_warning ("failed to get CPU affinity, not binding run-time threads [%s]", strerror (errno));
+		slick.binding = 0;
+		return;
+	}
+
+	for (c=0; (c < CPU_SETSIZE) && (n < MAX_RT_THREADS); c++) {
+		if (CPU_ISSET (c, &cset)) {
+			int node = snode_of_cpu (c);
+
+			/* insert, stable by node */
+			for (i=n; (i > 0) && (nodes[i - 1] > node); i--) {
+				cpus[i] = cpus[i - 1];
+				nodes[i] = nodes[i - 1];
+			}
+			cpus[i] = c;
+			nodes[i] = node;
+			n++;
+		}
+	}
+	if (!n) {
+		slick.binding = 0;
+		return;
+	}
+
+	for (i=0; i<slick.rt_nthreads; i++) {
+		/* fill CPUs in order if there are enough, else spread (keeping thread ranges within nodes) */
+		int j = (slick.rt_nthreads <= n) ? i : ((i * n) / slick.rt_nthreads);
+
+		slick.rt_cpu[i] = cpus[j];
+		slick.rt_node[i] = nodes[j];
+		if (i && (slick.rt_node[i] != slick.rt_node[i - 1])) {
+			slickss.nnodes++;
+		}
+	}
+	slickss.numa = (slickss.nnodes > 1) || slick.numa;
+
+	if (slick.verbose) {
+		slick_message ("binding run-time threads to CPUs across %d NUMA node%s%s", slickss.nnodes, (slickss.nnodes == 1) ? "" : "s",
+				slickss.numa ? ", with node-local memory" : "");
+	}
+}
+/*}}}*/
+
+/*{{{  static int slick_parse_nthreads (const char *str)*/
+/*
+ *	parses a thread count "N" or elastic range "MIN:MAX", returns 0 on success
+ */
+static int slick_parse_nthreads (const char *str)
+{
+	int min, max;
+
+	switch (sscanf (str, "%d:%d", &min, &max)) {
+	case 1:
+		max = min;
+		break;
+	case 2:
+		break;
+	default:
+		return -1;
+	}
+	if (!min && !max) {
+		slick.rt_nthreads = 0;			/* default */
+		return 0;
+	}
+	if ((min < 1) || (max < min) || (max > MAX_RT_THREADS)) {
+		slick_warning ("unsupported number of threads (%s), expect [1..%d]", str, MAX_RT_THREADS);
+		return 0;
+	}
+	slick.rt_minthreads = min;
+	slick.rt_nthreads = max;
+	return 0;
+}
+/*}}}*/
+/*{{{  static int slick_parse_quantum (const char *str)*/
+/*
+ *	parses a dispatch quantum "PPD[:MAX][@PRI[-PRI]]" (dispatches per process in a batch, at most
+ *	MAX per batch, for all or some priorities), returns 0 on success
+ */
+static int slick_parse_quantum (const char *str)
+{
+	int ppd, max = 0, lo = 0, hi = MAX_PRIORITY_LEVELS - 1;
+	int n, i;
+
+	if (sscanf (str, "%d%n", &ppd, &n) != 1) {
+		return -1;
+	}
+	str += n;
+	if (*str == ':') {
+		if ((sscanf (str + 1, "%d%n", &max, &n) != 1) || (max < 1)) {
+			return -1;
+		}
+		str += n + 1;
+	}
+	if (*str == '@') {
+		if (sscanf (str + 1, "%d%n", &lo, &n) != 1) {
+			return -1;
+		}
+		str += n + 1;
+		hi = lo;
+		if ((*str == '-') && (sscanf (str + 1, "%d%n", &hi, &n) == 1)) {
+			str += n + 1;
+		}
+	}
+	if (*str != '\0') {
+		return -1;
+	}
+	if ((ppd < 1) || (ppd > QUANTUM_MAX_PPD) || (max > QUANTUM_MAX_DISPATCHES) || (lo < 0) || (hi < lo) || (hi >= MAX_PRIORITY_LEVELS)) {
+		slick_warning ("unsupported dispatch quantum, expect [1..%d] per process, at most %d per batch, priorities [0..%d]",
+				QUANTUM_MAX_PPD, QUANTUM_MAX_DISPATCHES, MAX_PRIORITY_LEVELS - 1);
+		return 0;
+	}
+	for (i=lo; i<=hi; i++) {
+		slickss.quantum_ppd[i] = ppd;
+		if (max) {
+			slickss.quantum_max[i] = max;
+		}
+	}
+	return 0;
+}
+/*}}}*/
+/*{{{  static int slick_parse_reserve (const char *str)*/
+/*
+ *	parses a reserved partition "N:pri<P" (or "N:P"): N run-time threads that only run processes
+ *	at priorities above P (numerically below), returns 0 on success
+ */
+static int slick_parse_reserve (const char *str)
+{
+	int n, pri, len = 0;
+
+	if ((sscanf (str, "%d:pri<%d%n", &n, &pri, &len) != 2) && (sscanf (str, "%d:%d%n", &n, &pri, &len) != 2)) {
+		return -1;
+	}
+	if (str[len] != '\0') {
+		return -1;
+	}
+	if ((n < 0) || (n > MAX_SHARD_THREADS) || (pri < 1) || (pri > MAX_PRIORITY_LEVELS)) {
+		slick_warning ("unsupported reserved partition, expect [0..%d] threads for priorities above [1..%d]",
+				MAX_SHARD_THREADS, MAX_PRIORITY_LEVELS);
+		return 0;
+	}
+	slickss.reserve_n = n;
+	slickss.reserve_pri = n ? pri : 0;
+	return 0;
+}
+/*}}}*/
+/*{{{  static int slick_parse_offload (const char *str)*/
+/*
+ *	parses the blocking-call helper pool size "MAX" or "MIN:MAX" (MIN started up-front, more created
+ *	as calls queue up), returns 0 on success
+ */
+static int slick_parse_offload (const char *str)
+{
+	int min, max;
+
+	switch (sscanf (str, "%d:%d", &min, &max)) {
+	case 1:
+		max = min;
+		min = 0;
+		break;
+	case 2:
+		break;
+	default:
+		return -1;
+	}
+	if ((min < 0) || (max < min) || (max > MAX_RT_THREADS)) {
+		slick_warning ("unsupported number of helper threads (%s), expect [0..%d]", str, MAX_RT_THREADS);
+		return 0;
+	}
+	slick.offload_min = min;
+	slick.offload_max = max;
+	return 0;
+}
+/*}}}*/
+/*{{{  static const char *slick_policy_name (int policy)*/
+/*
+ *	name of an OS scheduling policy, as given to --rt-policy
+ */
+static const char *slick_policy_name (int policy)
+{
+	switch (policy) {
+	case SCHED_FIFO:
+		return "fifo";
+	case SCHED_RR:
+		return "rr";
+	default:
+		return "other";
+	}
+}
+/*}}}*/
+/*{{{  static int slick_parse_policy (const char *str)*/
+/*
+ *	parses an OS scheduling policy for the run-time threads "fifo[:PRI]", "rr[:PRI]" or "other",
+ *	returns 0 on success
+ */
+static int slick_parse_policy (const char *str)
+{
+	int policy, pri = RT_POLICY_DEFAULT_PRI;
+	int len, min, max;
+
+	if (!strcmp (str, "other")) {
+		slick.rt_policy = SCHED_OTHER;
+		slick.rt_policy_pri = 0;
+		return 0;
+	} else if (!strncmp (str, "fifo", 4)) {
+		policy = SCHED_FIFO;
+		len = 4;
+	} else if (!strncmp (str, "rr", 2)) {
+		policy = SCHED_RR;
+		len = 2;
+	} else {
+		return -1;
+	}
+	if (str[len] == ':') {
+		int n = 0;
+
+		if ((sscanf (str + len + 1, "%d%n", &pri, &n) != 1) || (str[len + 1 + n] != '\0')) {
+			return -1;
+		}
+	} else if (str[len] != '\0') {
+		return -1;
+	}
+
+	min = sched_get_priority_min (policy);
+	max = sched_get_priority_max (policy) - 1;		/* one above is left for the watchdog */
+	if ((pri < min) || (pri > max)) {
+		slick_warning ("unsupported %s priority, expect [%d..%d]", slick_policy_name (policy), min, max);
+		return 0;
+	}
+	slick.rt_policy = policy;
+	slick.rt_policy_pri = pri;
+	return 0;
+}
+/*}}}*/
 /*{{{  int slick_init (const char **argv, const int argc)*/
 /*
  *	called to initialise the scheduler (command-line arguments given)
@@ -123,6 +769,26 @@ int slick_init (const char **argv, const int argc)
 
 	memset (&slick, 0, sizeof (slick_t));
 	memset (&slickss, 0, sizeof (slick_ss_t));
+	slickss.spin_max_us = -1;
+	slickss.spin_max_pct = SPIN_DEFAULT_PCT;
+	slickss.shed_procs = SHED_DEFAULT_PROCS;
+	slickss.shed_batches = SHED_DEFAULT_BATCHES;
+	slickss.soft_slack = SOFT_AFFINITY_SLACK;
+	slickss.comm_sample = COMM_DEFAULT_SAMPLE;
+	slick.rt_policy = SCHED_OTHER;
+	slick.offload_max = OFFLOAD_DEFAULT_MAX;
+	slick.uring_entries = URING_DEFAULT_ENTRIES;
+	pthread_mutex_init (&slick.start_lock, NULL);
+	pthread_cond_init (&slick.start_cond, NULL);
+	pthread_mutex_init (&slick.offload_lock, NULL);
+	pthread_cond_init (&slick.offload_cond, NULL);
+	pthread_mutex_init (&slick.netlink_lock, NULL);
+	slick.netlink_epfd = -1;
+	slick.netlink_wakefd = -1;
+	for (i=0; i<MAX_PRIORITY_LEVELS; i++) {
+		slickss.quantum_ppd[i] = BATCH_PPD;
+		slickss.quantum_max[i] = BATCH_MD_MASK;
+	}
 
 	if (argc == 0) {
 		/*{{{  create some default arguments (incase anyone dereferences argv[0] assumingly) */
@@ -165,16 +831,22 @@ int slick_init (const char **argv, const int argc)
 					}
 					/*}}}*/
 				} else if (!strncmp (*av_walk + 5, "nthreads", 8)) {
-					/*{{{  --rt-nthreads=NN*/
+					/*{{{  --rt-nthreads=NN, --rt-nthreads=MIN:MAX*/
+					if ((*av_walk)[13] == '=') {
+						if (slick_parse_nthreads (*av_walk + 14)) {
+							slick_warning ("garbled command-line argument [%s]", *av_walk);
+						}
+					} else {
+						slick_warning ("garbled command-line argument [%s]", *av_walk);
+					}
+					/*}}}*/
+				} else if (!strncmp (*av_walk + 5, "spin-cpu", 8)) {
+					/*{{{  --rt-spin-cpu=PCT*/
 					if ((*av_walk)[13] == '=') {
 						int tmp;
 
-						if (sscanf (*av_walk + 14, "%d", &tmp) == 1) {
-							if ((tmp < 0) || (tmp > MAX_RT_THREADS)) {
-								slick_warning ("unsupported number of threads (%d), expect [1..%d]", tmp, MAX_RT_THREADS);
-							} else {
-								slick.rt_nthreads = tmp;
-							}
+						if ((sscanf (*av_walk + 14, "%d", &tmp) == 1) && (tmp >= 0) && (tmp <= 100)) {
+							slickss.spin_max_pct = tmp;
 						} else {
 							slick_warning ("garbled command-line argument [%s]", *av_walk);
 						}
@@ -182,25 +854,253 @@ int slick_init (const char **argv, const int argc)
 						slick_warning ("garbled command-line argument [%s]", *av_walk);
 					}
 					/*}}}*/
-				} else if (!strcmp (*av_walk + 5, "help")) {
-					/*{{{  --rt-help*/
-					slick_cmessage (\
-						"slick run-time scheduler options (--rt-help):\n" \
-						"    --rt-verbose[=N]          set verbosity level\n" \
-						"    --rt-nthreads=N           fix number of run-time threads (also )\n" \
-						"    --rt-help                 this help\n");
-
-					/* bail out and say we failed */
-					return -1;
+				} else if (!strncmp (*av_walk + 5, "spin", 4)) {
+					/*{{{  --rt-spin=US*/
+					if ((*av_walk)[9] == '=') {
+						int tmp;
 
+						if ((sscanf (*av_walk + 10, "%d", &tmp) == 1) && (tmp >= 0)) {
+							slickss.spin_max_us = tmp;
+						} else {
+							slick_warning ("garbled command-line argument [%s]", *av_walk);
+						}
+					} else {
+						slick_warning ("garbled command-line argument [%s]", *av_walk);
+					}
 					/*}}}*/
-				} else {
-					/*{{{  probably for us, but emit a warning and add it to the program*/
-					slick_warning ("passing argument [%s] to application", *av_walk);
+				} else if (!strncmp (*av_walk + 5, "shards", 6)) {
+					/*{{{  --rt-shards=N*/
+					if ((*av_walk)[11] == '=') {
+						int tmp;
 
-					*sav_walk = (char *)*av_walk;
-					sav_walk++, j++;
-					/*}}}*/
+						if ((sscanf (*av_walk + 12, "%d", &tmp) == 1) && (tmp > 0) && (tmp <= MAX_SHARDS)) {
+							slickss.nshards = tmp;
+						} else {
+							slick_warning ("garbled command-line argument [%s]", *av_walk);
+						}
+					} else {
+						slick_warning ("garbled command-line argument [%s]", *av_walk);
+					}
+					/*}}}*/
+				} else if (!strncmp (*av_walk + 5, "retire", 6)) {
+					/*{{{  --rt-retire=MS*/
+					if ((*av_walk)[11] == '=') {
+						int tmp;
+
+						if ((sscanf (*av_walk + 12, "%d", &tmp) == 1) && (tmp > 0)) {
+							slickss.retire_ms = tmp;
+						} else {
+							slick_warning ("garbled command-line argument [%s]", *av_walk);
+						}
+					} else {
+						slick_warning ("garbled command-line argument [%s]", *av_walk);
+					}
+					/*}}}*/
+				} else if (!strncmp (*av_walk + 5, "shed", 4)) {
+					/*{{{  --rt-shed=PROCS[:BATCHES]*/
+					if ((*av_walk)[9] == '=') {
+						int procs, batches;
+
+						switch (sscanf (*av_walk + 10, "%d:%d", &procs, &batches)) {
+						case 1:
+							batches = procs ? SHED_DEFAULT_BATCHES : 0;
+							/* fall through */
+						case 2:
+							if ((procs >= 0) && (batches >= 0)) {
+								slickss.shed_procs = procs;
+								slickss.shed_batches = batches;
+								break;
+							}
+							/* fall through */
+						default:
+							slick_warning ("garbled command-line argument [%s]", *av_walk);
+							break;
+						}
+					} else {
+						slick_warning ("garbled command-line argument [%s]", *av_walk);
+					}
+					/*}}}*/
+				} else if (!strncmp (*av_walk + 5, "soft-affinity", 13)) {
+					/*{{{  --rt-soft-affinity[=SLACK]*/
+					if ((*av_walk)[18] == '\0') {
+						slickss.soft_affinity = 1;
+					} else if ((*av_walk)[18] == '=') {
+						int tmp;
+
+						if ((sscanf (*av_walk + 19, "%d", &tmp) == 1) && (tmp >= 0)) {
+							slickss.soft_affinity = 1;
+							slickss.soft_slack = tmp;
+						} else {
+							slick_warning ("garbled command-line argument [%s]", *av_walk);
+						}
+					} else {
+						slick_warning ("garbled command-line argument [%s]", *av_walk);
+					}
+					/*}}}*/
+				} else if (!strncmp (*av_walk + 5, "colocate", 8)) {
+					/*{{{  --rt-colocate=N*/
+					if ((*av_walk)[13] == '=') {
+						int tmp;
+
+						if ((sscanf (*av_walk + 14, "%d", &tmp) == 1) && (tmp >= 0)) {
+							slickss.comm_sample = tmp;
+						} else {
+							slick_warning ("garbled command-line argument [%s]", *av_walk);
+						}
+					} else {
+						slick_warning ("garbled command-line argument [%s]", *av_walk);
+					}
+					/*}}}*/
+				} else if (!strcmp (*av_walk + 5, "quantum-adapt")) {
+					/*{{{  --rt-quantum-adapt*/
+					slickss.quantum_adapt = 1;
+					/*}}}*/
+				} else if (!strncmp (*av_walk + 5, "quantum", 7)) {
+					/*{{{  --rt-quantum=PPD[:MAX][@PRI[-PRI]]*/
+					if ((*av_walk)[12] == '=') {
+						if (slick_parse_quantum (*av_walk + 13)) {
+							slick_warning ("garbled command-line argument [%s]", *av_walk);
+						}
+					} else {
+						slick_warning ("garbled command-line argument [%s]", *av_walk);
+					}
+					/*}}}*/
+				} else if (!strncmp (*av_walk + 5, "slice", 5)) {
+					/*{{{  --rt-slice=MS*/
+					if ((*av_walk)[10] == '=') {
+						int tmp;
+
+						if ((sscanf (*av_walk + 11, "%d", &tmp) == 1) && (tmp >= 0)) {
+							slick.slice_ms = tmp;
+						} else {
+							slick_warning ("garbled command-line argument [%s]", *av_walk);
+						}
+					} else {
+						slick_warning ("garbled command-line argument [%s]", *av_walk);
+					}
+					/*}}}*/
+				} else if (!strncmp (*av_walk + 5, "reserve", 7)) {
+					/*{{{  --rt-reserve=N:pri<P*/
+					if ((*av_walk)[12] == '=') {
+						if (slick_parse_reserve (*av_walk + 13)) {
+							slick_warning ("garbled command-line argument [%s]", *av_walk);
+						}
+					} else {
+						slick_warning ("garbled command-line argument [%s]", *av_walk);
+					}
+					/*}}}*/
+				} else if (!strncmp (*av_walk + 5, "offload", 7)) {
+					/*{{{  --rt-offload=MAX, --rt-offload=MIN:MAX*/
+					if ((*av_walk)[12] == '=') {
+						if (slick_parse_offload (*av_walk + 13)) {
+							slick_warning ("garbled command-line argument [%s]", *av_walk);
+						}
+					} else {
+						slick_warning ("garbled command-line argument [%s]", *av_walk);
+					}
+					/*}}}*/
+				} else if (!strncmp (*av_walk + 5, "uring", 5)) {
+					/*{{{  --rt-uring=N*/
+					if ((*av_walk)[10] == '=') {
+						int tmp;
+
+						if ((sscanf (*av_walk + 11, "%d", &tmp) == 1) && (tmp >= 0) && (tmp <= URING_MAX_ENTRIES)) {
+							slick.uring_entries = tmp;
+						} else {
+							slick_warning ("garbled command-line argument [%s]", *av_walk);
+						}
+					} else {
+						slick_warning ("garbled command-line argument [%s]", *av_walk);
+					}
+					/*}}}*/
+				} else if (!strncmp (*av_walk + 5, "policy", 6)) {
+					/*{{{  --rt-policy=fifo[:PRI], --rt-policy=rr[:PRI], --rt-policy=other*/
+					if ((*av_walk)[11] == '=') {
+						if (slick_parse_policy (*av_walk + 12)) {
+							slick_warning ("garbled command-line argument [%s]", *av_walk);
+						}
+					} else {
+						slick_warning ("garbled command-line argument [%s]", *av_walk);
+					}
+					/*}}}*/
+				} else if (!strcmp (*av_walk + 5, "mlock")) {
+					/*{{{  --rt-mlock*/
+					slick.mlock = MCL_CURRENT | MCL_FUTURE;
+					/*}}}*/
+				} else if (!strncmp (*av_walk + 5, "prefault", 8)) {
+					/*{{{  --rt-prefault[=KB]*/
+					if ((*av_walk)[13] == '\0') {
+						slick.prefault_kb = PREFAULT_STACK_KB;
+					} else if ((*av_walk)[13] == '=') {
+						int tmp;
+
+						if ((sscanf (*av_walk + 14, "%d", &tmp) == 1) && (tmp >= 0)) {
+							slick.prefault_kb = tmp;
+						} else {
+							slick_warning ("garbled command-line argument [%s]", *av_walk);
+						}
+					} else {
+						slick_warning ("garbled command-line argument [%s]", *av_walk);
+					}
+					/*}}}*/
+				} else if (!strcmp (*av_walk + 5, "bind")) {
+					/*{{{  --rt-bind*/
+					slick.binding = 1;
+					/*}}}*/
+				} else if (!strcmp (*av_walk + 5, "numa")) {
+					/*{{{  --rt-numa*/
+					slick.binding = 1;
+					slick.numa = 1;
+					/*}}}*/
+				} else if (!strcmp (*av_walk + 5, "help")) {
+					/*{{{  --rt-help*/
+					slick_cmessage (\
+						"slick run-time scheduler options (--rt-help):\n" \
+						"    --rt-verbose[=N]          set verbosity level\n" \
+						"    --rt-nthreads=N           fix number of run-time threads (also SLICKRTNTHREADS)\n" \
+						"    --rt-nthreads=MIN:MAX     elastic pool of run-time threads, grown with load\n" \
+						"    --rt-retire=MS            park elastic pool threads idle for MS milliseconds\n" \
+						"    --rt-spin=US              cap idle spinning at US microseconds (also SLICKSCHEDULERSPIN)\n" \
+						"    --rt-spin-cpu=PCT         cap time spent spinning at PCT percent of CPU\n" \
+						"    --rt-shards=N             group threads into N shards for idle state (also SLICKRTNSHARDS)\n" \
+						"    --rt-shed=P[:B]           push work to idle threads when the current batch has more than P\n" \
+						"                              processes or a run-queue more than B batches (0 = only steal)\n" \
+						"    --rt-soft-affinity[=S]    send processes woken by channel communication back to the thread\n" \
+						"                              they blocked on, unless its load is more than S above ours\n" \
+						"    --rt-colocate=N           note channel partners for one communication in N and keep them\n" \
+						"                              in the same batch when splitting (0 = off, default 16)\n" \
+						"    --rt-quantum=P[:M][@PRI]  give batches P dispatches per process, at most M (default 8:127),\n" \
+						"                              for one priority or a range L-H (default all)\n" \
+						"    --rt-quantum-adapt        grow the quantum for batches that run alone, shrink it when thieves\n" \
+						"                              contend for our migration windows\n" \
+						"    --rt-slice=MS             ask processes running for more than MS milliseconds to yield at\n" \
+						"                              their next safepoint (0 = never, the default)\n" \
+						"    --rt-reserve=N:pri<P      keep the last N run-time threads for processes at priorities above P\n" \
+						"                              (numerically below), which no other thread runs or steals\n" \
+						"    --rt-offload=[MIN:]MAX    run blocking calls (os_blocking_call) on at most MAX helper threads,\n" \
+						"                              MIN of them started up-front (default 0:4; 0 = in place)\n" \
+						"    --rt-uring=N              give each run-time thread an io_uring of N entries for file I/O\n" \
+						"                              (os_read, os_write, os_fsync; default 64, 0 = use the helpers)\n" \
+						"    --rt-policy=P[:PRI]       run the run-time threads under OS scheduling policy P: fifo, rr or\n" \
+						"                              other (the default), at priority PRI for fifo and rr (default 1)\n" \
+						"    --rt-mlock                lock all memory, current and future, at start-up\n" \
+						"    --rt-prefault[=KB]        touch KB of each run-time thread's stack (default 256), scheduler\n" \
+						"                              batches and workspace from slick_alloc_ws() before they are used\n" \
+						"    --rt-bind                 bind run-time threads to CPUs (node-local memory if multiple NUMA nodes)\n" \
+						"    --rt-numa                 bind run-time threads and always use node-local memory\n" \
+						"    --rt-help                 this help\n");
+
+					/* bail out and say we failed */
+					return -1;
+
+					/*}}}*/
+				} else {
+					/*{{{  probably for us, but emit a warning and add it to the program*/
+					slick_warning ("passing argument [%s] to application", *av_walk);
+
+					*sav_walk = (char *)*av_walk;
+					sav_walk++, j++;
+					/*}}}*/
 				}
 			} else {
 				/* not for us, pass through to program */
@@ -219,8 +1119,8 @@ int slick_init (const char **argv, const int argc)
 		/*{{{  see if number of run-time threads is in the environment (SLICKRTNTHREADS)*/
 		ch = getenv ("SLICKRTNTHREADS");
 		if (ch) {
-			if (sscanf (ch, "%d", &slick.rt_nthreads) != 1) {
-				slick_warning ("not using environment variable SLICKRTNTHREADS, not an integer [%s]", ch);
+			if (slick_parse_nthreads (ch)) {
+				slick_warning ("not using environment variable SLICKRTNTHREADS, expected N or MIN:MAX [%s]", ch);
 				slick.rt_nthreads = 0;		/* default */
 			}
 		}
@@ -239,11 +1139,19 @@ int slick_init (const char **argv, const int argc)
 				slick_warning ("not using environment variable SLICKRTNCPUS, not an integer [%s]", ch);
 				slickss.ncpus = 0;		/* default */
 			}
+			slick.fixed_ncpus = (slickss.ncpus > 0);
 		}
 
 		/*}}}*/
 	}
 
+	if (slickss.ncpus == 0) {
+		/*{{{  CPUs we're allowed to use (affinity, cgroup quota/cpuset)*/
+		slickss.ncpus = (int32_t)slick_usable_cpus ();
+
+		/*}}}*/
+	}
+
 #ifdef _SC_NPROCESSORS_ONLN
 	if (slickss.ncpus == 0) {
 		/*{{{  try and figure out how many CPUs we have via sysconf*/
@@ -332,6 +1240,9 @@ skip_cpuinfo:
 	if (slick.rt_nthreads == 0) {
 		slick.rt_nthreads = slickss.ncpus;
 	}
+	if ((slick.rt_minthreads <= 0) || (slick.rt_minthreads > slick.rt_nthreads)) {
+		slick.rt_minthreads = slick.rt_nthreads;
+	}
 
 	if (slick.rt_nthreads > MAX_RT_THREADS) {
 		slick_warning ("more threads (%d) than MAX_RT_THREADS (%d)!", slick.rt_nthreads, MAX_RT_THREADS);
@@ -344,16 +1255,71 @@ skip_cpuinfo:
 
 	/* Note: number of run-time threads may differ from number of CPUs */
 
+	slickss.reserve_base = MAX_RT_THREADS;
+	if (slickss.reserve_n) {
+		/*{{{  reserved partition: the last threads (the first must stay ordinary, it runs the initial process)*/
+		if (slickss.reserve_n >= slick.rt_nthreads) {
+			slick_warning ("cannot reserve %d of %d run-time threads, not reserving any", slickss.reserve_n, slick.rt_nthreads);
+			slickss.reserve_n = 0;
+			slickss.reserve_pri = 0;
+		} else {
+			if (slick.rt_minthreads < slick.rt_nthreads) {
+				slick_warning ("reserved partition needs all its threads, using a fixed pool of %d", slick.rt_nthreads);
+				slick.rt_minthreads = slick.rt_nthreads;
+			}
+			slickss.reserve_base = slick.rt_nthreads - slickss.reserve_n;
+		}
+		/*}}}*/
+	}
+
+	if (slickss.spin_max_us < 0) {
+		/*{{{  idle spin cap: environment (SLICKSCHEDULERSPIN), else default; never spin on a uniprocessor*/
+		ch = getenv ("SLICKSCHEDULERSPIN");
+		if (ch && (sscanf (ch, "%d", &slickss.spin_max_us) == 1) && (slickss.spin_max_us >= 0)) {
+			/* explicit */
+		} else {
+			if (ch) {
+				slick_warning ("not using environment variable SLICKSCHEDULERSPIN, not an integer [%s]", ch);
+			}
+			slickss.spin_max_us = (slickss.ncpus < 2) ? 0 : SPIN_DEFAULT_US;
+		}
+		/*}}}*/
+	}
+
 	if (slick.verbose) {
-		slick_message ("going to use %d run-time threads", slick.rt_nthreads);
+		if (slickss.reserve_n) {
+			slick_message ("reserving run-time threads %d..%d for priorities 0..%d", slickss.reserve_base, slick.rt_nthreads - 1,
+					slickss.reserve_pri - 1);
+		}
+		if (slick.rt_policy != SCHED_OTHER) {
+			slick_message ("run-time threads to use OS scheduling policy %s, priority %d", slick_policy_name (slick.rt_policy),
+					slick.rt_policy_pri);
+		}
+		if (slick.rt_minthreads < slick.rt_nthreads) {
+			slick_message ("going to use between %d and %d run-time threads", slick.rt_minthreads, slick.rt_nthreads);
+		} else {
+			slick_message ("going to use %d run-time threads", slick.rt_nthreads);
+		}
 	}
 
 	/* initialise some fields in here */
 	slickss.verbose = slick.verbose;
-
-	bis128_init (&(slickss.enabled_threads), 0);
-	bis128_init (&(slickss.idle_threads), 0);
-	bis128_init (&(slickss.sleeping_threads), 0);
+	slickss.batches_kept = slick.prefault_kb ? PREFAULT_BATCHES : FREE_BATCHES_KEPT;
+
+	slick_setup_binding ();
+	slick_setup_shards ();
+	att32_init (&(slickss.nspinning), 0);
+	att32_init (&(slickss.nrspinning), 0);
+	att32_init (&(slickss.usable_cpus), slickss.ncpus);
+	att32_init (&(slickss.oversubscribed), (slick.rt_minthreads > slickss.ncpus));
+	att64_init (&(slickss.cpus_checked), 0);
+
+	slickss.elastic = (slick.rt_minthreads < slick.rt_nthreads);
+	if (slickss.retire_ms <= 0) {
+		slickss.retire_ms = ELASTIC_RETIRE_MS;
+	}
+	att32_init (&(slickss.nlive), slick.rt_minthreads);
+	att32_init (&(slickss.growing), 0);
 
 	for (i=0; i<MAX_RT_THREADS; i++) {
 		slickss.schedulers[i] = NULL;
@@ -362,69 +1328,1370 @@ skip_cpuinfo:
 	return 0;
 }
 /*}}}*/
-/*{{{  void slick_startup (void *ws, void (*proc)(void))*/
+/*{{{  static int slick_create_thread (pthread_t *tid, pthread_attr_t *attr, void *(*entry)(void *), void *arg, int boost)*/
 /*
- *	create run-time threads and start application
- *	Note: the workspace is intended to point at the topmost (but not beyond) 64-bit word
+ *	creates a run-time (or watchdog) thread, under the OS scheduling policy asked for with priority
+ *	raised by 'boost'.  Without the privilege for that, or if locking the new stack would go over
+ *	RLIMIT_MEMLOCK, warns and carries on without (for this and later threads).  Returns as
+ *	pthread_create().
  */
-void slick_startup (void *ws, void (*proc)(void))
+static int slick_create_thread (pthread_t *tid, pthread_attr_t *attr, void *(*entry)(void *), void *arg, int boost)
 {
-	int i;
+	int err;
 
-	/* sort out signal handling */
-	signal (SIGALRM, slick_sigalrm);
-	signal (SIGCHLD, SIG_IGN);		/* ignore exiting child threads */
-	signal (SIGILL, slick_sig_fatal);
-	signal (SIGBUS, slick_sig_fatal);
-	signal (SIGFPE, slick_sigfpe);
+	if (slick.rt_policy != SCHED_OTHER) {
+		struct sched_param param;
 
-	for (i=0; i<slick.rt_nthreads; i++) {
-		threadargs[i].thridx = i;
-		threadargs[i].sptr = &slick;
-		threadargs[i].initial_ws = NULL;
-		threadargs[i].initial_proc = NULL;
+		param.sched_priority = slick.rt_policy_pri + boost;
+		pthread_attr_setinheritsched (attr, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy (attr, slick.rt_policy);
+		pthread_attr_setschedparam (attr, &param);
+	}
+	err = pthread_create (tid, attr, entry, arg);
+
+	if ((err == EPERM) && (slick.rt_policy != SCHED_OTHER)) {
+		slick_warning ("not permitted to use OS scheduling policy %s, running threads under the default policy",
+				slick_policy_name (slick.rt_policy));
+		slick.rt_policy = SCHED_OTHER;
+		pthread_attr_setinheritsched (attr, PTHREAD_INHERIT_SCHED);
+		err = pthread_create (tid, attr, entry, arg);
 	}
+	if (((err == EAGAIN) || (err == ENOMEM)) && (slick.mlock & MCL_FUTURE)) {
+		slick_warning ("could not lock a new thread's stack [%s], no longer locking new memory", strerror (err));
+		slick.mlock = MCL_CURRENT;
+		mlockall (MCL_CURRENT);			/* (without MCL_FUTURE turns that off) */
+		err = pthread_create (tid, attr, entry, arg);
+	}
+	return err;
+}
+/*}}}*/
+/*{{{  static void slick_lock_memory (void)*/
+/*
+ *	locks all memory, current (including application workspace already allocated, which is faulted in)
+ *	and future (--rt-mlock); without the privilege or RLIMIT_MEMLOCK for that, warns and carries on
+ */
+static void slick_lock_memory (void)
+{
+	if (mlockall (slick.mlock)) {
+		slick_warning ("failed to lock memory [%s], carrying on without", strerror (errno));
+		slick.mlock = 0;
+	} else if (slick.verbose) {
+		slick_message ("locked all memory, current and future.");
+	}
+}
+/*}}}*/
+/*{{{  static void *slick_offload_helper (void *arg)*/
+/*
+ *	helper thread: runs blocking calls queued by os_blocking_call, one at a time, sending each process
+ *	back to its scheduler when its call is done
+ */
+static void *slick_offload_helper (void *arg)
+{
+	pthread_mutex_lock (&slick.offload_lock);
+	for (;;) {
+		workspace_t w;
+
+		while (!slick.offload_head) {
+			slick.offload_idle++;
+			pthread_cond_wait (&slick.offload_cond, &slick.offload_lock);
+			slick.offload_idle--;
+		}
+		w = slick.offload_head;
+		slick.offload_head = (workspace_t)w[LTLink];
+		if (!slick.offload_head) {
+			slick.offload_tail = NULL;
+		}
+		slick.offload_depth--;
+		pthread_mutex_unlock (&slick.offload_lock);
 
-	threadargs[0].initial_ws = ws;
-	threadargs[0].initial_proc = proc;
+		((void (*)(void *))w[LTimef]) ((void *)w[LPointer]);
 
-	// slick.rt_nthreads
-	for (i=0; i<slick.rt_nthreads; i++) {
-		pthread_attr_init (&slick.rt_threadattr[i]);
+		slick_resume_process (w);
+		att32_dec (&slickss.offloaded);		/* only now: it is live again, in someone's mail */
 
-		if (pthread_create (&slick.rt_threadid[i], &slick.rt_threadattr[i], slick_threadentry, &threadargs[i])) {
-			slick_fatal ("failed to create run-time thread [%s]", strerror (errno));
-		}
+		pthread_mutex_lock (&slick.offload_lock);
+	}
+	return NULL;
+}
+/*}}}*/
+/*{{{  static int slick_start_helper (void)*/
+/*
+ *	creates a blocking-call helper thread (called with offload_lock held), under the normal OS
+ *	scheduling policy whatever the run-time threads use; returns non-zero on failure
+ */
+static int slick_start_helper (void)
+{
+	pthread_attr_t attr;
+	pthread_t tid;
+	int err;
 
-		if (!i) {
-			int count = 10;
+	pthread_attr_init (&attr);
+	pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_DETACHED);
+	pthread_attr_setinheritsched (&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy (&attr, SCHED_OTHER);
 
-			/* first thread is special, wait for it to set the enabled bit */
-			while (!(bis128_val_lo (&slickss.enabled_threads) & 1)) {
-				struct timespec ts = {tv_sec: 0, tv_nsec: 10000000};		/* 10ms */
+	err = pthread_create (&tid, &attr, slick_offload_helper, NULL);
+	pthread_attr_destroy (&attr);
 
-				sched_yield ();
-				nanosleep (&ts, NULL);
-				count--;
-				if (!count) {
-					slick_fatal ("waited too long for first thread to become enabled.");
-				}
-			}
+	if (err) {
+		slick_warning ("failed to create blocking-call helper thread [%s]", strerror (err));
+		return -1;
+	}
+	slick.offload_threads++;
+	if (slick.verbose) {
+		slick_message ("created blocking-call helper thread %d.", slick.offload_threads - 1);
+	}
+	return 0;
+}
+/*}}}*/
+/*{{{  void slick_offload (workspace_t w)*/
+/*
+ *	queues a process's blocking call (set up by os_blocking_call) for a helper thread, creating another
+ *	helper if all are busy and there are fewer than the most allowed
+ */
+void slick_offload (workspace_t w)
+{
+	att32_inc (&slickss.offloaded);
+	w[LTLink] = 0;
+
+	pthread_mutex_lock (&slick.offload_lock);
+	if (slick.offload_tail) {
+		slick.offload_tail[LTLink] = (uint64_t)w;
+	} else {
+		slick.offload_head = w;
+	}
+	slick.offload_tail = w;
+	slick.offload_calls++;
+	slick.offload_depth++;
+	if (slick.offload_depth > slick.offload_maxdepth) {
+		slick.offload_maxdepth = slick.offload_depth;
+	}
+
+	if ((slick.offload_depth > slick.offload_idle) && (slick.offload_threads < slick.offload_max)) {
+		/* more queued than helpers to take them */
+		if (slick_start_helper () && !slick.offload_threads) {
+			slick_fatal ("no helper threads to run blocking calls.");
 		}
 	}
+	if (slick.offload_idle) {
+		pthread_cond_signal (&slick.offload_cond);
+	}
+	pthread_mutex_unlock (&slick.offload_lock);
+}
+/*}}}*/
+/*{{{  static void slick_netlink_resume (netreq_t *nr)*/
+/*
+ *	a networked channel input or output is done: sends the process back to its scheduler
+ */
+static void slick_netlink_resume (netreq_t *nr)
+{
+	workspace_t w = nr->w;
 
-#if 1
-slick_message ("slick_startup(): here, having created %d threads.. :)", slick.rt_nthreads);
-#endif
+	nr->link->waiting--;
+	sfree (nr);
+	slick_resume_process (w);
+	att32_dec (&slickss.offloaded);		/* only now: it is live again, in someone's mail */
+}
+/*}}}*/
+/*{{{  static void slick_netlink_queue (netlink_t *link, netreq_t *nr)*/
+/*
+ *	adds a frame to a link's send queue, to go with whatever else is queued when the link manager next flushes
+ */
+static void slick_netlink_queue (netlink_t *link, netreq_t *nr)
+{
+	nr->queued = 1;
+	nr->txdone = 0;
+	nr->txnext = NULL;
+	if (link->txtail) {
+		link->txtail->txnext = nr;
+	} else {
+		link->txhead = nr;
+	}
+	link->txtail = nr;
+}
+/*}}}*/
+/*{{{  static void slick_netlink_events (netlink_t *link, uint32_t events)*/
+/*
+ *	sets the epoll events the link manager waits for on a link (EPOLLOUT only while a write is held up)
+ */
+static void slick_netlink_events (netlink_t *link, uint32_t events)
+{
+	struct epoll_event ev;
 
-	// slick.rt_nthreads
-	for (i=0; i<slick.rt_nthreads; i++) {
-		void *result;
+	if (link->events == events) {
+		return;
+	}
+	ev.events = events;
+	ev.data.ptr = (void *)link;
+	epoll_ctl (slick.netlink_epfd, EPOLL_CTL_MOD, link->fd, &ev);
+	link->events = events;
+}
+/*}}}*/
+/*{{{  static void slick_netlink_fail (netlink_t *link, const char *why)*/
+/*
+ *	the other end went away, or the socket failed: fatal if processes are waiting on the link, else the link
+ *	is dropped from the epoll set, and any later use of it is fatal
+ */
+static void slick_netlink_fail (netlink_t *link, const char *why)
+{
+	if (link->waiting) {
+		slick_fatal ("networked channel link %p failed with %u processes waiting [%s]", link, link->waiting, why);
+	}
+	if (slick.verbose) {
+		slick_message ("networked channel link %p failed [%s].", link, why);
+	}
+	epoll_ctl (slick.netlink_epfd, EPOLL_CTL_DEL, link->fd, NULL);
+	link->dead = 1;
+}
+/*}}}*/
+/*{{{  static void slick_netlink_take (netreq_t *nr)*/
+/*
+ *	takes an input or output from a process: an input sends credit (the other end's output may then go), an
+ *	output is sent as soon as there is credit for it
+ */
+static void slick_netlink_take (netreq_t *nr)
+{
+	netlink_t *link = nr->link;
+	netvchan_t *vc = &(link->vchans[nr->vchan]);
 
-		pthread_join (slick.rt_threadid[i], &result);
+	if (link->dead) {
+		slick_fatal ("%s on virtual channel %u of failed networked channel link %p", nr->input ? "input" : "output", nr->vchan, link);
+	}
+	link->waiting++;
+	nr->queued = 0;
+	nr->frame.vchan = nr->vchan;
+	if (nr->input) {
+		if (vc->reader) {
+			slick_fatal ("two processes inputting on virtual channel %u of networked channel link %p", nr->vchan, link);
+		}
+		vc->reader = nr;
+		nr->frame.type = NETFRAME_CREDIT;
+		nr->frame.len = 0;
+		slick_netlink_queue (link, nr);
+	} else {
+		if (vc->writer) {
+			slick_fatal ("two processes outputting on virtual channel %u of networked channel link %p", nr->vchan, link);
+		}
+		vc->writer = nr;
+		nr->frame.type = NETFRAME_DATA;
+		nr->frame.len = nr->count;
+		if (vc->credit) {
+			vc->credit--;
+			slick_netlink_queue (link, nr);
+		}
 	}
+}
+/*}}}*/
+/*{{{  static void slick_netlink_delivered (netlink_t *link)*/
+/*
+ *	a message has been received into place: the input is done
+ */
+static void slick_netlink_delivered (netlink_t *link)
+{
+	netreq_t *nr = link->rxreq;
 
-	return;
+	link->vchans[nr->vchan].reader = NULL;
+	link->rxreq = NULL;
+	slick_netlink_resume (nr);
+}
+/*}}}*/
+/*{{{  static void slick_netlink_frame (netlink_t *link, netframe_t *f)*/
+/*
+ *	handles a frame header received on a link: credit lets a waiting output go (or is kept for the next),
+ *	a message is for the input that asked for it
+ */
+static void slick_netlink_frame (netlink_t *link, netframe_t *f)
+{
+	netvchan_t *vc;
+
+	if (f->vchan >= link->nvchans) {
+		slick_fatal ("frame for virtual channel %u on networked channel link %p, which has %u", f->vchan, link, link->nvchans);
+	}
+	vc = &(link->vchans[f->vchan]);
+	slick.netlink_rxframes++;
+
+	if (f->type == NETFRAME_CREDIT) {
+		if (vc->writer && !vc->writer->queued) {
+			slick_netlink_queue (link, vc->writer);
+		} else {
+			vc->credit++;
+		}
+	} else if (f->type == NETFRAME_DATA) {
+		netreq_t *nr = vc->reader;
+
+		if (!nr) {
+			slick_fatal ("message on virtual channel %u of networked channel link %p with no input for it", f->vchan, link);
+		} else if (f->len != nr->count) {
+			slick_fatal ("%lu byte message on virtual channel %u of networked channel link %p for a %lu byte input", f->len,
+					f->vchan, link, nr->count);
+		}
+		link->rxreq = nr;
+		link->rxdone = 0;
+		if (!f->len) {
+			slick_netlink_delivered (link);
+		}
+	} else {
+		slick_fatal ("unexpected frame (type %u) on networked channel link %p", f->type, link);
+	}
+}
+/*}}}*/
+/*{{{  static void slick_netlink_rx (netlink_t *link)*/
+/*
+ *	reads from a link that is ready, handling every frame that has arrived.  Payloads are copied into
+ *	place from the receive buffer, or read straight into place if there is enough of one still to come.
+ */
+static void slick_netlink_rx (netlink_t *link)
+{
+	int drained = 0;
+
+	for (;;) {
+		uint64_t want;
+		ssize_t r;
+
+		while (link->rxpos < link->rxlen) {
+			uint32_t avail = link->rxlen - link->rxpos;
+
+			if (link->rxreq) {
+				uint64_t n = link->rxreq->count - link->rxdone;
+
+				if (n > avail) {
+					n = avail;
+				}
+				memcpy ((uint8_t *)link->rxreq->addr + link->rxdone, link->rxbuf + link->rxpos, n);
+				link->rxpos += (uint32_t)n;
+				link->rxdone += n;
+				if (link->rxdone == link->rxreq->count) {
+					slick_netlink_delivered (link);
+				}
+			} else if (avail >= sizeof (netframe_t)) {
+				netframe_t f;
+
+				memcpy (&f, link->rxbuf + link->rxpos, sizeof (netframe_t));
+				link->rxpos += sizeof (netframe_t);
+				slick_netlink_frame (link, &f);
+			} else {
+				break;		/* while(): only part of a header */
+			}
+		}
+		if (link->rxpos) {
+			memmove (link->rxbuf, link->rxbuf + link->rxpos, link->rxlen - link->rxpos);
+			link->rxlen -= link->rxpos;
+			link->rxpos = 0;
+		}
+		if (drained) {
+			/* the last read came up short: wait for the rest (level-triggered) */
+			return;
+		}
+
+		if (link->rxreq && ((link->rxreq->count - link->rxdone) >= NETLINK_DIRECT_MIN)) {
+			/* (nothing buffered: it all went into place) */
+			want = link->rxreq->count - link->rxdone;
+			r = read (link->fd, (uint8_t *)link->rxreq->addr + link->rxdone, want);
+			if (r > 0) {
+				link->rxdone += (uint64_t)r;
+				if (link->rxdone == link->rxreq->count) {
+					slick_netlink_delivered (link);
+				}
+			}
+		} else {
+			want = NETLINK_RXBUF_SIZE - link->rxlen;
+			r = read (link->fd, link->rxbuf + link->rxlen, want);
+			if (r > 0) {
+				link->rxlen += (uint32_t)r;
+			}
+		}
+
+		if (r > 0) {
+			slick.netlink_reads++;
+			drained = ((uint64_t)r < want);
+		} else if (!r) {
+			slick_netlink_fail (link, "closed by the other end");
+			return;
+		} else if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+			return;
+		} else if (errno != EINTR) {
+			slick_netlink_fail (link, strerror (errno));
+			return;
+		}
+	}
+}
+/*}}}*/
+/*{{{  static void slick_netlink_tx (netlink_t *link)*/
+/*
+ *	sends what is queued on a link, as many frames per writev() as fit, gathering payloads straight from
+ *	the outputting processes' memory (they wait until it's gone).  Each output is done once its message
+ *	is written: its credit says the input at the other end is already waiting for it.
+ */
+static void slick_netlink_tx (netlink_t *link)
+{
+	while (link->txhead) {
+		struct iovec iov[NETLINK_MAX_IOV];
+		netreq_t *nr;
+		ssize_t r;
+		int n = 0;
+
+		for (nr = link->txhead; nr && (n <= (NETLINK_MAX_IOV - 2)); nr = nr->txnext) {
+			uint64_t done = nr->txdone;
+
+			if (done < sizeof (netframe_t)) {
+				iov[n].iov_base = (uint8_t *)&(nr->frame) + done;
+				iov[n].iov_len = sizeof (netframe_t) - done;
+				n++;
+				done = 0;
+			} else {
+				done -= sizeof (netframe_t);
+			}
+			if (nr->frame.len) {
+				iov[n].iov_base = (uint8_t *)nr->addr + done;
+				iov[n].iov_len = nr->frame.len - done;
+				n++;
+			}
+		}
+
+		r = writev (link->fd, iov, n);
+		if (r < 0) {
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+				slick_netlink_events (link, EPOLLIN | EPOLLOUT);
+				return;
+			} else if (errno != EINTR) {
+				slick_netlink_fail (link, strerror (errno));
+				return;
+			}
+			continue;
+		}
+		slick.netlink_writes++;
+
+		while (r && (nr = link->txhead)) {
+			uint64_t left = sizeof (netframe_t) + nr->frame.len - nr->txdone;
+
+			if ((uint64_t)r < left) {
+				nr->txdone += (uint64_t)r;
+				break;		/* while() */
+			}
+			r -= (ssize_t)left;
+			link->txhead = nr->txnext;
+			if (!link->txhead) {
+				link->txtail = NULL;
+			}
+			slick.netlink_txframes++;
+			if (!nr->input) {
+				link->vchans[nr->vchan].writer = NULL;
+				slick_netlink_resume (nr);
+			}
+		}
+	}
+	slick_netlink_events (link, EPOLLIN);
+}
+/*}}}*/
+/*{{{  static void *slick_netlink_manager (void *arg)*/
+/*
+ *	link manager thread: multiplexes the virtual channels of every link over its socket.  Each time round,
+ *	handles what has arrived, takes the processes' inputs and outputs, then flushes each link's send queue,
+ *	so that frames queued meanwhile (credit and messages, for any virtual channel) go in one write.
+ */
+static void *slick_netlink_manager (void *arg)
+{
+	struct epoll_event evs[NETLINK_MAX_EVENTS];
+
+	for (;;) {
+		netlink_t *link, **prev;
+		workspace_t w;
+		int i, n;
+
+		n = epoll_wait (slick.netlink_epfd, evs, NETLINK_MAX_EVENTS, -1);
+		for (i=0; i<n; i++) {
+			link = (netlink_t *)evs[i].data.ptr;
+
+			if (!link) {
+				uint64_t v;
+
+				if (read (slick.netlink_wakefd, &v, sizeof (v)) < 0) {
+					/* spurious */
+				}
+			} else if (!link->dead && (evs[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+				slick_netlink_rx (link);
+			}
+		}
+
+		pthread_mutex_lock (&slick.netlink_lock);
+		w = slick.netlink_head;
+		slick.netlink_head = NULL;
+		slick.netlink_tail = NULL;
+		for (prev = &slick.netlinks; (link = *prev); ) {
+			if (link->closing) {
+				if (link->waiting) {
+					slick_fatal ("networked channel link %p closed with %u processes waiting", link, link->waiting);
+				}
+				*prev = link->next;
+				if (!link->dead) {
+					epoll_ctl (slick.netlink_epfd, EPOLL_CTL_DEL, link->fd, NULL);
+				}
+				close (link->fd);
+				sfree (link->rxbuf);
+				sfree (link->vchans);
+				sfree (link);
+			} else {
+				prev = &(link->next);
+			}
+		}
+		link = slick.netlinks;			/* others may be added at the front meanwhile, but not removed */
+		pthread_mutex_unlock (&slick.netlink_lock);
+
+		while (w) {
+			workspace_t next = (workspace_t)w[LTLink];
+
+			slick_netlink_take ((netreq_t *)w[LPointer]);
+			w = next;
+		}
+
+		for (; link; link = link->next) {
+			if (link->txhead && !link->dead) {
+				slick_netlink_tx (link);
+			}
+		}
+	}
+	return NULL;
+}
+/*}}}*/
+/*{{{  static int slick_netlink_start (void)*/
+/*
+ *	starts the link manager, with the first link (called with netlink_lock held); returns non-zero on failure
+ */
+static int slick_netlink_start (void)
+{
+	struct epoll_event ev;
+	pthread_attr_t attr;
+	int err;
+
+	slick.netlink_epfd = epoll_create1 (EPOLL_CLOEXEC);
+	slick.netlink_wakefd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if ((slick.netlink_epfd < 0) || (slick.netlink_wakefd < 0)) {
+		slick_warning ("failed to set up networked channel link manager [%s]", strerror (errno));
+		goto out_close;
+	}
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+	if (epoll_ctl (slick.netlink_epfd, EPOLL_CTL_ADD, slick.netlink_wakefd, &ev) < 0) {
+		slick_warning ("failed to set up networked channel link manager [%s]", strerror (errno));
+		goto out_close;
+	}
+
+	pthread_attr_init (&attr);
+	pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_DETACHED);
+	/* as the run-time threads: processes wait on it */
+	err = slick_create_thread (&slick.netlink_thread, &attr, slick_netlink_manager, NULL, 0);
+	pthread_attr_destroy (&attr);
+	if (err) {
+		slick_warning ("failed to create networked channel link manager thread [%s]", strerror (err));
+		goto out_close;
+	}
+	if (slick.verbose) {
+		slick_message ("started networked channel link manager.");
+	}
+	return 0;
+
+out_close:
+	if (slick.netlink_epfd >= 0) {
+		close (slick.netlink_epfd);
+	}
+	if (slick.netlink_wakefd >= 0) {
+		close (slick.netlink_wakefd);
+	}
+	slick.netlink_epfd = -1;
+	slick.netlink_wakefd = -1;
+	return -1;
+}
+/*}}}*/
+/*{{{  void slick_netlink_request (workspace_t w)*/
+/*
+ *	passes a process's networked channel input or output (set up by os_netchanin or os_netchanout) to the
+ *	link manager, waking it if it may have gone back to waiting
+ */
+void slick_netlink_request (workspace_t w)
+{
+	int wake;
+
+	att32_inc (&slickss.offloaded);
+	w[LTLink] = 0;
+
+	pthread_mutex_lock (&slick.netlink_lock);
+	if (slick.netlink_tail) {
+		slick.netlink_tail[LTLink] = (uint64_t)w;
+	} else {
+		slick.netlink_head = w;
+	}
+	slick.netlink_tail = w;
+	wake = (slick.netlink_head == w);
+	pthread_mutex_unlock (&slick.netlink_lock);
+
+	if (wake) {
+		uint64_t one = 1;
+
+		if (write (slick.netlink_wakefd, &one, sizeof (one)) < 0) {
+			/* already signalled */
+		}
+	}
+}
+/*}}}*/
+/*{{{  static void *slick_watchdog (void *arg)*/
+/*
+ *	cooperative preemption: every half slice, looks for run-time threads that are still running the
+ *	dispatch they were two checks ago (so for at least a slice) and asks them to yield
+ */
+static void *slick_watchdog (void *arg)
+{
+	uint64_t half_ns = (uint64_t)slick.slice_ms * 500000ULL;
+	struct timespec ts = {tv_sec: (time_t)(half_ns / 1000000000ULL), tv_nsec: (long)(half_ns % 1000000000ULL)};
+	uint64_t last[MAX_RT_THREADS];
+	int ticks[MAX_RT_THREADS];
+	int i;
+
+	for (i=0; i<MAX_RT_THREADS; i++) {
+		last[i] = 0;
+		ticks[i] = 0;
+	}
+
+	for (;;) {
+		nanosleep (&ts, NULL);
+
+		for (i=0; i<(int)att32_val (&slick.rt_started); i++) {
+			psched_t *s = slickss.schedulers[i];
+			uint64_t d;
+
+			if (!s || !s->yield || s->stats.idle_since || att32_val (&(s->parked))) {
+				ticks[i] = 0;
+				continue;		/* for() */
+			}
+			d = s->stats.dispatches;
+			if (d != last[i]) {
+				last[i] = d;
+				ticks[i] = 0;
+			} else if (++ticks[i] >= 2) {
+				*(s->yield) = 1;
+			}
+		}
+	}
+	return NULL;
+}
+/*}}}*/
+/*{{{  static void slick_alloc_fdguards (void)*/
+/*
+ *	allocates guard state for every descriptor the process may have (os_enbfd), up to FDGUARD_MAX_FDS;
+ *	zeroed, and untouched until used
+ */
+static void slick_alloc_fdguards (void)
+{
+	struct rlimit rl;
+	int n = FDGUARD_MAX_FDS;
+
+	if (!getrlimit (RLIMIT_NOFILE, &rl) && (rl.rlim_max != RLIM_INFINITY) && (rl.rlim_max < (rlim_t)n)) {
+		n = (int)rl.rlim_max;
+	}
+	slickss.fdguards = (fdguard_t *)calloc (n, sizeof (fdguard_t));
+	if (!slickss.fdguards) {
+		slick_fatal ("out of memory (allocating %lu bytes)", n * sizeof (fdguard_t));
+	}
+	slickss.nfdguards = n;
+}
+/*}}}*/
+/*{{{  static void slick_prepare_start (void *ws, void (*proc)(void))*/
+/*
+ *	sets up for starting the run-time threads, the initial process 'proc' to start on thread 0 with 'ws'
+ *	Note: the workspace is intended to point at the topmost (but not beyond) 64-bit word
+ */
+static void slick_prepare_start (void *ws, void (*proc)(void))
+{
+	int i;
+
+	/* sort out signal handling */
+	signal (SIGALRM, slick_sigalrm);
+	signal (SIGCHLD, SIG_IGN);		/* ignore exiting child threads */
+	signal (SIGILL, slick_sig_fatal);
+	signal (SIGBUS, slick_sig_fatal);
+	signal (SIGFPE, slick_sigfpe);
+
+	for (i=0; i<slick.rt_nthreads; i++) {
+		threadargs[i].thridx = i;
+		threadargs[i].cpu = slick.rt_cpu[i];
+		threadargs[i].node = slick.rt_node[i];
+		threadargs[i].sptr = &slick;
+		threadargs[i].initial_ws = NULL;
+		threadargs[i].initial_proc = NULL;
+	}
+
+	threadargs[0].initial_ws = ws;
+	threadargs[0].initial_proc = proc;
+
+	slick_alloc_fdguards ();
+
+	if (slick.mlock) {
+		slick_lock_memory ();
+	}
+
+	/* the rest of an elastic pool is created on demand, see slick_grow_pool() */
+	att32_init (&slick.rt_started, slick.rt_minthreads);
+}
+/*}}}*/
+/*{{{  static void slick_create_threads (const int first)*/
+/*
+ *	creates run-time threads from 'first' on, and the helper and watchdog threads.  Doesn't wait for
+ *	them: the others wait for thread 0 to enter the scheduler before they do.
+ */
+static void slick_create_threads (const int first)
+{
+	int i;
+
+	for (i=first; i<slick.rt_minthreads; i++) {
+		int err;
+
+		pthread_attr_init (&slick.rt_threadattr[i]);
+
+		err = slick_create_thread (&slick.rt_threadid[i], &slick.rt_threadattr[i], slick_threadentry, &threadargs[i], 0);
+		if (err) {
+			slick_fatal ("failed to create run-time thread [%s]", strerror (err));
+		}
+	}
+
+	pthread_mutex_lock (&slick.offload_lock);
+	while (slick.offload_threads < slick.offload_min) {
+		if (slick_start_helper ()) {
+			break;		/* while() */
+		}
+	}
+	pthread_mutex_unlock (&slick.offload_lock);
+
+	if (slick.slice_ms) {
+		pthread_attr_t attr;
+		int err;
+
+		pthread_attr_init (&attr);
+		pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_DETACHED);
+		/* above the run-time threads, if they are real-time, or it would never get to ask */
+		err = slick_create_thread (&slick.watchdog, &attr, slick_watchdog, NULL, 1);
+		if (err) {
+			slick_warning ("failed to create preemption watchdog thread [%s], processes will not be asked to yield", strerror (err));
+		}
+		pthread_attr_destroy (&attr);
+	}
+
+#if 1
+slick_message ("slick_startup(): here, having created %d threads.. :)", slick.rt_minthreads - first);
+#endif
+}
+/*}}}*/
+/*{{{  static void *slick_starter (void *arg)*/
+/*
+ *	thread that creates the rest for slick_run_on_current_thread(), so that its caller goes straight
+ *	into the scheduler
+ */
+static void *slick_starter (void *arg)
+{
+	slick_create_threads (1);
+	return NULL;
+}
+/*}}}*/
+/*{{{  void slick_start_async (void *ws, void (*proc)(void))*/
+/*
+ *	create run-time threads and start application, returning straight away (for a host with its own
+ *	work to do on this thread); slick_wait() waits for the run-time to finish
+ */
+void slick_start_async (void *ws, void (*proc)(void))
+{
+	slick_prepare_start (ws, proc);
+	slick_create_threads (0);
+}
+/*}}}*/
+/*{{{  void slick_run_on_current_thread (void *ws, void (*proc)(void))*/
+/*
+ *	start application with the calling thread as run-time thread 0 (saving a thread, and moving the
+ *	initial process to it), the rest created alongside.  Returns when the run-time shuts down
+ *	(slick_shutdown(), or the top-level process returning); slick_wait() then waits for the others.
+ */
+void slick_run_on_current_thread (void *ws, void (*proc)(void))
+{
+	slick.rt_main = 1;
+	slick.rt_threadid[0] = pthread_self ();
+	slick_prepare_start (ws, proc);
+
+	if ((slick.rt_minthreads > 1) || slick.offload_min || slick.slice_ms) {
+		if (pthread_create (&slick.starter, NULL, slick_starter, NULL)) {
+			slick_create_threads (1);
+		} else {
+			slick.starting = 1;
+		}
+	}
+
+	if (slick.rt_policy != SCHED_OTHER) {
+		struct sched_param param;
+		int err;
+
+		param.sched_priority = slick.rt_policy_pri;
+		err = pthread_setschedparam (pthread_self (), slick.rt_policy, &param);
+		if (err) {
+			slick_warning ("failed to set OS scheduling policy %s for run-time thread 0 [%s]", slick_policy_name (slick.rt_policy), strerror (err));
+		}
+	}
+
+	slick_threadentry (&threadargs[0]);
+}
+/*}}}*/
+/*{{{  void slick_wait (void)*/
+/*
+ *	waits for the run-time threads to finish (once shut down); not to be called from one of them
+ */
+void slick_wait (void)
+{
+	int i;
+
+	if (slick.starting) {
+		/* the rest are all created once this is done */
+		pthread_join (slick.starter, NULL);
+		slick.starting = 0;
+	}
+	for (i=(slick.rt_main ? 1 : 0); i<slick.rt_minthreads; i++) {
+		void *result;
+
+		pthread_join (slick.rt_threadid[i], &result);
+	}
+}
+/*}}}*/
+/*{{{  void slick_shutdown (void)*/
+/*
+ *	shuts the run-time down, from any thread: each run-time thread leaves as it next schedules (after
+ *	the process it is running, if any), abandoning whatever processes are still queued.  Helper and
+ *	link-manager threads are left as they are.  The run-time can't be started again.
+ */
+void slick_shutdown (void)
+{
+	int i;
+
+	if (att32_swap (&slick.rt_shutdown, 1)) {
+		return;
+	}
+	att32_inc (&slickss.offloaded);		/* threads idle on the way out are not deadlocked */
+	write_barrier ();
+
+	for (i=0; i<(int)att32_val (&slick.rt_started); i++) {
+		psched_t *s = slickss.schedulers[i];
+
+		if (s) {
+			slick_wake_thread (s, SYNC_INTR_BIT);
+		}
+	}
+}
+/*}}}*/
+/*{{{  void slick_startup (void *ws, void (*proc)(void))*/
+/*
+ *	create run-time threads and start application, returning when the run-time has shut down
+ *	Note: the workspace is intended to point at the topmost (but not beyond) 64-bit word
+ */
+void slick_startup (void *ws, void (*proc)(void))
+{
+	slick_start_async (ws, proc);
+	slick_wait ();
+}
+/*}}}*/
+/*{{{  void slick_grow_pool (void)*/
+/*
+ *	called by a scheduler that keeps finding work with nobody to wake for it: adds a run-time thread
+ *	to an elastic pool, by unparking one if possible, else creating a new one
+ */
+__attribute__ ((force_align_arg_pointer)) void slick_grow_pool (void)
+{
+	uint32_t live = att32_val (&slickss.nlive);
+	int started = (int)att32_val (&slick.rt_started);
+	int i, err;
+
+	if (att32_val (&slick.rt_shutdown)) {
+		return;
+	}
+	do {
+		if ((int)live >= slick.rt_nthreads) {
+			return;
+		}
+	} while (!att32_cas (&slickss.nlive, live, live + 1));
+	att32_set (&slickss.oversubscribed, (live + 1) > att32_val (&slickss.usable_cpus));
+
+	for (i=1; i<started; i++) {
+		psched_t *s = slickss.schedulers[i];
+
+		if (s && att32_cas (&(s->parked), 1, 0)) {
+			slick_wake_thread (s, SYNC_WORK_BIT);
+			return;
+		}
+	}
+
+	if (att32_test_set_bit (&slickss.growing, 0)) {
+		/* someone else is already creating one */
+		att32_dec (&slickss.nlive);
+		return;
+	}
+	i = (int)att32_val (&slick.rt_started);
+	if (i < slick.rt_nthreads) {
+		pthread_attr_init (&slick.rt_threadattr[i]);
+		pthread_attr_setdetachstate (&slick.rt_threadattr[i], PTHREAD_CREATE_DETACHED);
+		err = slick_create_thread (&slick.rt_threadid[i], &slick.rt_threadattr[i], slick_threadentry, &threadargs[i], 0);
+		if (err) {
+			slick_warning ("failed to create run-time thread [%s]", strerror (err));
+			att32_dec (&slickss.nlive);
+		} else {
+			/* others scan [1, rt_started) for parked threads without holding 'growing' */
+			write_barrier ();
+			att32_set (&slick.rt_started, i + 1);
+			if (slick.verbose) {
+				slick_message ("created run-time thread %d (%d in the pool).", i, live + 1);
+			}
+		}
+	} else {
+		att32_dec (&slickss.nlive);
+	}
+	att32_clear_bit (&slickss.growing, 0);
+}
+/*}}}*/
+/*{{{  void *slick_alloc_ws (const size_t bytes, const int thread)*/
+/*
+ *	allocates process workspace on the NUMA node of a particular run-time thread, or of the calling
+ *	run-time thread if 'thread' is negative (thread 0 if called from outside the scheduler);
+ *	plain heap memory if not placing memory per node.  Faulted in up-front with --rt-prefault.
+ *	Free with slick_free_ws().
+ */
+void *slick_alloc_ws (const size_t bytes, const int thread)
+{
+	uint64_t *hdr;
+	int t = thread;
+
+	if (t < 0) {
+		t = slick_current_thread ();
+	}
+	if ((t < 0) || (t >= slick.rt_nthreads)) {
+		t = 0;
+	}
+
+	if (slickss.numa) {
+		size_t pgsize = (size_t)sysconf (_SC_PAGESIZE);
+		size_t len = (bytes + SLICK_WS_HDR_BYTES + (pgsize - 1)) & ~(pgsize - 1);
+
+		hdr = (uint64_t *)smalloc_node (len, slick.rt_node[t]);
+		hdr[0] = (uint64_t)len;
+	} else {
+		hdr = (uint64_t *)smalloc (bytes + SLICK_WS_HDR_BYTES);
+		hdr[0] = 0;
+	}
+	if (slick.prefault_kb) {
+		sprefault (hdr, bytes + SLICK_WS_HDR_BYTES);
+	}
+
+	return (void *)hdr + SLICK_WS_HDR_BYTES;
+}
+/*}}}*/
+/*{{{  void slick_prefault (void *ptr, const size_t bytes)*/
+/*
+ *	faults in memory that processes will use (workspace not from slick_alloc_ws(), say), so that the
+ *	first touch doesn't fault mid-request; the contents are unchanged
+ */
+void slick_prefault (void *ptr, const size_t bytes)
+{
+	sprefault (ptr, bytes);
+}
+/*}}}*/
+/*{{{  void slick_free_ws (void *ws)*/
+/*
+ *	frees workspace allocated with slick_alloc_ws()
+ */
+void slick_free_ws (void *ws)
+{
+	uint64_t *hdr = (uint64_t *)(ws - SLICK_WS_HDR_BYTES);
+
+	if (hdr[0]) {
+		sfree_node (hdr, (size_t)hdr[0]);
+	} else {
+		sfree (hdr);
+	}
+}
+/*}}}*/
+/*{{{  void *slick_shmchan_create (const size_t slotsize, const int nslots, int *fdp)*/
+/*
+ *	creates a channel for use between OS processes (os_shmchanin, os_shmchanout): a ring of 'nslots' messages
+ *	(rounded up to a power of 2) of up to 'slotsize' bytes, in a memfd whose descriptor is left in '*fdp' for
+ *	passing on (inherited across fork() and exec(), or sent over a Unix-domain socket).  One process writes to
+ *	it and one reads from it.  Returns the channel as mapped here, or NULL on failure.
+ */
+void *slick_shmchan_create (const size_t slotsize, const int nslots, int *fdp)
+{
+	shmchan_t *c;
+	uint64_t size;
+	uint32_t n = 1;
+	int fd;
+
+	if ((slotsize > SHMCHAN_MAX_SLOTSIZE) || (nslots < 1) || (nslots > SHMCHAN_MAX_SLOTS)) {
+		slick_warning ("unsupported shared-memory channel (%lu byte slots, %d of them), expect up to %d bytes and [1..%d]",
+				slotsize, nslots, SHMCHAN_MAX_SLOTSIZE, SHMCHAN_MAX_SLOTS);
+		return NULL;
+	}
+	while (n < (uint32_t)nslots) {
+		n <<= 1;
+	}
+	size = sizeof (shmchan_t) + ((uint64_t)n * ((slotsize + 7) & ~7));
+
+	fd = memfd_create ("slick-shmchan", MFD_ALLOW_SEALING);
+	if (fd < 0) {
+		slick_warning ("failed to create shared-memory channel [%s]", strerror (errno));
+		return NULL;
+	}
+	if ((ftruncate (fd, (off_t)size) < 0) || (fcntl (fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0)) {
+		slick_warning ("failed to size shared-memory channel [%s]", strerror (errno));
+		close (fd);
+		return NULL;
+	}
+	c = (shmchan_t *)mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+	if (c == MAP_FAILED) {
+		slick_warning ("failed to map shared-memory channel [%s]", strerror (errno));
+		close (fd);
+		return NULL;
+	}
+
+	c->slotsize = (uint32_t)((slotsize + 7) & ~7);
+	c->nslots = n;
+	c->size = size;
+	att32_init (&(c->tail), 0);
+	att32_init (&(c->rwaiting), 0);
+	att32_init (&(c->head), 0);
+	att32_init (&(c->wwaiting), 0);
+	write_barrier ();
+	c->magic = SHMCHAN_MAGIC;
+
+	*fdp = fd;
+	return (void *)c;
+}
+/*}}}*/
+/*{{{  void *slick_shmchan_attach (const int fd)*/
+/*
+ *	maps a channel made by slick_shmchan_create() (in this OS process or another) from its descriptor;
+ *	returns the channel, or NULL if 'fd' isn't one
+ */
+void *slick_shmchan_attach (const int fd)
+{
+	shmchan_t *c;
+	struct stat st;
+	uint64_t size;
+
+	if ((fstat (fd, &st) < 0) || (st.st_size < (off_t)sizeof (shmchan_t))) {
+		slick_warning ("descriptor %d is not a shared-memory channel", fd);
+		return NULL;
+	}
+	size = (uint64_t)st.st_size;
+	c = (shmchan_t *)mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+	if (c == MAP_FAILED) {
+		slick_warning ("failed to map shared-memory channel [%s]", strerror (errno));
+		return NULL;
+	}
+	if ((c->magic != SHMCHAN_MAGIC) || (c->size != size) || !c->nslots || (c->nslots & (c->nslots - 1)) ||
+			(sizeof (shmchan_t) + ((uint64_t)c->nslots * c->slotsize) > size)) {
+		slick_warning ("descriptor %d is not a shared-memory channel", fd);
+		munmap (c, size);
+		return NULL;
+	}
+
+	return (void *)c;
+}
+/*}}}*/
+/*{{{  void slick_shmchan_detach (void *chan)*/
+/*
+ *	unmaps a shared-memory channel (the descriptor stays open, for the caller to close)
+ */
+void slick_shmchan_detach (void *chan)
+{
+	shmchan_t *c = (shmchan_t *)chan;
+
+	munmap (c, c->size);
+}
+/*}}}*/
+/*{{{  static int slick_netlink_address (const char *addr, const int passive, struct sockaddr_storage *sa, socklen_t *salen)*/
+/*
+ *	turns a link address, "unix:PATH" or "tcp:HOST:PORT" (HOST may be empty: any address to listen on,
+ *	loopback to connect to), into a socket address; returns the address family, or -1 if it isn't one
+ */
+static int slick_netlink_address (const char *addr, const int passive, struct sockaddr_storage *sa, socklen_t *salen)
+{
+	memset (sa, 0, sizeof (struct sockaddr_storage));
+	if (!strncmp (addr, "unix:", 5)) {
+		struct sockaddr_un *sun = (struct sockaddr_un *)sa;
+
+		if (!addr[5] || (strlen (addr + 5) >= sizeof (sun->sun_path))) {
+			slick_warning ("unsupported networked channel link address \"%s\"", addr);
+			return -1;
+		}
+		sun->sun_family = AF_UNIX;
+		strcpy (sun->sun_path, addr + 5);
+		*salen = sizeof (struct sockaddr_un);
+		return AF_UNIX;
+	} else if (!strncmp (addr, "tcp:", 4)) {
+		const char *port = strrchr (addr + 4, ':');
+		struct addrinfo hints, *res;
+		char host[256];
+		int err;
+
+		if (!port || ((port - (addr + 4)) >= (int)sizeof (host))) {
+			slick_warning ("unsupported networked channel link address \"%s\", expected tcp:HOST:PORT", addr);
+			return -1;
+		}
+		memcpy (host, addr + 4, port - (addr + 4));
+		host[port - (addr + 4)] = '\0';
+
+		memset (&hints, 0, sizeof (hints));
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_flags = passive ? AI_PASSIVE : 0;
+		err = getaddrinfo (host[0] ? host : NULL, port + 1, &hints, &res);
+		if (err) {
+			slick_warning ("failed to resolve networked channel link address \"%s\" [%s]", addr, gai_strerror (err));
+			return -1;
+		}
+		memcpy (sa, res->ai_addr, res->ai_addrlen);
+		*salen = res->ai_addrlen;
+		err = res->ai_family;
+		freeaddrinfo (res);
+		return err;
+	}
+	slick_warning ("unsupported networked channel link address \"%s\", expected unix:PATH or tcp:HOST:PORT", addr);
+	return -1;
+}
+/*}}}*/
+/*{{{  void *slick_netlink_fd (const int fd, const int nvchans)*/
+/*
+ *	makes a networked channel link over a connected stream socket (TCP or Unix-domain) to another slick node,
+ *	which must do the same with its end.  Virtual channels 0 .. nvchans-1 on it are used with os_netchanin and
+ *	os_netchanout, one process inputting and one outputting on each, as agreed between the two ends.  The link
+ *	takes over the descriptor.  Call after slick_init(); returns the link, or NULL on failure.
+ */
+void *slick_netlink_fd (const int fd, const int nvchans)
+{
+	struct epoll_event ev;
+	netlink_t *link;
+	int one = 1;
+
+	if ((nvchans < 1) || (nvchans > NETLINK_MAX_VCHANS)) {
+		slick_warning ("unsupported networked channel link (%d virtual channels), expect [1..%d]", nvchans, NETLINK_MAX_VCHANS);
+		return NULL;
+	}
+	if (fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) | O_NONBLOCK) < 0) {
+		slick_warning ("failed to set up networked channel link on descriptor %d [%s]", fd, strerror (errno));
+		return NULL;
+	}
+	/* frames are batched here already (ignored if not TCP) */
+	setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof (one));
+
+	link = (netlink_t *)smalloc (sizeof (netlink_t));
+	memset (link, 0, sizeof (netlink_t));
+	link->fd = fd;
+	link->nvchans = (uint32_t)nvchans;
+	link->vchans = (netvchan_t *)smalloc (nvchans * sizeof (netvchan_t));
+	memset (link->vchans, 0, nvchans * sizeof (netvchan_t));
+	link->rxbuf = (uint8_t *)smalloc (NETLINK_RXBUF_SIZE);
+	link->events = EPOLLIN;
+
+	pthread_mutex_lock (&slick.netlink_lock);
+	if ((slick.netlink_wakefd < 0) && slick_netlink_start ()) {
+		pthread_mutex_unlock (&slick.netlink_lock);
+		goto out_free;
+	}
+	ev.events = link->events;
+	ev.data.ptr = (void *)link;
+	if (epoll_ctl (slick.netlink_epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		slick_warning ("failed to set up networked channel link on descriptor %d [%s]", fd, strerror (errno));
+		pthread_mutex_unlock (&slick.netlink_lock);
+		goto out_free;
+	}
+	link->next = slick.netlinks;
+	slick.netlinks = link;
+	pthread_mutex_unlock (&slick.netlink_lock);
+
+	return (void *)link;
+
+out_free:
+	sfree (link->rxbuf);
+	sfree (link->vchans);
+	sfree (link);
+	return NULL;
+}
+/*}}}*/
+/*{{{  void *slick_netlink_connect (const char *addr, const int nvchans)*/
+/*
+ *	connects to a slick node listening at 'addr' (see slick_netlink_listen()) and makes a link with 'nvchans'
+ *	virtual channels; returns the link, or NULL on failure
+ */
+void *slick_netlink_connect (const char *addr, const int nvchans)
+{
+	struct sockaddr_storage sa;
+	socklen_t salen;
+	void *link;
+	int family, fd;
+
+	family = slick_netlink_address (addr, 0, &sa, &salen);
+	if (family < 0) {
+		return NULL;
+	}
+	fd = socket (family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		slick_warning ("failed to create socket for networked channel link [%s]", strerror (errno));
+		return NULL;
+	}
+	if (connect (fd, (struct sockaddr *)&sa, salen) < 0) {
+		slick_warning ("failed to connect networked channel link to \"%s\" [%s]", addr, strerror (errno));
+		close (fd);
+		return NULL;
+	}
+	link = slick_netlink_fd (fd, nvchans);
+	if (!link) {
+		close (fd);
+	}
+	return link;
+}
+/*}}}*/
+/*{{{  int slick_netlink_listen (const char *addr)*/
+/*
+ *	listens for slick nodes connecting at 'addr' ("unix:PATH" or "tcp:HOST:PORT"); returns the listening
+ *	socket for slick_netlink_accept(), or -1 on failure
+ */
+int slick_netlink_listen (const char *addr)
+{
+	struct sockaddr_storage sa;
+	socklen_t salen;
+	int family, fd;
+	int one = 1;
+
+	family = slick_netlink_address (addr, 1, &sa, &salen);
+	if (family < 0) {
+		return -1;
+	}
+	fd = socket (family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		slick_warning ("failed to create socket for networked channel links [%s]", strerror (errno));
+		return -1;
+	}
+	if (family != AF_UNIX) {
+		setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof (one));
+	}
+	if ((bind (fd, (struct sockaddr *)&sa, salen) < 0) || (listen (fd, SOMAXCONN) < 0)) {
+		slick_warning ("failed to listen for networked channel links at \"%s\" [%s]", addr, strerror (errno));
+		close (fd);
+		return -1;
+	}
+	return fd;
+}
+/*}}}*/
+/*{{{  void *slick_netlink_accept (const int lfd, const int nvchans)*/
+/*
+ *	waits for a slick node to connect to a listening socket (from slick_netlink_listen()) and makes a link
+ *	with 'nvchans' virtual channels; returns the link, or NULL on failure
+ */
+void *slick_netlink_accept (const int lfd, const int nvchans)
+{
+	void *link;
+	int fd;
+
+	do {
+		fd = accept4 (lfd, NULL, NULL, SOCK_CLOEXEC);
+	} while ((fd < 0) && (errno == EINTR));
+	if (fd < 0) {
+		slick_warning ("failed to accept networked channel link [%s]", strerror (errno));
+		return NULL;
+	}
+	link = slick_netlink_fd (fd, nvchans);
+	if (!link) {
+		close (fd);
+	}
+	return link;
+}
+/*}}}*/
+/*{{{  void slick_netlink_close (void *link)*/
+/*
+ *	closes a networked channel link (and its socket), once nothing is waiting on it: the link manager
+ *	does this when it next looks
+ */
+void slick_netlink_close (void *link)
+{
+	uint64_t one = 1;
+
+	pthread_mutex_lock (&slick.netlink_lock);
+	((netlink_t *)link)->closing = 1;
+	pthread_mutex_unlock (&slick.netlink_lock);
+
+	if (write (slick.netlink_wakefd, &one, sizeof (one)) < 0) {
+		/* already signalled */
+	}
+}
+/*}}}*/
+/*{{{  void slick_dump_stats (void)*/
+/*
+ *	reports per-thread scheduler statistics (on stderr).  Counters are read without
+ *	synchronisation, so figures for threads that are still running are approximate.
+ *	Reserved threads (--rt-reserve) are marked with a '*'; blocking calls, file I/O, descriptor
+ *	guards, shared-memory channel waits and networked channel traffic, if any, are summarised after.
+ */
+void slick_dump_stats (void)
+{
+	uint64_t ioreqs = 0, iosubmits = 0, fdwakes = 0, shmwaits = 0;
+	int i;
+
+	slick_cmessage ("slick: run-time thread statistics:\n");
+	slick_cmessage ("    thread   dispatches      batches       steals      rsteals       pushes       mailed        homed       routed     overruns          edf         late       sleeps        wakes      idle-ms      spin-ms     sleep-ms  spin%%  budget-us\n");
+	for (i=0; i<slick.rt_nthreads; i++) {
+		psched_t *s = slickss.schedulers[i];
+		uint64_t idle;
+
+		if (!s) {
+			continue;		/* for() */
+		}
+		idle = s->stats.spin_ns + s->stats.sleep_ns;
+
+		slick_cmessage ("    %6d%c%12lu %12lu %12lu %12lu %12lu %12lu %12lu %12lu %12lu %12lu %12lu %12lu %12lu %12.3f %12.3f %12.3f %6.1f %10.3f\n", i,
+				s->reserved ? '*' : ' ', s->stats.dispatches, s->stats.batches,
+				s->stats.steals, s->stats.rsteals, s->stats.pushes, s->stats.mailed, s->stats.homed, s->stats.routed, s->stats.overruns, s->stats.edf, s->stats.late, s->stats.sleeps, s->stats.wakes, (double)s->stats.idle_ns / 1000000.0,
+				(double)s->stats.spin_ns / 1000000.0, (double)s->stats.sleep_ns / 1000000.0,
+				idle ? (100.0 * (double)s->stats.spin_ns / (double)idle) : 0.0, (double)s->stats.spin_budget_ns / 1000.0);
+	}
+	for (i=0; i<slick.rt_nthreads; i++) {
+		psched_t *s = slickss.schedulers[i];
+		int j;
+
+		if (!s || !s->stats.overruns) {
+			continue;		/* for() */
+		}
+		for (j=0; j<HOG_TABLE_SIZE; j++) {
+			if (s->hog_count[j]) {
+				slick_cmessage ("    thread %d: process at %p overran its slice %lu times, last stopped at %p\n", i,
+						s->hog_w[j], s->hog_count[j], (void *)s->hog_iptr[j]);
+			}
+		}
+	}
+	if (slick.offload_calls) {
+		slick_cmessage ("    blocking calls: %lu on %d helper thread%s, queued at most %d deep\n", slick.offload_calls,
+				slick.offload_threads, (slick.offload_threads == 1) ? "" : "s", slick.offload_maxdepth);
+	}
+	for (i=0; i<slick.rt_nthreads; i++) {
+		psched_t *s = slickss.schedulers[i];
+
+		if (s) {
+			ioreqs += s->stats.ioreqs;
+			iosubmits += s->stats.iosubmits;
+			fdwakes += s->stats.fdwakes;
+			shmwaits += s->stats.shmwaits;
+		}
+	}
+	if (ioreqs) {
+		slick_cmessage ("    file I/O: %lu requests through io_uring, in %lu submissions\n", ioreqs, iosubmits);
+	}
+	if (fdwakes) {
+		slick_cmessage ("    descriptor guards: %lu ALTs woken by a ready descriptor\n", fdwakes);
+	}
+	if (shmwaits) {
+		slick_cmessage ("    shared-memory channels: %lu waits for the other end\n", shmwaits);
+	}
+	if (slick.netlink_txframes || slick.netlink_rxframes) {
+		slick_cmessage ("    networked channels: %lu frames sent in %lu writes, %lu received in %lu reads\n", slick.netlink_txframes,
+				slick.netlink_writes, slick.netlink_rxframes, slick.netlink_reads);
+	}
 }
 /*}}}*/
 
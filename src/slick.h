@@ -21,8 +21,56 @@
 #ifndef __SLICK_H
 #define __SLICK_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 extern int slick_init (const char **argv, const int argc);
 extern void slick_startup (void *ws, void (*proc)(void));
+extern void slick_start_async (void *ws, void (*proc)(void));
+extern void slick_run_on_current_thread (void *ws, void (*proc)(void));
+extern void slick_wait (void);
+extern void slick_shutdown (void);
+extern void slick_dump_stats (void);
+
+extern void *slick_alloc_ws (const size_t bytes, const int thread);
+extern void slick_free_ws (void *ws);
+extern void slick_prefault (void *ptr, const size_t bytes);
+
+extern void *slick_shmchan_create (const size_t slotsize, const int nslots, int *fdp);
+extern void *slick_shmchan_attach (const int fd);
+extern void slick_shmchan_detach (void *chan);
+
+extern void *slick_netlink_fd (const int fd, const int nvchans);
+extern void *slick_netlink_connect (const char *addr, const int nvchans);
+extern int slick_netlink_listen (const char *addr);
+extern void *slick_netlink_accept (const int lfd, const int nvchans);
+extern void slick_netlink_close (void *link);
+
+/*
+ *	for threads that are not run-time threads (a host application's own): starting processes, and
+ *	channel output to them.  A host that has processes waiting on it holds the run-time while it does,
+ *	so that they are not taken for deadlocked.
+ */
+extern void slick_submit (void *ws, void (*entry)(void), uint64_t priofinity);
+extern void slick_external_chanout (void **chanptr, void *addr, const int count);
+extern void slick_external_hold (void);
+extern void slick_external_release (void);
+
+/*
+ *	cooperative preemption (--rt-slice=MS): set for a run-time thread whose current process has run
+ *	for longer than the slice.  Generated code polls it at loop back-edges and yields, e.g.
+ *
+ *		cmpl	$0, %fs:slick_yield@tpoff
+ *		jz	1f
+ *		movq	%rbp, %rdi
+ *		call	os_pause
+ *	1:
+ *
+ *	C code called from a process can test SLICK_YIELD_DUE() and return early so that its caller yields.
+ */
+extern __thread volatile int slick_yield;
+
+#define SLICK_YIELD_DUE()	(slick_yield)
 
 
 #endif	/* !__SLICK_H */
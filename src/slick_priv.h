@@ -24,12 +24,190 @@
 /* global scheduler structure */
 extern slick_ss_t slickss;
 
+
+/*{{{  thread-state shard helpers*/
+static inline sshard_t *shard_of_thread (unsigned int t) /*{{{*/
+{
+	return &(slickss.shards[slickss.shard_of[t]]);
+}
+/*}}}*/
+static inline void shard_set_enabled (unsigned int t) /*{{{*/
+{
+	sshard_t *sh = shard_of_thread (t);
+
+	att64_set_bit (&(sh->enabled), t - sh->base);
+}
+/*}}}*/
+static inline void shard_clear_enabled (unsigned int t) /*{{{*/
+{
+	sshard_t *sh = shard_of_thread (t);
+
+	att64_clear_bit (&(sh->enabled), t - sh->base);
+}
+/*}}}*/
+static inline void shard_set_idle (unsigned int t) /*{{{*/
+{
+	sshard_t *sh = shard_of_thread (t);
+
+	att64_set_bit (&(sh->idle), t - sh->base);
+}
+/*}}}*/
+static inline void shard_clear_idle (unsigned int t) /*{{{*/
+{
+	sshard_t *sh = shard_of_thread (t);
+
+	att64_clear_bit (&(sh->idle), t - sh->base);
+}
+/*}}}*/
+static inline void shard_set_sleeping (unsigned int t) /*{{{*/
+{
+	unsigned int k = slickss.shard_of[t];
+	sshard_t *sh = &(slickss.shards[k]);
+
+	att64_set_bit (&(sh->sleeping), t - sh->base);
+	if (!(att64_val (&slickss.sleeping_shards) & (1ULL << k))) {
+		att64_set_bit (&slickss.sleeping_shards, k);
+	}
+}
+/*}}}*/
+static inline void shard_clear_sleeping (unsigned int t) /*{{{*/
+{
+	unsigned int k = slickss.shard_of[t];
+	sshard_t *sh = &(slickss.shards[k]);
+
+	att64_clear_bit (&(sh->sleeping), t - sh->base);
+	if (!att64_val (&(sh->sleeping))) {
+		att64_clear_bit (&slickss.sleeping_shards, k);
+		/* re-check: someone in the shard may have gone to sleep after seeing the summary bit still set */
+		if (att64_val (&(sh->sleeping))) {
+			att64_set_bit (&slickss.sleeping_shards, k);
+		}
+	}
+}
+/*}}}*/
+static inline int shard_is_sleeping (unsigned int t) /*{{{*/
+{
+	sshard_t *sh = shard_of_thread (t);
+
+	return (att64_val (&(sh->sleeping)) >> (t - sh->base)) & 1;
+}
+/*}}}*/
+static inline void shard_bits_to_bitset (sshard_t *sh, uint64_t bits, bitset128_t *bs) /*{{{*/
+{
+	/* 'bs' is a private copy, so plain accesses */
+	if (sh->base >= 64) {
+		bs->values[1] |= bits << (sh->base - 64);
+	} else if (sh->base) {
+		bs->values[0] |= bits << sh->base;
+		bs->values[1] |= bits >> (64 - sh->base);
+	} else {
+		bs->values[0] |= bits;
+	}
+}
+/*}}}*/
+static inline void slick_enabled_threads (bitset128_t *bs) /*{{{*/
+{
+	int i;
+
+	bis128_init (bs, 0);
+	for (i=0; i<slickss.nshards; i++) {
+		sshard_t *sh = &(slickss.shards[i]);
+
+		shard_bits_to_bitset (sh, att64_val (&(sh->enabled)), bs);
+	}
+}
+/*}}}*/
+static inline void slick_active_threads (bitset128_t *bs) /*{{{*/
+{
+	int i;
+
+	bis128_init (bs, 0);
+	for (i=0; i<slickss.nshards; i++) {
+		sshard_t *sh = &(slickss.shards[i]);
+
+		shard_bits_to_bitset (sh, att64_val (&(sh->enabled)) & ~att64_val (&(sh->sleeping)), bs);
+	}
+}
+/*}}}*/
+static inline bitset128_t *slick_partition (unsigned int t) /*{{{*/
+{
+	/* threads on the same side of the reserved partition as 't' (all of them if there is none) */
+	return &(slickss.partition[(int)t >= slickss.reserve_base]);
+}
+/*}}}*/
+static inline unsigned int slick_first_sleeping (unsigned int near) /*{{{*/
+{
+	unsigned int k = slickss.shard_of[near];
+	uint64_t summary;
+	uint64_t bits;
+
+	/* prefer a thread sharing our cache/node */
+	bits = att64_val (&(slickss.shards[k].sleeping));
+	if (bits) {
+		return slickss.shards[k].base + bsf64 (bits);
+	}
+
+	/* never across the reserved partition: its threads are only woken for its own work */
+	summary = att64_val (&slickss.sleeping_shards) & ~(1ULL << k);
+	summary &= (slickss.reserved_shards & (1ULL << k)) ? slickss.reserved_shards : ~slickss.reserved_shards;
+	while (summary) {
+		k = bsf64 (summary);
+		bits = att64_val (&(slickss.shards[k].sleeping));
+		if (bits) {
+			return slickss.shards[k].base + bsf64 (bits);
+		}
+		summary &= ~(1ULL << k);
+	}
+	return MAX_RT_THREADS;
+}
+/*}}}*/
+static inline int slick_all_threads_stuck (void) /*{{{*/
+{
+	uint64_t gen = 0;
+	int stuck = 1;
+	int i;
+
+	if (att32_val (&slickss.offloaded)) {
+		/* processes in blocking calls will be back (mailed, so waking a thread, before this drops) */
+		return 0;
+	}
+	read_barrier ();
+
+	/* (idle & sleeping) == enabled in every shard, with no wakes while we looked */
+	for (i=0; i<slickss.nshards; i++) {
+		gen += att64_val (&(slickss.shards[i].wakes));
+	}
+	read_barrier ();
+	for (i=0; stuck && (i<slickss.nshards); i++) {
+		sshard_t *sh = &(slickss.shards[i]);
+
+		if ((att64_val (&(sh->idle)) & att64_val (&(sh->sleeping))) != att64_val (&(sh->enabled))) {
+			stuck = 0;
+		}
+	}
+	read_barrier ();
+	for (i=0; i<slickss.nshards; i++) {
+		gen -= att64_val (&(slickss.shards[i].wakes));
+	}
+	return stuck && !gen;
+}
+/*}}}*/
+
+/*}}}*/
+
 /* in sched.c */
 extern uint64_t sched_time_now (void);
 extern void slick_wake_thread (psched_t *s, unsigned int sync_bit);
+extern int slick_current_thread (void);
+extern void slick_resume_process (workspace_t w);
 
 /* in slick.c */
 extern void slick_assert (const int v, const char *file, const int line);
+extern void slick_recheck_cpus (void);
+extern void slick_grow_pool (void);
+extern void slick_offload (workspace_t w);
+extern void slick_netlink_request (workspace_t w);
+extern void slick_shutdown (void);
 
 
 #endif	/* !__SLICK_PRIV_H */
@@ -28,29 +28,117 @@
 /* a reasonable limit for now -- mirroring number of cores */
 #define MAX_RT_THREADS		(128)
 #define MAX_PRIORITY_LEVELS	(32)
+#define MAX_SHARDS		(64)			/* groups of threads (LLC/node) for idle/sleeping state */
+#define MAX_SHARD_THREADS	(64)
 
 /* for batch scheduling */
 #define BATCH_EMPTIED		(0x4000000000000000)
 #define BATCH_PPD		(8)			/* per-process dispatch */
-#define BATCH_PPD_SHIFT		(3)
 #define BATCH_MD_MASK		(0x7f)			/* maximum dispatches as mask */
+#define QUANTUM_MAX_PPD		(1024)			/* limits on tuned dispatches per process.. */
+#define QUANTUM_MAX_DISPATCHES	(65536)			/* ..and per batch */
+#define QUANTUM_SHIFT_MIN	(-3)			/* adaptive quantum: at least 1/8th of the tuned one.. */
+#define QUANTUM_SHIFT_MAX	(3)			/* ..and at most 8 times */
+#define QUANTUM_GROW_RUNS	(4)			/* times a batch is re-selected alone before it grows */
+#define BATCH_ARENA_SIZE	(65536)			/* node-local chunk that batches are carved from */
+#define BATCH_INLINE		(8)			/* processes held in the batch itself, before its list */
+#define BATCH_INLINE_MASK	(BATCH_INLINE - 1)
+
+#define SLICK_WS_HDR_BYTES	(CACHELINE_BYTES)	/* header kept in front of workspace from slick_alloc_ws() */
 
 #define BATCH_DIRTY_BIT		(63)
 #define BATCH_DIRTY		((uint64_t)1 << BATCH_DIRTY_BIT)
 
+/* for adaptive idle spinning */
+#define SPIN_DEFAULT_US		(16)			/* default cap on spinning per idle period */
+#define SPIN_DEFAULT_PCT	(50)			/* default cap on CPU spent spinning */
+#define SPIN_MIN_NS		(1000)			/* least spin when waits are long */
+#define SPIN_WINDOW_NS		(10000000)		/* accounting window for the CPU cap */
+#define SPIN_EWMA_SHIFT		(3)			/* wait average weights new samples by 1/8 */
+
+#define CPU_RECHECK_NS		(1000000000)		/* how often to re-check usable CPUs (cgroup quota, etc.) */
+
+/* for elastic thread pools */
+#define ELASTIC_GROW_NS		(1000000)		/* unserved work for this long adds a thread */
+#define ELASTIC_RETIRE_MS	(1000)			/* default idle time before a thread parks */
+
+/* for pushing work away from overloaded schedulers */
+#define SHED_DEFAULT_PROCS	(32)			/* current batch bigger than this is split */
+#define SHED_DEFAULT_BATCHES	(4)			/* run-queue longer than this gives a batch away */
+
+/* for mailing processes to other schedulers */
+#define MAX_OUTBOXES		(64)			/* destinations collected for (affinity covers no more) */
+#define OUTBOX_MAX_PROCS	(32)			/* sent once this many are collected */
+
+/* for returning woken processes to the scheduler they last ran on */
+#define SOFT_AFFINITY_SLACK	(8)			/* default: home may be this much busier than us */
+
+/* for keeping processes that talk to each other in the same batch */
+#define COMM_TABLE_BITS		(8)
+#define COMM_TABLE_SIZE		(1 << COMM_TABLE_BITS)	/* processes whose last partner is remembered */
+#define COMM_DEFAULT_SAMPLE	(16)			/* one channel communication in this many is noted */
+
+/* for cooperative preemption */
+#define HOG_TABLE_SIZE		(8)			/* processes that overran their slice remembered per thread */
+
+/* for earliest-deadline-first processes */
+#define EDF_HEAP_INITIAL	(64)			/* deadline heap entries allocated at first, doubled as needed */
+
+/* for scheduler memory */
+#define FREE_BATCHES_KEPT	(32)			/* free-list trimmed to this many batches.. */
+#define PREFAULT_BATCHES	(1024)			/* ..or allocated up-front and all kept, with --rt-prefault */
+#define PREFAULT_STACK_KB	(256)			/* default run-time thread stack touched at start-up */
+
+/* for blocking calls run by helper threads (os_blocking_call) */
+#define OFFLOAD_DEFAULT_MAX	(4)			/* helper threads, at most */
+
+/* for file I/O through each run-time thread's io_uring (os_read, os_write, os_fsync) */
+#define URING_DEFAULT_ENTRIES	(64)			/* submission queue entries (0 = use the helper threads) */
+#define URING_MAX_ENTRIES	(4096)
+
+/* for descriptor ALT guards (os_enbfd, os_disfd) */
+#define FDGUARD_MAX_FDS		(65536)			/* descriptors that can be guards, at most (else RLIMIT_NOFILE) */
+
+/* for shared-memory channels between OS processes (os_shmchanin, os_shmchanout) */
+#define SHMCHAN_MAGIC		(0x736c69636b73686dULL)	/* "slickshm" */
+#define SHMCHAN_MAX_SLOTS	(65536)
+#define SHMCHAN_MAX_SLOTSIZE	(1 << 20)
+
+/* for networked channels between slick nodes (os_netchanin, os_netchanout) */
+#define NETLINK_MAX_VCHANS	(65536)			/* virtual channels on a link, at most */
+#define NETLINK_RXBUF_SIZE	(65536)			/* bytes read from a link at once.. */
+#define NETLINK_DIRECT_MIN	(16384)			/* ..but payloads (what's left of them) this big are read straight into place */
+#define NETLINK_MAX_IOV		(64)			/* buffers gathered per writev() */
+#define NETLINK_MAX_EVENTS	(32)			/* epoll events the link manager takes at once */
+
+#define NETFRAME_DATA		(1)			/* netframe_t.type: a message (len bytes follow).. */
+#define NETFRAME_CREDIT		(2)			/* ..or a process waiting to input one */
+
+/* for real-time OS scheduling of run-time threads */
+#define RT_POLICY_DEFAULT_PRI	(1)			/* SCHED_FIFO/SCHED_RR priority if not given */
+
 /*}}}*/
 /*{{{  typedef .._t type definitions from structures and other*/
 typedef uint64_t *workspace_t;		/* pointer to process workspace */
 
 typedef struct TAG_slick_t slick_t;
 typedef struct TAG_slick_ss_t slick_ss_t;
+typedef struct TAG_sshard_t sshard_t;
+typedef struct TAG_bpool_t bpool_t;
 typedef struct TAG_pbatch_t pbatch_t;
 
 typedef struct TAG_runqueue_t runqueue_t;
 typedef struct TAG_mwindow_t mwindow_t;
 typedef struct TAG_tqnode_t tqnode_t;
+typedef struct TAG_fdguard_t fdguard_t;
+typedef struct TAG_shmchan_t shmchan_t;
+typedef struct TAG_netframe_t netframe_t;
+typedef struct TAG_netreq_t netreq_t;
+typedef struct TAG_netvchan_t netvchan_t;
+typedef struct TAG_netlink_t netlink_t;
 
 typedef struct TAG_psched_t psched_t;
+typedef struct TAG_pstats_t pstats_t;
 typedef struct TAG_slickts_t slickts_t;
 
 /*}}}*/
@@ -69,6 +157,11 @@ typedef struct TAG_slickts_t slickts_t;
 #define LTLink		-5		/* timer-queue link */
 #define LTimef		-6		/* timeout time */
 
+/* LLink of a process waiting in a channel: its home scheduler, tagged so it can't be mistaken for a pointer */
+#define LinkHome_p		0x8000000000000000
+#define BuildLinkHome(s)	(LinkHome_p | (uint64_t)(s))
+#define LinkHome(x)		(((x) & LinkHome_p) ? (unsigned int)((x) & ~LinkHome_p) : MAX_RT_THREADS)
+
 
 #define ALT_ENABLING_BIT	30
 #define ALT_ENABLING		(1 << ALT_ENABLING_BIT)
@@ -85,39 +178,171 @@ typedef struct TAG_slickts_t slickts_t;
 /*}}}*/
 /*{{{  priority and affinity constants/macros*/
 
-#define AFFINITY_MASK		(0xffffffffffffffe0)
+#define AFFINITY_MASK		(0x7fffffffffffffe0)
 #define AFFINITY_SHIFT		(5)
 #define PRIORITY_MASK		(0x000000000000001f)
 
-#define PHasAffinity(x)		((x) & AFFINITY_MASK)
+/*
+ *	earliest-deadline-first processes have the top bit set, and an absolute deadline (a timer value,
+ *	to 32ns) where the affinity would be; they have no affinity, and the priority is the one they
+ *	go back to when leaving the class
+ */
+#define PRIOFINITY_EDF		(0x8000000000000000)
+#define DEADLINE_MASK		(0x7fffffffffffffe0)
+
+#define PHasAffinity(x)		(((x) & PRIOFINITY_EDF) ? 0 : ((x) & AFFINITY_MASK))
 #define PAffinity(x)		(((x) & AFFINITY_MASK) >> AFFINITY_SHIFT)
 #define PPriority(x)		((x) & PRIORITY_MASK)
 #define BuildPriofinity(a,p)	((((a) << AFFINITY_SHIFT) & AFFINITY_MASK) | ((p) & PRIORITY_MASK))
 
+#define PIsEDF(x)		((x) & PRIOFINITY_EDF)
+#define PDeadline(x)		((x) & DEADLINE_MASK)
+#define BuildDeadline(t,p)	(PRIOFINITY_EDF | ((t) & DEADLINE_MASK) | ((p) & PRIORITY_MASK))
+
 /*}}}*/
 /*{{{  slick_t, slickss_t: global scheduler state*/
 struct TAG_slick_t {
 	int rt_nthreads;		/* number of run-time threads in use (1 for each CPU by default) */
+	int rt_minthreads;		/* fewest run-time threads (less than rt_nthreads if elastic) */
+	atomic32_t rt_started;		/* run-time threads created so far (grows while others read it) */
+	int fixed_ncpus;		/* non-zero if SLICKRTNCPUS said how many CPUs (not re-checked) */
 	char **prog_argv;		/* top-level program arguments (copy at top-level) */
 	int prog_argc;			/* number of arguments (left) */
 	int verbose;			/* non-zero if verbose */
 	int binding;			/* 0=any CPU, 1=one-to-one */
+	int numa;			/* 1=place memory on local NUMA nodes even with only one node (for testing) */
+	int slice_ms;			/* ask processes to yield after running this long (0 = never) */
+	pthread_t watchdog;		/* thread that does the asking */
+	int rt_policy;			/* OS scheduling policy for run-time threads (SCHED_OTHER unless --rt-policy).. */
+	int rt_policy_pri;		/* ..and priority, for SCHED_FIFO and SCHED_RR (the watchdog gets one more) */
+	int mlock;			/* MCL_ flags memory is locked with (0 = not locked) */
+	int prefault_kb;		/* run-time thread stack touched at start-up, in KB (0 = don't prefault) */
+
+	pthread_mutex_t start_lock;	/* start-up: run-time threads other than 0 wait for it to enter the scheduler, guarding: */
+	pthread_cond_t start_cond;	/* (broadcast when it has) */
+	int start_open;			/* non-zero once it has */
+	int rt_main;			/* non-zero if thread 0 is the embedding thread (slick_run_on_current_thread).. */
+	pthread_t starter;		/* ..which leaves creating the rest to this thread.. */
+	int starting;			/* ..if set (until slick_wait() has joined it) */
+	atomic32_t rt_shutdown;		/* set by slick_shutdown(): run-time threads leave as they next schedule */
+
+	pthread_mutex_t offload_lock;	/* helper threads for blocking calls (os_blocking_call), guarding: */
+	pthread_cond_t offload_cond;	/* (signalled when a call is queued) */
+	int offload_min;		/* helpers started up-front.. */
+	int offload_max;		/* ..and at most this many (0 = run blocking calls in place) */
+	int offload_threads;		/* helpers created so far */
+	int offload_idle;		/* ..of which waiting for a call */
+	workspace_t offload_head;	/* queued calls (processes, linked through LTLink) */
+	workspace_t offload_tail;
+	int offload_depth;		/* calls queued.. */
+	int offload_maxdepth;		/* ..and the most there have been */
+	uint64_t offload_calls;		/* calls made */
+	int uring_entries;		/* io_uring submission queue size for each run-time thread (0 = none) */
+
+	pthread_mutex_t netlink_lock;	/* link manager for networked channels (os_netchanin, os_netchanout), guarding: */
+	workspace_t netlink_head;	/* requests from processes, not yet taken (linked through LTLink) */
+	workspace_t netlink_tail;
+	netlink_t *netlinks;		/* all links */
+	pthread_t netlink_thread;	/* the manager, started with the first link.. */
+	int netlink_epfd;		/* ..waiting on the links' sockets.. */
+	int netlink_wakefd;		/* ..and an eventfd for requests (-1 until started) */
+	uint64_t netlink_txframes;	/* frames sent.. */
+	uint64_t netlink_writes;	/* ..in this many writes */
+	uint64_t netlink_rxframes;	/* frames received.. */
+	uint64_t netlink_reads;		/* ..in this many reads */
+
+	int rt_cpu[MAX_RT_THREADS];			/* CPU each run-time thread is bound to (-1 if not) */
+	int rt_node[MAX_RT_THREADS];			/* NUMA node of that CPU */
 
 	pthread_t rt_threadid[MAX_RT_THREADS];		/* thread ID for each run-time thread */
 	pthread_attr_t rt_threadattr[MAX_RT_THREADS];	/* thread attributes for each run-time thread */
 
 };
 
+/*
+ *	thread state (enabled, idle, sleeping) is kept in shards, one per cache-line, each covering
+ *	a contiguous range of run-time threads that share a last-level cache or NUMA node, so that
+ *	sleep/wake traffic mostly stays local.  sleeping_shards summarises which shards have sleepers.
+ */
+struct TAG_sshard_t {
+	atomic64_t enabled;		/* bit (n - base) for each member thread n */
+	atomic64_t idle;
+	atomic64_t sleeping;
+	atomic64_t wakes;		/* bumped after each wake of a member (for consistent deadlock checks) */
+	int32_t base;			/* first thread in this shard */
+	int32_t count;			/* number of threads in this shard */
+	uint64_t dummy[3];		/* pad to 64 bytes */
+} __attribute__ ((packed));
+
+/*
+ *	with --rt-numa, batches are carved from node-local arenas and can't be freed one by one.  A
+ *	scheduler trimming its free-list hands the excess to a pool for its shard (whose threads are
+ *	on the same node), and schedulers there take from the pool before carving more.
+ */
+struct TAG_bpool_t {
+	atomic32_t lock;
+	int32_t count;			/* batches in the pool.. */
+	pbatch_t *free;			/* ..linked through 'nb' */
+	uint64_t dummy[6];		/* pad to 64 bytes */
+} __attribute__ ((packed));
+
 struct TAG_slick_ss_t {
-	/* moderately wide bit-fields */
-	bitset128_t enabled_threads;
-	bitset128_t idle_threads;
-	bitset128_t sleeping_threads;
+	sshard_t shards[MAX_SHARDS] CACHELINE_ALIGN;
+	bpool_t bpools[MAX_SHARDS] CACHELINE_ALIGN;	/* spare arena batches for each shard (--rt-numa) */
+	atomic64_t sleeping_shards CACHELINE_ALIGN;	/* bit per shard that may have sleeping threads */
+	uint64_t dummy2[CACHELINE_LWORDS - 1];
+
+	int32_t nshards;
+	uint8_t shard_of[MAX_RT_THREADS];		/* thread index to shard */
+
+	int32_t nnodes;			/* NUMA nodes the run-time threads are bound across */
+	int32_t numa;			/* non-zero if scheduler memory is placed per node */
 
 	psched_t *schedulers[MAX_RT_THREADS];
 
 	int32_t verbose;
 	int32_t ncpus;
+
+	int32_t spin_max_us;		/* cap on spinning per idle period (0 = never spin) */
+	int32_t spin_max_pct;		/* cap on fraction of CPU time spent spinning */
+
+	int32_t shed_procs;		/* split and push away half of a current batch bigger than this (0 = never) */
+	int32_t shed_batches;		/* push away a batch from a run-queue longer than this (0 = never) */
+	int32_t soft_affinity;		/* non-zero if processes woken by channel communication go back home */
+	int32_t soft_slack;		/* ... unless home's load is more than this above ours */
+	int32_t comm_sample;		/* note partners for one channel communication in this many (0 = never) */
+	int32_t batches_kept;		/* free batches each scheduler keeps when trimming its free-list */
+	int32_t quantum_adapt;		/* non-zero if schedulers adjust the dispatch quantum as they go */
+	int32_t quantum_ppd[MAX_PRIORITY_LEVELS];	/* dispatches per process in a batch, per priority.. */
+	int32_t quantum_max[MAX_PRIORITY_LEVELS];	/* ..and at most this many per batch */
+
+	int32_t reserve_n;		/* run-time threads reserved for latency-critical priorities (--rt-reserve).. */
+	int32_t reserve_pri;		/* ..those above this one (0 = no reserved partition).. */
+	int32_t reserve_base;		/* ..being the last ones, from this thread on (MAX_RT_THREADS if none) */
+	int32_t dummy6;
+	uint64_t reserved_shards;	/* bit for each shard holding reserved threads */
+	bitset128_t partition[2];	/* ordinary and reserved threads */
+
+	fdguard_t *fdguards;		/* state for each descriptor that may be an ALT guard.. */
+	int32_t nfdguards;		/* ..this many */
+	int32_t dummy7;
+
+	atomic32_t nspinning CACHELINE_ALIGN;	/* ordinary threads spinning in the idle loop looking for work */
+	atomic32_t usable_cpus;			/* CPUs we may use (affinity, cgroup quota/cpuset), re-checked */
+	atomic32_t oversubscribed;		/* non-zero if more run-time threads than usable CPUs */
+	atomic32_t nrspinning;			/* reserved threads spinning (counted apart from the others) */
+	atomic64_t cpus_checked;		/* when usable_cpus was last re-checked */
+	uint64_t dummy1[CACHELINE_LWORDS - 3];
+
+	atomic32_t nlive CACHELINE_ALIGN;	/* run-time threads in the pool (not parked) */
+	atomic32_t growing;			/* set while a new run-time thread is being created */
+	int32_t elastic;			/* non-zero if the pool grows and shrinks */
+	int32_t retire_ms;			/* idle time after which an elastic pool thread parks */
+	atomic32_t offloaded;			/* processes in blocking calls, file I/O, or descriptor guards armed, or held from outside (so still live) */
+	atomic32_t external_next;		/* where the next search for a scheduler to take work from outside starts */
+	uint64_t dummy3[CACHELINE_LWORDS - 3];
+
+	uint64_t opslack[100];		/* atomics.h's asm operands (__dummy_atomic64_t) extend this far past an atomic field */
 };
 
 /*}}}*/
@@ -125,18 +350,26 @@ struct TAG_slick_ss_t {
 
 #define PBATCH_ALLOC_SIZE	(sizeof (uint64_t) * 16)
 
+/*
+ *	the first processes in a batch are held in a small ring in the batch itself, so that dispatch
+ *	finds the next one (and the one after) without reading the workspace of the one it's taking.
+ *	Beyond that they overflow to a list threaded through w[LLink].  Order is the ring, then the
+ *	list: processes only go in the ring while the list is empty (or at the front).
+ */
 struct TAG_pbatch_t {		/* batch of processes */
-	workspace_t fptr;
+	workspace_t fptr;		/* overflow list */
 	workspace_t bptr;
-	uint64_t size;
+	uint64_t size;			/* processes in all (ring and list) */
 
 	struct TAG_pbatch_t *nb;	/* next batch */
 
 	atomic64_t state;		/* migration fields */
 	uint64_t priofinity;
 
-	struct TAG_pbatch_t *prio[8];	/* barrier fields */
-	uint64_t dummy[2];		/* pad to 16*8=128 bytes */
+	uint32_t head;			/* ring: next to dequeue from 'ws'.. */
+	uint32_t tail;			/* ..and next free (both free-running, taken modulo BATCH_INLINE) */
+	uint64_t dummy;			/* pad to 16*8=128 bytes */
+	workspace_t ws[BATCH_INLINE];
 } __attribute__ ((packed));
 
 /*}}}*/
@@ -150,8 +383,10 @@ static inline void init_pbatch_t (pbatch_t *b) /*{{{*/
 	b->nb = NULL;
 	att64_init (&(b->state), 0);
 	b->priofinity = 0;
-	for (i=0; i<8; i++) {
-		b->prio[i] = NULL;
+	b->head = 0;
+	b->tail = 0;
+	for (i=0; i<BATCH_INLINE; i++) {
+		b->ws[i] = NULL;
 	}
 }
 /*}}}*/
@@ -159,6 +394,8 @@ static inline void reinit_pbatch_t (pbatch_t *b) /*{{{*/
 {
 	b->fptr = NULL;
 	b->size = 0;
+	b->head = 0;
+	b->tail = 0;
 }
 /*}}}*/
 /*{{{  batch_... macros*/
@@ -171,11 +408,13 @@ static inline void reinit_pbatch_t (pbatch_t *b) /*{{{*/
 #define batch_set_clean(b)		do { att64_set (&((b)->state), 0); } while (0)
 #define batch_set_dirty(b)		do { att64_set (&((b)->state), BATCH_DIRTY); } while (0)
 
-#define batch_set_dirty_value(b,v)	do { att64_set (&((b)->state), (v & 1)); } while (0)
+#define batch_set_dirty_value(b,v)	do { att64_set (&((b)->state), ((v) & 1) ? BATCH_DIRTY : 0); } while (0)
 #define batch_window(b)			(att64_val (&((b)->state)) & 0xff)
 #define batch_set_window(b,w)		do { att64_set (&((b)->state), BATCH_DIRTY | (w)); } while (0)
 
-#define batch_isempty(b)		((b)->fptr == NULL)
+#define batch_ring_count(b)		((b)->tail - (b)->head)
+#define batch_isempty(b)		(((b)->head == (b)->tail) && ((b)->fptr == NULL))
+#define batch_front(b)			(((b)->head != (b)->tail) ? (b)->ws[(b)->head & BATCH_INLINE_MASK] : (b)->fptr)
 
 /*}}}*/
 
@@ -187,6 +426,7 @@ struct TAG_runqueue_t {
 	pbatch_t *bptr;
 	uint64_t priofinity;		/* of pending batch */
 	pbatch_t *pending;
+	uint64_t length;		/* batches linked in (local run-queues only) */
 } __attribute__ ((packed));
 
 
@@ -197,6 +437,7 @@ static inline void init_runqueue_t (runqueue_t *r) /*{{{*/
 	r->bptr = NULL;
 	r->priofinity = 0;
 	r->pending = NULL;
+	r->length = 0;
 }
 /*}}}*/
 
@@ -266,6 +507,85 @@ static inline void init_tqnode_t (tqnode_t *t) /*{{{*/
 	t->wptr = NULL;
 }
 
+/*}}}*/
+/*{{{  fdguard_t: descriptor ALT guard state (one per descriptor, in slickss.fdguards)*/
+
+struct TAG_fdguard_t {
+	atomic64_t wptr;		/* ALTing process (low bit set, as in a channel), or NULL once fired or disabled */
+	atomic64_t armed;		/* scheduler whose epoll has it armed (one-shot, not yet fired), or NULL */
+	psched_t *reg;			/* scheduler whose epoll it is registered with (written by the ALTer only) */
+	uint64_t dummy;
+} __attribute__ ((packed));
+
+/*}}}*/
+/*{{{  shmchan_t: shared-memory channel (in a memfd, mapped by each OS process that uses it)*/
+
+struct TAG_shmchan_t {
+	uint64_t magic;			/* SHMCHAN_MAGIC */
+	uint32_t slotsize;		/* bytes per message, at most.. */
+	uint32_t nslots;		/* ..buffered this many at once (a power of 2) */
+	uint64_t size;			/* of the whole mapping */
+	uint64_t dummy[5];
+
+	atomic32_t tail CACHELINE_ALIGN;	/* messages written (by the one writer); futex the reader waits on.. */
+	atomic32_t rwaiting;		/* ..when it sets this */
+	uint32_t dummy2[14];
+
+	atomic32_t head CACHELINE_ALIGN;	/* messages read (by the one reader); futex the writer waits on.. */
+	atomic32_t wwaiting;		/* ..when it sets this */
+	uint32_t dummy3[14];
+
+	uint8_t data[] CACHELINE_ALIGN;	/* nslots * slotsize */
+} __attribute__ ((packed));
+
+/*}}}*/
+/*{{{  netlink_t: networked channel link (a stream socket to another slick node), and what goes over it*/
+
+struct TAG_netframe_t {			/* frame header, as sent (both ends are x86-64) */
+	uint32_t type;			/* NETFRAME_... */
+	uint32_t vchan;			/* virtual channel */
+	uint64_t len;			/* payload bytes following */
+} __attribute__ ((packed));
+
+struct TAG_netreq_t {			/* input or output by a process, handled by the link manager */
+	netlink_t *link;
+	workspace_t w;			/* the process (resumed on its scheduler when done) */
+	void *addr;
+	uint64_t count;
+	uint32_t vchan;
+	int32_t input;			/* non-zero for os_netchanin */
+	int32_t queued;			/* set once in the link's send queue: a DATA frame, or an input's CREDIT */
+	int32_t dummy;
+	uint64_t txdone;		/* bytes of frame and payload sent */
+	netreq_t *txnext;
+	netframe_t frame;
+};
+
+struct TAG_netvchan_t {
+	netreq_t *reader;		/* input waiting for its message (credit sent, or to be).. */
+	netreq_t *writer;		/* ..and output waiting for credit, or to be sent */
+	uint32_t credit;		/* inputs waiting at the other end, not yet sent a message */
+	uint32_t dummy;
+};
+
+struct TAG_netlink_t {
+	netlink_t *next;		/* all links (slick.netlinks) */
+	int fd;				/* non-blocking stream socket */
+	uint32_t nvchans;
+	netvchan_t *vchans;
+	int32_t closing;		/* set by slick_netlink_close() */
+	int32_t dead;			/* the other end went away (or the socket failed) */
+	uint32_t events;		/* epoll events registered for */
+	uint32_t waiting;		/* processes waiting on this link */
+	netreq_t *txhead;		/* frames to send, in order */
+	netreq_t *txtail;
+	uint8_t *rxbuf;			/* bytes read (NETLINK_RXBUF_SIZE).. */
+	uint32_t rxlen;			/* ..this many.. */
+	uint32_t rxpos;			/* ..consumed so far */
+	netreq_t *rxreq;		/* input the payload coming in is for (NULL between frames).. */
+	uint64_t rxdone;		/* ..and how much of it has */
+};
+
 /*}}}*/
 
 
@@ -273,6 +593,7 @@ static inline void init_tqnode_t (tqnode_t *t) /*{{{*/
 
 #define SYNC_INTR_BIT	1
 #define SYNC_TIME_BIT	2
+#define SYNC_IO_BIT	3
 #define SYNC_BMAIL_BIT	4
 #define SYNC_PMAIL_BIT	5
 #define SYNC_WORK_BIT	6
@@ -280,6 +601,7 @@ static inline void init_tqnode_t (tqnode_t *t) /*{{{*/
 
 #define SYNC_INTR	(1 << SYNC_INTR_BIT)
 #define SYNC_TIME	(1 << SYNC_TIME_BIT)
+#define SYNC_IO		(1 << SYNC_IO_BIT)
 #define SYNC_BMAIL	(1 << SYNC_BMAIL_BIT)
 #define SYNC_PMAIL	(1 << SYNC_PMAIL_BIT)
 #define SYNC_MAIL	(SYNC_BMAIL | SYNC_PMAIL)
@@ -287,6 +609,60 @@ static inline void init_tqnode_t (tqnode_t *t) /*{{{*/
 #define SYNC_TQ		(1 << SYNC_TQ_BIT)
 
 
+/*}}}*/
+/*{{{  pstats_t: per-scheduler-thread statistics*/
+struct TAG_pstats_t {
+	uint64_t dispatches;			/* processes dispatched */
+	uint64_t batches;			/* batches picked from local run-queues */
+	uint64_t steals;			/* batches migrated in from other schedulers */
+	uint64_t rsteals;			/* of which from schedulers on another NUMA node */
+	uint64_t sleeps;			/* number of times gone to sleep */
+	uint64_t wakes;				/* sleeping threads woken to take work from us */
+	uint64_t pushes;			/* batches pushed out to other schedulers */
+	uint64_t mailed;			/* batches of remote-affine processes sent to other schedulers */
+	uint64_t homed;				/* woken processes sent back to the scheduler they last ran on */
+	uint64_t routed;			/* processes sent across to the other side of the reserved partition */
+	uint64_t overruns;			/* processes that ran past the preemption slice */
+	uint64_t edf;				/* batches picked by deadline (local or stolen) */
+	uint64_t late;				/* of which picked after their deadline */
+	uint64_t idle_ns;			/* time spent without work (spinning or asleep) */
+	uint64_t idle_since;			/* start of current idle period, 0 if busy */
+	uint64_t spin_ns;			/* part of idle_ns spent spinning */
+	uint64_t sleep_ns;			/* part of idle_ns spent asleep */
+	uint64_t spin_budget_ns;		/* current spin budget */
+	uint64_t ioreqs;			/* file I/O requests through our io_uring.. */
+	uint64_t iosubmits;			/* ..in this many submissions */
+	uint64_t fdwakes;			/* ALTs woken by a descriptor guard */
+	uint64_t shmwaits;			/* processes that waited on a shared-memory channel */
+} __attribute__ ((packed));
+
+
+/*}}}*/
+static inline void init_pstats_t (pstats_t *st) /*{{{*/
+{
+	st->dispatches = 0;
+	st->batches = 0;
+	st->steals = 0;
+	st->rsteals = 0;
+	st->sleeps = 0;
+	st->wakes = 0;
+	st->pushes = 0;
+	st->mailed = 0;
+	st->homed = 0;
+	st->routed = 0;
+	st->overruns = 0;
+	st->edf = 0;
+	st->late = 0;
+	st->idle_ns = 0;
+	st->idle_since = 0;
+	st->spin_ns = 0;
+	st->sleep_ns = 0;
+	st->spin_budget_ns = 0;
+	st->ioreqs = 0;
+	st->iosubmits = 0;
+	st->fdwakes = 0;
+	st->shmwaits = 0;
+}
 /*}}}*/
 /*{{{  psched_t: per-scheduler-thread state*/
 struct TAG_psched_t {
@@ -298,14 +674,23 @@ struct TAG_psched_t {
 
 	/* scheduler constants */
 	int32_t sidx;				/* which particular thread we are */
-	int32_t dummy0;
+	int32_t spinning;			/* non-zero if counted in *nspinning */
 	bitset128_t id;				/* 1 << sidx */
 
 	int32_t signal_in;			/* sleep/wake-up pipe FDs */
 	int32_t signal_out;
+	int32_t epoll_fd;			/* what we sleep in: signal_out, the io_uring and descriptor guards */
+	int32_t dummy3;
 
-	uint64_t spin;
+	uint64_t spin;				/* current spin budget (idle_cpu() iterations) */
 	slick_t *sptr;				/* pointer to global state */
+	uint64_t spin_per_us;			/* calibrated idle_cpu() iterations per microsecond */
+	int32_t cpu;				/* CPU bound to (-1 if not) */
+	int32_t node;				/* NUMA node of that CPU */
+	volatile int *yield;			/* this thread's slick_yield, set by the watchdog */
+	int32_t reserved;			/* non-zero if reserved for latency-critical priorities (--rt-reserve) */
+	int32_t dummy0;
+	atomic32_t *nspinning;			/* spinner count for our side of the reserved partition */
 
 	uint64_t dummy1[CACHELINE_LWORDS] CACHELINE_ALIGN;
 	
@@ -318,16 +703,69 @@ struct TAG_psched_t {
 	pbatch_t *free;
 	pbatch_t *laundry;
 
+	uint64_t spin_ewma;			/* smoothed wait for new work (ns) */
+	uint64_t spin_start;			/* start of current spin, zero if not spinning */
+	uint64_t spin_window;			/* start of current CPU-cap window */
+	uint64_t spin_window_ns;		/* time spent spinning in that window */
+
 	tqnode_t *tq_fptr;
 	tqnode_t *tq_bptr;
 
+	uint8_t *arena;				/* node-local memory that new batches are carved from */
+	uint64_t arena_left;
+
+	uint64_t grow_since;			/* start of run of unserved work with nobody to wake (elastic) */
+	uint64_t grow_last;
+
+	int32_t shed_hold;			/* set when there was nowhere to push work to, until the next batch */
+	int32_t comm_count;			/* channel communications until the next one noted */
+
+	int8_t qshift[MAX_PRIORITY_LEVELS];	/* adaptive quantum: scaling (as a shift) per priority.. */
+	uint8_t qalone[MAX_PRIORITY_LEVELS];	/* ..and times a batch was re-selected alone in a row */
+
+	pbatch_t **edf_heap;			/* earliest-deadline-first batches, a binary heap on deadline.. */
+	uint32_t edf_n;				/* ..holding this many (changed under edf_lock, also by thieves).. */
+	uint32_t edf_size;			/* ..in this much space */
+
+	int32_t uring_fd;			/* io_uring for file I/O (-1 if none), whose.. */
+	uint32_t uring_pending;			/* ..requests queued but not yet submitted.. */
+	uint32_t uring_inflight;		/* ..and all made, not yet reaped */
+	uint32_t uring_futex;			/* set if it can wait on a futex (IORING_OP_FUTEX_WAIT, 6.7) */
+	uint32_t *sq_head;			/* submission queue ring (mapped from the kernel) */
+	uint32_t *sq_tail;
+	uint32_t sq_mask;
+	uint32_t cq_mask;
+	void *sqes;				/* submission queue entries */
+	uint32_t *cq_head;			/* completion queue ring */
+	uint32_t *cq_tail;
+	void *cqes;
+
+	workspace_t current;			/* process last dispatched */
+	workspace_t hog_w[HOG_TABLE_SIZE];	/* processes that overran their slice.. */
+	uint64_t hog_iptr[HOG_TABLE_SIZE];	/* ..where they last yielded or blocked.. */
+	uint64_t hog_count[HOG_TABLE_SIZE];	/* ..and how many times */
+
+	uint64_t outboxes;			/* bit for each scheduler we're collecting processes for */
+	pbatch_t *outbox[MAX_OUTBOXES];		/* processes collected for each */
+
+	workspace_t comm_w[COMM_TABLE_SIZE];		/* sampled communications: a process (hashed).. */
+	workspace_t comm_partner[COMM_TABLE_SIZE];	/* ..and who it last talked to */
+
 	pbatch_t cbch CACHELINE_ALIGN;		/* current batch */
 	runqueue_t rq[MAX_PRIORITY_LEVELS];
 	uint64_t dummy2[CACHELINE_LWORDS];
 
+	pstats_t stats CACHELINE_ALIGN;		/* local statistics (read racily by others) */
+
 	/* globally accessed scheduler state */
 	atomic32_t sync CACHELINE_ALIGN;
-	int32_t dummy3;
+	atomic32_t spinwake;			/* set if woken as a spinner (already counted in *nspinning) */
+	atomic32_t parked;			/* set if retired from an elastic pool (mailers must wake us) */
+	atomic32_t load;			/* rough backlog: processes in the current batch plus batches queued */
+	atomic32_t contended;			/* thieves that lost a race for a batch in our migration windows */
+	atomic32_t edf_lock;			/* held while the deadline heap is changed (by us or a thief) */
+	atomic64_t edf_head;			/* priofinity of the most urgent batch in the heap (0 if empty) */
+	atomic32_t fdarmed;			/* descriptor guards armed in our epoll (also disarmed by others) */
 	uint64_t dummy4[CACHELINE_LWORDS] CACHELINE_ALIGN;
 
 	runqueue_t bmail CACHELINE_ALIGN;	/* batch mail */
@@ -350,11 +788,19 @@ static inline void init_psched_t (psched_t *s) /*{{{*/
 	int i;
 
 	s->sidx = -1;
+	s->spinning = 0;
 	bis128_init (&(s->id), 0);
 	s->signal_in = -1;
 	s->signal_out = -1;
+	s->epoll_fd = -1;
 	s->spin = 0;
 	s->sptr = NULL;
+	s->spin_per_us = 1;
+	s->cpu = -1;
+	s->node = 0;
+	s->yield = NULL;
+	s->reserved = 0;
+	s->nspinning = NULL;
 
 	s->dispatches = 0;
 	s->priofinity = 0;
@@ -364,16 +810,76 @@ static inline void init_psched_t (psched_t *s) /*{{{*/
 	s->free = NULL;
 	s->laundry = NULL;
 
+	s->spin_ewma = 0;
+	s->spin_start = 0;
+	s->spin_window = 0;
+	s->spin_window_ns = 0;
+
 	s->tq_fptr = NULL;
 	s->tq_bptr = NULL;
 
+	s->arena = NULL;
+	s->arena_left = 0;
+
+	s->grow_since = 0;
+	s->grow_last = 0;
+
+	s->shed_hold = 0;
+	s->comm_count = 0;
+	for (i=0; i<MAX_PRIORITY_LEVELS; i++) {
+		s->qshift[i] = 0;
+		s->qalone[i] = 0;
+	}
+
+	s->edf_heap = NULL;
+	s->edf_n = 0;
+	s->edf_size = 0;
+
+	s->uring_fd = -1;
+	s->uring_pending = 0;
+	s->uring_inflight = 0;
+	s->uring_futex = 0;
+	s->sq_head = NULL;
+	s->sq_tail = NULL;
+	s->sq_mask = 0;
+	s->cq_mask = 0;
+	s->sqes = NULL;
+	s->cq_head = NULL;
+	s->cq_tail = NULL;
+	s->cqes = NULL;
+
+	s->current = NULL;
+	for (i=0; i<HOG_TABLE_SIZE; i++) {
+		s->hog_w[i] = NULL;
+		s->hog_iptr[i] = 0;
+		s->hog_count[i] = 0;
+	}
+
+	s->outboxes = 0;
+	for (i=0; i<MAX_OUTBOXES; i++) {
+		s->outbox[i] = NULL;
+	}
+	for (i=0; i<COMM_TABLE_SIZE; i++) {
+		s->comm_w[i] = NULL;
+		s->comm_partner[i] = NULL;
+	}
+
 	init_pbatch_t (&(s->cbch));
 
 	for (i=0; i<MAX_PRIORITY_LEVELS; i++) {
 		init_runqueue_t (&(s->rq[i]));
 	}
 
+	init_pstats_t (&(s->stats));
+
 	att32_init (&(s->sync), 0);
+	att32_init (&(s->spinwake), 0);
+	att32_init (&(s->parked), 0);
+	att32_init (&(s->load), 0);
+	att32_init (&(s->contended), 0);
+	att32_init (&(s->edf_lock), 0);
+	att64_init (&(s->edf_head), 0);
+	att32_init (&(s->fdarmed), 0);
 	
 	init_runqueue_t (&(s->bmail));
 	init_runqueue_t (&(s->pmail));
@@ -387,6 +893,8 @@ static inline void init_psched_t (psched_t *s) /*{{{*/
 /*{{{  slickts_t: startup data for threads*/
 struct TAG_slickts_t {
 	int thridx;				/* thread index */
+	int cpu;				/* CPU to bind to (-1 if not) */
+	int node;				/* and its NUMA node */
 	slick_t *sptr;
 
 	void *initial_ws;			/* pointers to workspace and code */
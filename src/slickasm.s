@@ -35,3 +35,10 @@ slick_schedlinkage:
 	call	os_entry
 
 
+.globl	slick_external_stub
+.type	slick_external_stub, @function
+
+slick_external_stub:
+	movq	%rbp, %rdi			/* stand-in workspace for a thread outside the run-time (slick_external_chanout) */
+	call	os_external_woken
+
@@ -30,7 +30,10 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include <fcntl.h>
+#include <dirent.h>
 #include <time.h>
 #include <errno.h>
 
@@ -39,12 +42,27 @@
 
 #include "sutil.h"
 
+/* memory policy bits for mbind(2), used directly so as not to depend on libnuma */
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED		1
+#endif
+#ifndef MPOL_MF_MOVE
+#define MPOL_MF_MOVE		(1 << 1)
+#endif
+
+#define SNODE_MASK_WORDS	(2)		/* nodemask passed to mbind, up to 128 nodes */
+
+/* populating pages with madvise(2) (Linux 5.14 on), likewise defined here for older headers */
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE	23
+#endif
+
 
 /*{{{  void slick_fatal (const char *fmt, ...)*/
 /*
  *	called in the event of a fatal error
  */
-void slick_fatal (const char *fmt, ...)
+__attribute__ ((force_align_arg_pointer)) void slick_fatal (const char *fmt, ...)
 {
 	va_list ap;
 
@@ -143,6 +161,101 @@ void sfree (void *ptr)
 	return;
 }
 /*}}}*/
+/*{{{  int snode_of_cpu (const int cpu)*/
+/*
+ *	returns the NUMA node that a particular CPU belongs to (0 if not known)
+ */
+int snode_of_cpu (const int cpu)
+{
+	char dname[64];
+	struct dirent *de;
+	DIR *dir;
+	int node = 0;
+
+	snprintf (dname, sizeof (dname), "/sys/devices/system/cpu/cpu%d", cpu);
+	dir = opendir (dname);
+	if (!dir) {
+		return 0;
+	}
+	while ((de = readdir (dir)) != NULL) {
+		if (!strncmp (de->d_name, "node", 4) && (sscanf (de->d_name + 4, "%d", &node) == 1)) {
+			break;		/* while() */
+		}
+		node = 0;
+	}
+	closedir (dir);
+
+	return node;
+}
+/*}}}*/
+/*{{{  int smove_to_node (void *ptr, const size_t bytes, const int node)*/
+/*
+ *	sets the preferred NUMA node for the pages covering a region of memory, moving any that
+ *	are already in place; returns 0 on success, non-zero on failure (no NUMA support, etc.)
+ */
+int smove_to_node (void *ptr, const size_t bytes, const int node)
+{
+	unsigned long mask[SNODE_MASK_WORDS] = {0, };
+	uintptr_t pgsize = (uintptr_t)sysconf (_SC_PAGESIZE);
+	uintptr_t start = (uintptr_t)ptr & ~(pgsize - 1);
+	uintptr_t end = ((uintptr_t)ptr + bytes + (pgsize - 1)) & ~(pgsize - 1);
+
+	if ((node < 0) || (node >= (int)(SNODE_MASK_WORDS * 8 * sizeof (unsigned long)))) {
+		return -1;
+	}
+	mask[node / (8 * sizeof (unsigned long))] = 1UL << (node % (8 * sizeof (unsigned long)));
+
+	return (int)syscall (SYS_mbind, start, end - start, MPOL_PREFERRED, mask, SNODE_MASK_WORDS * 8 * sizeof (unsigned long), MPOL_MF_MOVE);
+}
+/*}}}*/
+/*{{{  void *smalloc_node (const size_t bytes, const int node)*/
+/*
+ *	checked allocator for page-granular memory that prefers a particular NUMA node
+ *	(falls back quietly to first-touch placement if the kernel won't do it)
+ */
+void *smalloc_node (const size_t bytes, const int node)
+{
+	void *ptr = mmap (NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
 
+	if (ptr == MAP_FAILED) {
+		slick_fatal ("out of memory (mapping %lu bytes for node %d)", bytes, node);
+	}
+	smove_to_node (ptr, bytes, node);
 
+	return ptr;
+}
+/*}}}*/
+/*{{{  void sfree_node (void *ptr, const size_t bytes)*/
+/*
+ *	frees memory allocated with smalloc_node()
+ */
+void sfree_node (void *ptr, const size_t bytes)
+{
+	if (!ptr) {
+		slick_fatal ("attempt to free NULL pointer");
+	}
+	munmap (ptr, bytes);
+}
+/*}}}*/
+/*{{{  void sprefault (void *ptr, const size_t bytes)*/
+/*
+ *	faults in (for writing) the pages covering a region of memory, leaving the contents alone: by
+ *	asking the kernel to populate them where it can, otherwise by touching each page
+ */
+void sprefault (void *ptr, const size_t bytes)
+{
+	uintptr_t pgsize = (uintptr_t)sysconf (_SC_PAGESIZE);
+	uintptr_t start = (uintptr_t)ptr & ~(pgsize - 1);
+	uintptr_t end = ((uintptr_t)ptr + bytes + (pgsize - 1)) & ~(pgsize - 1);
+	uintptr_t addr;
+
+	if (!bytes || !madvise ((void *)start, end - start, MADV_POPULATE_WRITE)) {
+		return;
+	}
+	for (addr = (uintptr_t)ptr; addr < ((uintptr_t)ptr + bytes); addr = (addr & ~(pgsize - 1)) + pgsize) {
+		/* an atomic add of nothing: writes the page without racing anyone else writing to it */
+		__sync_fetch_and_add ((volatile uint8_t *)addr, 0);
+	}
+}
+/*}}}*/
 
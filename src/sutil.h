@@ -29,6 +29,12 @@ extern int slick_cmessage (const char *fmt, ...) __attribute__ ((format (printf,
 extern void *smalloc (const size_t bytes);
 extern void sfree (void *ptr);
 
+extern int snode_of_cpu (const int cpu);
+extern int smove_to_node (void *ptr, const size_t bytes, const int node);
+extern void *smalloc_node (const size_t bytes, const int node);
+extern void sfree_node (void *ptr, const size_t bytes);
+extern void sprefault (void *ptr, const size_t bytes);
+
 
 #endif	/* !__SUTIL_H */
 
@@ -0,0 +1,321 @@
+/*
+ *	blocking.c -- wrapper for blocking test program (workers making blocking calls alongside ones that only compute)
+ *	Copyright (C) 2016 Fred Barnes, University of Kent <frmb@kent.ac.uk>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <errno.h>
+
+#include <sched.h>
+#include <pthread.h>
+
+#include "slick.h"
+
+
+#define BL_MAXWORKERS	(16384)
+#define BL_MAXTHREADS	(128)
+#define BL_TOPWS	(48)			/* o_blocking frame, including return-address */
+#define BL_BRWS		(64)			/* each worker's workspace */
+
+#define BL_INPLACE	0			/* blocking calls made on the run-time thread (--rt-offload=0) */
+#define BL_OFFLOAD	1			/* ..or on helper threads */
+
+extern void o_blocking_startup (void);		/* synthetic compiler-generated entry point */
+
+int64_t bl_nworkers = 0;			/* read by the process code */
+
+static const char *bl_modenames[] = {"in-place", "offload"};
+static int bl_mode;
+static int bl_nthreads = 2;
+static int bl_nhelpers = 0;			/* --rt-offload for the offload run (0 = library default) */
+static int64_t bl_chunks = 10;			/* work per worker, in chunks.. */
+static int64_t bl_chunk_us = 200;		/* ..of this long */
+static int64_t bl_block_us = 2000;		/* how long each blocking call takes */
+static uint64_t bl_t0;
+static int bl_resfd = -1;
+
+static int64_t *bl_left;			/* chunks left for each worker */
+static uint64_t *bl_done;			/* when each worker finished */
+static int64_t *bl_calls;			/* blocking calls made by each worker (written by the helper) */
+static int64_t bl_rtthreads[BL_MAXTHREADS];	/* threads (OS thread IDs) that ran workers.. */
+static int64_t bl_callthreads[BL_MAXTHREADS];	/* ..and that made the blocking calls */
+static volatile int64_t bl_sink = 0;
+
+
+/*{{{  static uint64_t bl_time (void)*/
+/*
+ *	current time in nanoseconds
+ */
+static uint64_t bl_time (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+/*}}}*/
+/*{{{  static void bl_seen (int64_t *set)*/
+/*
+ *	adds the calling thread to a set of thread IDs (if there is room)
+ */
+static void bl_seen (int64_t *set)
+{
+	int64_t tid = (int64_t)syscall (SYS_gettid);
+	int i;
+
+	for (i=0; i<BL_MAXTHREADS; i++) {
+		if ((set[i] == tid) || (!set[i] && __sync_bool_compare_and_swap (&set[i], 0, tid))) {
+			break;
+		}
+	}
+}
+/*}}}*/
+/*{{{  int64_t bl_chunk (int64_t idx)*/
+/*
+ *	called by each worker: keeps the CPU busy for one chunk; returns zero when there are no more,
+ *	2 if an odd worker should make a blocking call after it, 1 otherwise
+ */
+__attribute__ ((force_align_arg_pointer)) int64_t bl_chunk (int64_t idx)
+{
+	uint64_t until = bl_time () + (bl_chunk_us * 1000);
+	int64_t sum = 0;
+	int i;
+
+	bl_seen (bl_rtthreads);
+	if (!bl_left[idx]) {
+		bl_done[idx] = bl_time ();
+		return 0;
+	}
+	bl_left[idx]--;
+	while (bl_time () < until) {
+		for (i=0; i<256; i++) {
+			sum += i * idx;
+		}
+	}
+	bl_sink += sum;
+	return (idx & 1) ? 2 : 1;
+}
+/*}}}*/
+/*{{{  void bl_block (void *arg)*/
+/*
+ *	the blocking call (run by os_blocking_call): sleeps, as a read() or fsync() might
+ */
+void bl_block (void *arg)
+{
+	int64_t idx = (int64_t)arg;
+	struct timespec ts = {tv_sec: 0, tv_nsec: bl_block_us * 1000};
+
+	bl_seen (bl_callthreads);
+	nanosleep (&ts, NULL);
+	bl_calls[idx]++;
+}
+/*}}}*/
+/*{{{  void bl_begin (void)*/
+/*
+ *	called by o_blocking before starting the workers
+ */
+void bl_begin (void)
+{
+	bl_t0 = bl_time ();
+}
+/*}}}*/
+/*{{{  void bl_finish (void)*/
+/*
+ *	called by o_blocking when all workers are done: passes results back to the parent, reports and exits
+ */
+__attribute__ ((force_align_arg_pointer, noreturn)) void bl_finish (void)
+{
+	int64_t res[5];
+	int64_t i, j, sum[2] = {0, 0};
+
+	res[0] = (int64_t)(bl_time () - bl_t0);
+	res[3] = 0;
+	for (i=0; i<bl_nworkers; i++) {
+		sum[i & 1] += (int64_t)(bl_done[i] - bl_t0);
+		if (bl_calls[i] != ((i & 1) ? bl_chunks : 0)) {
+			res[3]++;
+		}
+	}
+	res[1] = sum[0] / ((bl_nworkers + 1) >> 1);			/* computing workers' mean finish */
+	res[2] = sum[1] / (bl_nworkers >> 1);				/* blocking workers' */
+	res[4] = 0;							/* run-time threads that made blocking calls */
+	for (i=0; (i<BL_MAXTHREADS) && bl_callthreads[i]; i++) {
+		for (j=0; (j<BL_MAXTHREADS) && bl_rtthreads[j]; j++) {
+			if (bl_callthreads[i] == bl_rtthreads[j]) {
+				res[4]++;
+			}
+		}
+	}
+
+	if (write (bl_resfd, res, sizeof (res)) != sizeof (res)) {
+		fprintf (stderr, "blocking: failed to write result [%s]\n", strerror (errno));
+	}
+	slick_dump_stats ();
+	exit (EXIT_SUCCESS);
+}
+/*}}}*/
+
+/*{{{  static void bl_child (char *prog, int rt_argc, char **rt_argv)*/
+/*
+ *	runs the workers, with blocking calls made in place or on helper threads (in a child process)
+ */
+static void bl_child (char *prog, int rt_argc, char **rt_argv)
+{
+	char **argv = (char **)malloc ((rt_argc + 4) * sizeof (char *));
+	char ntbuf[32], olbuf[32];
+	void *ws, *wstop;
+	int64_t wssize;
+	int64_t i;
+	int j = 1;
+
+	argv[0] = prog;
+	snprintf (ntbuf, sizeof (ntbuf), "--rt-nthreads=%d", bl_nthreads);
+	argv[j++] = ntbuf;
+	if (bl_mode == BL_INPLACE) {
+		argv[j++] = "--rt-offload=0";
+	} else if (bl_nhelpers) {
+		snprintf (olbuf, sizeof (olbuf), "--rt-offload=%d", bl_nhelpers);
+		argv[j++] = olbuf;
+	}
+	for (i=0; i<rt_argc; i++) {
+		argv[j++] = rt_argv[i];
+	}
+	argv[j] = NULL;
+
+	if (slick_init ((const char **)argv, j)) {
+		fprintf (stderr, "blocking: oops, failed to initialise scheduler\n");
+		exit (EXIT_FAILURE);
+	}
+
+	bl_left = (int64_t *)malloc (bl_nworkers * sizeof (int64_t));
+	bl_done = (uint64_t *)calloc (bl_nworkers, sizeof (uint64_t));
+	bl_calls = (int64_t *)calloc (bl_nworkers, sizeof (int64_t));
+	wssize = BL_TOPWS + (BL_BRWS * (bl_nworkers + 1)) + 64;
+	ws = malloc (wssize);
+	if (!bl_left || !bl_done || !bl_calls || !ws) {
+		fprintf (stderr, "blocking: failed to allocate %ld bytes of workspace\n", wssize);
+		exit (EXIT_FAILURE);
+	}
+	for (i=0; i<bl_nworkers; i++) {
+		bl_left[i] = bl_chunks;
+	}
+	wstop = ws + (int)(wssize - sizeof (uint64_t));
+
+	slick_startup (wstop, o_blocking_startup);
+	exit (EXIT_FAILURE);
+}
+/*}}}*/
+
+
+int main (int argc, char **argv)
+{
+	char **rt_argv = (char **)malloc (argc * sizeof (char *));
+	int rt_argc = 0;
+	int modes = 0;
+	int failed = 0;
+	int i;
+
+	for (i=1; i<argc; i++) {
+		if (!strncmp (argv[i], "--rt-", 5)) {
+			if (strncmp (argv[i] + 5, "nthreads", 8) && strncmp (argv[i] + 5, "offload", 7)) {
+				rt_argv[rt_argc++] = argv[i];		/* passed through to each run */
+			}
+		} else if (!strcmp (argv[i], "in-place")) {
+			modes |= (1 << BL_INPLACE);
+		} else if (!strcmp (argv[i], "offload")) {
+			modes |= (1 << BL_OFFLOAD);
+		} else if (!strcmp (argv[i], "-w") && (i < (argc - 1))) {
+			bl_nworkers = atol (argv[++i]);
+		} else if (!strcmp (argv[i], "-t") && (i < (argc - 1))) {
+			bl_nthreads = atoi (argv[++i]);
+		} else if (!strcmp (argv[i], "-h") && (i < (argc - 1))) {
+			bl_nhelpers = atoi (argv[++i]);
+		} else if (!strcmp (argv[i], "-c") && (i < (argc - 1))) {
+			bl_chunks = atol (argv[++i]);
+		} else if (!strcmp (argv[i], "-u") && (i < (argc - 1))) {
+			bl_chunk_us = atol (argv[++i]);
+		} else if (!strcmp (argv[i], "-b") && (i < (argc - 1))) {
+			bl_block_us = atol (argv[++i]);
+		} else {
+			fprintf (stderr, "usage: %s [in-place] [offload] [-w workers] [-t threads] [-h helpers] [-c chunks] [-u us-per-chunk] "
+					"[-b us-per-call] [--rt-...]\n", argv[0]);
+			exit (EXIT_FAILURE);
+		}
+	}
+	if (!modes) {
+		modes = (1 << BL_INPLACE) | (1 << BL_OFFLOAD);
+	}
+	if (!bl_nworkers) {
+		bl_nworkers = 4 * bl_nthreads;
+	}
+	if ((bl_nworkers < 2) || (bl_nworkers > BL_MAXWORKERS) || (bl_nthreads < 1) || (bl_nthreads > BL_MAXTHREADS) || (bl_nhelpers < 0) ||
+			(bl_chunks < 1) || (bl_chunk_us < 1) || (bl_block_us < 1) || (bl_block_us >= 1000000)) {
+		fprintf (stderr, "blocking: expected 2..%d workers, 1..%d threads, at least one chunk of work and calls under a second\n",
+				BL_MAXWORKERS, BL_MAXTHREADS);
+		exit (EXIT_FAILURE);
+	}
+
+	fprintf (stderr, "blocking: %ld workers on %d threads, %ld chunks of %ld us each, odd workers block for %ld us after each\n",
+			bl_nworkers, bl_nthreads, bl_chunks, bl_chunk_us, bl_block_us);
+
+	for (bl_mode = BL_INPLACE; bl_mode <= BL_OFFLOAD; bl_mode++) {
+		int fds[2];
+		int64_t res[5];
+		pid_t pid;
+		int status;
+
+		if (!(modes & (1 << bl_mode))) {
+			continue;
+		}
+		if (pipe (fds) < 0) {
+			fprintf (stderr, "blocking: failed to create pipe [%s]\n", strerror (errno));
+			exit (EXIT_FAILURE);
+		}
+		fflush (stderr);
+
+		pid = fork ();
+		if (pid < 0) {
+			fprintf (stderr, "blocking: failed to fork [%s]\n", strerror (errno));
+			exit (EXIT_FAILURE);
+		} else if (!pid) {
+			close (fds[0]);
+			bl_resfd = fds[1];
+			bl_child (argv[0], rt_argc, rt_argv);
+		}
+		close (fds[1]);
+
+		if (read (fds[0], res, sizeof (res)) != sizeof (res)) {
+			fprintf (stderr, "blocking: %s run failed\n", bl_modenames[bl_mode]);
+			exit (EXIT_FAILURE);
+		}
+		close (fds[0]);
+		waitpid (pid, &status, 0);
+
+		printf ("%-8s: %10.3f ms, mean finish computing %10.3f ms, blocking %10.3f ms%s\n", bl_modenames[bl_mode],
+				(double)res[0] / 1000000.0, (double)res[1] / 1000000.0, (double)res[2] / 1000000.0, res[3] ? " (WRONG)" : "");
+		fflush (stdout);
+
+		if (res[3]) {
+			fprintf (stderr, "blocking: %ld workers made the wrong number of blocking calls\n", res[3]);
+			failed++;
+		}
+		if ((bl_mode == BL_OFFLOAD) && res[4]) {
+			fprintf (stderr, "blocking: blocking calls were made on %ld run-time thread(s) when offloading\n", res[4]);
+			failed++;
+		}
+	}
+
+	if (failed) {
+		exit (EXIT_FAILURE);
+	}
+	return 0;
+}
+
@@ -0,0 +1,274 @@
+/*
+ *	burst.c -- wrapper for spawn-burst test program (one process starts many CPU-bound workers at once)
+ *	Copyright (C) 2016 Fred Barnes, University of Kent <frmb@kent.ac.uk>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <errno.h>
+
+#include <sched.h>
+#include <pthread.h>
+
+#include "slick.h"
+
+
+#define BU_MAXWORKERS	(65536)
+#define BU_TOPWS	(48)			/* o_burst frame, including return-address */
+#define BU_BRWS		(64)			/* each worker's workspace */
+
+#define BU_PULL		0			/* work only moves by being stolen (--rt-shed=0) */
+#define BU_PUSH		1			/* overloaded schedulers push work away */
+
+extern void o_burst_startup (void);		/* synthetic compiler-generated entry point */
+
+int64_t bu_nworkers = 0;			/* read by the process code */
+
+static const char *bu_modenames[] = {"pull", "push"};
+static int bu_mode;
+static int64_t bu_work_us = 200;
+static uint64_t bu_t0;
+static int bu_resfd = -1;
+static int64_t *bu_started;			/* start time of each worker, relative to bu_t0 */
+static int64_t *bu_thread;			/* run-time thread (OS thread ID) each worker ran on */
+static volatile int64_t bu_sink = 0;
+
+
+/*{{{  static uint64_t bu_time (void)*/
+/*
+ *	current time in nanoseconds
+ */
+static uint64_t bu_time (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+/*}}}*/
+/*{{{  void bu_work (int64_t idx)*/
+/*
+ *	called by each worker process: notes when it started, then keeps the CPU busy for a while
+ */
+__attribute__ ((force_align_arg_pointer)) void bu_work (int64_t idx)
+{
+	uint64_t now = bu_time ();
+	uint64_t until = now + (bu_work_us * 1000);
+	int64_t sum = 0;
+	int i;
+
+	bu_started[idx] = (int64_t)(now - bu_t0);
+	bu_thread[idx] = (int64_t)syscall (SYS_gettid);
+	while (bu_time () < until) {
+		for (i=0; i<256; i++) {
+			sum += i * idx;
+		}
+	}
+	bu_sink += sum;
+}
+/*}}}*/
+/*{{{  void bu_begin (void)*/
+/*
+ *	called by o_burst before starting the workers
+ */
+void bu_begin (void)
+{
+	bu_t0 = bu_time ();
+}
+/*}}}*/
+/*{{{  static int bu_cmp (const void *a, const void *b)*/
+/*
+ *	compares start times (for qsort)
+ */
+static int bu_cmp (const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *)a;
+	int64_t y = *(const int64_t *)b;
+
+	return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+/*}}}*/
+/*{{{  void bu_finish (void)*/
+/*
+ *	called by o_burst when all workers are done: passes results back to the parent, reports and exits
+ */
+__attribute__ ((force_align_arg_pointer, noreturn)) void bu_finish (void)
+{
+	int64_t res[6];
+	int64_t sum = 0;
+	int64_t i;
+
+	res[0] = (int64_t)(bu_time () - bu_t0);
+
+	/* workers that never ran, and how many run-time threads the rest were spread over */
+	res[4] = 0;
+	res[5] = 0;
+	qsort (bu_thread, bu_nworkers, sizeof (int64_t), bu_cmp);
+	for (i=0; i<bu_nworkers; i++) {
+		if (bu_thread[i] < 0) {
+			res[4]++;
+		} else if (!res[5] || (bu_thread[i] != bu_thread[i - 1])) {
+			res[5]++;
+		}
+	}
+
+	qsort (bu_started, bu_nworkers, sizeof (int64_t), bu_cmp);
+	for (i=0; i<bu_nworkers; i++) {
+		sum += bu_started[i];
+	}
+	res[1] = sum / bu_nworkers;				/* mean start delay */
+	res[2] = bu_started[bu_nworkers / 2];			/* half the workers going */
+	res[3] = bu_started[bu_nworkers - 1];			/* all of them going */
+
+	if (write (bu_resfd, res, sizeof (res)) != sizeof (res)) {
+		fprintf (stderr, "burst: failed to write result [%s]\n", strerror (errno));
+	}
+	slick_dump_stats ();
+	exit (EXIT_SUCCESS);
+}
+/*}}}*/
+
+/*{{{  static void bu_child (char *prog, int rt_argc, char **rt_argv)*/
+/*
+ *	runs the burst with a particular balancing mode (in a child process)
+ */
+static void bu_child (char *prog, int rt_argc, char **rt_argv)
+{
+	char **argv = (char **)malloc ((rt_argc + 3) * sizeof (char *));
+	void *ws, *wstop;
+	int64_t wssize;
+	int i, j = 1;
+
+	argv[0] = prog;
+	if (bu_mode == BU_PULL) {
+		argv[j++] = "--rt-shed=0";
+	}
+	for (i=0; i<rt_argc; i++) {
+		argv[j++] = rt_argv[i];
+	}
+	argv[j] = NULL;
+
+	if (slick_init ((const char **)argv, j)) {
+		fprintf (stderr, "burst: oops, failed to initialise scheduler\n");
+		exit (EXIT_FAILURE);
+	}
+
+	bu_started = (int64_t *)malloc (bu_nworkers * sizeof (int64_t));
+	bu_thread = (int64_t *)malloc (bu_nworkers * sizeof (int64_t));
+	wssize = BU_TOPWS + (BU_BRWS * (bu_nworkers + 1)) + 64;
+	ws = malloc (wssize);
+	if (!bu_started || !bu_thread || !ws) {
+		fprintf (stderr, "burst: failed to allocate %ld bytes of workspace\n", wssize);
+		exit (EXIT_FAILURE);
+	}
+	for (i=0; i<bu_nworkers; i++) {
+		bu_thread[i] = -1;
+	}
+	wstop = ws + (int)(wssize - sizeof (uint64_t));
+
+	slick_startup (wstop, o_burst_startup);
+	exit (EXIT_FAILURE);
+}
+/*}}}*/
+
+
+int main (int argc, char **argv)
+{
+	char **rt_argv = (char **)malloc (argc * sizeof (char *));
+	int rt_argc = 0;
+	int modes = 0;
+	int ncpus = (int)sysconf (_SC_NPROCESSORS_ONLN);
+	int failed = 0;
+	int i;
+
+	for (i=1; i<argc; i++) {
+		if (!strncmp (argv[i], "--rt-", 5)) {
+			rt_argv[rt_argc++] = argv[i];			/* passed through to each run */
+		} else if (!strcmp (argv[i], "pull")) {
+			modes |= (1 << BU_PULL);
+		} else if (!strcmp (argv[i], "push")) {
+			modes |= (1 << BU_PUSH);
+		} else if (!strcmp (argv[i], "-w") && (i < (argc - 1))) {
+			bu_nworkers = atol (argv[++i]);
+		} else if (!strcmp (argv[i], "-u") && (i < (argc - 1))) {
+			bu_work_us = atol (argv[++i]);
+		} else {
+			fprintf (stderr, "usage: %s [pull] [push] [-w workers] [-u work-us-per-worker] [--rt-...]\n", argv[0]);
+			exit (EXIT_FAILURE);
+		}
+	}
+	if (!modes) {
+		modes = (1 << BU_PULL) | (1 << BU_PUSH);
+	}
+	if (!bu_nworkers) {
+		bu_nworkers = 64 * (int64_t)ncpus;
+	}
+	if ((bu_nworkers < 1) || (bu_nworkers > BU_MAXWORKERS) || (bu_work_us < 0)) {
+		fprintf (stderr, "burst: expected 1..%d workers and a non-negative amount of work\n", BU_MAXWORKERS);
+		exit (EXIT_FAILURE);
+	}
+
+	fprintf (stderr, "burst: %ld workers, %ld us each\n", bu_nworkers, bu_work_us);
+
+	for (bu_mode = BU_PULL; bu_mode <= BU_PUSH; bu_mode++) {
+		int fds[2];
+		int64_t res[6];
+		pid_t pid;
+		int status;
+
+		if (!(modes & (1 << bu_mode))) {
+			continue;
+		}
+		if (pipe (fds) < 0) {
+			fprintf (stderr, "burst: failed to create pipe [%s]\n", strerror (errno));
+			exit (EXIT_FAILURE);
+		}
+		fflush (stderr);
+
+		pid = fork ();
+		if (pid < 0) {
+			fprintf (stderr, "burst: failed to fork [%s]\n", strerror (errno));
+			exit (EXIT_FAILURE);
+		} else if (!pid) {
+			close (fds[0]);
+			bu_resfd = fds[1];
+			bu_child (argv[0], rt_argc, rt_argv);
+		}
+		close (fds[1]);
+
+		if (read (fds[0], res, sizeof (res)) != sizeof (res)) {
+			fprintf (stderr, "burst: %s run failed\n", bu_modenames[bu_mode]);
+			exit (EXIT_FAILURE);
+		}
+		close (fds[0]);
+		waitpid (pid, &status, 0);
+
+		printf ("%-4s: %10.3f ms, workers started: mean %10.3f ms, half by %10.3f ms, all by %10.3f ms\n",
+				bu_modenames[bu_mode], (double)res[0] / 1000000.0, (double)res[1] / 1000000.0,
+				(double)res[2] / 1000000.0, (double)res[3] / 1000000.0);
+		fflush (stdout);
+
+		if (res[4]) {
+			fprintf (stderr, "burst: %s run lost %ld of %ld workers\n", bu_modenames[bu_mode], res[4], bu_nworkers);
+			failed++;
+		}
+		if ((ncpus > 1) && !rt_argc && (bu_nworkers > 1) && (res[5] < 2)) {
+			/* a run-time thread per CPU by default: the burst should not all stay where it started */
+			fprintf (stderr, "burst: %s run left all workers on one run-time thread\n", bu_modenames[bu_mode]);
+			failed++;
+		}
+	}
+
+	if (failed) {
+		exit (EXIT_FAILURE);
+	}
+	return 0;
+}
+
@@ -0,0 +1,285 @@
+/*
+ *	deadline.c -- wrapper for deadline test program (jobs with deadlines amongst CPU-bound background work)
+ *	Copyright (C) 2016 Fred Barnes, University of Kent <frmb@kent.ac.uk>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <errno.h>
+
+#include <sched.h>
+#include <pthread.h>
+
+#include "slick.h"
+
+
+#define DL_MAXBRANCHES	(65536)
+#define DL_TOPWS	(48)			/* o_deadline frame, including return-address */
+#define DL_BRWS		(64)			/* each branch's workspace */
+
+#define DL_FIFO		0			/* jobs take their turn with the background work */
+#define DL_EDF		1			/* jobs run earliest-deadline-first (os_setdeadline) */
+
+extern void o_deadline_startup (void);		/* synthetic compiler-generated entry point */
+
+int64_t dl_nbranches = 0;			/* jobs + background workers, read by the process code */
+
+static const char *dl_modenames[] = {"fifo", "edf"};
+static int dl_mode;
+static int64_t dl_nbackground = 8;
+static int64_t dl_njobs = 8;
+static int64_t dl_chunks = 20;			/* work per process, in chunks.. */
+static int64_t dl_chunk_us = 100;		/* ..of this long */
+static int64_t dl_spacing_us = 0;		/* between successive jobs' deadlines */
+static uint64_t dl_t0;
+static int dl_resfd = -1;
+
+static int64_t *dl_left;			/* chunks left for each process */
+static uint64_t *dl_deadline;			/* each job's deadline (absolute) */
+static uint64_t *dl_done;			/* when each process finished */
+static volatile int64_t dl_sink = 0;
+
+
+/*{{{  static uint64_t dl_time (void)*/
+/*
+ *	current time in nanoseconds
+ */
+static uint64_t dl_time (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+/*}}}*/
+/*{{{  uint64_t dl_setup (int64_t idx)*/
+/*
+ *	called by each process before it starts: returns the deadline to run to, or zero for none
+ */
+uint64_t dl_setup (int64_t idx)
+{
+	if ((dl_mode == DL_EDF) && (idx < dl_njobs)) {
+		return dl_deadline[idx];
+	}
+	return 0;
+}
+/*}}}*/
+/*{{{  int64_t dl_chunk (int64_t idx)*/
+/*
+ *	called by each process: keeps the CPU busy for one chunk, returns zero when there are no more
+ */
+__attribute__ ((force_align_arg_pointer)) int64_t dl_chunk (int64_t idx)
+{
+	uint64_t until = dl_time () + (dl_chunk_us * 1000);
+	int64_t sum = 0;
+	int i;
+
+	if (!dl_left[idx]) {
+		dl_done[idx] = dl_time ();
+		return 0;
+	}
+	dl_left[idx]--;
+	while (dl_time () < until) {
+		for (i=0; i<256; i++) {
+			sum += i * idx;
+		}
+	}
+	dl_sink += sum;
+	return 1;
+}
+/*}}}*/
+/*{{{  void dl_begin (void)*/
+/*
+ *	called by o_deadline before starting the processes: job i's deadline is (i + 1) spacings from now
+ */
+void dl_begin (void)
+{
+	int64_t i;
+
+	dl_t0 = dl_time ();
+	for (i=0; i<dl_njobs; i++) {
+		dl_deadline[i] = dl_t0 + ((i + 1) * dl_spacing_us * 1000);
+	}
+}
+/*}}}*/
+/*{{{  void dl_finish (void)*/
+/*
+ *	called by o_deadline when all are done: passes results back to the parent, reports and exits
+ */
+__attribute__ ((force_align_arg_pointer, noreturn)) void dl_finish (void)
+{
+	int64_t res[4];
+	int64_t i;
+
+	res[0] = (int64_t)(dl_time () - dl_t0);
+	res[1] = 0;				/* late jobs */
+	res[2] = 0;				/* latest by */
+	res[3] = 0;				/* last background worker done */
+	for (i=0; i<dl_nbranches; i++) {
+		int64_t done = (int64_t)(dl_done[i] - dl_t0);
+
+		if (i >= dl_njobs) {
+			if (done > res[3]) {
+				res[3] = done;
+			}
+		} else if (dl_done[i] > dl_deadline[i]) {
+			res[1]++;
+			if ((int64_t)(dl_done[i] - dl_deadline[i]) > res[2]) {
+				res[2] = (int64_t)(dl_done[i] - dl_deadline[i]);
+			}
+		}
+	}
+
+	if (write (dl_resfd, res, sizeof (res)) != sizeof (res)) {
+		fprintf (stderr, "deadline: failed to write result [%s]\n", strerror (errno));
+	}
+	slick_dump_stats ();
+	exit (EXIT_SUCCESS);
+}
+/*}}}*/
+
+/*{{{  static void dl_child (char *prog, int rt_argc, char **rt_argv)*/
+/*
+ *	runs the background work and jobs with or without deadlines (in a child process)
+ */
+static void dl_child (char *prog, int rt_argc, char **rt_argv)
+{
+	char **argv = (char **)malloc ((rt_argc + 2) * sizeof (char *));
+	void *ws, *wstop;
+	int64_t wssize;
+	int64_t i;
+	int j = 1;
+
+	argv[0] = prog;
+	for (i=0; i<rt_argc; i++) {
+		argv[j++] = rt_argv[i];
+	}
+	argv[j] = NULL;
+
+	if (slick_init ((const char **)argv, j)) {
+		fprintf (stderr, "deadline: oops, failed to initialise scheduler\n");
+		exit (EXIT_FAILURE);
+	}
+
+	dl_left = (int64_t *)malloc (dl_nbranches * sizeof (int64_t));
+	dl_deadline = (uint64_t *)calloc (dl_nbranches, sizeof (uint64_t));
+	dl_done = (uint64_t *)calloc (dl_nbranches, sizeof (uint64_t));
+	wssize = DL_TOPWS + (DL_BRWS * (dl_nbranches + 1)) + 64;
+	ws = malloc (wssize);
+	if (!dl_left || !dl_deadline || !dl_done || !ws) {
+		fprintf (stderr, "deadline: failed to allocate %ld bytes of workspace\n", wssize);
+		exit (EXIT_FAILURE);
+	}
+	for (i=0; i<dl_nbranches; i++) {
+		dl_left[i] = dl_chunks;
+	}
+	wstop = ws + (int)(wssize - sizeof (uint64_t));
+
+	slick_startup (wstop, o_deadline_startup);
+	exit (EXIT_FAILURE);
+}
+/*}}}*/
+
+
+int main (int argc, char **argv)
+{
+	char **rt_argv = (char **)malloc (argc * sizeof (char *));
+	int rt_argc = 0;
+	int modes = 0;
+	int failed = 0;
+	int i;
+
+	for (i=1; i<argc; i++) {
+		if (!strncmp (argv[i], "--rt-", 5)) {
+			rt_argv[rt_argc++] = argv[i];			/* passed through to each run */
+		} else if (!strcmp (argv[i], "fifo")) {
+			modes |= (1 << DL_FIFO);
+		} else if (!strcmp (argv[i], "edf")) {
+			modes |= (1 << DL_EDF);
+		} else if (!strcmp (argv[i], "-b") && (i < (argc - 1))) {
+			dl_nbackground = atol (argv[++i]);
+		} else if (!strcmp (argv[i], "-j") && (i < (argc - 1))) {
+			dl_njobs = atol (argv[++i]);
+		} else if (!strcmp (argv[i], "-c") && (i < (argc - 1))) {
+			dl_chunks = atol (argv[++i]);
+		} else if (!strcmp (argv[i], "-u") && (i < (argc - 1))) {
+			dl_chunk_us = atol (argv[++i]);
+		} else if (!strcmp (argv[i], "-s") && (i < (argc - 1))) {
+			dl_spacing_us = atol (argv[++i]);
+		} else {
+			fprintf (stderr, "usage: %s [fifo] [edf] [-b background] [-j jobs] [-c chunks] [-u us-per-chunk] [-s deadline-spacing-us] [--rt-...]\n", argv[0]);
+			exit (EXIT_FAILURE);
+		}
+	}
+	if (!modes) {
+		modes = (1 << DL_FIFO) | (1 << DL_EDF);
+	}
+	if (!dl_spacing_us) {
+		/* a job's worth of work and a half: enough for jobs run one after another on one thread */
+		dl_spacing_us = (3 * dl_chunks * dl_chunk_us) / 2;
+	}
+	dl_nbranches = dl_nbackground + dl_njobs;
+	if ((dl_nbackground < 0) || (dl_njobs < 1) || (dl_nbranches > DL_MAXBRANCHES) || (dl_chunks < 1) || (dl_chunk_us < 1) || (dl_spacing_us < 1)) {
+		fprintf (stderr, "deadline: expected at least one job (%d processes in all), a chunk of work and a positive deadline spacing\n", DL_MAXBRANCHES);
+		exit (EXIT_FAILURE);
+	}
+
+	fprintf (stderr, "deadline: %ld background, %ld jobs, %ld chunks of %ld us each, deadlines %ld us apart\n", dl_nbackground, dl_njobs,
+			dl_chunks, dl_chunk_us, dl_spacing_us);
+
+	for (dl_mode = DL_FIFO; dl_mode <= DL_EDF; dl_mode++) {
+		int fds[2];
+		int64_t res[4];
+		pid_t pid;
+		int status;
+
+		if (!(modes & (1 << dl_mode))) {
+			continue;
+		}
+		if (pipe (fds) < 0) {
+			fprintf (stderr, "deadline: failed to create pipe [%s]\n", strerror (errno));
+			exit (EXIT_FAILURE);
+		}
+		fflush (stderr);
+
+		pid = fork ();
+		if (pid < 0) {
+			fprintf (stderr, "deadline: failed to fork [%s]\n", strerror (errno));
+			exit (EXIT_FAILURE);
+		} else if (!pid) {
+			close (fds[0]);
+			dl_resfd = fds[1];
+			dl_child (argv[0], rt_argc, rt_argv);
+		}
+		close (fds[1]);
+
+		if (read (fds[0], res, sizeof (res)) != sizeof (res)) {
+			fprintf (stderr, "deadline: %s run failed\n", dl_modenames[dl_mode]);
+			exit (EXIT_FAILURE);
+		}
+		close (fds[0]);
+		waitpid (pid, &status, 0);
+
+		printf ("%-4s: %10.3f ms, %ld of %ld jobs late (by at most %10.3f ms), background done by %10.3f ms\n", dl_modenames[dl_mode],
+				(double)res[0] / 1000000.0, res[1], dl_njobs, (double)res[2] / 1000000.0, (double)res[3] / 1000000.0);
+		fflush (stdout);
+
+		/* deadlines are spaced for the jobs to run one after another, so EDF should meet every one */
+		if ((dl_mode == DL_EDF) && res[1]) {
+			fprintf (stderr, "deadline: %ld of %ld jobs missed their deadline under EDF\n", res[1], dl_njobs);
+			failed++;
+		}
+	}
+
+	if (failed) {
+		exit (EXIT_FAILURE);
+	}
+	return 0;
+}
+
@@ -0,0 +1,272 @@
+/*
+ *	embed.c -- wrapper for embed test program (start-up and shut-down of a short-lived application, each way a host can run it)
+ *	Copyright (C) 2016 Fred Barnes, University of Kent <frmb@kent.ac.uk>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <errno.h>
+
+#include <sched.h>
+#include <pthread.h>
+
+#include "slick.h"
+
+
+#define EM_MAXBRANCHES	(4096)
+#define EM_TOPWS	(48)			/* o_embed frame, including return-address */
+#define EM_BRWS		(64)			/* each branch's workspace */
+
+#define EM_STARTUP	0			/* slick_startup(), as ever.. */
+#define EM_ASYNC	1			/* ..slick_start_async() then slick_wait().. */
+#define EM_CURRENT	2			/* ..or slick_run_on_current_thread() then slick_wait() */
+#define EM_NMODES	3
+
+extern void o_embed_startup (void);		/* synthetic compiler-generated entry point */
+
+int64_t em_nbranches = 16;			/* read by the process code */
+
+static const char *em_modenames[] = {"startup", "async", "current"};
+static int em_nthreads = 4;
+static int em_runs = 20;
+static int64_t em_rounds = 100;			/* work each branch does */
+static int64_t *em_left;			/* and has left to do */
+static uint64_t em_tbegin;			/* when the application started running.. */
+static uint64_t em_tdone;			/* ..and finished */
+static pthread_t em_caller;			/* thread that started it */
+static int64_t em_oncaller = 0;			/* rounds of work done on that thread */
+
+
+/*{{{  static uint64_t em_time (void)*/
+/*
+ *	current time in nanoseconds
+ */
+static uint64_t em_time (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+/*}}}*/
+/*{{{  void em_begin (void)*/
+/*
+ *	called by o_embed as it starts
+ */
+void em_begin (void)
+{
+	em_tbegin = em_time ();
+}
+/*}}}*/
+/*{{{  int64_t em_work (int64_t idx)*/
+/*
+ *	called by each branch for each round: returns non-zero if more to do
+ */
+int64_t em_work (int64_t idx)
+{
+	if (pthread_equal (pthread_self (), em_caller)) {
+		__sync_fetch_and_add (&em_oncaller, 1);
+	}
+	return (--em_left[idx] > 0);
+}
+/*}}}*/
+/*{{{  void em_done (void)*/
+/*
+ *	called by o_embed when all branches are done, just before it returns
+ */
+void em_done (void)
+{
+	em_tdone = em_time ();
+}
+/*}}}*/
+
+/*{{{  static void em_child (char *prog, int mode, int fd)*/
+/*
+ *	runs the application once (in a child process) and passes timings back to the parent: from the start
+ *	call to the application running, from its finishing to the start call returning (or slick_wait()), and
+ *	overall (including slick_init()); then whether anything went wrong, and how much work the calling
+ *	thread did
+ */
+static void em_child (char *prog, int mode, int fd)
+{
+	char ntbuf[32];
+	const char *argv[3] = {prog, ntbuf, NULL};
+	void *ws, *wstop;
+	int64_t wssize;
+	int64_t res[5];
+	uint64_t t0, tstart, tback;
+	int64_t i;
+
+	t0 = em_time ();
+	snprintf (ntbuf, sizeof (ntbuf), "--rt-nthreads=%d", em_nthreads);
+	if (slick_init (argv, 2)) {
+		fprintf (stderr, "embed: oops, failed to initialise scheduler\n");
+		exit (EXIT_FAILURE);
+	}
+
+	em_left = (int64_t *)malloc (em_nbranches * sizeof (int64_t));
+	wssize = EM_TOPWS + (EM_BRWS * (em_nbranches + 1)) + 64;
+	ws = malloc (wssize);
+	if (!em_left || !ws) {
+		fprintf (stderr, "embed: failed to allocate %ld bytes of workspace\n", wssize);
+		exit (EXIT_FAILURE);
+	}
+	for (i=0; i<em_nbranches; i++) {
+		em_left[i] = em_rounds;
+	}
+	wstop = ws + (int)(wssize - sizeof (uint64_t));
+
+	em_caller = pthread_self ();
+	tstart = em_time ();
+	switch (mode) {
+	case EM_STARTUP:
+		slick_startup (wstop, o_embed_startup);
+		break;
+	case EM_ASYNC:
+		slick_start_async (wstop, o_embed_startup);
+		slick_wait ();
+		break;
+	case EM_CURRENT:
+		slick_run_on_current_thread (wstop, o_embed_startup);
+		slick_wait ();
+		break;
+	}
+	tback = em_time ();
+
+	res[0] = (int64_t)(em_tbegin - tstart);
+	res[1] = (int64_t)(tback - em_tdone);
+	res[2] = (int64_t)(tback - t0);
+	res[3] = 0;
+	for (i=0; i<em_nbranches; i++) {
+		res[3] += (em_left[i] != 0);		/* work not done */
+	}
+	if (!em_tbegin || !em_tdone) {
+		res[3]++;
+	}
+	res[4] = em_oncaller;
+
+	if (write (fd, res, sizeof (res)) != sizeof (res)) {
+		fprintf (stderr, "embed: failed to write result [%s]\n", strerror (errno));
+	}
+	exit (EXIT_SUCCESS);
+}
+/*}}}*/
+
+
+int main (int argc, char **argv)
+{
+	int modes = 0;
+	int failed = 0;
+	int mode, i;
+
+	for (i=1; i<argc; i++) {
+		if (!strcmp (argv[i], "startup")) {
+			modes |= (1 << EM_STARTUP);
+		} else if (!strcmp (argv[i], "async")) {
+			modes |= (1 << EM_ASYNC);
+		} else if (!strcmp (argv[i], "current")) {
+			modes |= (1 << EM_CURRENT);
+		} else if (!strcmp (argv[i], "-r") && (i < (argc - 1))) {
+			em_runs = atoi (argv[++i]);
+		} else if (!strcmp (argv[i], "-t") && (i < (argc - 1))) {
+			em_nthreads = atoi (argv[++i]);
+		} else if (!strcmp (argv[i], "-b") && (i < (argc - 1))) {
+			em_nbranches = atol (argv[++i]);
+		} else if (!strcmp (argv[i], "-n") && (i < (argc - 1))) {
+			em_rounds = atol (argv[++i]);
+		} else {
+			fprintf (stderr, "usage: %s [startup] [async] [current] [-r runs] [-t threads] [-b branches] [-n rounds]\n", argv[0]);
+			exit (EXIT_FAILURE);
+		}
+	}
+	if (!modes) {
+		modes = (1 << EM_STARTUP) | (1 << EM_ASYNC) | (1 << EM_CURRENT);
+	}
+	if ((em_runs < 1) || (em_nthreads < 1) || (em_nbranches < 1) || (em_nbranches > EM_MAXBRANCHES) || (em_rounds < 1)) {
+		fprintf (stderr, "embed: expected at least 1 run, thread and round, and 1..%d branches\n", EM_MAXBRANCHES);
+		exit (EXIT_FAILURE);
+	}
+
+	fprintf (stderr, "embed: %d runs of %ld branches doing %ld rounds each, on %d threads\n", em_runs, em_nbranches, em_rounds, em_nthreads);
+
+	for (mode=0; mode<EM_NMODES; mode++) {
+		int64_t sum[3] = {0, 0, 0};
+		int64_t max[3] = {0, 0, 0};
+		int64_t wrong = 0;
+		int misplaced = 0;
+		int r, j;
+
+		if (!(modes & (1 << mode))) {
+			continue;
+		}
+		for (r=0; r<em_runs; r++) {
+			int64_t res[5];
+			int fds[2];
+			pid_t pid;
+			int status;
+
+			fflush (stderr);
+			if (pipe (fds) < 0) {
+				fprintf (stderr, "embed: failed to create pipe [%s]\n", strerror (errno));
+				exit (EXIT_FAILURE);
+			}
+			pid = fork ();
+			if (pid < 0) {
+				fprintf (stderr, "embed: failed to fork [%s]\n", strerror (errno));
+				exit (EXIT_FAILURE);
+			} else if (!pid) {
+				close (fds[0]);
+				em_child (argv[0], mode, fds[1]);
+			}
+			close (fds[1]);
+			if (read (fds[0], res, sizeof (res)) != sizeof (res)) {
+				waitpid (pid, &status, 0);
+				fprintf (stderr, "embed: %s run failed (%s %d)\n", em_modenames[mode], WIFSIGNALED (status) ? "signal" : "exit status",
+						WIFSIGNALED (status) ? WTERMSIG (status) : WEXITSTATUS (status));
+				exit (EXIT_FAILURE);
+			}
+			close (fds[0]);
+			waitpid (pid, &status, 0);
+
+			for (j=0; j<3; j++) {
+				sum[j] += res[j];
+				if (res[j] > max[j]) {
+					max[j] = res[j];
+				}
+			}
+			wrong += res[3];
+
+			/* the calling thread is a run-time thread only with slick_run_on_current_thread(), else waits */
+			if ((mode == EM_CURRENT) != (res[4] > 0)) {
+				misplaced++;
+			}
+		}
+
+		printf ("%-8s: start %8.1f us (max %8.1f), shut down %8.1f us (max %8.1f), overall %8.1f us (max %8.1f)%s\n", em_modenames[mode],
+				(double)sum[0] / em_runs / 1000.0, (double)max[0] / 1000.0, (double)sum[1] / em_runs / 1000.0, (double)max[1] / 1000.0,
+				(double)sum[2] / em_runs / 1000.0, (double)max[2] / 1000.0, wrong ? " (WRONG)" : "");
+		fflush (stdout);
+
+		if (wrong) {
+			fprintf (stderr, "embed: %s runs left work undone %ld time(s)\n", em_modenames[mode], wrong);
+			failed++;
+		}
+		if (misplaced) {
+			fprintf (stderr, "embed: %d of %d %s runs %s on the calling thread\n", misplaced, em_runs, em_modenames[mode],
+					(mode == EM_CURRENT) ? "did no work" : "did work");
+			failed++;
+		}
+	}
+
+	if (failed) {
+		exit (EXIT_FAILURE);
+	}
+	return 0;
+}
+
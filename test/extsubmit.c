@@ -0,0 +1,258 @@
+/*
+ *	extsubmit.c -- wrapper for extsubmit test program (host threads outside the run-time starting processes and talking to them)
+ *	Copyright (C) 2016 Fred Barnes, University of Kent <frmb@kent.ac.uk>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+
+#include <sched.h>
+#include <pthread.h>
+
+#include "slick.h"
+
+
+#define ES_MAXHOSTS	(64)
+#define ES_TOPWS	(48)			/* o_extsubmit frame, including return-address */
+#define ES_BRWS		(80)			/* each server's workspace */
+#define ES_PROCWS	(64)			/* each started process's workspace (just the slots below Wptr) */
+#define ES_PRIOFINITY	(16)			/* run-time default priofinity (priority 16, no affinity) */
+
+extern void o_extsubmit_startup (void);		/* synthetic compiler-generated entry point */
+extern void o_extsubmit_proc (void);		/* what the host threads start */
+
+int64_t es_nhosts = 4;				/* read by the process code */
+void **es_chans;				/* channel from each host thread to its server.. */
+int64_t *es_inbox;				/* ..and where that puts each message */
+
+static int es_nthreads = 2;
+static int64_t es_count = 100000;		/* messages each host thread sends, and processes it starts */
+static volatile int es_started = 0;		/* set once the run-time is going */
+static int64_t *es_expect;			/* next message each server should get */
+static uint8_t *es_procws;			/* workspace for every process started */
+static uint64_t *es_submitted;			/* when each was submitted */
+static int64_t es_nran = 0;			/* how many have run.. */
+static int64_t es_sumlat = 0;			/* ..and the time from submitting each to its running */
+static int64_t es_maxlat = 0;
+static int64_t es_wrong = 0;			/* messages out of order */
+static volatile int es_served = 0;		/* set when all servers are done */
+static int es_hostsdone = 0;
+static uint64_t es_t0;
+static uint64_t es_chanout_ns = 0;		/* total time host threads spent in slick_external_chanout() */
+
+
+/*{{{  static uint64_t es_time (void)*/
+/*
+ *	current time in nanoseconds
+ */
+static uint64_t es_time (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+/*}}}*/
+/*{{{  void es_begin (void)*/
+/*
+ *	called by o_extsubmit before starting the servers: lets the host threads go
+ */
+void es_begin (void)
+{
+	es_t0 = es_time ();
+	__sync_synchronize ();
+	es_started = 1;
+}
+/*}}}*/
+/*{{{  int64_t es_got (int64_t idx)*/
+/*
+ *	called by a server for each message: checks it, returning non-zero if more to come
+ */
+int64_t es_got (int64_t idx)
+{
+	if (es_inbox[idx] != es_expect[idx]) {
+		__sync_fetch_and_add (&es_wrong, 1);
+	}
+	es_expect[idx]++;
+	return (es_expect[idx] <= es_count);
+}
+/*}}}*/
+/*{{{  void es_servers_done (void)*/
+/*
+ *	called by o_extsubmit when all servers are done
+ */
+void es_servers_done (void)
+{
+	__sync_synchronize ();
+	es_served = 1;
+}
+/*}}}*/
+/*{{{  void es_ran (void *w)*/
+/*
+ *	called by each process a host thread started, on a run-time thread
+ */
+__attribute__ ((force_align_arg_pointer)) void es_ran (void *w)
+{
+	int64_t idx = ((uint8_t *)w - es_procws) / ES_PROCWS;
+	int64_t lat = (int64_t)(es_time () - es_submitted[idx]);
+	int64_t max;
+
+	__sync_fetch_and_add (&es_sumlat, lat);
+	do {
+		max = es_maxlat;
+	} while ((lat > max) && !__sync_bool_compare_and_swap (&es_maxlat, max, lat));
+	__sync_fetch_and_add (&es_nran, 1);
+}
+/*}}}*/
+/*{{{  static void es_report (void)*/
+/*
+ *	called by the last host thread to finish, once everything it started has run: reports and exits,
+ *	failing if any message arrived out of order or a process ran other than once
+ */
+static void es_report (void)
+{
+	int64_t total = es_nhosts * es_count;
+	struct timespec ts = {tv_sec: 0, tv_nsec: 100000};
+	uint64_t t;
+
+	while (!es_served || (__sync_fetch_and_add (&es_nran, 0) < total)) {
+		nanosleep (&ts, NULL);
+	}
+
+	t = es_time () - es_t0;
+
+	printf ("%ld host threads, %ld processes started and %ld messages sent: %10.3f ms\n", es_nhosts, total, total, (double)t / 1000000.0);
+	printf ("    slick_submit() to running: mean %8.3f us, max %10.3f us\n", (double)es_sumlat / (double)total / 1000.0, (double)es_maxlat / 1000.0);
+	printf ("    slick_external_chanout():  mean %8.3f us%s\n", (double)es_chanout_ns / (double)total / 1000.0, es_wrong ? " (WRONG)" : "");
+	fflush (stdout);
+
+	slick_dump_stats ();
+	if (es_wrong || (es_nran != total)) {
+		fprintf (stderr, "extsubmit: %ld messages out of order, %ld of %ld submitted processes ran\n", es_wrong, es_nran, total);
+		exit (EXIT_FAILURE);
+	}
+	exit (EXIT_SUCCESS);
+}
+/*}}}*/
+/*{{{  static void *es_host (void *arg)*/
+/*
+ *	a host thread (not a run-time thread): starts processes and sends messages to its server
+ */
+static void *es_host (void *arg)
+{
+	int64_t h = (int64_t)arg;
+	struct timespec ts = {tv_sec: 0, tv_nsec: 100000};
+	uint64_t chanout_ns = 0;
+	int64_t m;
+	int last;
+
+	while (!es_started) {
+		nanosleep (&ts, NULL);
+	}
+
+	for (m=0; m<es_count; m++) {
+		int64_t idx = (h * es_count) + m;
+		uint8_t *ws = es_procws + (idx * ES_PROCWS) + (ES_PROCWS - sizeof (uint64_t));
+		int64_t val = m + 1;
+		uint64_t t;
+
+		es_submitted[idx] = es_time ();
+		slick_submit (ws, o_extsubmit_proc, ES_PRIOFINITY);
+
+		t = es_time ();
+		slick_external_chanout (&(es_chans[h]), &val, sizeof (val));
+		chanout_ns += es_time () - t;
+	}
+
+	__sync_fetch_and_add (&es_chanout_ns, chanout_ns);
+	last = (__sync_add_and_fetch (&es_hostsdone, 1) == es_nhosts);
+	if (last) {
+		es_report ();
+	}
+	return NULL;
+}
+/*}}}*/
+
+
+int main (int argc, char **argv)
+{
+	char **rt_argv = (char **)malloc ((argc + 2) * sizeof (char *));
+	int rt_argc = 1;
+	char ntbuf[32];
+	pthread_t *hosts;
+	void *ws, *wstop;
+	int64_t wssize;
+	int64_t i;
+
+	rt_argv[0] = argv[0];
+	for (i=1; i<argc; i++) {
+		if (!strncmp (argv[i], "--rt-", 5)) {
+			if (strncmp (argv[i] + 5, "nthreads", 8)) {
+				rt_argv[rt_argc++] = argv[i];
+			}
+		} else if (!strcmp (argv[i], "-h") && (i < (argc - 1))) {
+			es_nhosts = atol (argv[++i]);
+		} else if (!strcmp (argv[i], "-t") && (i < (argc - 1))) {
+			es_nthreads = atoi (argv[++i]);
+		} else if (!strcmp (argv[i], "-n") && (i < (argc - 1))) {
+			es_count = atol (argv[++i]);
+		} else {
+			fprintf (stderr, "usage: %s [-h host-threads] [-t threads] [-n messages] [--rt-...]\n", argv[0]);
+			exit (EXIT_FAILURE);
+		}
+	}
+	if ((es_nhosts < 1) || (es_nhosts > ES_MAXHOSTS) || (es_nthreads < 1) || (es_count < 1)) {
+		fprintf (stderr, "extsubmit: expected 1..%d host threads, at least 1 run-time thread and message\n", ES_MAXHOSTS);
+		exit (EXIT_FAILURE);
+	}
+	snprintf (ntbuf, sizeof (ntbuf), "--rt-nthreads=%d", es_nthreads);
+	rt_argv[rt_argc++] = ntbuf;
+	rt_argv[rt_argc] = NULL;
+
+	if (slick_init ((const char **)rt_argv, rt_argc)) {
+		fprintf (stderr, "extsubmit: oops, failed to initialise scheduler\n");
+		exit (EXIT_FAILURE);
+	}
+
+	es_chans = (void **)calloc (es_nhosts, sizeof (void *));
+	es_inbox = (int64_t *)calloc (es_nhosts, sizeof (int64_t));
+	es_expect = (int64_t *)malloc (es_nhosts * sizeof (int64_t));
+	es_procws = (uint8_t *)calloc (es_nhosts * es_count, ES_PROCWS);
+	es_submitted = (uint64_t *)calloc (es_nhosts * es_count, sizeof (uint64_t));
+	hosts = (pthread_t *)malloc (es_nhosts * sizeof (pthread_t));
+	wssize = ES_TOPWS + (ES_BRWS * (es_nhosts + 1)) + 64;
+	ws = malloc (wssize);
+	if (!es_chans || !es_inbox || !es_expect || !es_procws || !es_submitted || !hosts || !ws) {
+		fprintf (stderr, "extsubmit: failed to allocate memory\n");
+		exit (EXIT_FAILURE);
+	}
+	for (i=0; i<es_nhosts; i++) {
+		es_expect[i] = 1;
+	}
+
+	fprintf (stderr, "extsubmit: %ld host threads each starting %ld processes and sending %ld messages, to %d run-time threads\n",
+			es_nhosts, es_count, es_count, es_nthreads);
+
+	/* the servers wait for the host threads, which the run-time can't see */
+	slick_external_hold ();
+
+	for (i=0; i<es_nhosts; i++) {
+		int err = pthread_create (&hosts[i], NULL, es_host, (void *)i);
+
+		if (err) {
+			fprintf (stderr, "extsubmit: failed to create host thread [%s]\n", strerror (err));
+			exit (EXIT_FAILURE);
+		}
+	}
+
+	wstop = ws + (int)(wssize - sizeof (uint64_t));
+	slick_startup (wstop, o_extsubmit_startup);
+
+	return 0;
+}
+
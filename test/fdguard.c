@@ -0,0 +1,510 @@
+/*
+ *	fdguard.c -- wrapper for fdguard test program (ALTs waiting on pipes or sockets fed from outside, alongside a channel and a timeout;
+ *	and on pipes never written, which must not keep a deadlock from being reported)
+ *	Copyright (C) 2016 Fred Barnes, University of Kent <frmb@kent.ac.uk>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <errno.h>
+
+#include <sched.h>
+#include <pthread.h>
+
+#include "slick.h"
+
+
+#define FG_MAXREADERS	(1024)
+#define FG_MAXTHREADS	(128)
+#define FG_TOPWS	(48)			/* o_fdguard frame, including return-address */
+#define FG_BRWS		(96)			/* each branch's workspace */
+
+#define FG_PIPE		0			/* each reader's descriptor is the read end of a pipe.. */
+#define FG_SOCKET	1			/* ..or one end of a Unix-domain socketpair.. */
+#define FG_IDLE		2			/* ..or of a pipe never written: readers time out, then wait for good */
+#define FG_NMODES	3
+
+#define FG_IDLE_ALTS	(10)			/* ALTs each idle reader times out of before it waits.. */
+#define FG_IDLE_WAIT_MS	(10000)			/* ..and how long we give the run-time to report the deadlock */
+
+extern void o_fdguard_startup (void);		/* synthetic compiler-generated entry point */
+
+int64_t fg_nreaders = 0;			/* read by the process code */
+int64_t fg_timeout_ns;
+int64_t *fg_chans;				/* channel from each reader's ticker */
+int64_t *fg_inbox;
+int64_t *fg_outbox;
+
+static const char *fg_modenames[] = {"pipe", "socket", "idle"};
+static int fg_mode;
+static int fg_nthreads = 2;
+static int64_t fg_nmsgs = 1000;			/* messages written to each reader's descriptor.. */
+static int64_t fg_interval_us = 200;		/* ..this far apart */
+static int64_t fg_nticks = 1000;		/* and sent down its channel */
+static int64_t fg_timeout_us = 5000;		/* ALT timeout */
+static uint64_t fg_t0;
+static int fg_resfd = -1;
+
+static int *fg_rfd;				/* each reader's end.. */
+static int *fg_wfd;				/* ..and the writer's */
+static int64_t *fg_got;				/* messages each reader has had.. */
+static int64_t *fg_ticks;			/* ..and ticks */
+static int64_t *fg_sent;			/* ticks each ticker has sent */
+static int64_t *fg_wrong;			/* out of order or short, per reader */
+static int64_t *fg_alts;			/* ALTs each reader has started (idle) */
+static uint8_t (*fg_part)[16];			/* partial message per reader.. */
+static int *fg_partlen;				/* ..and how much of it */
+static int64_t fg_sumlat = 0;
+static int64_t fg_maxlat = 0;
+static int64_t fg_timeouts = 0;
+static pthread_t fg_writer;
+
+
+/*{{{  static uint64_t fg_time (void)*/
+/*
+ *	current time in nanoseconds
+ */
+static uint64_t fg_time (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+/*}}}*/
+/*{{{  static void *fg_write_thread (void *arg)*/
+/*
+ *	writes each message (a sequence number and when it was sent) to every reader in turn, then waits
+ *	for the next interval; runs outside the scheduler, as a device or a network peer would
+ */
+static void *fg_write_thread (void *arg)
+{
+	struct timespec ts = {tv_sec: 0, tv_nsec: fg_interval_us * 1000};
+	int64_t m, i;
+
+	for (m=0; m<fg_nmsgs; m++) {
+		for (i=0; i<fg_nreaders; i++) {
+			uint64_t msg[2] = {(uint64_t)m, fg_time ()};
+
+			if (write (fg_wfd[i], msg, sizeof (msg)) != sizeof (msg)) {
+				fprintf (stderr, "fdguard: failed to write message [%s]\n", strerror (errno));
+				exit (EXIT_FAILURE);
+			}
+		}
+		nanosleep (&ts, NULL);
+	}
+	return NULL;
+}
+/*}}}*/
+/*{{{  int64_t fg_setup (int64_t idx)*/
+/*
+ *	called by each reader at the start: returns the descriptor it waits on
+ */
+int64_t fg_setup (int64_t idx)
+{
+	return (int64_t)fg_rfd[idx];
+}
+/*}}}*/
+/*{{{  int64_t fg_more (int64_t idx)*/
+/*
+ *	called by each reader before each ALT: returns zero when it has had all messages and ticks
+ */
+int64_t fg_more (int64_t idx)
+{
+	if (fg_mode == FG_IDLE) {
+		return (fg_alts[idx]++ < FG_IDLE_ALTS);
+	}
+	return (fg_got[idx] < fg_nmsgs) || (fg_ticks[idx] < fg_nticks);
+}
+/*}}}*/
+/*{{{  void fg_read (int64_t idx)*/
+/*
+ *	called by a reader whose descriptor guard fired: takes what's there without blocking, noting how
+ *	long each message took to arrive
+ */
+__attribute__ ((force_align_arg_pointer)) void fg_read (int64_t idx)
+{
+	uint64_t buf[128];
+	uint64_t now;
+	ssize_t n, i;
+	int64_t lat, max;
+
+	n = read (fg_rfd[idx], (uint8_t *)buf + fg_partlen[idx], sizeof (buf) - 16);
+	if (n <= 0) {
+		if ((n < 0) && (errno != EAGAIN)) {
+			fprintf (stderr, "fdguard: failed to read [%s]\n", strerror (errno));
+			fg_wrong[idx]++;
+		}
+		return;
+	}
+	now = fg_time ();
+	memcpy (buf, fg_part[idx], fg_partlen[idx]);
+	n += fg_partlen[idx];
+
+	for (i=0; (i + 16) <= n; i += 16) {
+		uint64_t *msg = (uint64_t *)((uint8_t *)buf + i);
+
+		if (msg[0] != (uint64_t)fg_got[idx]) {
+			fg_wrong[idx]++;
+		}
+		fg_got[idx]++;
+		lat = (int64_t)(now - msg[1]);
+		__sync_fetch_and_add (&fg_sumlat, lat);
+		do {
+			max = fg_maxlat;
+		} while ((lat > max) && !__sync_bool_compare_and_swap (&fg_maxlat, max, lat));
+	}
+	fg_partlen[idx] = (int)(n - i);
+	memcpy (fg_part[idx], (uint8_t *)buf + i, fg_partlen[idx]);
+}
+/*}}}*/
+/*{{{  void fg_tick (int64_t idx)*/
+/*
+ *	called by a reader after input from its ticker (in fg_inbox[idx])
+ */
+void fg_tick (int64_t idx)
+{
+	if (fg_inbox[idx] != fg_ticks[idx]) {
+		fg_wrong[idx]++;
+	}
+	fg_ticks[idx]++;
+}
+/*}}}*/
+/*{{{  void fg_timeout (int64_t idx)*/
+/*
+ *	called by a reader whose ALT timed out
+ */
+void fg_timeout (int64_t idx)
+{
+	__sync_fetch_and_add (&fg_timeouts, 1);
+}
+/*}}}*/
+/*{{{  int64_t fg_stuck (int64_t idx)*/
+/*
+ *	called by each reader when it is done: non-zero if it should then wait on its channel for good (idle)
+ */
+int64_t fg_stuck (int64_t idx)
+{
+	return (fg_mode == FG_IDLE);
+}
+/*}}}*/
+/*{{{  int64_t fg_next_tick (int64_t idx)*/
+/*
+ *	called by each ticker (for reader idx): puts the next tick in fg_outbox[idx], returns zero when all are sent
+ */
+int64_t fg_next_tick (int64_t idx)
+{
+	if ((fg_mode == FG_IDLE) || (fg_sent[idx] == fg_nticks)) {
+		return 0;
+	}
+	fg_outbox[idx] = fg_sent[idx]++;
+	return 1;
+}
+/*}}}*/
+/*{{{  void fg_begin (void)*/
+/*
+ *	called by o_fdguard before starting the readers and tickers: starts the writer
+ */
+__attribute__ ((force_align_arg_pointer)) void fg_begin (void)
+{
+	fg_t0 = fg_time ();
+	if (fg_mode == FG_IDLE) {
+		return;			/* nothing written */
+	}
+	if (pthread_create (&fg_writer, NULL, fg_write_thread, NULL)) {
+		fprintf (stderr, "fdguard: failed to start writer thread\n");
+		exit (EXIT_FAILURE);
+	}
+}
+/*}}}*/
+/*{{{  void fg_finish (void)*/
+/*
+ *	called by o_fdguard when all readers are done: passes results back to the parent, reports and exits
+ */
+__attribute__ ((force_align_arg_pointer, noreturn)) void fg_finish (void)
+{
+	int64_t res[5];
+	int64_t i, total = fg_nreaders * fg_nmsgs;
+
+	res[0] = (int64_t)(fg_time () - fg_t0);
+	res[1] = fg_sumlat / total;
+	res[2] = fg_maxlat;
+	res[3] = fg_timeouts;
+	res[4] = 0;
+	for (i=0; i<fg_nreaders; i++) {
+		res[4] += fg_wrong[i] + fg_partlen[i];
+	}
+	pthread_join (fg_writer, NULL);
+
+	if (write (fg_resfd, res, sizeof (res)) != sizeof (res)) {
+		fprintf (stderr, "fdguard: failed to write result [%s]\n", strerror (errno));
+	}
+	slick_dump_stats ();
+	exit (EXIT_SUCCESS);
+}
+/*}}}*/
+
+/*{{{  static void fg_child (char *prog, int rt_argc, char **rt_argv)*/
+/*
+ *	runs the readers over pipes or socketpairs (in a child process).  Idle pipes are kept open at both
+ *	ends, so never ready.
+ */
+static void fg_child (char *prog, int rt_argc, char **rt_argv)
+{
+	char **argv = (char **)malloc ((rt_argc + 3) * sizeof (char *));
+	char ntbuf[32];
+	void *ws, *wstop;
+	int64_t wssize;
+	int64_t i;
+	int j = 1;
+
+	argv[0] = prog;
+	snprintf (ntbuf, sizeof (ntbuf), "--rt-nthreads=%d", fg_nthreads);
+	argv[j++] = ntbuf;
+	for (i=0; i<rt_argc; i++) {
+		argv[j++] = rt_argv[i];
+	}
+	argv[j] = NULL;
+
+	if (slick_init ((const char **)argv, j)) {
+		fprintf (stderr, "fdguard: oops, failed to initialise scheduler\n");
+		exit (EXIT_FAILURE);
+	}
+
+	fg_rfd = (int *)malloc (fg_nreaders * sizeof (int));
+	fg_wfd = (int *)malloc (fg_nreaders * sizeof (int));
+	fg_chans = (int64_t *)calloc (fg_nreaders, sizeof (int64_t));
+	fg_inbox = (int64_t *)calloc (fg_nreaders, sizeof (int64_t));
+	fg_outbox = (int64_t *)calloc (fg_nreaders, sizeof (int64_t));
+	fg_got = (int64_t *)calloc (fg_nreaders, sizeof (int64_t));
+	fg_ticks = (int64_t *)calloc (fg_nreaders, sizeof (int64_t));
+	fg_sent = (int64_t *)calloc (fg_nreaders, sizeof (int64_t));
+	fg_wrong = (int64_t *)calloc (fg_nreaders, sizeof (int64_t));
+	fg_alts = (int64_t *)calloc (fg_nreaders, sizeof (int64_t));
+	fg_part = (uint8_t (*)[16])calloc (fg_nreaders, 16);
+	fg_partlen = (int *)calloc (fg_nreaders, sizeof (int));
+	wssize = FG_TOPWS + (FG_BRWS * ((2 * fg_nreaders) + 1)) + 64;
+	ws = malloc (wssize);
+	if (!fg_rfd || !fg_wfd || !fg_chans || !fg_inbox || !fg_outbox || !fg_got || !fg_ticks || !fg_sent || !fg_wrong || !fg_alts ||
+			!fg_part || !fg_partlen || !ws) {
+		fprintf (stderr, "fdguard: failed to allocate %ld bytes of workspace\n", wssize);
+		exit (EXIT_FAILURE);
+	}
+	for (i=0; i<fg_nreaders; i++) {
+		int fds[2];
+		int r;
+
+		if (fg_mode == FG_SOCKET) {
+			r = socketpair (AF_UNIX, SOCK_STREAM, 0, fds);
+		} else {
+			r = pipe (fds);
+		}
+		if ((r < 0) || (fcntl (fds[0], F_SETFL, O_NONBLOCK) < 0)) {
+			fprintf (stderr, "fdguard: failed to create %s [%s]\n", fg_modenames[fg_mode], strerror (errno));
+			exit (EXIT_FAILURE);
+		}
+		fg_rfd[i] = fds[0];
+		fg_wfd[i] = fds[1];
+	}
+	wstop = ws + (int)(wssize - sizeof (uint64_t));
+
+	slick_startup (wstop, o_fdguard_startup);
+	exit (EXIT_FAILURE);
+}
+/*}}}*/
+/*{{{  static int fg_run_idle (char *prog, int rt_argc, char **rt_argv)*/
+/*
+ *	runs idle readers (in a child process), which end up with every process waiting on a channel and
+ *	every descriptor guard disabled: expects the run-time to report the deadlock on stderr, and exit.
+ *	Returns non-zero if it did not.
+ */
+static int fg_run_idle (char *prog, int rt_argc, char **rt_argv)
+{
+	char buf[4096];
+	int len = 0;
+	int fds[2];
+	pid_t pid;
+	int status;
+	uint64_t t, deadline;
+	int reported;
+
+	if (pipe (fds) < 0) {
+		fprintf (stderr, "fdguard: failed to create pipe [%s]\n", strerror (errno));
+		exit (EXIT_FAILURE);
+	}
+	fflush (stderr);
+
+	pid = fork ();
+	if (pid < 0) {
+		fprintf (stderr, "fdguard: failed to fork [%s]\n", strerror (errno));
+		exit (EXIT_FAILURE);
+	} else if (!pid) {
+		close (fds[0]);
+		dup2 (fds[1], 2);
+		close (fds[1]);
+		fg_child (prog, rt_argc, rt_argv);
+	}
+	close (fds[1]);
+
+	t = fg_time ();
+	deadline = t + (FG_IDLE_WAIT_MS * 1000000ULL);
+	for (;;) {
+		struct pollfd pfd = {fd: fds[0], events: POLLIN, revents: 0};
+		uint64_t now = fg_time ();
+		ssize_t n;
+
+		if ((now >= deadline) || (poll (&pfd, 1, (int)((deadline - now) / 1000000ULL) + 1) <= 0)) {
+			if (fg_time () >= deadline) {
+				break;		/* for() */
+			}
+			continue;
+		}
+		n = read (fds[0], buf + len, sizeof (buf) - 1 - len);
+		if (n <= 0) {
+			break;		/* for() */
+		}
+		len += (int)n;
+		if (len == (int)(sizeof (buf) - 1)) {
+			len = 0;		/* keep the tail */
+		}
+	}
+	buf[len] = '\0';
+	t = fg_time () - t;
+	close (fds[0]);
+
+	if (waitpid (pid, &status, WNOHANG) != pid) {
+		kill (pid, SIGKILL);
+		waitpid (pid, &status, 0);
+	}
+	reported = WIFEXITED (status) && (WEXITSTATUS (status) == EXIT_FAILURE) && strstr (buf, "deadlocked");
+
+	printf ("%-8s: %10.3f ms, %s%s\n", fg_modenames[FG_IDLE], (double)t / 1000000.0,
+			reported ? "deadlock reported" : "no deadlock reported", reported ? "" : " (WRONG)");
+	fflush (stdout);
+
+	return !reported;
+}
+/*}}}*/
+
+
+int main (int argc, char **argv)
+{
+	char **rt_argv = (char **)malloc (argc * sizeof (char *));
+	int rt_argc = 0;
+	int modes = 0;
+	int failed = 0;
+	int i;
+
+	for (i=1; i<argc; i++) {
+		if (!strncmp (argv[i], "--rt-", 5)) {
+			if (strncmp (argv[i] + 5, "nthreads", 8)) {
+				rt_argv[rt_argc++] = argv[i];		/* passed through to each run */
+			}
+		} else if (!strcmp (argv[i], "pipe")) {
+			modes |= (1 << FG_PIPE);
+		} else if (!strcmp (argv[i], "socket")) {
+			modes |= (1 << FG_SOCKET);
+		} else if (!strcmp (argv[i], "idle")) {
+			modes |= (1 << FG_IDLE);
+		} else if (!strcmp (argv[i], "-r") && (i < (argc - 1))) {
+			fg_nreaders = atol (argv[++i]);
+		} else if (!strcmp (argv[i], "-t") && (i < (argc - 1))) {
+			fg_nthreads = atoi (argv[++i]);
+		} else if (!strcmp (argv[i], "-m") && (i < (argc - 1))) {
+			fg_nmsgs = atol (argv[++i]);
+		} else if (!strcmp (argv[i], "-i") && (i < (argc - 1))) {
+			fg_interval_us = atol (argv[++i]);
+		} else if (!strcmp (argv[i], "-k") && (i < (argc - 1))) {
+			fg_nticks = atol (argv[++i]);
+		} else if (!strcmp (argv[i], "-o") && (i < (argc - 1))) {
+			fg_timeout_us = atol (argv[++i]);
+		} else {
+			fprintf (stderr, "usage: %s [pipe] [socket] [idle] [-r readers] [-t threads] [-m messages] [-i us-between] [-k ticks] "
+					"[-o timeout-us] [--rt-...]\n", argv[0]);
+			exit (EXIT_FAILURE);
+		}
+	}
+	if (!modes) {
+		modes = (1 << FG_PIPE) | (1 << FG_SOCKET) | (1 << FG_IDLE);
+	}
+	if (!fg_nreaders) {
+		fg_nreaders = 4 * fg_nthreads;
+	}
+	if ((fg_nreaders < 1) || (fg_nreaders > FG_MAXREADERS) || (fg_nthreads < 1) || (fg_nthreads > FG_MAXTHREADS) ||
+			(fg_nmsgs < 1) || (fg_interval_us < 0) || (fg_interval_us >= 1000000) || (fg_nticks < 0) || (fg_timeout_us < 1)) {
+		fprintf (stderr, "fdguard: expected 1..%d readers, 1..%d threads, at least one message, intervals under a second and a timeout\n",
+				FG_MAXREADERS, FG_MAXTHREADS);
+		exit (EXIT_FAILURE);
+	}
+	fg_timeout_ns = fg_timeout_us * 1000;
+
+	fprintf (stderr, "fdguard: %ld readers on %d threads, %ld messages each %ld us apart, %ld ticks, timeout %ld us\n",
+			fg_nreaders, fg_nthreads, fg_nmsgs, fg_interval_us, fg_nticks, fg_timeout_us);
+
+	for (fg_mode = FG_PIPE; fg_mode < FG_NMODES; fg_mode++) {
+		int fds[2];
+		int64_t res[5];
+		pid_t pid;
+		int status;
+
+		if (!(modes & (1 << fg_mode))) {
+			continue;
+		}
+		if (fg_mode == FG_IDLE) {
+			if (fg_run_idle (argv[0], rt_argc, rt_argv)) {
+				fprintf (stderr, "fdguard: run-time did not report idle readers as deadlocked\n");
+				failed++;
+			}
+			continue;
+		}
+		if (pipe (fds) < 0) {
+			fprintf (stderr, "fdguard: failed to create pipe [%s]\n", strerror (errno));
+			exit (EXIT_FAILURE);
+		}
+		fflush (stderr);
+
+		pid = fork ();
+		if (pid < 0) {
+			fprintf (stderr, "fdguard: failed to fork [%s]\n", strerror (errno));
+			exit (EXIT_FAILURE);
+		} else if (!pid) {
+			close (fds[0]);
+			fg_resfd = fds[1];
+			fg_child (argv[0], rt_argc, rt_argv);
+		}
+		close (fds[1]);
+
+		if (read (fds[0], res, sizeof (res)) != sizeof (res)) {
+			fprintf (stderr, "fdguard: %s run failed\n", fg_modenames[fg_mode]);
+			exit (EXIT_FAILURE);
+		}
+		close (fds[0]);
+		waitpid (pid, &status, 0);
+
+		printf ("%-8s: %10.3f ms, message latency mean %8.3f ms, max %8.3f ms, %6ld timeouts%s\n", fg_modenames[fg_mode],
+				(double)res[0] / 1000000.0, (double)res[1] / 1000000.0, (double)res[2] / 1000000.0, res[3], res[4] ? " (WRONG)" : "");
+		fflush (stdout);
+
+		/* readers only finish once their guards have fired for every message */
+		if (res[4]) {
+			fprintf (stderr, "fdguard: %s run had %ld messages or ticks out of order or cut short\n", fg_modenames[fg_mode], res[4]);
+			failed++;
+		}
+	}
+
+	if (failed) {
+		exit (EXIT_FAILURE);
+	}
+	return 0;
+}
+
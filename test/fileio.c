@@ -0,0 +1,346 @@
+/*
+ *	fileio.c -- wrapper for fileio test program (workers writing, syncing and reading back files, in place,
+ *	on helper threads or through io_uring)
+ *	Copyright (C) 2016 Fred Barnes, University of Kent <frmb@kent.ac.uk>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <errno.h>
+
+#include <sched.h>
+#include <pthread.h>
+
+#include "slick.h"
+
+
+#define FI_MAXWORKERS	(4096)
+#define FI_MAXTHREADS	(128)
+#define FI_TOPWS	(48)			/* o_fileio frame, including return-address */
+#define FI_BRWS		(64)			/* each worker's workspace */
+
+#define FI_INPLACE	0			/* file I/O on the run-time thread (--rt-uring=0 --rt-offload=0) */
+#define FI_HELPER	1			/* ..on helper threads (--rt-uring=0) */
+#define FI_URING	2			/* ..through each run-time thread's io_uring */
+
+#define FI_READ		0			/* fi_req_t.op, as in fileio_code.S */
+#define FI_WRITE	1
+#define FI_FSYNC	2
+
+typedef struct {				/* laid out for fileio_code.S */
+	int64_t op;
+	int64_t fd;
+	void *buf;
+	int64_t count;
+	int64_t offset;
+	int64_t result;				/* written by the run-time */
+} fi_req_t;
+
+extern void o_fileio_startup (void);		/* synthetic compiler-generated entry point */
+
+int64_t fi_nworkers = 0;			/* read by the process code */
+
+static const char *fi_modenames[] = {"in-place", "helper", "uring"};
+static int fi_mode;
+static int fi_nthreads = 2;
+static int64_t fi_blocks = 64;			/* each worker writes this many blocks, syncs, then reads them back.. */
+static int64_t fi_block_kb = 4;			/* ..of this size */
+static const char *fi_dir = "/dev/shm";		/* in files here (tmpfs) */
+static uint64_t fi_t0;
+static int fi_resfd = -1;
+
+static fi_req_t *fi_reqs;			/* each worker's request */
+static int64_t *fi_pos;				/* and how far through (blocks written, then the sync, then read) */
+static uint64_t *fi_issued;			/* when its current request was made */
+static uint8_t **fi_wbuf;			/* its buffers */
+static uint8_t **fi_rbuf;
+static char **fi_names;				/* and its file */
+static int64_t fi_sumlat = 0;			/* time from making each request to the worker running again */
+static int64_t fi_nreqs = 0;
+static int64_t fi_wrong = 0;			/* requests with an unexpected result, or data that didn't read back */
+
+
+/*{{{  static uint64_t fi_time (void)*/
+/*
+ *	current time in nanoseconds
+ */
+static uint64_t fi_time (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+/*}}}*/
+/*{{{  static uint8_t fi_pattern (int64_t idx, int64_t blk)*/
+/*
+ *	what a worker writes in each byte of a block
+ */
+static uint8_t fi_pattern (int64_t idx, int64_t blk)
+{
+	return (uint8_t)((idx * 31) + blk + 1);
+}
+/*}}}*/
+/*{{{  fi_req_t *fi_step (int64_t idx)*/
+/*
+ *	called by each worker: checks how its last request went and sets up the next, returning it
+ *	(NULL when done)
+ */
+__attribute__ ((force_align_arg_pointer)) fi_req_t *fi_step (int64_t idx)
+{
+	fi_req_t *rq = &(fi_reqs[idx]);
+	int64_t bytes = fi_block_kb << 10;
+	int64_t pos = fi_pos[idx];
+
+	if (fi_issued[idx]) {
+		int64_t i, ok;
+
+		__sync_fetch_and_add (&fi_sumlat, (int64_t)(fi_time () - fi_issued[idx]));
+		__sync_fetch_and_add (&fi_nreqs, 1);
+
+		ok = (rq->result == ((rq->op == FI_FSYNC) ? 0 : bytes));
+		if (ok && (rq->op == FI_READ)) {
+			uint8_t want = fi_pattern (idx, rq->offset / bytes);
+
+			for (i=0; i<bytes; i++) {
+				if (fi_rbuf[idx][i] != want) {
+					ok = 0;
+					break;		/* for() */
+				}
+			}
+		}
+		if (!ok) {
+			__sync_fetch_and_add (&fi_wrong, 1);
+		}
+		pos = ++fi_pos[idx];
+	}
+
+	if (pos > (2 * fi_blocks)) {
+		return NULL;
+	} else if (pos < fi_blocks) {
+		rq->op = FI_WRITE;
+		rq->buf = fi_wbuf[idx];
+		rq->offset = pos * bytes;
+		memset (rq->buf, fi_pattern (idx, pos), bytes);
+	} else if (pos == fi_blocks) {
+		rq->op = FI_FSYNC;
+	} else {
+		rq->op = FI_READ;
+		rq->buf = fi_rbuf[idx];
+		rq->offset = ((2 * fi_blocks) - pos) * bytes;		/* back to front */
+		memset (rq->buf, 0, bytes);
+	}
+	rq->count = bytes;
+	rq->result = -1;
+	fi_issued[idx] = fi_time ();
+
+	return rq;
+}
+/*}}}*/
+/*{{{  void fi_begin (void)*/
+/*
+ *	called by o_fileio before starting the workers
+ */
+void fi_begin (void)
+{
+	fi_t0 = fi_time ();
+}
+/*}}}*/
+/*{{{  void fi_finish (void)*/
+/*
+ *	called by o_fileio when all workers are done: passes results back to the parent, removes the files,
+ *	reports and exits
+ */
+__attribute__ ((force_align_arg_pointer, noreturn)) void fi_finish (void)
+{
+	int64_t res[4];
+	int64_t i;
+
+	res[0] = (int64_t)(fi_time () - fi_t0);
+	res[1] = fi_nreqs;
+	res[2] = fi_nreqs ? (fi_sumlat / fi_nreqs) : 0;
+	res[3] = fi_wrong + ((fi_nreqs == (fi_nworkers * ((2 * fi_blocks) + 1))) ? 0 : 1);
+
+	for (i=0; i<fi_nworkers; i++) {
+		close ((int)fi_reqs[i].fd);
+		unlink (fi_names[i]);
+	}
+	if (write (fi_resfd, res, sizeof (res)) != sizeof (res)) {
+		fprintf (stderr, "fileio: failed to write result [%s]\n", strerror (errno));
+	}
+	slick_dump_stats ();
+	exit (EXIT_SUCCESS);
+}
+/*}}}*/
+
+/*{{{  static void fi_child (char *prog, int rt_argc, char **rt_argv)*/
+/*
+ *	runs the workers, with file I/O in place, on helper threads or through io_uring (in a child process)
+ */
+static void fi_child (char *prog, int rt_argc, char **rt_argv)
+{
+	char **argv = (char **)malloc ((rt_argc + 5) * sizeof (char *));
+	char ntbuf[32];
+	void *ws, *wstop;
+	int64_t wssize;
+	int64_t i;
+	int j = 1;
+
+	argv[0] = prog;
+	snprintf (ntbuf, sizeof (ntbuf), "--rt-nthreads=%d", fi_nthreads);
+	argv[j++] = ntbuf;
+	if (fi_mode != FI_URING) {
+		argv[j++] = "--rt-uring=0";
+	}
+	if (fi_mode == FI_INPLACE) {
+		argv[j++] = "--rt-offload=0";
+	}
+	for (i=0; i<rt_argc; i++) {
+		argv[j++] = rt_argv[i];
+	}
+	argv[j] = NULL;
+
+	if (slick_init ((const char **)argv, j)) {
+		fprintf (stderr, "fileio: oops, failed to initialise scheduler\n");
+		exit (EXIT_FAILURE);
+	}
+
+	fi_reqs = (fi_req_t *)calloc (fi_nworkers, sizeof (fi_req_t));
+	fi_pos = (int64_t *)calloc (fi_nworkers, sizeof (int64_t));
+	fi_issued = (uint64_t *)calloc (fi_nworkers, sizeof (uint64_t));
+	fi_wbuf = (uint8_t **)malloc (fi_nworkers * sizeof (uint8_t *));
+	fi_rbuf = (uint8_t **)malloc (fi_nworkers * sizeof (uint8_t *));
+	fi_names = (char **)malloc (fi_nworkers * sizeof (char *));
+	wssize = FI_TOPWS + (FI_BRWS * (fi_nworkers + 1)) + 64;
+	ws = malloc (wssize);
+	if (!fi_reqs || !fi_pos || !fi_issued || !fi_wbuf || !fi_rbuf || !fi_names || !ws) {
+		fprintf (stderr, "fileio: failed to allocate %ld bytes of workspace\n", wssize);
+		exit (EXIT_FAILURE);
+	}
+	for (i=0; i<fi_nworkers; i++) {
+		fi_wbuf[i] = (uint8_t *)malloc (fi_block_kb << 10);
+		fi_rbuf[i] = (uint8_t *)malloc (fi_block_kb << 10);
+		fi_names[i] = (char *)malloc (strlen (fi_dir) + 64);
+		sprintf (fi_names[i], "%s/slick-fileio-%d-%ld", fi_dir, (int)getpid (), i);
+		fi_reqs[i].fd = open (fi_names[i], O_RDWR | O_CREAT | O_TRUNC, 0600);
+		if (!fi_wbuf[i] || !fi_rbuf[i] || (fi_reqs[i].fd < 0)) {
+			fprintf (stderr, "fileio: failed to set up %s [%s]\n", fi_names[i], strerror (errno));
+			exit (EXIT_FAILURE);
+		}
+	}
+	wstop = ws + (int)(wssize - sizeof (uint64_t));
+
+	slick_startup (wstop, o_fileio_startup);
+	exit (EXIT_FAILURE);
+}
+/*}}}*/
+
+
+int main (int argc, char **argv)
+{
+	char **rt_argv = (char **)malloc (argc * sizeof (char *));
+	int rt_argc = 0;
+	int modes = 0;
+	int failed = 0;
+	int i;
+
+	for (i=1; i<argc; i++) {
+		if (!strncmp (argv[i], "--rt-", 5)) {
+			if (strncmp (argv[i] + 5, "nthreads", 8) && strncmp (argv[i] + 5, "uring", 5)) {
+				rt_argv[rt_argc++] = argv[i];		/* passed through to each run */
+			}
+		} else if (!strcmp (argv[i], "in-place")) {
+			modes |= (1 << FI_INPLACE);
+		} else if (!strcmp (argv[i], "helper")) {
+			modes |= (1 << FI_HELPER);
+		} else if (!strcmp (argv[i], "uring")) {
+			modes |= (1 << FI_URING);
+		} else if (!strcmp (argv[i], "-w") && (i < (argc - 1))) {
+			fi_nworkers = atol (argv[++i]);
+		} else if (!strcmp (argv[i], "-t") && (i < (argc - 1))) {
+			fi_nthreads = atoi (argv[++i]);
+		} else if (!strcmp (argv[i], "-b") && (i < (argc - 1))) {
+			fi_blocks = atol (argv[++i]);
+		} else if (!strcmp (argv[i], "-k") && (i < (argc - 1))) {
+			fi_block_kb = atol (argv[++i]);
+		} else if (!strcmp (argv[i], "-d") && (i < (argc - 1))) {
+			fi_dir = argv[++i];
+		} else {
+			fprintf (stderr, "usage: %s [in-place] [helper] [uring] [-w workers] [-t threads] [-b blocks] [-k KB-per-block] "
+					"[-d directory] [--rt-...]\n", argv[0]);
+			exit (EXIT_FAILURE);
+		}
+	}
+	if (!modes) {
+		modes = (1 << FI_INPLACE) | (1 << FI_HELPER) | (1 << FI_URING);
+	}
+	if (!fi_nworkers) {
+		fi_nworkers = 4 * fi_nthreads;
+	}
+	if ((fi_nworkers < 1) || (fi_nworkers > FI_MAXWORKERS) || (fi_nthreads < 1) || (fi_nthreads > FI_MAXTHREADS) ||
+			(fi_blocks < 1) || (fi_block_kb < 1) || (fi_block_kb > 65536)) {
+		fprintf (stderr, "fileio: expected 1..%d workers, 1..%d threads and at least one block of up to 64 MB\n",
+				FI_MAXWORKERS, FI_MAXTHREADS);
+		exit (EXIT_FAILURE);
+	}
+
+	fprintf (stderr, "fileio: %ld workers on %d threads, each writing %ld blocks of %ld KB to a file in %s, syncing and reading them back\n",
+			fi_nworkers, fi_nthreads, fi_blocks, fi_block_kb, fi_dir);
+
+	for (fi_mode = FI_INPLACE; fi_mode <= FI_URING; fi_mode++) {
+		int fds[2];
+		int64_t res[4];
+		pid_t pid;
+		int status;
+
+		if (!(modes & (1 << fi_mode))) {
+			continue;
+		}
+		if (pipe (fds) < 0) {
+			fprintf (stderr, "fileio: failed to create pipe [%s]\n", strerror (errno));
+			exit (EXIT_FAILURE);
+		}
+		fflush (stderr);
+
+		pid = fork ();
+		if (pid < 0) {
+			fprintf (stderr, "fileio: failed to fork [%s]\n", strerror (errno));
+			exit (EXIT_FAILURE);
+		} else if (!pid) {
+			close (fds[0]);
+			fi_resfd = fds[1];
+			fi_child (argv[0], rt_argc, rt_argv);
+		}
+		close (fds[1]);
+
+		if (read (fds[0], res, sizeof (res)) != sizeof (res)) {
+			fprintf (stderr, "fileio: %s run failed\n", fi_modenames[fi_mode]);
+			exit (EXIT_FAILURE);
+		}
+		close (fds[0]);
+		waitpid (pid, &status, 0);
+
+		printf ("%-8s: %10.3f ms, %8ld requests, %10.1f per ms, mean wait %8.3f us%s\n", fi_modenames[fi_mode],
+				(double)res[0] / 1000000.0, res[1], res[0] ? ((double)res[1] * 1000000.0 / (double)res[0]) : 0.0,
+				(double)res[2] / 1000.0, res[3] ? " (WRONG)" : "");
+		fflush (stdout);
+
+		if (res[3]) {
+			fprintf (stderr, "fileio: %s run had requests fail, go missing or read back the wrong data\n", fi_modenames[fi_mode]);
+			failed++;
+		}
+	}
+
+	if (failed) {
+		exit (EXIT_FAILURE);
+	}
+	return 0;
+}
+
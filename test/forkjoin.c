@@ -0,0 +1,268 @@
+/*
+ *	forkjoin.c -- wrapper for fork-join (parallel fib / unbalanced tree sum) test program
+ *	Copyright (C) 2016 Fred Barnes, University of Kent <frmb@kent.ac.uk>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <errno.h>
+
+#include <sched.h>
+#include <pthread.h>
+
+#include "slick.h"
+
+
+#define FJ_MAXDEPTH	(64)
+#define FJ_LEAFWS	(80)			/* bytes below entry Wptr for a leaf o_fjnode */
+#define FJ_NODEWS	(152)			/* bytes below entry Wptr for a node, excluding children */
+#define FJ_TOPWS	(96)			/* o_forkjoin frame, plus call into o_fjnode */
+
+extern void o_forkjoin_startup (void);		/* synthetic compiler-generated entry point */
+
+int64_t fj_wsneed[FJ_MAXDEPTH + 1];		/* workspace needed by o_fjnode(n), read by the process code */
+int64_t fj_depth;				/* top-level n, read by the process code */
+
+static int fj_tree = 0;				/* 0 = fib(n), 1 = unbalanced tree sum */
+static int64_t fj_grain = 12;			/* subtrees at or below this are done sequentially */
+static uint64_t fj_t0;
+static int fj_resfd = -1;
+
+
+/*{{{  static uint64_t fj_time (void)*/
+/*
+ *	current time in nanoseconds
+ */
+static uint64_t fj_time (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+/*}}}*/
+/*{{{  uint64_t fj_lseed (uint64_t seed), uint64_t fj_rseed (uint64_t seed)*/
+/*
+ *	derive the seeds for left and right subtrees (tree sum only)
+ */
+uint64_t fj_lseed (uint64_t seed)
+{
+	return (seed * 6364136223846793005ULL) + 1442695040888963407ULL;
+}
+
+uint64_t fj_rseed (uint64_t seed)
+{
+	return (seed * 6364136223846793005ULL) + 1013904223ULL;
+}
+/*}}}*/
+/*{{{  static int fj_pruned (int64_t n, uint64_t seed)*/
+/*
+ *	decides whether a tree-sum node is cut short (what makes the tree unbalanced), never the root
+ */
+static int fj_pruned (int64_t n, uint64_t seed)
+{
+	return fj_tree && (n > 1) && (n < fj_depth) && (((seed >> 40) & 0x07) == 0);
+}
+/*}}}*/
+/*{{{  static int64_t fj_seq (int64_t n, uint64_t seed)*/
+/*
+ *	sequential version of the whole computation
+ */
+static int64_t fj_seq (int64_t n, uint64_t seed)
+{
+	if (n < 2) {
+		return fj_tree ? 1 : n;
+	} else if (fj_pruned (n, seed)) {
+		return 1;
+	}
+	return fj_seq (n - 1, fj_lseed (seed)) + fj_seq (n - 2, fj_rseed (seed));
+}
+/*}}}*/
+/*{{{  int64_t fj_leaf (int64_t n, uint64_t seed, int64_t *result)*/
+/*
+ *	called by o_fjnode: if the node is a leaf, computes it sequentially and returns non-zero
+ */
+int64_t fj_leaf (int64_t n, uint64_t seed, int64_t *result)
+{
+	if ((n <= fj_grain) || fj_pruned (n, seed)) {
+		*result = fj_seq (n, seed);
+		return 1;
+	}
+	return 0;
+}
+/*}}}*/
+/*{{{  void fj_begin (void)*/
+/*
+ *	called by o_forkjoin before starting the computation
+ */
+void fj_begin (void)
+{
+	fj_t0 = fj_time ();
+}
+/*}}}*/
+/*{{{  void fj_finish (int64_t result)*/
+/*
+ *	called by o_forkjoin when done: passes result and time back to the parent, reports and exits
+ */
+__attribute__ ((force_align_arg_pointer, noreturn)) void fj_finish (int64_t result)
+{
+	int64_t res[2];
+
+	res[0] = result;
+	res[1] = (int64_t)(fj_time () - fj_t0);
+
+	if (write (fj_resfd, res, sizeof (res)) != sizeof (res)) {
+		fprintf (stderr, "forkjoin: failed to write result [%s]\n", strerror (errno));
+	}
+	slick_dump_stats ();
+	exit (EXIT_SUCCESS);
+}
+/*}}}*/
+
+/*{{{  static void fj_child (char *prog, int nthreads, int rt_argc, char **rt_argv)*/
+/*
+ *	runs the computation with a specific number of run-time threads (in a child process)
+ */
+static void fj_child (char *prog, int nthreads, int rt_argc, char **rt_argv)
+{
+	char **argv = (char **)malloc ((rt_argc + 3) * sizeof (char *));
+	char ntbuf[32];
+	void *ws, *wstop;
+	int64_t wssize;
+	int i;
+
+	snprintf (ntbuf, sizeof (ntbuf), "--rt-nthreads=%d", nthreads);
+	argv[0] = prog;
+	argv[1] = ntbuf;
+	for (i=0; i<rt_argc; i++) {
+		argv[i + 2] = rt_argv[i];
+	}
+	argv[i + 2] = NULL;
+
+	if (slick_init ((const char **)argv, rt_argc + 2)) {
+		fprintf (stderr, "forkjoin: oops, failed to initialise scheduler\n");
+		exit (EXIT_FAILURE);
+	}
+
+	wssize = fj_wsneed[fj_depth] + FJ_TOPWS + 64;
+	ws = malloc (wssize);
+	if (!ws) {
+		fprintf (stderr, "forkjoin: failed to allocate %ld bytes of workspace\n", wssize);
+		exit (EXIT_FAILURE);
+	}
+	wstop = ws + (int)(wssize - sizeof (uint64_t));
+
+	slick_startup (wstop, o_forkjoin_startup);
+	exit (EXIT_FAILURE);
+}
+/*}}}*/
+
+
+int main (int argc, char **argv)
+{
+	char **rt_argv = (char **)malloc (argc * sizeof (char *));
+	int rt_argc = 0;
+	int maxthreads = (int)sysconf (_SC_NPROCESSORS_ONLN);
+	int64_t expected;
+	uint64_t t1 = 0;
+	int nthreads, i;
+	int failed = 0;
+
+	fj_depth = 32;
+	for (i=1; i<argc; i++) {
+		if (!strncmp (argv[i], "--rt-", 5)) {
+			if (strncmp (argv[i] + 5, "nthreads", 8)) {
+				rt_argv[rt_argc++] = argv[i];		/* passed through to each run */
+			}
+		} else if (!strcmp (argv[i], "fib")) {
+			fj_tree = 0;
+		} else if (!strcmp (argv[i], "tree")) {
+			fj_tree = 1;
+		} else if (!strcmp (argv[i], "-n") && (i < (argc - 1))) {
+			fj_depth = atol (argv[++i]);
+		} else if (!strcmp (argv[i], "-g") && (i < (argc - 1))) {
+			fj_grain = atol (argv[++i]);
+		} else if (!strcmp (argv[i], "-t") && (i < (argc - 1))) {
+			maxthreads = atoi (argv[++i]);
+		} else {
+			fprintf (stderr, "usage: %s [fib | tree] [-n depth] [-g grain] [-t max-threads] [--rt-...]\n", argv[0]);
+			exit (EXIT_FAILURE);
+		}
+	}
+	if ((fj_depth < 2) || (fj_depth > FJ_MAXDEPTH) || (fj_grain < 1) || (maxthreads < 1)) {
+		fprintf (stderr, "forkjoin: expected depth in [2..%d], grain >= 1 and at least one thread\n", FJ_MAXDEPTH);
+		exit (EXIT_FAILURE);
+	}
+
+	/* workspace sizes: a node has its PAR-spawned child (n-1) and the inline call (n-2) below it */
+	for (i=0; i<=FJ_MAXDEPTH; i++) {
+		if (i <= fj_grain) {
+			fj_wsneed[i] = FJ_LEAFWS;
+		} else {
+			fj_wsneed[i] = FJ_NODEWS + fj_wsneed[i - 1] + fj_wsneed[i - 2];
+		}
+	}
+	if (fj_wsneed[fj_depth] > (1L << 30)) {
+		fprintf (stderr, "forkjoin: depth %ld with grain %ld needs too much workspace, increase grain\n", fj_depth, fj_grain);
+		exit (EXIT_FAILURE);
+	}
+
+	expected = fj_seq (fj_depth, (uint64_t)fj_depth);
+	fprintf (stderr, "forkjoin: %s, depth %ld, grain %ld, %ld bytes of workspace, expecting %ld\n",
+			fj_tree ? "tree sum" : "fib", fj_depth, fj_grain, fj_wsneed[fj_depth] + FJ_TOPWS, expected);
+
+	/* 1 thread, then doubling up to (and including) maxthreads */
+	for (nthreads = 1; nthreads; nthreads = (nthreads == maxthreads) ? 0 : ((nthreads * 2) > maxthreads ? maxthreads : nthreads * 2)) {
+		int fds[2];
+		int64_t res[2];
+		pid_t pid;
+		int status;
+
+		if (pipe (fds) < 0) {
+			fprintf (stderr, "forkjoin: failed to create pipe [%s]\n", strerror (errno));
+			exit (EXIT_FAILURE);
+		}
+		fflush (stderr);
+
+		pid = fork ();
+		if (pid < 0) {
+			fprintf (stderr, "forkjoin: failed to fork [%s]\n", strerror (errno));
+			exit (EXIT_FAILURE);
+		} else if (!pid) {
+			close (fds[0]);
+			fj_resfd = fds[1];
+			fj_child (argv[0], nthreads, rt_argc, rt_argv);
+		}
+		close (fds[1]);
+
+		if (read (fds[0], res, sizeof (res)) != sizeof (res)) {
+			fprintf (stderr, "forkjoin: run with %d threads failed\n", nthreads);
+			exit (EXIT_FAILURE);
+		}
+		close (fds[0]);
+		waitpid (pid, &status, 0);
+
+		if (nthreads == 1) {
+			t1 = (uint64_t)res[1];
+		}
+		if (res[0] != expected) {
+			failed++;
+		}
+		printf ("threads %3d: result %ld%s, %10.3f ms, speedup %6.2f\n", nthreads, res[0], (res[0] == expected) ? "" : " (WRONG)",
+				(double)res[1] / 1000000.0, (double)t1 / (double)res[1]);
+		fflush (stdout);
+	}
+
+	if (failed) {
+		fprintf (stderr, "forkjoin: %d run(s) computed the wrong result\n", failed);
+		exit (EXIT_FAILURE);
+	}
+	return 0;
+}
+
@@ -0,0 +1,279 @@
+/*
+ *	hog.c -- wrapper for CPU hog test program (how long processes sharing a thread with a hog wait to run)
+ *	Copyright (C) 2016 Fred Barnes, University of Kent <frmb@kent.ac.uk>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <errno.h>
+
+#include <sched.h>
+#include <pthread.h>
+
+#include "slick.h"
+
+
+#define HG_MAXPINGERS	(1024)
+#define HG_TOPWS	(48)			/* o_hog frame, including return-address */
+#define HG_BRWS		(64)			/* each branch's workspace */
+
+#define HG_COOP		0			/* nobody asks the hog to yield */
+#define HG_SLICE	1			/* asked to yield after a slice (--rt-slice) */
+
+extern void o_hog_startup (void);		/* synthetic compiler-generated entry point */
+
+int64_t hg_nbranches = 0;			/* hog + pingers, read by the process code */
+
+static const char *hg_modenames[] = {"coop", "slice"};
+static int hg_mode;
+static int64_t hg_npingers = 4;
+static int64_t hg_chunks = 2000;		/* hog's work, in chunks.. */
+static int64_t hg_chunk_us = 100;		/* ..of this long (distance between safepoints) */
+static int hg_slice_ms = 5;
+static uint64_t hg_t0;
+static int hg_resfd = -1;
+
+static volatile int hg_done = 0;
+static int64_t hg_left;
+static uint64_t *hg_last;			/* each pinger's last run */
+static int64_t hg_maxgap = 0;
+static int64_t hg_sumgap = 0;
+static int64_t hg_pings = 0;
+static int64_t hg_busy_pings = 0;		/* pings while the hog still had work to do */
+static volatile int64_t hg_sink = 0;
+
+
+/*{{{  static uint64_t hg_time (void)*/
+/*
+ *	current time in nanoseconds
+ */
+static uint64_t hg_time (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+/*}}}*/
+/*{{{  int64_t hg_chunk (void)*/
+/*
+ *	called by the hog: keeps the CPU busy for one chunk, returns zero when there are no more
+ */
+__attribute__ ((force_align_arg_pointer)) int64_t hg_chunk (void)
+{
+	uint64_t until = hg_time () + (hg_chunk_us * 1000);
+	int64_t sum = 0;
+	int i;
+
+	if (!hg_left) {
+		hg_done = 1;
+		return 0;
+	}
+	hg_left--;
+	while (hg_time () < until) {
+		for (i=0; i<256; i++) {
+			sum += i * hg_left;
+		}
+	}
+	hg_sink += sum;
+	return 1;
+}
+/*}}}*/
+/*{{{  int64_t hg_ping (int64_t idx)*/
+/*
+ *	called by each pinger: notes how long since it last ran, returns zero once the hog is done
+ */
+__attribute__ ((force_align_arg_pointer)) int64_t hg_ping (int64_t idx)
+{
+	uint64_t now = hg_time ();
+	int64_t gap = (int64_t)(now - hg_last[idx]);
+
+	hg_last[idx] = now;
+	if (gap > hg_maxgap) {
+		hg_maxgap = gap;
+	}
+	hg_sumgap += gap;
+	hg_pings++;
+	if (!hg_done) {
+		hg_busy_pings++;
+	}
+
+	return !hg_done;
+}
+/*}}}*/
+/*{{{  void hg_begin (void)*/
+/*
+ *	called by o_hog before starting the hog and pingers
+ */
+void hg_begin (void)
+{
+	int64_t i;
+
+	hg_t0 = hg_time ();
+	for (i=0; i<hg_nbranches; i++) {
+		hg_last[i] = hg_t0;
+	}
+}
+/*}}}*/
+/*{{{  void hg_finish (void)*/
+/*
+ *	called by o_hog when all are done: passes results back to the parent, reports and exits
+ */
+__attribute__ ((force_align_arg_pointer, noreturn)) void hg_finish (void)
+{
+	int64_t res[4];
+
+	res[0] = (int64_t)(hg_time () - hg_t0);
+	res[1] = hg_maxgap;
+	res[2] = hg_pings ? (hg_sumgap / hg_pings) : 0;
+	res[3] = hg_busy_pings;
+
+	if (write (hg_resfd, res, sizeof (res)) != sizeof (res)) {
+		fprintf (stderr, "hog: failed to write result [%s]\n", strerror (errno));
+	}
+	slick_dump_stats ();
+	exit (EXIT_SUCCESS);
+}
+/*}}}*/
+
+/*{{{  static void hg_child (char *prog, int rt_argc, char **rt_argv)*/
+/*
+ *	runs the hog and pingers on one run-time thread, with or without a slice (in a child process)
+ */
+static void hg_child (char *prog, int rt_argc, char **rt_argv)
+{
+	char **argv = (char **)malloc ((rt_argc + 4) * sizeof (char *));
+	char slbuf[32];
+	void *ws, *wstop;
+	int64_t wssize;
+	int i, j = 1;
+
+	argv[0] = prog;
+	argv[j++] = "--rt-nthreads=1";
+	if (hg_mode == HG_SLICE) {
+		snprintf (slbuf, sizeof (slbuf), "--rt-slice=%d", hg_slice_ms);
+		argv[j++] = slbuf;
+	}
+	for (i=0; i<rt_argc; i++) {
+		argv[j++] = rt_argv[i];
+	}
+	argv[j] = NULL;
+
+	if (slick_init ((const char **)argv, j)) {
+		fprintf (stderr, "hog: oops, failed to initialise scheduler\n");
+		exit (EXIT_FAILURE);
+	}
+
+	hg_left = hg_chunks;
+	hg_last = (uint64_t *)malloc (hg_nbranches * sizeof (uint64_t));
+	wssize = HG_TOPWS + (HG_BRWS * (hg_nbranches + 1)) + 64;
+	ws = malloc (wssize);
+	if (!hg_last || !ws) {
+		fprintf (stderr, "hog: failed to allocate %ld bytes of workspace\n", wssize);
+		exit (EXIT_FAILURE);
+	}
+	wstop = ws + (int)(wssize - sizeof (uint64_t));
+
+	slick_startup (wstop, o_hog_startup);
+	exit (EXIT_FAILURE);
+}
+/*}}}*/
+
+
+int main (int argc, char **argv)
+{
+	char **rt_argv = (char **)malloc (argc * sizeof (char *));
+	int rt_argc = 0;
+	int modes = 0;
+	int failed = 0;
+	int i;
+
+	for (i=1; i<argc; i++) {
+		if (!strncmp (argv[i], "--rt-", 5)) {
+			if (strncmp (argv[i] + 5, "slice", 5)) {
+				rt_argv[rt_argc++] = argv[i];		/* passed through to each run */
+			}
+		} else if (!strcmp (argv[i], "coop")) {
+			modes |= (1 << HG_COOP);
+		} else if (!strcmp (argv[i], "slice")) {
+			modes |= (1 << HG_SLICE);
+		} else if (!strcmp (argv[i], "-p") && (i < (argc - 1))) {
+			hg_npingers = atol (argv[++i]);
+		} else if (!strcmp (argv[i], "-c") && (i < (argc - 1))) {
+			hg_chunks = atol (argv[++i]);
+		} else if (!strcmp (argv[i], "-u") && (i < (argc - 1))) {
+			hg_chunk_us = atol (argv[++i]);
+		} else if (!strcmp (argv[i], "-s") && (i < (argc - 1))) {
+			hg_slice_ms = atoi (argv[++i]);
+		} else {
+			fprintf (stderr, "usage: %s [coop] [slice] [-p pingers] [-c chunks] [-u us-per-chunk] [-s slice-ms] [--rt-...]\n", argv[0]);
+			exit (EXIT_FAILURE);
+		}
+	}
+	if (!modes) {
+		modes = (1 << HG_COOP) | (1 << HG_SLICE);
+	}
+	hg_nbranches = hg_npingers + 1;
+	if ((hg_npingers < 1) || (hg_npingers > HG_MAXPINGERS) || (hg_chunks < 1) || (hg_chunk_us < 1) || (hg_slice_ms < 1)) {
+		fprintf (stderr, "hog: expected 1..%d pingers, at least one chunk of work and a slice of at least 1 ms\n", HG_MAXPINGERS);
+		exit (EXIT_FAILURE);
+	}
+
+	fprintf (stderr, "hog: %ld chunks of %ld us, %ld pingers, slice %d ms\n", hg_chunks, hg_chunk_us, hg_npingers, hg_slice_ms);
+
+	for (hg_mode = HG_COOP; hg_mode <= HG_SLICE; hg_mode++) {
+		int fds[2];
+		int64_t res[4];
+		pid_t pid;
+		int status;
+
+		if (!(modes & (1 << hg_mode))) {
+			continue;
+		}
+		if (pipe (fds) < 0) {
+			fprintf (stderr, "hog: failed to create pipe [%s]\n", strerror (errno));
+			exit (EXIT_FAILURE);
+		}
+		fflush (stderr);
+
+		pid = fork ();
+		if (pid < 0) {
+			fprintf (stderr, "hog: failed to fork [%s]\n", strerror (errno));
+			exit (EXIT_FAILURE);
+		} else if (!pid) {
+			close (fds[0]);
+			hg_resfd = fds[1];
+			hg_child (argv[0], rt_argc, rt_argv);
+		}
+		close (fds[1]);
+
+		if (read (fds[0], res, sizeof (res)) != sizeof (res)) {
+			fprintf (stderr, "hog: %s run failed\n", hg_modenames[hg_mode]);
+			exit (EXIT_FAILURE);
+		}
+		close (fds[0]);
+		waitpid (pid, &status, 0);
+
+		printf ("%-5s: %10.3f ms, pingers waited at most %10.3f ms, mean %10.3f ms, %ld pings while the hog ran\n", hg_modenames[hg_mode],
+				(double)res[0] / 1000000.0, (double)res[1] / 1000000.0, (double)res[2] / 1000000.0, res[3]);
+		fflush (stdout);
+
+		/* with a slice the hog must have yielded: pingers got in while it was busy, and never waited for all of it */
+		if ((hg_mode == HG_SLICE) && (!res[3] || (res[1] > (res[0] / 2)))) {
+			fprintf (stderr, "hog: hog did not yield to the pingers with a %d ms slice\n", hg_slice_ms);
+			failed++;
+		}
+	}
+
+	if (failed) {
+		exit (EXIT_FAILURE);
+	}
+	return 0;
+}
+
@@ -0,0 +1,413 @@
+/*
+ *	netchan.c -- wrapper for netchan test program (ping-pong between two slick nodes, over a networked channel link)
+ *	Copyright (C) 2016 Fred Barnes, University of Kent <frmb@kent.ac.uk>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <time.h>
+#include <errno.h>
+
+#include <sched.h>
+#include <pthread.h>
+
+#include "slick.h"
+
+
+#define NC_MAXPAIRS	(4096)
+#define NC_MAXTHREADS	(128)
+#define NC_TOPWS	(48)			/* o_netchan frame, including return-address */
+#define NC_BRWS		(64)			/* each worker's workspace */
+
+#define NC_UNIX		0			/* link over a Unix-domain socket.. */
+#define NC_TCP		1			/* ..or TCP on loopback */
+
+#define NC_PINGER	0			/* nc_role: sends each message and waits for it back.. */
+#define NC_PONGER	1			/* ..from the other node, which echoes it */
+
+#define NC_IN		0			/* nc_req_t.op, as in netchan_code.S */
+#define NC_OUT		1
+
+typedef struct {				/* laid out for netchan_code.S */
+	int64_t op;
+	void *link;
+	int64_t vchan;
+	void *buf;
+	int64_t count;
+} nc_req_t;
+
+extern void o_netchan_startup (void);		/* synthetic compiler-generated entry point */
+
+int64_t nc_npairs = 4;				/* read by the process code */
+
+static const char *nc_modenames[] = {"unix", "tcp"};
+static int nc_mode;
+static int nc_role;
+static int nc_nthreads = 2;
+static int64_t nc_rounds = 10000;		/* messages each pinger sends.. */
+static int64_t nc_bytes = 64;			/* ..of this size */
+static uint64_t nc_t0;
+static int nc_resfd = -1;
+static int nc_lfd = -1;				/* the ponger's listening socket.. */
+static char nc_addr[128];			/* ..at this address */
+
+static void *nc_link;				/* to the other node: virtual channels 2i (pinger to ponger) and 2i+1 (back) */
+static nc_req_t *nc_reqs;			/* each worker's request */
+static int64_t *nc_pos;				/* and how far through */
+static uint8_t **nc_buf;			/* its message buffer */
+static uint64_t *nc_sent;			/* (pinger) when its message went */
+static int64_t nc_sumrtt = 0;			/* time from sending each message to having it back */
+static int64_t nc_maxrtt = 0;
+static int64_t nc_nrtts = 0;
+static int64_t nc_wrong = 0;			/* messages that came back (or arrived) other than as sent */
+
+
+/*{{{  static uint64_t nc_time (void)*/
+/*
+ *	current time in nanoseconds
+ */
+static uint64_t nc_time (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+/*}}}*/
+/*{{{  static void nc_fill (int64_t idx, int64_t seq)*/
+/*
+ *	sets up message 'seq' of pair 'idx' in its buffer
+ */
+static void nc_fill (int64_t idx, int64_t seq)
+{
+	uint8_t *buf = nc_buf[idx];
+
+	*(int64_t *)buf = seq;
+	memset (buf + sizeof (int64_t), (int)((idx * 31) + seq + 1) & 0xff, nc_bytes - sizeof (int64_t));
+}
+/*}}}*/
+/*{{{  static int nc_check (int64_t idx, int64_t seq)*/
+/*
+ *	non-zero if the buffer holds message 'seq' of pair 'idx', as nc_fill() left it
+ */
+static int nc_check (int64_t idx, int64_t seq)
+{
+	uint8_t *buf = nc_buf[idx];
+	uint8_t want = (uint8_t)((idx * 31) + seq + 1);
+	int64_t i;
+
+	if (*(int64_t *)buf != seq) {
+		return 0;
+	}
+	for (i=sizeof (int64_t); i<nc_bytes; i++) {
+		if (buf[i] != want) {
+			return 0;
+		}
+	}
+	return 1;
+}
+/*}}}*/
+/*{{{  static void nc_setreq (nc_req_t *rq, int64_t idx, int input)*/
+/*
+ *	sets up a worker's next request: input or output on its pair's virtual channel for this direction
+ */
+static void nc_setreq (nc_req_t *rq, int64_t idx, int input)
+{
+	int toponger = ((nc_role == NC_PINGER) != input);
+
+	rq->op = input ? NC_IN : NC_OUT;
+	rq->link = nc_link;
+	rq->vchan = (2 * idx) + (toponger ? 0 : 1);
+	rq->buf = nc_buf[idx];
+	rq->count = nc_bytes;
+}
+/*}}}*/
+/*{{{  nc_req_t *nc_step (int64_t idx)*/
+/*
+ *	called by each worker: checks how its last request went and sets up the next, returning it (NULL when
+ *	done).  A pinger sends a message and takes it back; a ponger echoes each as it comes.
+ */
+__attribute__ ((force_align_arg_pointer)) nc_req_t *nc_step (int64_t idx)
+{
+	nc_req_t *rq = &(nc_reqs[idx]);
+	int64_t pos = nc_pos[idx]++;
+	int64_t seq = pos >> 1;
+
+	if (nc_role == NC_PINGER) {
+		if (pos && !(pos & 1)) {
+			int64_t rtt = (int64_t)(nc_time () - nc_sent[idx]);
+			int64_t max;
+
+			if (!nc_check (idx, seq - 1)) {
+				__sync_fetch_and_add (&nc_wrong, 1);
+			}
+			__sync_fetch_and_add (&nc_sumrtt, rtt);
+			__sync_fetch_and_add (&nc_nrtts, 1);
+			do {
+				max = nc_maxrtt;
+			} while ((rtt > max) && !__sync_bool_compare_and_swap (&nc_maxrtt, max, rtt));
+		}
+
+		if (seq >= nc_rounds) {
+			return NULL;
+		} else if (!(pos & 1)) {
+			nc_fill (idx, seq);
+			nc_setreq (rq, idx, 0);
+			nc_sent[idx] = nc_time ();
+		} else {
+			memset (nc_buf[idx], 0, nc_bytes);
+			nc_setreq (rq, idx, 1);
+		}
+	} else {
+		if (pos & 1) {
+			if (!nc_check (idx, seq)) {
+				__sync_fetch_and_add (&nc_wrong, 1);
+			}
+			nc_setreq (rq, idx, 0);		/* straight back */
+		} else if (seq >= nc_rounds) {
+			return NULL;
+		} else {
+			nc_setreq (rq, idx, 1);
+		}
+	}
+
+	return rq;
+}
+/*}}}*/
+/*{{{  void nc_begin (void)*/
+/*
+ *	called by o_netchan before starting the workers
+ */
+void nc_begin (void)
+{
+	nc_t0 = nc_time ();
+}
+/*}}}*/
+/*{{{  void nc_finish (void)*/
+/*
+ *	called by o_netchan when all workers are done: passes results back to the parent, reports (the pinger)
+ *	and exits
+ */
+__attribute__ ((force_align_arg_pointer, noreturn)) void nc_finish (void)
+{
+	int64_t res[4];
+
+	res[0] = (int64_t)(nc_time () - nc_t0);
+	res[1] = nc_nrtts ? (nc_sumrtt / nc_nrtts) : 0;
+	res[2] = nc_maxrtt;
+	res[3] = nc_wrong + (((nc_role == NC_PONGER) || (nc_nrtts == (nc_npairs * nc_rounds))) ? 0 : 1);
+
+	if (write (nc_resfd, res, sizeof (res)) != sizeof (res)) {
+		fprintf (stderr, "netchan: failed to write result [%s]\n", strerror (errno));
+	}
+	if (nc_role == NC_PINGER) {
+		slick_dump_stats ();
+	}
+	exit (EXIT_SUCCESS);
+}
+/*}}}*/
+
+/*{{{  static void nc_child (char *prog, int rt_argc, char **rt_argv)*/
+/*
+ *	runs the pinger or ponger workers, one for each pair, on a link to the other (in a child process)
+ */
+static void nc_child (char *prog, int rt_argc, char **rt_argv)
+{
+	char **argv = (char **)malloc ((rt_argc + 3) * sizeof (char *));
+	char ntbuf[32];
+	void *ws, *wstop;
+	int64_t wssize;
+	int64_t i;
+	int j = 1;
+
+	argv[0] = prog;
+	snprintf (ntbuf, sizeof (ntbuf), "--rt-nthreads=%d", nc_nthreads);
+	argv[j++] = ntbuf;
+	for (i=0; i<rt_argc; i++) {
+		argv[j++] = rt_argv[i];
+	}
+	argv[j] = NULL;
+
+	if (slick_init ((const char **)argv, j)) {
+		fprintf (stderr, "netchan: oops, failed to initialise scheduler\n");
+		exit (EXIT_FAILURE);
+	}
+
+	nc_reqs = (nc_req_t *)calloc (nc_npairs, sizeof (nc_req_t));
+	nc_pos = (int64_t *)calloc (nc_npairs, sizeof (int64_t));
+	nc_buf = (uint8_t **)malloc (nc_npairs * sizeof (uint8_t *));
+	nc_sent = (uint64_t *)calloc (nc_npairs, sizeof (uint64_t));
+	wssize = NC_TOPWS + (NC_BRWS * (nc_npairs + 1)) + 64;
+	ws = malloc (wssize);
+	if (!nc_reqs || !nc_pos || !nc_buf || !nc_sent || !ws) {
+		fprintf (stderr, "netchan: failed to allocate %ld bytes of workspace\n", wssize);
+		exit (EXIT_FAILURE);
+	}
+	for (i=0; i<nc_npairs; i++) {
+		nc_buf[i] = (uint8_t *)malloc (nc_bytes);
+		if (!nc_buf[i]) {
+			fprintf (stderr, "netchan: failed to allocate buffers\n");
+			exit (EXIT_FAILURE);
+		}
+	}
+
+	if (nc_role == NC_PONGER) {
+		nc_link = slick_netlink_accept (nc_lfd, (int)(2 * nc_npairs));
+		close (nc_lfd);
+	} else {
+		close (nc_lfd);
+		nc_link = slick_netlink_connect (nc_addr, (int)(2 * nc_npairs));
+	}
+	if (!nc_link) {
+		fprintf (stderr, "netchan: failed to make link at %s\n", nc_addr);
+		exit (EXIT_FAILURE);
+	}
+	wstop = ws + (int)(wssize - sizeof (uint64_t));
+
+	slick_startup (wstop, o_netchan_startup);
+	exit (EXIT_FAILURE);
+}
+/*}}}*/
+/*{{{  static int nc_listen (void)*/
+/*
+ *	sets up the address the ponger listens at for this run, and the listening socket (before forking the two
+ *	sides, so the pinger can connect straight away); returns non-zero on failure
+ */
+static int nc_listen (void)
+{
+	if (nc_mode == NC_UNIX) {
+		snprintf (nc_addr, sizeof (nc_addr), "unix:/tmp/slick-netchan-%d", (int)getpid ());
+		unlink (nc_addr + 5);
+		nc_lfd = slick_netlink_listen (nc_addr);
+	} else {
+		struct sockaddr_in sin;
+		socklen_t slen = sizeof (sin);
+
+		/* any free port */
+		nc_lfd = slick_netlink_listen ("tcp:127.0.0.1:0");
+		if ((nc_lfd >= 0) && !getsockname (nc_lfd, (struct sockaddr *)&sin, &slen)) {
+			snprintf (nc_addr, sizeof (nc_addr), "tcp:127.0.0.1:%d", (int)ntohs (sin.sin_port));
+		}
+	}
+	if (nc_lfd < 0) {
+		fprintf (stderr, "netchan: failed to listen for %s link\n", nc_modenames[nc_mode]);
+		return -1;
+	}
+	return 0;
+}
+/*}}}*/
+
+
+int main (int argc, char **argv)
+{
+	char **rt_argv = (char **)malloc (argc * sizeof (char *));
+	int rt_argc = 0;
+	int modes = 0;
+	int failed = 0;
+	int i;
+
+	for (i=1; i<argc; i++) {
+		if (!strncmp (argv[i], "--rt-", 5)) {
+			if (strncmp (argv[i] + 5, "nthreads", 8)) {
+				rt_argv[rt_argc++] = argv[i];		/* passed through to each run */
+			}
+		} else if (!strcmp (argv[i], "unix")) {
+			modes |= (1 << NC_UNIX);
+		} else if (!strcmp (argv[i], "tcp")) {
+			modes |= (1 << NC_TCP);
+		} else if (!strcmp (argv[i], "-p") && (i < (argc - 1))) {
+			nc_npairs = atol (argv[++i]);
+		} else if (!strcmp (argv[i], "-t") && (i < (argc - 1))) {
+			nc_nthreads = atoi (argv[++i]);
+		} else if (!strcmp (argv[i], "-n") && (i < (argc - 1))) {
+			nc_rounds = atol (argv[++i]);
+		} else if (!strcmp (argv[i], "-s") && (i < (argc - 1))) {
+			nc_bytes = atol (argv[++i]);
+		} else {
+			fprintf (stderr, "usage: %s [unix] [tcp] [-p pairs] [-t threads] [-n messages] [-s bytes] [--rt-...]\n", argv[0]);
+			exit (EXIT_FAILURE);
+		}
+	}
+	if (!modes) {
+		modes = (1 << NC_UNIX) | (1 << NC_TCP);
+	}
+	if ((nc_npairs < 1) || (nc_npairs > NC_MAXPAIRS) || (nc_nthreads < 1) || (nc_nthreads > NC_MAXTHREADS) ||
+			(nc_bytes < (int64_t)sizeof (int64_t)) || (nc_bytes > (16 << 20)) || (nc_rounds < 1)) {
+		fprintf (stderr, "netchan: expected 1..%d pairs, 1..%d threads and messages of 8 bytes to 16 MB\n",
+				NC_MAXPAIRS, NC_MAXTHREADS);
+		exit (EXIT_FAILURE);
+	}
+
+	fprintf (stderr, "netchan: %ld pairs of workers on %d threads in each of two slick nodes, %ld messages of %ld bytes each way\n",
+			nc_npairs, nc_nthreads, nc_rounds, nc_bytes);
+
+	for (nc_mode = NC_UNIX; nc_mode <= NC_TCP; nc_mode++) {
+		int fds[2][2];
+		int64_t res[2][4];
+		pid_t pid[2];
+		int status;
+
+		if (!(modes & (1 << nc_mode))) {
+			continue;
+		}
+		if (nc_listen ()) {
+			exit (EXIT_FAILURE);
+		}
+		fflush (stderr);
+
+		for (nc_role = NC_PINGER; nc_role <= NC_PONGER; nc_role++) {
+			if (pipe (fds[nc_role]) < 0) {
+				fprintf (stderr, "netchan: failed to create pipe [%s]\n", strerror (errno));
+				exit (EXIT_FAILURE);
+			}
+			pid[nc_role] = fork ();
+			if (pid[nc_role] < 0) {
+				fprintf (stderr, "netchan: failed to fork [%s]\n", strerror (errno));
+				exit (EXIT_FAILURE);
+			} else if (!pid[nc_role]) {
+				close (fds[nc_role][0]);
+				nc_resfd = fds[nc_role][1];
+				nc_child (argv[0], rt_argc, rt_argv);
+			}
+			close (fds[nc_role][1]);
+		}
+		close (nc_lfd);
+
+		for (nc_role = NC_PINGER; nc_role <= NC_PONGER; nc_role++) {
+			if (read (fds[nc_role][0], res[nc_role], sizeof (res[nc_role])) != sizeof (res[nc_role])) {
+				fprintf (stderr, "netchan: %s run failed\n", nc_modenames[nc_mode]);
+				exit (EXIT_FAILURE);
+			}
+			close (fds[nc_role][0]);
+			waitpid (pid[nc_role], &status, 0);
+		}
+		if (nc_mode == NC_UNIX) {
+			unlink (nc_addr + 5);
+		}
+
+		printf ("%-8s: %10.3f ms, %10.1f round trips per ms, mean %8.3f us, max %10.3f us%s\n", nc_modenames[nc_mode],
+				(double)res[0][0] / 1000000.0, res[0][0] ? ((double)(nc_npairs * nc_rounds) * 1000000.0 / (double)res[0][0]) : 0.0,
+				(double)res[0][1] / 1000.0, (double)res[0][2] / 1000.0, (res[0][3] || res[1][3]) ? " (WRONG)" : "");
+		fflush (stdout);
+
+		/* both nodes check every message's sequence number and bytes, and the pinger that all came back */
+		if (res[0][3] || res[1][3]) {
+			fprintf (stderr, "netchan: %s run lost or corrupted messages (pinger %ld, ponger %ld)\n", nc_modenames[nc_mode],
+					res[0][3], res[1][3]);
+			failed++;
+		}
+	}
+
+	if (failed) {
+		exit (EXIT_FAILURE);
+	}
+	return 0;
+}
+
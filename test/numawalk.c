@@ -0,0 +1,309 @@
+/*
+ *	numawalk.c -- wrapper for NUMA placement test program (parallel workers streaming over private buffers)
+ *	Copyright (C) 2016 Fred Barnes, University of Kent <frmb@kent.ac.uk>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <errno.h>
+
+#include <sched.h>
+#include <pthread.h>
+
+#include "slick.h"
+
+
+#define NW_MAXWORKERS	(1024)
+#define NW_TOPWS	(48)			/* o_numawalk frame, including return-address */
+#define NW_BRWS		(64)			/* each worker's workspace */
+#define NW_SAMPLES	(16)			/* pages sampled per buffer for placement */
+
+#define NW_HEAP		0			/* buffers from the heap, touched by the main thread */
+#define NW_NODE0	1			/* buffers placed on run-time thread 0's node */
+#define NW_LOCAL	2			/* buffers allocated and touched by the worker itself */
+
+extern void o_numawalk_startup (void);		/* synthetic compiler-generated entry point */
+
+int64_t nw_nworkers = 0;			/* read by the process code */
+
+static const char *nw_modenames[] = {"heap", "node0", "local"};
+static int nw_mode;
+static int64_t nw_bytes = 16 << 20;
+static int nw_passes = 8;
+static void *nw_bufs[NW_MAXWORKERS];
+static uint64_t nw_t0;
+static int nw_resfd = -1;
+
+static int64_t nw_walk_ns = 0;			/* summed over workers */
+static int64_t nw_pages = 0;			/* sampled pages */
+static int64_t nw_remote = 0;			/* of which on a node other than the walking CPU's */
+static int64_t nw_checksum = 0;
+
+
+/*{{{  static uint64_t nw_time (void)*/
+/*
+ *	current time in nanoseconds
+ */
+static uint64_t nw_time (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+/*}}}*/
+/*{{{  static void nw_touch (void *buf)*/
+/*
+ *	fills in a buffer (and so places its pages, if not already placed)
+ */
+static void nw_touch (void *buf)
+{
+	uint64_t *p = (uint64_t *)buf;
+	int64_t i;
+
+	for (i=0; i<(nw_bytes / (int64_t)sizeof (uint64_t)); i++) {
+		p[i] = (uint64_t)i;
+	}
+}
+/*}}}*/
+/*{{{  static void nw_sample (void *buf)*/
+/*
+ *	counts how many sampled pages of a buffer live on a node other than the one we're running on
+ */
+static void nw_sample (void *buf)
+{
+	void *pages[NW_SAMPLES];
+	int status[NW_SAMPLES];
+	unsigned int cpu, node;
+	int i, remote = 0;
+
+	if (syscall (SYS_getcpu, &cpu, &node, NULL) < 0) {
+		return;
+	}
+	for (i=0; i<NW_SAMPLES; i++) {
+		pages[i] = buf + ((nw_bytes / NW_SAMPLES) * i);
+	}
+	if (syscall (SYS_move_pages, 0, NW_SAMPLES, pages, NULL, status, 0) < 0) {
+		return;
+	}
+	for (i=0; i<NW_SAMPLES; i++) {
+		if ((status[i] >= 0) && (status[i] != (int)node)) {
+			remote++;
+		}
+	}
+	__sync_fetch_and_add (&nw_pages, NW_SAMPLES);
+	__sync_fetch_and_add (&nw_remote, remote);
+}
+/*}}}*/
+/*{{{  void nw_work (int64_t idx)*/
+/*
+ *	called by each worker process: streams over its buffer a few times
+ */
+__attribute__ ((force_align_arg_pointer)) void nw_work (int64_t idx)
+{
+	uint64_t *p;
+	uint64_t t0, sum = 0;
+	int64_t i;
+	int r;
+
+	if (nw_mode == NW_LOCAL) {
+		nw_bufs[idx] = slick_alloc_ws (nw_bytes, -1);
+		nw_touch (nw_bufs[idx]);
+	}
+	p = (uint64_t *)nw_bufs[idx];
+
+	t0 = nw_time ();
+	for (r=0; r<nw_passes; r++) {
+		for (i=0; i<(nw_bytes / (int64_t)sizeof (uint64_t)); i += 8) {
+			sum += p[i];
+		}
+	}
+	__sync_fetch_and_add (&nw_walk_ns, (int64_t)(nw_time () - t0));
+	__sync_fetch_and_add (&nw_checksum, (int64_t)sum);
+
+	nw_sample (p);
+}
+/*}}}*/
+/*{{{  void nw_begin (void)*/
+/*
+ *	called by o_numawalk before starting the workers
+ */
+void nw_begin (void)
+{
+	nw_t0 = nw_time ();
+}
+/*}}}*/
+/*{{{  void nw_finish (void)*/
+/*
+ *	called by o_numawalk when all workers are done: passes results back to the parent, reports and exits
+ */
+__attribute__ ((force_align_arg_pointer, noreturn)) void nw_finish (void)
+{
+	int64_t res[5];
+
+	res[0] = (int64_t)(nw_time () - nw_t0);
+	res[1] = nw_walk_ns;
+	res[2] = nw_pages;
+	res[3] = nw_remote;
+	res[4] = nw_checksum;
+
+	if (write (nw_resfd, res, sizeof (res)) != sizeof (res)) {
+		fprintf (stderr, "numawalk: failed to write result [%s]\n", strerror (errno));
+	}
+	slick_dump_stats ();
+	exit (EXIT_SUCCESS);
+}
+/*}}}*/
+
+/*{{{  static void nw_child (char *prog, int rt_argc, char **rt_argv)*/
+/*
+ *	runs the workers with a particular buffer placement (in a child process)
+ */
+static void nw_child (char *prog, int rt_argc, char **rt_argv)
+{
+	char **argv = (char **)malloc ((rt_argc + 3) * sizeof (char *));
+	void *ws, *wstop;
+	int64_t wssize;
+	int i;
+
+	argv[0] = prog;
+	argv[1] = "--rt-bind";
+	for (i=0; i<rt_argc; i++) {
+		argv[i + 2] = rt_argv[i];
+	}
+	argv[i + 2] = NULL;
+
+	if (slick_init ((const char **)argv, rt_argc + 2)) {
+		fprintf (stderr, "numawalk: oops, failed to initialise scheduler\n");
+		exit (EXIT_FAILURE);
+	}
+
+	for (i=0; (nw_mode != NW_LOCAL) && (i<nw_nworkers); i++) {
+		nw_bufs[i] = (nw_mode == NW_HEAP) ? malloc (nw_bytes) : slick_alloc_ws (nw_bytes, 0);
+		if (!nw_bufs[i]) {
+			fprintf (stderr, "numawalk: failed to allocate %ld bytes\n", nw_bytes);
+			exit (EXIT_FAILURE);
+		}
+		nw_touch (nw_bufs[i]);
+	}
+
+	wssize = NW_TOPWS + (NW_BRWS * (nw_nworkers + 1)) + 64;
+	ws = slick_alloc_ws (wssize, 0);
+	wstop = ws + (int)(wssize - sizeof (uint64_t));
+
+	slick_startup (wstop, o_numawalk_startup);
+	exit (EXIT_FAILURE);
+}
+/*}}}*/
+
+
+int main (int argc, char **argv)
+{
+	char **rt_argv = (char **)malloc (argc * sizeof (char *));
+	int rt_argc = 0;
+	int modes = 0;
+	int failed = 0;
+	uint64_t k, expected;
+	int i;
+
+	for (i=1; i<argc; i++) {
+		if (!strncmp (argv[i], "--rt-", 5)) {
+			rt_argv[rt_argc++] = argv[i];			/* passed through to each run */
+		} else if (!strcmp (argv[i], "heap")) {
+			modes |= (1 << NW_HEAP);
+		} else if (!strcmp (argv[i], "node0")) {
+			modes |= (1 << NW_NODE0);
+		} else if (!strcmp (argv[i], "local")) {
+			modes |= (1 << NW_LOCAL);
+		} else if (!strcmp (argv[i], "-w") && (i < (argc - 1))) {
+			nw_nworkers = atol (argv[++i]);
+		} else if (!strcmp (argv[i], "-m") && (i < (argc - 1))) {
+			nw_bytes = atol (argv[++i]) << 20;
+		} else if (!strcmp (argv[i], "-r") && (i < (argc - 1))) {
+			nw_passes = atoi (argv[++i]);
+		} else {
+			fprintf (stderr, "usage: %s [heap] [node0] [local] [-w workers] [-m MiB-per-worker] [-r passes] [--rt-...]\n", argv[0]);
+			exit (EXIT_FAILURE);
+		}
+	}
+	if (!modes) {
+		modes = (1 << NW_HEAP) | (1 << NW_NODE0) | (1 << NW_LOCAL);
+	}
+	if (!nw_nworkers) {
+		nw_nworkers = 2 * (int64_t)sysconf (_SC_NPROCESSORS_ONLN);
+	}
+	if ((nw_nworkers < 1) || (nw_nworkers > NW_MAXWORKERS) || (nw_bytes < (1 << 20)) || (nw_passes < 1)) {
+		fprintf (stderr, "numawalk: expected 1..%d workers, at least 1 MiB each and at least one pass\n", NW_MAXWORKERS);
+		exit (EXIT_FAILURE);
+	}
+
+	fprintf (stderr, "numawalk: %ld workers, %ld MiB each, %d passes\n", nw_nworkers, nw_bytes >> 20, nw_passes);
+
+	/* every worker sums p[0], p[8], p[16], .. over its buffer, where p[i] == i */
+	k = (uint64_t)nw_bytes / (8 * sizeof (uint64_t));
+	expected = ((8 * ((k * (k - 1)) / 2)) * (uint64_t)nw_passes) * (uint64_t)nw_nworkers;
+
+	for (nw_mode = NW_HEAP; nw_mode <= NW_LOCAL; nw_mode++) {
+		int fds[2];
+		int64_t res[5];
+		pid_t pid;
+		int status;
+
+		if (!(modes & (1 << nw_mode))) {
+			continue;
+		}
+		if (pipe (fds) < 0) {
+			fprintf (stderr, "numawalk: failed to create pipe [%s]\n", strerror (errno));
+			exit (EXIT_FAILURE);
+		}
+		fflush (stderr);
+
+		pid = fork ();
+		if (pid < 0) {
+			fprintf (stderr, "numawalk: failed to fork [%s]\n", strerror (errno));
+			exit (EXIT_FAILURE);
+		} else if (!pid) {
+			close (fds[0]);
+			nw_resfd = fds[1];
+			nw_child (argv[0], rt_argc, rt_argv);
+		}
+		close (fds[1]);
+
+		if (read (fds[0], res, sizeof (res)) != sizeof (res)) {
+			fprintf (stderr, "numawalk: %s run failed\n", nw_modenames[nw_mode]);
+			exit (EXIT_FAILURE);
+		}
+		close (fds[0]);
+		waitpid (pid, &status, 0);
+
+		printf ("%-6s: %10.3f ms, walking %10.3f ms (%7.2f GB/s per worker), remote pages %5.1f%% of %ld sampled\n",
+				nw_modenames[nw_mode], (double)res[0] / 1000000.0, (double)res[1] / 1000000.0,
+				((double)nw_bytes * nw_passes * nw_nworkers) / (double)res[1],
+				res[2] ? (100.0 * (double)res[3] / (double)res[2]) : 0.0, res[2]);
+		fflush (stdout);
+
+		if ((uint64_t)res[4] != expected) {
+			fprintf (stderr, "numawalk: %s run read back the wrong data (checksum %lu, expected %lu)\n",
+					nw_modenames[nw_mode], (uint64_t)res[4], expected);
+			failed++;
+		}
+		if ((nw_mode == NW_LOCAL) && res[3]) {
+			/* workers allocate and walk on the same (bound) thread, so nothing should be remote */
+			fprintf (stderr, "numawalk: local run has %ld of %ld sampled pages on a remote node\n", res[3], res[2]);
+			failed++;
+		}
+	}
+
+	if (failed) {
+		exit (EXIT_FAILURE);
+	}
+	return 0;
+}
+
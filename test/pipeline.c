@@ -0,0 +1,291 @@
+/*
+ *	pipeline.c -- wrapper for pipeline test program (commstime-like chains of stages, each with private state)
+ *	Copyright (C) 2016 Fred Barnes, University of Kent <frmb@kent.ac.uk>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <errno.h>
+
+#include <sched.h>
+#include <pthread.h>
+
+#include "slick.h"
+
+
+#define PL_MAXSTAGES	(65536)
+#define PL_TOPWS	(48)			/* o_pipeline frame, including return-address */
+#define PL_BRWS		(128)			/* each stage's workspace */
+
+#define PL_DRIFT	0			/* woken stages run wherever they were woken */
+#define PL_HOME		1			/* woken stages go back to where they last ran (--rt-soft-affinity) */
+
+extern void o_pipeline_startup (void);		/* synthetic compiler-generated entry point */
+
+int64_t pl_nstages = 0;				/* read by the process code */
+int64_t pl_ntokens = 20000;			/* tokens through each pipeline, read by the process code */
+
+static const char *pl_modenames[] = {"drift", "home"};
+static int pl_mode;
+static int64_t pl_npipes = 0;
+static int64_t pl_depth = 8;			/* stages per pipeline */
+static int64_t pl_bytes = 64 << 10;		/* private state per stage */
+static uint64_t pl_t0;
+static int pl_resfd = -1;
+
+static void **pl_chans;				/* input channel of each stage (first stages' unused) */
+static uint64_t **pl_bufs;			/* state of each stage, allocated by the stage itself */
+static pthread_t *pl_last;			/* run-time thread each stage last ran on */
+static int64_t *pl_moves;			/* times each stage found itself on another thread */
+static int64_t *pl_sums;
+static int64_t pl_checksum = 0;
+
+
+/*{{{  static uint64_t pl_time (void)*/
+/*
+ *	current time in nanoseconds
+ */
+static uint64_t pl_time (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+/*}}}*/
+/*{{{  void **pl_inchan (int64_t idx), void **pl_outchan (int64_t idx)*/
+/*
+ *	channels a stage reads from and writes to, NULL at the ends of its pipeline
+ */
+void **pl_inchan (int64_t idx)
+{
+	return (idx % pl_depth) ? &(pl_chans[idx]) : NULL;
+}
+
+void **pl_outchan (int64_t idx)
+{
+	return ((idx % pl_depth) < (pl_depth - 1)) ? &(pl_chans[idx + 1]) : NULL;
+}
+/*}}}*/
+/*{{{  int64_t pl_work (int64_t idx, int64_t value)*/
+/*
+ *	called by each stage for each token: walks its private state, returns the value to pass on
+ */
+__attribute__ ((force_align_arg_pointer)) int64_t pl_work (int64_t idx, int64_t value)
+{
+	pthread_t self = pthread_self ();
+	uint64_t *p = pl_bufs[idx];
+	int64_t i, sum = 0;
+
+	if (!p) {
+		p = (uint64_t *)malloc (pl_bytes);
+		for (i=0; i<(pl_bytes / (int64_t)sizeof (uint64_t)); i++) {
+			p[i] = (uint64_t)(i ^ idx);
+		}
+		pl_bufs[idx] = p;
+	} else if (!pthread_equal (self, pl_last[idx])) {
+		pl_moves[idx]++;
+	}
+	pl_last[idx] = self;
+
+	for (i=0; i<(pl_bytes / (int64_t)sizeof (uint64_t)); i += 8) {
+		sum += p[i];
+	}
+	pl_sums[idx] += sum;
+
+	if ((idx % pl_depth) == (pl_depth - 1)) {
+		__sync_fetch_and_add (&pl_checksum, value);
+	}
+	return value + 1;
+}
+/*}}}*/
+/*{{{  void pl_begin (void)*/
+/*
+ *	called by o_pipeline before starting the stages
+ */
+void pl_begin (void)
+{
+	pl_t0 = pl_time ();
+}
+/*}}}*/
+/*{{{  void pl_finish (void)*/
+/*
+ *	called by o_pipeline when all stages are done: passes results back to the parent, reports and exits
+ */
+__attribute__ ((force_align_arg_pointer, noreturn)) void pl_finish (void)
+{
+	int64_t res[3];
+	int64_t i;
+
+	res[0] = (int64_t)(pl_time () - pl_t0);
+	res[1] = 0;
+	for (i=0; i<pl_nstages; i++) {
+		res[1] += pl_moves[i];
+	}
+	res[2] = pl_checksum;
+
+	if (write (pl_resfd, res, sizeof (res)) != sizeof (res)) {
+		fprintf (stderr, "pipeline: failed to write result [%s]\n", strerror (errno));
+	}
+	slick_dump_stats ();
+	exit (EXIT_SUCCESS);
+}
+/*}}}*/
+
+/*{{{  static void pl_child (char *prog, int rt_argc, char **rt_argv)*/
+/*
+ *	runs the pipelines with or without soft affinity (in a child process)
+ */
+static void pl_child (char *prog, int rt_argc, char **rt_argv)
+{
+	char **argv = (char **)malloc ((rt_argc + 3) * sizeof (char *));
+	void *ws, *wstop;
+	int64_t wssize;
+	int i, j = 1;
+
+	argv[0] = prog;
+	if (pl_mode == PL_HOME) {
+		argv[j++] = "--rt-soft-affinity";
+	}
+	for (i=0; i<rt_argc; i++) {
+		argv[j++] = rt_argv[i];
+	}
+	argv[j] = NULL;
+
+	if (slick_init ((const char **)argv, j)) {
+		fprintf (stderr, "pipeline: oops, failed to initialise scheduler\n");
+		exit (EXIT_FAILURE);
+	}
+
+	pl_chans = (void **)calloc (pl_nstages, sizeof (void *));
+	pl_bufs = (uint64_t **)calloc (pl_nstages, sizeof (uint64_t *));
+	pl_last = (pthread_t *)calloc (pl_nstages, sizeof (pthread_t));
+	pl_moves = (int64_t *)calloc (pl_nstages, sizeof (int64_t));
+	pl_sums = (int64_t *)calloc (pl_nstages, sizeof (int64_t));
+	wssize = PL_TOPWS + (PL_BRWS * (pl_nstages + 1)) + 64;
+	ws = malloc (wssize);
+	if (!pl_chans || !pl_bufs || !pl_last || !pl_moves || !pl_sums || !ws) {
+		fprintf (stderr, "pipeline: failed to allocate %ld bytes of workspace\n", wssize);
+		exit (EXIT_FAILURE);
+	}
+	wstop = ws + (int)(wssize - sizeof (uint64_t));
+
+	slick_startup (wstop, o_pipeline_startup);
+	exit (EXIT_FAILURE);
+}
+/*}}}*/
+
+
+int main (int argc, char **argv)
+{
+	char **rt_argv = (char **)malloc (argc * sizeof (char *));
+	int rt_argc = 0;
+	int modes = 0;
+	int64_t expected;
+	double moved[2] = {-1.0, -1.0};
+	int failed = 0;
+	int i;
+
+	for (i=1; i<argc; i++) {
+		if (!strncmp (argv[i], "--rt-", 5)) {
+			if (strncmp (argv[i] + 5, "soft-affinity", 13)) {
+				rt_argv[rt_argc++] = argv[i];		/* passed through to each run */
+			}
+		} else if (!strcmp (argv[i], "drift")) {
+			modes |= (1 << PL_DRIFT);
+		} else if (!strcmp (argv[i], "home")) {
+			modes |= (1 << PL_HOME);
+		} else if (!strcmp (argv[i], "-p") && (i < (argc - 1))) {
+			pl_npipes = atol (argv[++i]);
+		} else if (!strcmp (argv[i], "-d") && (i < (argc - 1))) {
+			pl_depth = atol (argv[++i]);
+		} else if (!strcmp (argv[i], "-n") && (i < (argc - 1))) {
+			pl_ntokens = atol (argv[++i]);
+		} else if (!strcmp (argv[i], "-k") && (i < (argc - 1))) {
+			pl_bytes = atol (argv[++i]) << 10;
+		} else {
+			fprintf (stderr, "usage: %s [drift] [home] [-p pipelines] [-d stages-per-pipeline] [-n tokens] [-k KiB-per-stage] [--rt-...]\n", argv[0]);
+			exit (EXIT_FAILURE);
+		}
+	}
+	if (!modes) {
+		modes = (1 << PL_DRIFT) | (1 << PL_HOME);
+	}
+	if (!pl_npipes) {
+		pl_npipes = 2 * (int64_t)sysconf (_SC_NPROCESSORS_ONLN);
+	}
+	pl_nstages = pl_npipes * pl_depth;
+	if ((pl_npipes < 1) || (pl_depth < 2) || (pl_nstages > PL_MAXSTAGES) || (pl_ntokens < 1) || (pl_bytes < 1024)) {
+		fprintf (stderr, "pipeline: expected at least one pipeline of 2 or more stages (%d in all), a token and 1 KiB per stage\n", PL_MAXSTAGES);
+		exit (EXIT_FAILURE);
+	}
+
+	/* each pipeline's last stage sees d-1, d, .., d+n-2 (values start at 0, +1 per stage) */
+	expected = pl_npipes * ((pl_ntokens * (pl_depth - 1)) + ((pl_ntokens * (pl_ntokens - 1)) / 2));
+	fprintf (stderr, "pipeline: %ld pipelines of %ld stages, %ld tokens, %ld KiB per stage\n", pl_npipes, pl_depth, pl_ntokens, pl_bytes >> 10);
+
+	for (pl_mode = PL_DRIFT; pl_mode <= PL_HOME; pl_mode++) {
+		int fds[2];
+		int64_t res[3];
+		pid_t pid;
+		int status;
+
+		if (!(modes & (1 << pl_mode))) {
+			continue;
+		}
+		if (pipe (fds) < 0) {
+			fprintf (stderr, "pipeline: failed to create pipe [%s]\n", strerror (errno));
+			exit (EXIT_FAILURE);
+		}
+		fflush (stderr);
+
+		pid = fork ();
+		if (pid < 0) {
+			fprintf (stderr, "pipeline: failed to fork [%s]\n", strerror (errno));
+			exit (EXIT_FAILURE);
+		} else if (!pid) {
+			close (fds[0]);
+			pl_resfd = fds[1];
+			pl_child (argv[0], rt_argc, rt_argv);
+		}
+		close (fds[1]);
+
+		if (read (fds[0], res, sizeof (res)) != sizeof (res)) {
+			fprintf (stderr, "pipeline: %s run failed\n", pl_modenames[pl_mode]);
+			exit (EXIT_FAILURE);
+		}
+		close (fds[0]);
+		waitpid (pid, &status, 0);
+
+		printf ("%-5s: %10.3f ms, %8.1f ns per stage-token, stages changed thread on %5.1f%% of tokens%s\n",
+				pl_modenames[pl_mode], (double)res[0] / 1000000.0, (double)res[0] / (double)(pl_nstages * pl_ntokens),
+				100.0 * (double)res[1] / (double)(pl_nstages * pl_ntokens), (res[2] == expected) ? "" : " (WRONG)");
+		fflush (stdout);
+
+		if (res[2] != expected) {
+			fprintf (stderr, "pipeline: %s run passed the wrong values along (checksum %ld, expected %ld)\n",
+					pl_modenames[pl_mode], res[2], expected);
+			failed++;
+		}
+		moved[pl_mode] = 100.0 * (double)res[1] / (double)(pl_nstages * pl_ntokens);
+	}
+
+	/* with soft affinity a stage only changes thread when stolen, so no more often than without (give or take) */
+	if ((moved[PL_DRIFT] >= 0.0) && (moved[PL_HOME] > (moved[PL_DRIFT] + 1.0))) {
+		fprintf (stderr, "pipeline: stages changed thread more often with soft affinity (%.1f%%) than without (%.1f%%)\n",
+				moved[PL_HOME], moved[PL_DRIFT]);
+		failed++;
+	}
+
+	if (failed) {
+		exit (EXIT_FAILURE);
+	}
+	return 0;
+}
+
@@ -0,0 +1,290 @@
+/*
+ *	prefault.c -- wrapper for prefault test program (how long requests take that first touch memory, with and without prefaulting)
+ *	Copyright (C) 2016 Fred Barnes, University of Kent <frmb@kent.ac.uk>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <errno.h>
+
+#include <sched.h>
+#include <pthread.h>
+
+#include "slick.h"
+
+
+#define PF_MAXWORKERS	(4096)
+#define PF_MAXTHREADS	(128)
+#define PF_TOPWS	(48)			/* o_prefault frame, including return-address */
+#define PF_BRWS		(64)			/* each worker's workspace */
+
+#define PF_PLAIN	0			/* memory faulted in as requests first touch it */
+#define PF_PREFAULT	1			/* --rt-prefault and --rt-mlock (and --rt-policy=fifo with -f) */
+
+extern void o_prefault_startup (void);		/* synthetic compiler-generated entry point */
+
+int64_t pf_nworkers = 0;			/* read by the process code */
+
+static const char *pf_modenames[] = {"plain", "prefault"};
+static int pf_mode;
+static int pf_nthreads = 2;
+static int pf_fifo = 0;
+static int64_t pf_scratch_kb = 1024;		/* each worker's scratch memory.. */
+static int64_t pf_request_kb = 64;		/* ..of which each request writes the next this much */
+static uint64_t pf_t0;
+static long pf_flt0;
+static int pf_resfd = -1;
+
+static uint8_t **pf_scratch;			/* each worker's scratch memory (from slick_alloc_ws) */
+static int64_t *pf_next;			/* and how far through it */
+static int64_t pf_maxreq = 0;			/* longest request */
+static int64_t pf_sumreq = 0;
+static int64_t pf_nreqs = 0;
+
+
+/*{{{  static uint64_t pf_time (void)*/
+/*
+ *	current time in nanoseconds
+ */
+static uint64_t pf_time (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+/*}}}*/
+/*{{{  static long pf_minflt (void)*/
+/*
+ *	minor page faults taken by the process so far
+ */
+static long pf_minflt (void)
+{
+	struct rusage ru;
+
+	getrusage (RUSAGE_SELF, &ru);
+	return ru.ru_minflt;
+}
+/*}}}*/
+/*{{{  int64_t pf_request (int64_t idx)*/
+/*
+ *	called by each worker: serves one request, writing the next part of its scratch memory, and
+ *	notes how long that took; returns zero when it has been all the way through
+ */
+__attribute__ ((force_align_arg_pointer)) int64_t pf_request (int64_t idx)
+{
+	int64_t bytes = pf_request_kb << 10;
+	uint8_t *p = pf_scratch[idx] + pf_next[idx];
+	uint64_t t0;
+	int64_t lat, max, i;
+
+	if (pf_next[idx] >= (pf_scratch_kb << 10)) {
+		return 0;
+	}
+	t0 = pf_time ();
+	for (i=0; i<bytes; i += 64) {
+		p[i] = (uint8_t)(i + idx);
+	}
+	lat = (int64_t)(pf_time () - t0);
+	pf_next[idx] += bytes;
+
+	__sync_fetch_and_add (&pf_sumreq, lat);
+	__sync_fetch_and_add (&pf_nreqs, 1);
+	do {
+		max = pf_maxreq;
+	} while ((lat > max) && !__sync_bool_compare_and_swap (&pf_maxreq, max, lat));
+
+	return 1;
+}
+/*}}}*/
+/*{{{  void pf_begin (void)*/
+/*
+ *	called by o_prefault before starting the workers
+ */
+void pf_begin (void)
+{
+	pf_t0 = pf_time ();
+	pf_flt0 = pf_minflt ();
+}
+/*}}}*/
+/*{{{  void pf_finish (void)*/
+/*
+ *	called by o_prefault when all workers are done: passes results back to the parent, reports and exits
+ */
+__attribute__ ((force_align_arg_pointer, noreturn)) void pf_finish (void)
+{
+	int64_t res[4];
+
+	res[0] = (int64_t)(pf_time () - pf_t0);
+	res[1] = pf_maxreq;
+	res[2] = pf_nreqs ? (pf_sumreq / pf_nreqs) : 0;
+	res[3] = (int64_t)(pf_minflt () - pf_flt0);
+
+	if (write (pf_resfd, res, sizeof (res)) != sizeof (res)) {
+		fprintf (stderr, "prefault: failed to write result [%s]\n", strerror (errno));
+	}
+	slick_dump_stats ();
+	exit (EXIT_SUCCESS);
+}
+/*}}}*/
+
+/*{{{  static void pf_child (char *prog, int rt_argc, char **rt_argv)*/
+/*
+ *	runs the workers, with or without prefaulting (in a child process)
+ */
+static void pf_child (char *prog, int rt_argc, char **rt_argv)
+{
+	char **argv = (char **)malloc ((rt_argc + 6) * sizeof (char *));
+	char ntbuf[32];
+	void *ws, *wstop;
+	int64_t wssize;
+	int64_t i;
+	int j = 1;
+
+	argv[0] = prog;
+	snprintf (ntbuf, sizeof (ntbuf), "--rt-nthreads=%d", pf_nthreads);
+	argv[j++] = ntbuf;
+	if (pf_mode == PF_PREFAULT) {
+		argv[j++] = "--rt-prefault";
+		argv[j++] = "--rt-mlock";
+		if (pf_fifo) {
+			argv[j++] = "--rt-policy=fifo";
+		}
+	}
+	for (i=0; i<rt_argc; i++) {
+		argv[j++] = rt_argv[i];
+	}
+	argv[j] = NULL;
+
+	if (slick_init ((const char **)argv, j)) {
+		fprintf (stderr, "prefault: oops, failed to initialise scheduler\n");
+		exit (EXIT_FAILURE);
+	}
+
+	pf_scratch = (uint8_t **)malloc (pf_nworkers * sizeof (uint8_t *));
+	pf_next = (int64_t *)calloc (pf_nworkers, sizeof (int64_t));
+	wssize = PF_TOPWS + (PF_BRWS * (pf_nworkers + 1)) + 64;
+	ws = malloc (wssize);
+	if (!pf_scratch || !pf_next || !ws) {
+		fprintf (stderr, "prefault: failed to allocate %ld bytes of workspace\n", wssize);
+		exit (EXIT_FAILURE);
+	}
+	for (i=0; i<pf_nworkers; i++) {
+		pf_scratch[i] = (uint8_t *)slick_alloc_ws (pf_scratch_kb << 10, (int)(i % pf_nthreads));
+	}
+	wstop = ws + (int)(wssize - sizeof (uint64_t));
+
+	slick_startup (wstop, o_prefault_startup);
+	exit (EXIT_FAILURE);
+}
+/*}}}*/
+
+
+int main (int argc, char **argv)
+{
+	char **rt_argv = (char **)malloc (argc * sizeof (char *));
+	int rt_argc = 0;
+	int modes = 0;
+	int64_t npages;
+	int failed = 0;
+	int i;
+
+	for (i=1; i<argc; i++) {
+		if (!strncmp (argv[i], "--rt-", 5)) {
+			if (strncmp (argv[i] + 5, "nthreads", 8)) {
+				rt_argv[rt_argc++] = argv[i];		/* passed through to each run */
+			}
+		} else if (!strcmp (argv[i], "plain")) {
+			modes |= (1 << PF_PLAIN);
+		} else if (!strcmp (argv[i], "prefault")) {
+			modes |= (1 << PF_PREFAULT);
+		} else if (!strcmp (argv[i], "-f")) {
+			pf_fifo = 1;
+		} else if (!strcmp (argv[i], "-w") && (i < (argc - 1))) {
+			pf_nworkers = atol (argv[++i]);
+		} else if (!strcmp (argv[i], "-t") && (i < (argc - 1))) {
+			pf_nthreads = atoi (argv[++i]);
+		} else if (!strcmp (argv[i], "-s") && (i < (argc - 1))) {
+			pf_scratch_kb = atol (argv[++i]);
+		} else if (!strcmp (argv[i], "-r") && (i < (argc - 1))) {
+			pf_request_kb = atol (argv[++i]);
+		} else {
+			fprintf (stderr, "usage: %s [plain] [prefault] [-f] [-w workers] [-t threads] [-s scratch-KB] [-r KB-per-request] [--rt-...]\n",
+					argv[0]);
+			exit (EXIT_FAILURE);
+		}
+	}
+	if (!modes) {
+		modes = (1 << PF_PLAIN) | (1 << PF_PREFAULT);
+	}
+	if (!pf_nworkers) {
+		pf_nworkers = 4 * pf_nthreads;
+	}
+	if ((pf_nworkers < 1) || (pf_nworkers > PF_MAXWORKERS) || (pf_nthreads < 1) || (pf_nthreads > PF_MAXTHREADS) ||
+			(pf_request_kb < 1) || (pf_scratch_kb < pf_request_kb)) {
+		fprintf (stderr, "prefault: expected 1..%d workers, 1..%d threads and scratch memory for at least one request\n",
+				PF_MAXWORKERS, PF_MAXTHREADS);
+		exit (EXIT_FAILURE);
+	}
+
+	npages = (pf_nworkers * (pf_scratch_kb << 10)) / (int64_t)sysconf (_SC_PAGESIZE);
+	fprintf (stderr, "prefault: %ld workers on %d threads, %ld KB scratch each, %ld KB per request%s\n", pf_nworkers,
+			pf_nthreads, pf_scratch_kb, pf_request_kb, pf_fifo ? ", SCHED_FIFO when prefaulting" : "");
+
+	for (pf_mode = PF_PLAIN; pf_mode <= PF_PREFAULT; pf_mode++) {
+		int fds[2];
+		int64_t res[4];
+		pid_t pid;
+		int status;
+
+		if (!(modes & (1 << pf_mode))) {
+			continue;
+		}
+		if (pipe (fds) < 0) {
+			fprintf (stderr, "prefault: failed to create pipe [%s]\n", strerror (errno));
+			exit (EXIT_FAILURE);
+		}
+		fflush (stderr);
+
+		pid = fork ();
+		if (pid < 0) {
+			fprintf (stderr, "prefault: failed to fork [%s]\n", strerror (errno));
+			exit (EXIT_FAILURE);
+		} else if (!pid) {
+			close (fds[0]);
+			pf_resfd = fds[1];
+			pf_child (argv[0], rt_argc, rt_argv);
+		}
+		close (fds[1]);
+
+		if (read (fds[0], res, sizeof (res)) != sizeof (res)) {
+			fprintf (stderr, "prefault: %s run failed\n", pf_modenames[pf_mode]);
+			exit (EXIT_FAILURE);
+		}
+		close (fds[0]);
+		waitpid (pid, &status, 0);
+
+		printf ("%-8s: %10.3f ms, requests took at most %8.3f ms, mean %8.3f ms, page faults while running %8ld\n",
+				pf_modenames[pf_mode], (double)res[0] / 1000000.0, (double)res[1] / 1000000.0, (double)res[2] / 1000000.0, res[3]);
+		fflush (stdout);
+
+		/* prefaulted scratch memory is all there before the workers start: allow for stacks and the like */
+		if ((pf_mode == PF_PREFAULT) && (res[3] > (npages / 10))) {
+			fprintf (stderr, "prefault: %ld page faults while running, scratch memory is %ld pages\n", res[3], npages);
+			failed++;
+		}
+	}
+
+	if (failed) {
+		exit (EXIT_FAILURE);
+	}
+	return 0;
+}
+
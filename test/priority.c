@@ -0,0 +1,316 @@
+/*
+ *	priority.c -- wrapper for priority test program (workers that set their own priority and affinity)
+ *	Copyright (C) 2016 Fred Barnes, University of Kent <frmb@kent.ac.uk>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <errno.h>
+
+#include <sched.h>
+#include <pthread.h>
+
+#include "slick.h"
+
+
+#define PR_MAXWORKERS	(65536)
+#define PR_MAXTHREADS	(58)			/* run-time threads that affinity can name */
+#define PR_TOPWS	(48)			/* o_priority frame, including return-address */
+#define PR_BRWS		(64)			/* each worker's workspace */
+#define PR_DEFPRI	(16)			/* run-time default priority */
+
+#define PR_FLAT		0			/* workers leave priority and affinity alone */
+#define PR_SET		1			/* odd workers raise their priority, all pin themselves to a thread */
+
+extern void o_priority_startup (void);		/* synthetic compiler-generated entry point */
+
+int64_t pr_nworkers = 0;			/* read by the process code */
+
+static const char *pr_modenames[] = {"flat", "set"};
+static int pr_mode;
+static int pr_nthreads = 2;
+static int64_t pr_high = 4;			/* priority odd workers move to */
+static int64_t pr_chunks = 20;			/* work per worker, in chunks.. */
+static int64_t pr_chunk_us = 100;		/* ..of this long */
+static uint64_t pr_t0;
+static int pr_resfd = -1;
+
+static int64_t *pr_left;			/* chunks left for each worker */
+static uint64_t *pr_done;			/* when each worker finished */
+static pthread_t *pr_last;			/* run-time thread each worker last ran on */
+static int64_t pr_moves = 0;			/* chunks run on a different thread to the last */
+static int64_t pr_wrong = 0;			/* os_getpri/os_getaff results not as set */
+static volatile int64_t pr_sink = 0;
+
+
+/*{{{  static uint64_t pr_time (void)*/
+/*
+ *	current time in nanoseconds
+ */
+static uint64_t pr_time (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+/*}}}*/
+/*{{{  int64_t pr_want_pri (int64_t idx), uint64_t pr_want_aff (int64_t idx)*/
+/*
+ *	priority (-1 to leave alone) and affinity (0 to leave alone) a worker should set
+ */
+int64_t pr_want_pri (int64_t idx)
+{
+	return ((pr_mode == PR_SET) && (idx & 1)) ? pr_high : -1;
+}
+
+uint64_t pr_want_aff (int64_t idx)
+{
+	return (pr_mode == PR_SET) ? (1ULL << ((idx >> 1) % pr_nthreads)) : 0;		/* an odd and an even worker on each */
+}
+/*}}}*/
+/*{{{  void pr_note_pri (int64_t idx, int64_t pri), void pr_note_aff (int64_t idx, uint64_t aff)*/
+/*
+ *	called by each worker with what os_getpri and os_getaff said, after setting them
+ */
+void pr_note_pri (int64_t idx, int64_t pri)
+{
+	int64_t want = pr_want_pri (idx);
+
+	if (pri != ((want < 0) ? PR_DEFPRI : want)) {
+		__sync_fetch_and_add (&pr_wrong, 1);
+	}
+}
+
+void pr_note_aff (int64_t idx, uint64_t aff)
+{
+	if (aff != pr_want_aff (idx)) {
+		__sync_fetch_and_add (&pr_wrong, 1);
+	}
+}
+/*}}}*/
+/*{{{  int64_t pr_chunk (int64_t idx)*/
+/*
+ *	called by each worker: keeps the CPU busy for one chunk, returns zero when there are no more
+ */
+__attribute__ ((force_align_arg_pointer)) int64_t pr_chunk (int64_t idx)
+{
+	pthread_t self = pthread_self ();
+	uint64_t until = pr_time () + (pr_chunk_us * 1000);
+	int64_t sum = 0;
+	int i;
+
+	if ((pr_left[idx] < pr_chunks) && !pthread_equal (self, pr_last[idx])) {
+		__sync_fetch_and_add (&pr_moves, 1);
+	}
+	pr_last[idx] = self;
+
+	if (!pr_left[idx]) {
+		pr_done[idx] = pr_time ();
+		return 0;
+	}
+	pr_left[idx]--;
+	while (pr_time () < until) {
+		for (i=0; i<256; i++) {
+			sum += i * idx;
+		}
+	}
+	pr_sink += sum;
+	return 1;
+}
+/*}}}*/
+/*{{{  void pr_begin (void)*/
+/*
+ *	called by o_priority before starting the workers
+ */
+void pr_begin (void)
+{
+	pr_t0 = pr_time ();
+}
+/*}}}*/
+/*{{{  void pr_finish (void)*/
+/*
+ *	called by o_priority when all workers are done: passes results back to the parent, reports and exits
+ */
+__attribute__ ((force_align_arg_pointer, noreturn)) void pr_finish (void)
+{
+	int64_t res[5];
+	int64_t i, sum[2] = {0, 0};
+
+	res[0] = (int64_t)(pr_time () - pr_t0);
+	for (i=0; i<pr_nworkers; i++) {
+		sum[i & 1] += (int64_t)(pr_done[i] - pr_t0);
+	}
+	res[1] = sum[1] / (pr_nworkers >> 1);				/* odd workers' mean finish */
+	res[2] = sum[0] / ((pr_nworkers + 1) >> 1);			/* even workers' */
+	res[3] = pr_moves;
+	res[4] = pr_wrong;
+
+	if (write (pr_resfd, res, sizeof (res)) != sizeof (res)) {
+		fprintf (stderr, "priority: failed to write result [%s]\n", strerror (errno));
+	}
+	slick_dump_stats ();
+	exit (EXIT_SUCCESS);
+}
+/*}}}*/
+
+/*{{{  static void pr_child (char *prog, int rt_argc, char **rt_argv)*/
+/*
+ *	runs the workers on a fixed number of run-time threads, with or without setting priority
+ *	and affinity (in a child process)
+ */
+static void pr_child (char *prog, int rt_argc, char **rt_argv)
+{
+	char **argv = (char **)malloc ((rt_argc + 3) * sizeof (char *));
+	char ntbuf[32];
+	void *ws, *wstop;
+	int64_t wssize;
+	int64_t i;
+	int j = 1;
+
+	argv[0] = prog;
+	snprintf (ntbuf, sizeof (ntbuf), "--rt-nthreads=%d", pr_nthreads);
+	argv[j++] = ntbuf;
+	for (i=0; i<rt_argc; i++) {
+		argv[j++] = rt_argv[i];
+	}
+	argv[j] = NULL;
+
+	if (slick_init ((const char **)argv, j)) {
+		fprintf (stderr, "priority: oops, failed to initialise scheduler\n");
+		exit (EXIT_FAILURE);
+	}
+
+	pr_left = (int64_t *)malloc (pr_nworkers * sizeof (int64_t));
+	pr_done = (uint64_t *)calloc (pr_nworkers, sizeof (uint64_t));
+	pr_last = (pthread_t *)calloc (pr_nworkers, sizeof (pthread_t));
+	wssize = PR_TOPWS + (PR_BRWS * (pr_nworkers + 1)) + 64;
+	ws = malloc (wssize);
+	if (!pr_left || !pr_done || !pr_last || !ws) {
+		fprintf (stderr, "priority: failed to allocate %ld bytes of workspace\n", wssize);
+		exit (EXIT_FAILURE);
+	}
+	for (i=0; i<pr_nworkers; i++) {
+		pr_left[i] = pr_chunks;
+	}
+	wstop = ws + (int)(wssize - sizeof (uint64_t));
+
+	slick_startup (wstop, o_priority_startup);
+	exit (EXIT_FAILURE);
+}
+/*}}}*/
+
+
+int main (int argc, char **argv)
+{
+	char **rt_argv = (char **)malloc (argc * sizeof (char *));
+	int rt_argc = 0;
+	int modes = 0;
+	int failed = 0;
+	int i;
+
+	for (i=1; i<argc; i++) {
+		if (!strncmp (argv[i], "--rt-", 5)) {
+			if (strncmp (argv[i] + 5, "nthreads", 8)) {
+				rt_argv[rt_argc++] = argv[i];		/* passed through to each run */
+			}
+		} else if (!strcmp (argv[i], "flat")) {
+			modes |= (1 << PR_FLAT);
+		} else if (!strcmp (argv[i], "set")) {
+			modes |= (1 << PR_SET);
+		} else if (!strcmp (argv[i], "-w") && (i < (argc - 1))) {
+			pr_nworkers = atol (argv[++i]);
+		} else if (!strcmp (argv[i], "-t") && (i < (argc - 1))) {
+			pr_nthreads = atoi (argv[++i]);
+		} else if (!strcmp (argv[i], "-p") && (i < (argc - 1))) {
+			pr_high = atol (argv[++i]);
+		} else if (!strcmp (argv[i], "-c") && (i < (argc - 1))) {
+			pr_chunks = atol (argv[++i]);
+		} else if (!strcmp (argv[i], "-u") && (i < (argc - 1))) {
+			pr_chunk_us = atol (argv[++i]);
+		} else {
+			fprintf (stderr, "usage: %s [flat] [set] [-w workers] [-t threads] [-p high-priority] [-c chunks] [-u us-per-chunk] [--rt-...]\n", argv[0]);
+			exit (EXIT_FAILURE);
+		}
+	}
+	if (!modes) {
+		modes = (1 << PR_FLAT) | (1 << PR_SET);
+	}
+	if (!pr_nworkers) {
+		pr_nworkers = 8 * pr_nthreads;
+	}
+	if ((pr_nworkers < 2) || (pr_nworkers > PR_MAXWORKERS) || (pr_nthreads < 1) || (pr_nthreads > PR_MAXTHREADS) ||
+			(pr_high < 0) || (pr_high >= PR_DEFPRI) || (pr_chunks < 1) || (pr_chunk_us < 1)) {
+		fprintf (stderr, "priority: expected 2..%d workers, 1..%d threads, a priority above %d and at least one chunk of work\n",
+				PR_MAXWORKERS, PR_MAXTHREADS, PR_DEFPRI);
+		exit (EXIT_FAILURE);
+	}
+
+	fprintf (stderr, "priority: %ld workers on %d threads, %ld chunks of %ld us each, odd workers at priority %ld\n", pr_nworkers,
+			pr_nthreads, pr_chunks, pr_chunk_us, pr_high);
+
+	for (pr_mode = PR_FLAT; pr_mode <= PR_SET; pr_mode++) {
+		int fds[2];
+		int64_t res[5];
+		pid_t pid;
+		int status;
+
+		if (!(modes & (1 << pr_mode))) {
+			continue;
+		}
+		if (pipe (fds) < 0) {
+			fprintf (stderr, "priority: failed to create pipe [%s]\n", strerror (errno));
+			exit (EXIT_FAILURE);
+		}
+		fflush (stderr);
+
+		pid = fork ();
+		if (pid < 0) {
+			fprintf (stderr, "priority: failed to fork [%s]\n", strerror (errno));
+			exit (EXIT_FAILURE);
+		} else if (!pid) {
+			close (fds[0]);
+			pr_resfd = fds[1];
+			pr_child (argv[0], rt_argc, rt_argv);
+		}
+		close (fds[1]);
+
+		if (read (fds[0], res, sizeof (res)) != sizeof (res)) {
+			fprintf (stderr, "priority: %s run failed\n", pr_modenames[pr_mode]);
+			exit (EXIT_FAILURE);
+		}
+		close (fds[0]);
+		waitpid (pid, &status, 0);
+
+		printf ("%-4s: %10.3f ms, mean finish odd %10.3f ms, even %10.3f ms, thread changes %6ld%s\n", pr_modenames[pr_mode],
+				(double)res[0] / 1000000.0, (double)res[1] / 1000000.0, (double)res[2] / 1000000.0, res[3],
+				res[4] ? " (WRONG)" : "");
+		fflush (stdout);
+
+		if (res[4]) {
+			fprintf (stderr, "priority: os_getpri/os_getaff disagreed with what was set %ld time(s)\n", res[4]);
+			failed++;
+		}
+		if ((pr_mode == PR_SET) && res[3]) {
+			fprintf (stderr, "priority: workers pinned to a thread changed thread %ld time(s)\n", res[3]);
+			failed++;
+		}
+		if ((pr_mode == PR_SET) && (res[1] >= res[2])) {
+			/* each thread has as many odd as even workers, so the raised ones should be done first */
+			fprintf (stderr, "priority: higher-priority workers did not finish ahead of the others\n");
+			failed++;
+		}
+	}
+
+	if (failed) {
+		exit (EXIT_FAILURE);
+	}
+	return 0;
+}
+
@@ -0,0 +1,341 @@
+/*
+ *	reserve.c -- wrapper for reserve test program (how long high-priority monitors wait to run under a full data-plane load)
+ *	Copyright (C) 2016 Fred Barnes, University of Kent <frmb@kent.ac.uk>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <errno.h>
+
+#include <sched.h>
+#include <pthread.h>
+
+#include "slick.h"
+
+
+#define RS_MAXWORKERS	(16384)
+#define RS_MAXTHREADS	(128)
+#define RS_TOPWS	(48)			/* o_reserve frame, including return-address */
+#define RS_BRWS		(64)			/* each branch's workspace */
+
+#define RS_SHARED	0			/* monitors share the threads with the workers */
+#define RS_RESERVED	1			/* monitors get threads of their own (--rt-reserve) */
+
+extern void o_reserve_startup (void);		/* synthetic compiler-generated entry point */
+
+int64_t rs_nworkers = 0;			/* read by the process code */
+int64_t rs_nbranches = 0;			/* workers + a monitor for each */
+uint64_t *rs_chans;				/* worker i to monitor i */
+int64_t *rs_outbox;				/* what worker i sends.. */
+int64_t *rs_inbox;				/* ..and where monitor i receives it */
+
+static const char *rs_modenames[] = {"shared", "reserved"};
+static int rs_mode;
+static int rs_nthreads = 3;
+static int rs_nreserved = 1;
+static int64_t rs_pri = 2;			/* monitors' priority */
+static int64_t rs_chunks = 40;			/* work per worker, in chunks.. */
+static int64_t rs_chunk_us = 500;		/* ..of this long */
+static int64_t rs_every = 4;			/* chunks between messages to the monitor */
+static uint64_t rs_t0;
+static int rs_resfd = -1;
+
+static int64_t *rs_left;			/* chunks left for each worker */
+static int64_t rs_maxlat = 0;			/* longest a monitor took to run after being sent to */
+static int64_t rs_sumlat = 0;
+static int64_t rs_msgs = 0;
+static int64_t rs_wthreads[RS_MAXTHREADS];	/* run-time threads (OS thread IDs) that ran worker chunks */
+static volatile int64_t rs_sink = 0;
+
+
+/*{{{  static uint64_t rs_time (void)*/
+/*
+ *	current time in nanoseconds
+ */
+static uint64_t rs_time (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+/*}}}*/
+/*{{{  int64_t rs_setup (int64_t idx)*/
+/*
+ *	called by each process before it starts: the priority to move to, or -1 to stay put
+ */
+int64_t rs_setup (int64_t idx)
+{
+	return (idx >= rs_nworkers) ? rs_pri : -1;
+}
+/*}}}*/
+/*{{{  int64_t rs_next (int64_t idx)*/
+/*
+ *	called by each worker before a chunk: zero when there is no more work (a zero for the monitor to
+ *	say so is in its outbox), 1 to carry on, 2 to send the time-stamp in its outbox to the monitor first
+ */
+__attribute__ ((force_align_arg_pointer)) int64_t rs_next (int64_t idx)
+{
+	int64_t left = rs_left[idx];
+
+	if (!left) {
+		rs_outbox[idx] = 0;
+		return 0;
+	}
+	rs_left[idx] = left - 1;
+	if (!((rs_chunks - left) % rs_every)) {
+		rs_outbox[idx] = (int64_t)rs_time ();
+		return 2;
+	}
+	return 1;
+}
+/*}}}*/
+/*{{{  void rs_chunk (int64_t idx)*/
+/*
+ *	called by each worker: notes which thread it is on, then keeps the CPU busy for one chunk
+ */
+__attribute__ ((force_align_arg_pointer)) void rs_chunk (int64_t idx)
+{
+	int64_t tid = (int64_t)syscall (SYS_gettid);
+	uint64_t until = rs_time () + (rs_chunk_us * 1000);
+	int64_t sum = 0;
+	int i;
+
+	for (i=0; i<RS_MAXTHREADS; i++) {
+		if ((rs_wthreads[i] == tid) || (!rs_wthreads[i] && __sync_bool_compare_and_swap (&rs_wthreads[i], 0, tid))) {
+			break;
+		}
+	}
+	while (rs_time () < until) {
+		for (i=0; i<256; i++) {
+			sum += i * idx;
+		}
+	}
+	rs_sink += sum;
+}
+/*}}}*/
+/*{{{  int64_t rs_note (int64_t idx)*/
+/*
+ *	called by each monitor with what it received: notes how long since it was sent, returns zero
+ *	once its worker is done
+ */
+__attribute__ ((force_align_arg_pointer)) int64_t rs_note (int64_t idx)
+{
+	int64_t stamp = rs_inbox[idx - rs_nworkers];
+	int64_t lat, max;
+
+	if (!stamp) {
+		return 0;
+	}
+	lat = (int64_t)rs_time () - stamp;
+	__sync_fetch_and_add (&rs_sumlat, lat);
+	__sync_fetch_and_add (&rs_msgs, 1);
+	do {
+		max = rs_maxlat;
+	} while ((lat > max) && !__sync_bool_compare_and_swap (&rs_maxlat, max, lat));
+
+	return 1;
+}
+/*}}}*/
+/*{{{  void rs_begin (void)*/
+/*
+ *	called by o_reserve before starting the workers and monitors
+ */
+void rs_begin (void)
+{
+	rs_t0 = rs_time ();
+}
+/*}}}*/
+/*{{{  void rs_finish (void)*/
+/*
+ *	called by o_reserve when all are done: passes results back to the parent, reports and exits
+ */
+__attribute__ ((force_align_arg_pointer, noreturn)) void rs_finish (void)
+{
+	int64_t res[5];
+	int i;
+
+	res[0] = (int64_t)(rs_time () - rs_t0);
+	res[1] = rs_maxlat;
+	res[2] = rs_msgs ? (rs_sumlat / rs_msgs) : 0;
+	res[3] = rs_msgs;
+	for (i=0; (i<RS_MAXTHREADS) && rs_wthreads[i]; i++);
+	res[4] = i;				/* threads the workers ran on */
+
+	if (write (rs_resfd, res, sizeof (res)) != sizeof (res)) {
+		fprintf (stderr, "reserve: failed to write result [%s]\n", strerror (errno));
+	}
+	slick_dump_stats ();
+	exit (EXIT_SUCCESS);
+}
+/*}}}*/
+
+/*{{{  static void rs_child (char *prog, int rt_argc, char **rt_argv)*/
+/*
+ *	runs the workers and monitors, with or without reserved threads for the monitors (in a child process)
+ */
+static void rs_child (char *prog, int rt_argc, char **rt_argv)
+{
+	char **argv = (char **)malloc ((rt_argc + 4) * sizeof (char *));
+	char ntbuf[32], rsbuf[48];
+	void *ws, *wstop;
+	int64_t wssize;
+	int64_t i;
+	int j = 1;
+
+	argv[0] = prog;
+	snprintf (ntbuf, sizeof (ntbuf), "--rt-nthreads=%d", rs_nthreads);
+	argv[j++] = ntbuf;
+	if (rs_mode == RS_RESERVED) {
+		snprintf (rsbuf, sizeof (rsbuf), "--rt-reserve=%d:pri<%ld", rs_nreserved, rs_pri + 1);
+		argv[j++] = rsbuf;
+	}
+	for (i=0; i<rt_argc; i++) {
+		argv[j++] = rt_argv[i];
+	}
+	argv[j] = NULL;
+
+	if (slick_init ((const char **)argv, j)) {
+		fprintf (stderr, "reserve: oops, failed to initialise scheduler\n");
+		exit (EXIT_FAILURE);
+	}
+
+	rs_left = (int64_t *)malloc (rs_nworkers * sizeof (int64_t));
+	rs_chans = (uint64_t *)calloc (rs_nworkers, sizeof (uint64_t));
+	rs_outbox = (int64_t *)calloc (rs_nworkers, sizeof (int64_t));
+	rs_inbox = (int64_t *)calloc (rs_nworkers, sizeof (int64_t));
+	wssize = RS_TOPWS + (RS_BRWS * (rs_nbranches + 1)) + 64;
+	ws = malloc (wssize);
+	if (!rs_left || !rs_chans || !rs_outbox || !rs_inbox || !ws) {
+		fprintf (stderr, "reserve: failed to allocate %ld bytes of workspace\n", wssize);
+		exit (EXIT_FAILURE);
+	}
+	for (i=0; i<rs_nworkers; i++) {
+		rs_left[i] = rs_chunks;
+	}
+	wstop = ws + (int)(wssize - sizeof (uint64_t));
+
+	slick_startup (wstop, o_reserve_startup);
+	exit (EXIT_FAILURE);
+}
+/*}}}*/
+
+
+int main (int argc, char **argv)
+{
+	char **rt_argv = (char **)malloc (argc * sizeof (char *));
+	int rt_argc = 0;
+	int modes = 0;
+	int64_t expected;
+	int failed = 0;
+	int i;
+
+	for (i=1; i<argc; i++) {
+		if (!strncmp (argv[i], "--rt-", 5)) {
+			if (strncmp (argv[i] + 5, "nthreads", 8) && strncmp (argv[i] + 5, "reserve", 7)) {
+				rt_argv[rt_argc++] = argv[i];		/* passed through to each run */
+			}
+		} else if (!strcmp (argv[i], "shared")) {
+			modes |= (1 << RS_SHARED);
+		} else if (!strcmp (argv[i], "reserved")) {
+			modes |= (1 << RS_RESERVED);
+		} else if (!strcmp (argv[i], "-w") && (i < (argc - 1))) {
+			rs_nworkers = atol (argv[++i]);
+		} else if (!strcmp (argv[i], "-t") && (i < (argc - 1))) {
+			rs_nthreads = atoi (argv[++i]);
+		} else if (!strcmp (argv[i], "-r") && (i < (argc - 1))) {
+			rs_nreserved = atoi (argv[++i]);
+		} else if (!strcmp (argv[i], "-p") && (i < (argc - 1))) {
+			rs_pri = atol (argv[++i]);
+		} else if (!strcmp (argv[i], "-c") && (i < (argc - 1))) {
+			rs_chunks = atol (argv[++i]);
+		} else if (!strcmp (argv[i], "-u") && (i < (argc - 1))) {
+			rs_chunk_us = atol (argv[++i]);
+		} else if (!strcmp (argv[i], "-e") && (i < (argc - 1))) {
+			rs_every = atol (argv[++i]);
+		} else {
+			fprintf (stderr, "usage: %s [shared] [reserved] [-w workers] [-t threads] [-r reserved-threads] [-p monitor-priority] [-c chunks] "
+					"[-u us-per-chunk] [-e chunks-per-message] [--rt-...]\n", argv[0]);
+			exit (EXIT_FAILURE);
+		}
+	}
+	if (!modes) {
+		modes = (1 << RS_SHARED) | (1 << RS_RESERVED);
+	}
+	if (!rs_nworkers) {
+		rs_nworkers = 4 * rs_nthreads;
+	}
+	rs_nbranches = 2 * rs_nworkers;
+	if ((rs_nworkers < 1) || (rs_nworkers > RS_MAXWORKERS) || (rs_nthreads < 2) || (rs_nthreads > RS_MAXTHREADS) || (rs_nreserved < 1) ||
+			(rs_nreserved >= rs_nthreads) || (rs_pri < 0) || (rs_pri > 15) || (rs_chunks < 1) || (rs_chunk_us < 1) || (rs_every < 1)) {
+		fprintf (stderr, "reserve: expected 1..%d workers, 2..%d threads of which fewer reserved, a monitor priority of 0..15 "
+				"and at least one chunk of work\n", RS_MAXWORKERS, RS_MAXTHREADS);
+		exit (EXIT_FAILURE);
+	}
+
+	/* a worker sends before chunks 0, e, 2e, .. */
+	expected = rs_nworkers * ((rs_chunks + rs_every - 1) / rs_every);
+	fprintf (stderr, "reserve: %ld workers on %d threads, %ld chunks of %ld us each, a message every %ld, monitors at priority %ld\n",
+			rs_nworkers, rs_nthreads, rs_chunks, rs_chunk_us, rs_every, rs_pri);
+
+	for (rs_mode = RS_SHARED; rs_mode <= RS_RESERVED; rs_mode++) {
+		int fds[2];
+		int64_t res[5];
+		pid_t pid;
+		int status;
+
+		if (!(modes & (1 << rs_mode))) {
+			continue;
+		}
+		if (pipe (fds) < 0) {
+			fprintf (stderr, "reserve: failed to create pipe [%s]\n", strerror (errno));
+			exit (EXIT_FAILURE);
+		}
+		fflush (stderr);
+
+		pid = fork ();
+		if (pid < 0) {
+			fprintf (stderr, "reserve: failed to fork [%s]\n", strerror (errno));
+			exit (EXIT_FAILURE);
+		} else if (!pid) {
+			close (fds[0]);
+			rs_resfd = fds[1];
+			rs_child (argv[0], rt_argc, rt_argv);
+		}
+		close (fds[1]);
+
+		if (read (fds[0], res, sizeof (res)) != sizeof (res)) {
+			fprintf (stderr, "reserve: %s run failed\n", rs_modenames[rs_mode]);
+			exit (EXIT_FAILURE);
+		}
+		close (fds[0]);
+		waitpid (pid, &status, 0);
+
+		printf ("%-8s: %10.3f ms, %6ld messages, monitors waited at most %10.3f ms, mean %10.3f ms, workers on %ld threads\n", rs_modenames[rs_mode],
+				(double)res[0] / 1000000.0, res[3], (double)res[1] / 1000000.0, (double)res[2] / 1000000.0, res[4]);
+		fflush (stdout);
+
+		if (res[3] != expected) {
+			fprintf (stderr, "reserve: %s run delivered %ld of %ld messages\n", rs_modenames[rs_mode], res[3], expected);
+			failed++;
+		}
+		if ((rs_mode == RS_RESERVED) && (res[4] > (rs_nthreads - rs_nreserved))) {
+			/* workers are at the default priority, so must keep off the reserved threads */
+			fprintf (stderr, "reserve: workers ran on %ld threads, only %d are not reserved\n", res[4], rs_nthreads - rs_nreserved);
+			failed++;
+		}
+	}
+
+	if (failed) {
+		exit (EXIT_FAILURE);
+	}
+	return 0;
+}
+
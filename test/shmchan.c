@@ -0,0 +1,486 @@
+/*
+ *	shmchan.c -- wrapper for shmchan test program (ping-pong between two OS processes, over shared-memory channels or sockets)
+ *	Copyright (C) 2016 Fred Barnes, University of Kent <frmb@kent.ac.uk>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <errno.h>
+
+#include <sched.h>
+#include <pthread.h>
+
+#include "slick.h"
+
+
+#define SC_MAXPAIRS	(4096)
+#define SC_MAXTHREADS	(128)
+#define SC_TOPWS	(48)			/* o_shmchan frame, including return-address */
+#define SC_BRWS		(64)			/* each worker's workspace */
+
+#define SC_SOCKET	0			/* SOCK_SEQPACKET socketpair, with os_write and os_read */
+#define SC_HELPER	1			/* shared-memory channels, waiting on helper threads (--rt-uring=0) */
+#define SC_URING	2			/* ..or in each run-time thread's io_uring */
+
+#define SC_PINGER	0			/* sc_role: sends each message and waits for it back.. */
+#define SC_PONGER	1			/* ..from the other OS process, which echoes it */
+
+#define SC_SHMIN	0			/* sc_req_t.op, as in shmchan_code.S */
+#define SC_SHMOUT	1
+#define SC_READ		2
+#define SC_WRITE	3
+
+typedef struct {				/* laid out for shmchan_code.S */
+	int64_t op;
+	void *chan;
+	int64_t fd;
+	void *buf;
+	int64_t count;
+	int64_t result;				/* written by the run-time (os_read, os_write) */
+} sc_req_t;
+
+extern void o_shmchan_startup (void);		/* synthetic compiler-generated entry point */
+
+int64_t sc_npairs = 4;				/* read by the process code */
+
+static const char *sc_modenames[] = {"socket", "helper", "uring"};
+static int sc_mode;
+static int sc_role;
+static int sc_nthreads = 2;
+static int64_t sc_rounds = 10000;		/* messages each pinger sends.. */
+static int64_t sc_bytes = 64;			/* ..of this size.. */
+static int64_t sc_window = 1;			/* ..this many at a time before waiting for them back */
+static int sc_nslots = 16;			/* buffered by each shared-memory channel */
+static uint64_t sc_t0;
+static int sc_resfd = -1;
+
+static void **sc_ping;				/* each pair's channels (pinger to ponger).. */
+static void **sc_pong;				/* ..and back */
+static int *sc_pingfd;
+static int *sc_pongfd;
+static int (*sc_socks)[2];			/* or socketpair ([0] pinger's end) */
+
+static sc_req_t *sc_reqs;			/* each worker's request */
+static int64_t *sc_pos;				/* and how far through */
+static uint8_t **sc_buf;			/* its message buffer */
+static uint64_t **sc_sent;			/* (pinger) when each message in the window went */
+static int64_t sc_sumrtt = 0;			/* time from sending each message to having it back */
+static int64_t sc_maxrtt = 0;
+static int64_t sc_nrtts = 0;
+static int64_t sc_wrong = 0;			/* messages that came back (or arrived) other than as sent */
+
+
+/*{{{  static uint64_t sc_time (void)*/
+/*
+ *	current time in nanoseconds
+ */
+static uint64_t sc_time (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+/*}}}*/
+/*{{{  static void sc_fill (int64_t idx, int64_t seq)*/
+/*
+ *	sets up message 'seq' of pair 'idx' in its buffer
+ */
+static void sc_fill (int64_t idx, int64_t seq)
+{
+	uint8_t *buf = sc_buf[idx];
+
+	*(int64_t *)buf = seq;
+	memset (buf + sizeof (int64_t), (int)((idx * 31) + seq + 1) & 0xff, sc_bytes - sizeof (int64_t));
+}
+/*}}}*/
+/*{{{  static int sc_check (int64_t idx, int64_t seq)*/
+/*
+ *	non-zero if the buffer holds message 'seq' of pair 'idx', as sc_fill() left it
+ */
+static int sc_check (int64_t idx, int64_t seq)
+{
+	uint8_t *buf = sc_buf[idx];
+	uint8_t want = (uint8_t)((idx * 31) + seq + 1);
+	int64_t i;
+
+	if (*(int64_t *)buf != seq) {
+		return 0;
+	}
+	for (i=sizeof (int64_t); i<sc_bytes; i++) {
+		if (buf[i] != want) {
+			return 0;
+		}
+	}
+	return 1;
+}
+/*}}}*/
+/*{{{  static void sc_setreq (sc_req_t *rq, int64_t idx, int input)*/
+/*
+ *	sets up a worker's next request: input or output on its pair's channel, or socket, for this direction
+ */
+static void sc_setreq (sc_req_t *rq, int64_t idx, int input)
+{
+	int toponger = ((sc_role == SC_PINGER) != input);
+
+	if (sc_mode == SC_SOCKET) {
+		rq->op = input ? SC_READ : SC_WRITE;
+		rq->fd = sc_socks[idx][(sc_role == SC_PINGER) ? 0 : 1];
+	} else {
+		rq->op = input ? SC_SHMIN : SC_SHMOUT;
+		rq->chan = toponger ? sc_ping[idx] : sc_pong[idx];
+	}
+	rq->buf = sc_buf[idx];
+	rq->count = sc_bytes;
+	rq->result = (sc_mode == SC_SOCKET) ? -1 : sc_bytes;
+}
+/*}}}*/
+/*{{{  sc_req_t *sc_step (int64_t idx)*/
+/*
+ *	called by each worker: checks how its last request went and sets up the next, returning it (NULL when
+ *	done).  A pinger sends a window of messages then takes them back; a ponger echoes each as it comes.
+ */
+__attribute__ ((force_align_arg_pointer)) sc_req_t *sc_step (int64_t idx)
+{
+	sc_req_t *rq = &(sc_reqs[idx]);
+	int64_t pos = sc_pos[idx]++;
+
+	if (pos && (rq->result != sc_bytes)) {
+		__sync_fetch_and_add (&sc_wrong, 1);
+	}
+
+	if (sc_role == SC_PINGER) {
+		int64_t batch = pos / (2 * sc_window);
+		int64_t j = pos % (2 * sc_window);
+
+		if (pos && !j) {
+			/* previous request was the last reply of the last batch */
+			int64_t seq = ((batch - 1) * sc_window) + sc_window - 1;
+
+			if (!sc_check (idx, seq)) {
+				__sync_fetch_and_add (&sc_wrong, 1);
+			}
+		} else if (j > sc_window) {
+			int64_t seq = (batch * sc_window) + (j - sc_window - 1);
+
+			if (!sc_check (idx, seq)) {
+				__sync_fetch_and_add (&sc_wrong, 1);
+			}
+		}
+		if (pos && (!j || (j > sc_window))) {
+			int64_t k = (j ? (j - sc_window - 1) : (sc_window - 1));
+			int64_t rtt = (int64_t)(sc_time () - sc_sent[idx][k]);
+			int64_t max;
+
+			__sync_fetch_and_add (&sc_sumrtt, rtt);
+			__sync_fetch_and_add (&sc_nrtts, 1);
+			do {
+				max = sc_maxrtt;
+			} while ((rtt > max) && !__sync_bool_compare_and_swap (&sc_maxrtt, max, rtt));
+		}
+
+		if ((batch * sc_window) >= sc_rounds) {
+			return NULL;
+		} else if (j < sc_window) {
+			sc_fill (idx, (batch * sc_window) + j);
+			sc_setreq (rq, idx, 0);
+			sc_sent[idx][j] = sc_time ();
+		} else {
+			sc_setreq (rq, idx, 1);
+		}
+	} else {
+		int64_t seq = pos >> 1;
+
+		if (pos & 1) {
+			if (!sc_check (idx, seq)) {
+				__sync_fetch_and_add (&sc_wrong, 1);
+			}
+			sc_setreq (rq, idx, 0);		/* straight back */
+		} else if (seq >= sc_rounds) {
+			return NULL;
+		} else {
+			sc_setreq (rq, idx, 1);
+		}
+	}
+
+	return rq;
+}
+/*}}}*/
+/*{{{  void sc_begin (void)*/
+/*
+ *	called by o_shmchan before starting the workers
+ */
+void sc_begin (void)
+{
+	sc_t0 = sc_time ();
+}
+/*}}}*/
+/*{{{  void sc_finish (void)*/
+/*
+ *	called by o_shmchan when all workers are done: passes results back to the parent, reports (the pinger)
+ *	and exits
+ */
+__attribute__ ((force_align_arg_pointer, noreturn)) void sc_finish (void)
+{
+	int64_t res[4];
+
+	res[0] = (int64_t)(sc_time () - sc_t0);
+	res[1] = sc_nrtts ? (sc_sumrtt / sc_nrtts) : 0;
+	res[2] = sc_maxrtt;
+	res[3] = sc_wrong + (((sc_role == SC_PONGER) || (sc_nrtts == (sc_npairs * sc_rounds))) ? 0 : 1);
+
+	if (write (sc_resfd, res, sizeof (res)) != sizeof (res)) {
+		fprintf (stderr, "shmchan: failed to write result [%s]\n", strerror (errno));
+	}
+	if (sc_role == SC_PINGER) {
+		slick_dump_stats ();
+	}
+	exit (EXIT_SUCCESS);
+}
+/*}}}*/
+
+/*{{{  static void sc_child (char *prog, int rt_argc, char **rt_argv)*/
+/*
+ *	runs the pinger or ponger workers, one for each pair (in a child process)
+ */
+static void sc_child (char *prog, int rt_argc, char **rt_argv)
+{
+	char **argv = (char **)malloc ((rt_argc + 4) * sizeof (char *));
+	char ntbuf[32];
+	void *ws, *wstop;
+	int64_t wssize;
+	int64_t i;
+	int j = 1;
+
+	argv[0] = prog;
+	snprintf (ntbuf, sizeof (ntbuf), "--rt-nthreads=%d", sc_nthreads);
+	argv[j++] = ntbuf;
+	if (sc_mode == SC_HELPER) {
+		argv[j++] = "--rt-uring=0";
+	}
+	for (i=0; i<rt_argc; i++) {
+		argv[j++] = rt_argv[i];
+	}
+	argv[j] = NULL;
+
+	if (slick_init ((const char **)argv, j)) {
+		fprintf (stderr, "shmchan: oops, failed to initialise scheduler\n");
+		exit (EXIT_FAILURE);
+	}
+
+	sc_reqs = (sc_req_t *)calloc (sc_npairs, sizeof (sc_req_t));
+	sc_pos = (int64_t *)calloc (sc_npairs, sizeof (int64_t));
+	sc_buf = (uint8_t **)malloc (sc_npairs * sizeof (uint8_t *));
+	sc_sent = (uint64_t **)malloc (sc_npairs * sizeof (uint64_t *));
+	wssize = SC_TOPWS + (SC_BRWS * (sc_npairs + 1)) + 64;
+	ws = malloc (wssize);
+	if (!sc_reqs || !sc_pos || !sc_buf || !sc_sent || !ws) {
+		fprintf (stderr, "shmchan: failed to allocate %ld bytes of workspace\n", wssize);
+		exit (EXIT_FAILURE);
+	}
+	for (i=0; i<sc_npairs; i++) {
+		sc_buf[i] = (uint8_t *)malloc (sc_bytes);
+		sc_sent[i] = (uint64_t *)malloc (sc_window * sizeof (uint64_t));
+		if (!sc_buf[i] || !sc_sent[i]) {
+			fprintf (stderr, "shmchan: failed to allocate buffers\n");
+			exit (EXIT_FAILURE);
+		}
+	}
+	for (i=0; i<sc_npairs; i++) {
+		if (sc_mode == SC_SOCKET) {
+			close (sc_socks[i][(sc_role == SC_PINGER) ? 1 : 0]);
+		} else if (sc_role == SC_PONGER) {
+			/* the ponger maps its own, as an unrelated OS process would from a descriptor passed to it */
+			sc_ping[i] = slick_shmchan_attach (sc_pingfd[i]);
+			sc_pong[i] = slick_shmchan_attach (sc_pongfd[i]);
+			if (!sc_ping[i] || !sc_pong[i]) {
+				fprintf (stderr, "shmchan: failed to attach channels for pair %ld\n", i);
+				exit (EXIT_FAILURE);
+			}
+		}
+	}
+
+	wstop = ws + (int)(wssize - sizeof (uint64_t));
+
+	slick_startup (wstop, o_shmchan_startup);
+	exit (EXIT_FAILURE);
+}
+/*}}}*/
+/*{{{  static int sc_setup (void)*/
+/*
+ *	makes each pair's channels, or sockets, for this run (before forking the two sides); returns non-zero on failure
+ */
+static int sc_setup (void)
+{
+	int64_t i;
+
+	for (i=0; i<sc_npairs; i++) {
+		if (sc_mode == SC_SOCKET) {
+			if (socketpair (AF_UNIX, SOCK_SEQPACKET, 0, sc_socks[i]) < 0) {
+				fprintf (stderr, "shmchan: failed to create socketpair [%s]\n", strerror (errno));
+				return -1;
+			}
+		} else {
+			sc_ping[i] = slick_shmchan_create ((size_t)sc_bytes, sc_nslots, &(sc_pingfd[i]));
+			sc_pong[i] = slick_shmchan_create ((size_t)sc_bytes, sc_nslots, &(sc_pongfd[i]));
+			if (!sc_ping[i] || !sc_pong[i]) {
+				fprintf (stderr, "shmchan: failed to create shared-memory channels\n");
+				return -1;
+			}
+		}
+	}
+	return 0;
+}
+/*}}}*/
+/*{{{  static void sc_teardown (void)*/
+/*
+ *	closes each pair's channels, or sockets, after a run
+ */
+static void sc_teardown (void)
+{
+	int64_t i;
+
+	for (i=0; i<sc_npairs; i++) {
+		if (sc_mode == SC_SOCKET) {
+			close (sc_socks[i][0]);
+			close (sc_socks[i][1]);
+		} else {
+			slick_shmchan_detach (sc_ping[i]);
+			slick_shmchan_detach (sc_pong[i]);
+			close (sc_pingfd[i]);
+			close (sc_pongfd[i]);
+		}
+	}
+}
+/*}}}*/
+
+
+int main (int argc, char **argv)
+{
+	char **rt_argv = (char **)malloc (argc * sizeof (char *));
+	int rt_argc = 0;
+	int modes = 0;
+	int failed = 0;
+	int i;
+
+	for (i=1; i<argc; i++) {
+		if (!strncmp (argv[i], "--rt-", 5)) {
+			if (strncmp (argv[i] + 5, "nthreads", 8) && strncmp (argv[i] + 5, "uring", 5)) {
+				rt_argv[rt_argc++] = argv[i];		/* passed through to each run */
+			}
+		} else if (!strcmp (argv[i], "socket")) {
+			modes |= (1 << SC_SOCKET);
+		} else if (!strcmp (argv[i], "helper")) {
+			modes |= (1 << SC_HELPER);
+		} else if (!strcmp (argv[i], "uring")) {
+			modes |= (1 << SC_URING);
+		} else if (!strcmp (argv[i], "-p") && (i < (argc - 1))) {
+			sc_npairs = atol (argv[++i]);
+		} else if (!strcmp (argv[i], "-t") && (i < (argc - 1))) {
+			sc_nthreads = atoi (argv[++i]);
+		} else if (!strcmp (argv[i], "-n") && (i < (argc - 1))) {
+			sc_rounds = atol (argv[++i]);
+		} else if (!strcmp (argv[i], "-s") && (i < (argc - 1))) {
+			sc_bytes = atol (argv[++i]);
+		} else if (!strcmp (argv[i], "-w") && (i < (argc - 1))) {
+			sc_window = atol (argv[++i]);
+		} else if (!strcmp (argv[i], "-q") && (i < (argc - 1))) {
+			sc_nslots = atoi (argv[++i]);
+		} else {
+			fprintf (stderr, "usage: %s [socket] [helper] [uring] [-p pairs] [-t threads] [-n messages] [-s bytes] [-w window] "
+					"[-q slots] [--rt-...]\n", argv[0]);
+			exit (EXIT_FAILURE);
+		}
+	}
+	if (!modes) {
+		modes = (1 << SC_SOCKET) | (1 << SC_HELPER) | (1 << SC_URING);
+	}
+	if ((sc_npairs < 1) || (sc_npairs > SC_MAXPAIRS) || (sc_nthreads < 1) || (sc_nthreads > SC_MAXTHREADS) ||
+			(sc_bytes < (int64_t)sizeof (int64_t)) || (sc_bytes > 65536) || (sc_nslots < 1) || (sc_window < 1) ||
+			(sc_window > sc_nslots) || (sc_rounds < 1)) {
+		fprintf (stderr, "shmchan: expected 1..%d pairs, 1..%d threads, messages of 8..65536 bytes and a window no wider "
+				"than the channel\n", SC_MAXPAIRS, SC_MAXTHREADS);
+		exit (EXIT_FAILURE);
+	}
+	sc_rounds = ((sc_rounds + sc_window - 1) / sc_window) * sc_window;		/* whole windows */
+
+	sc_ping = (void **)calloc (sc_npairs, sizeof (void *));
+	sc_pong = (void **)calloc (sc_npairs, sizeof (void *));
+	sc_pingfd = (int *)calloc (sc_npairs, sizeof (int));
+	sc_pongfd = (int *)calloc (sc_npairs, sizeof (int));
+	sc_socks = (int (*)[2])calloc (sc_npairs, 2 * sizeof (int));
+	if (!sc_ping || !sc_pong || !sc_pingfd || !sc_pongfd || !sc_socks) {
+		fprintf (stderr, "shmchan: failed to allocate pairs\n");
+		exit (EXIT_FAILURE);
+	}
+
+	fprintf (stderr, "shmchan: %ld pairs of workers on %d threads in each of two OS processes, %ld messages of %ld bytes each way, "
+			"%ld at a time, %d slot channels\n", sc_npairs, sc_nthreads, sc_rounds, sc_bytes, sc_window, sc_nslots);
+
+	for (sc_mode = SC_SOCKET; sc_mode <= SC_URING; sc_mode++) {
+		int fds[2][2];
+		int64_t res[2][4];
+		pid_t pid[2];
+		int status;
+
+		if (!(modes & (1 << sc_mode))) {
+			continue;
+		}
+		if (sc_setup ()) {
+			exit (EXIT_FAILURE);
+		}
+		fflush (stderr);
+
+		for (sc_role = SC_PINGER; sc_role <= SC_PONGER; sc_role++) {
+			if (pipe (fds[sc_role]) < 0) {
+				fprintf (stderr, "shmchan: failed to create pipe [%s]\n", strerror (errno));
+				exit (EXIT_FAILURE);
+			}
+			pid[sc_role] = fork ();
+			if (pid[sc_role] < 0) {
+				fprintf (stderr, "shmchan: failed to fork [%s]\n", strerror (errno));
+				exit (EXIT_FAILURE);
+			} else if (!pid[sc_role]) {
+				close (fds[sc_role][0]);
+				sc_resfd = fds[sc_role][1];
+				sc_child (argv[0], rt_argc, rt_argv);
+			}
+			close (fds[sc_role][1]);
+		}
+
+		for (sc_role = SC_PINGER; sc_role <= SC_PONGER; sc_role++) {
+			if (read (fds[sc_role][0], res[sc_role], sizeof (res[sc_role])) != sizeof (res[sc_role])) {
+				fprintf (stderr, "shmchan: %s run failed\n", sc_modenames[sc_mode]);
+				exit (EXIT_FAILURE);
+			}
+			close (fds[sc_role][0]);
+			waitpid (pid[sc_role], &status, 0);
+		}
+		sc_teardown ();
+
+		printf ("%-8s: %10.3f ms, %10.1f round trips per ms, mean %8.3f us, max %10.3f us%s\n", sc_modenames[sc_mode],
+				(double)res[0][0] / 1000000.0, res[0][0] ? ((double)(sc_npairs * sc_rounds) * 1000000.0 / (double)res[0][0]) : 0.0,
+				(double)res[0][1] / 1000.0, (double)res[0][2] / 1000.0, (res[0][3] || res[1][3]) ? " (WRONG)" : "");
+		fflush (stdout);
+
+		/* both sides check every message's sequence number and bytes, and the pinger that all came back */
+		if (res[0][3] || res[1][3]) {
+			fprintf (stderr, "shmchan: %s run lost or corrupted messages (pinger %ld, ponger %ld)\n", sc_modenames[sc_mode],
+					res[0][3], res[1][3]);
+			failed++;
+		}
+	}
+
+	if (failed) {
+		exit (EXIT_FAILURE);
+	}
+	return 0;
+}
+